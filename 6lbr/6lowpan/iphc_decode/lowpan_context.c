@@ -28,6 +28,7 @@
 #include "common/log_legacy.h"
 #include "common/ns_list.h"
 #include "net/protocol.h"
+#include "net/timers.h"
 
 #include "6lowpan/iphc_decode/lowpan_context.h"
 
@@ -93,5 +94,8 @@ void lowpan_context_timer(int ticks)
             tr_debug("Delete Expired context");
         }
     }
+    // Contexts are only ever removed, nothing is left to age
+    if (ns_list_is_empty(list))
+        ws_timer_stop(WS_TIMER_6LOWPAN_CONTEXT);
 }
 
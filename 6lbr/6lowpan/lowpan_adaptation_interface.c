@@ -20,12 +20,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include "common/endian.h"
+#include "common/hash_table.h"
 #include "common/rand.h"
 #include "common/dhcp_server.h"
 #include "common/log_legacy.h"
 #include "common/ns_list.h"
 #include "common/version.h"
 #include "common/memutils.h"
+#include "common/mathutils.h"
 #include "common/specs/ieee802154.h"
 #include "common/specs/ws.h"
 #include "common/specs/ip.h"
@@ -84,6 +86,24 @@ typedef struct fragmenter_tx_entry {
 
 typedef NS_LIST_HEAD(fragmenter_tx_entry_t, link) fragmenter_tx_list_t;
 
+// Packets waiting for a given destination (or for the broadcast of a given
+// kind). The queues holding packets are served by deficit round robin, see
+// lowpan_adaptation_tx_queue_read(), so a heavy flow to a slow node cannot
+// starve the rest of the network. They are also indexed by destination, see
+// lowpan_tx_queue_key().
+typedef struct lowpan_tx_queue {
+    addrtype_e addr_type;
+    uint8_t addr[8];
+    bool lfn_multicast;
+    buffer_list_t packets;
+    uint16_t size;
+    int deficit; /*!< Bytes the queue is allowed to send */
+    ns_list_link_t link;
+    struct hash_entry hash_entry;
+} lowpan_tx_queue_t;
+
+typedef NS_LIST_HEAD(lowpan_tx_queue_t, link) lowpan_tx_queue_list_t;
+
 typedef struct fragmenter_interface {
     int8_t interface_id;
     uint16_t local_frag_tag;
@@ -93,9 +113,15 @@ typedef struct fragmenter_interface {
     fragmenter_tx_entry_t active_broadcast_tx_buf; //Current active direct broadcast tx process
     fragmenter_tx_entry_t active_lfn_broadcast_tx_buf; //Current active direct lfn broadcast tx process
     fragmenter_tx_list_t activeUnicastList; //Unicast packets waiting data confirmation from MAC
-    buffer_list_t directTxQueue; //Waiting free tx process
-    uint16_t directTxQueue_size;
+    lowpan_tx_queue_list_t directTxQueues; //Waiting free tx process, in round robin order
+    struct hash_table directTxQueues_index;
+    uint16_t directTxQueue_size; //Total of all queues
     uint16_t directTxQueue_level;
+    int drr_quantum;
+    uint16_t directTxQueue_max; //Per destination
+    // Time spent in the adaptation layer before the first transmission:
+    // <100ms, <200ms, <400ms, ..., >=6.4s
+    uint32_t tx_delay_hist[LOWPAN_TX_DELAY_HIST_LEN];
     uint16_t activeTxList_size;
     bool fragmenter_active; /*!< Fragmenter state */
     mpx_api_t *mpx_api;
@@ -104,6 +130,8 @@ typedef struct fragmenter_interface {
 } fragmenter_interface_t;
 
 #define LOWPAN_ACTIVE_UNICAST_ONGOING_MAX 10
+#define LOWPAN_DRR_QUANTUM_DEFAULT 1280 // bytes
+#define LOWPAN_TX_QUEUE_MAX_DEFAULT 32  // packets per destination
 #define LOWPAN_HIGH_PRIORITY_STATE_LENGTH 50 //5 seconds 100us ticks
 
 #define LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY     30 // Remove low priority packets older than limit (seconds)
@@ -174,43 +202,199 @@ static struct net_if *lowpan_adaptation_network_interface_discover(const mpx_api
 
 static void lowpan_adaptation_tx_queue_level_update(struct net_if *cur, fragmenter_interface_t *interface_ptr)
 {
+    const uint32_t *hist = interface_ptr->tx_delay_hist;
+
     red_aq_calc(&cur->random_early_detection, interface_ptr->directTxQueue_size);
 
     if (interface_ptr->directTxQueue_size == interface_ptr->directTxQueue_level + ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE ||
             interface_ptr->directTxQueue_size == interface_ptr->directTxQueue_level - ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE) {
         interface_ptr->directTxQueue_level = interface_ptr->directTxQueue_size;
-        tr_info("Adaptation layer TX queue size %u Active MAC tx request %u", interface_ptr->directTxQueue_level, interface_ptr->activeTxList_size);
+        tr_info("Adaptation layer TX queue size %u (%u destinations) Active MAC tx request %u",
+                interface_ptr->directTxQueue_level, (unsigned int)ns_list_count(&interface_ptr->directTxQueues),
+                interface_ptr->activeTxList_size);
+        tr_info("Adaptation layer TX delay <100ms:%u <200ms:%u <400ms:%u <800ms:%u <1.6s:%u <3.2s:%u <6.4s:%u more:%u",
+                hist[0], hist[1], hist[2], hist[3], hist[4], hist[5], hist[6], hist[7]);
     }
 }
 
+// Packets requeued after MLME_TRANSACTION_EXPIRED go through
+// lowpan_adaptation_interface_tx() again, only their first transmission is
+// recorded
+static void lowpan_adaptation_tx_delay_record(fragmenter_interface_t *interface_ptr, buffer_t *buf)
+{
+    uint32_t delay = g_monotonic_time_100ms - buf->adaptation_timestamp;
+    int i;
+
+    if (buf->adaptation_delay_recorded)
+        return;
+    buf->adaptation_delay_recorded = true;
+    i = delay ? 32 - __builtin_clz(delay) : 0;
+    if (i >= ARRAY_SIZE(interface_ptr->tx_delay_hist))
+        i = ARRAY_SIZE(interface_ptr->tx_delay_hist) - 1;
+    interface_ptr->tx_delay_hist[i]++;
+}
+
+// The PAN ID stored before the MAC address is not part of the key, and the
+// bytes following a short address are not initialized.
+static int lowpan_tx_queue_addr_len(addrtype_e addr_type)
+{
+    return MAX(addr_len_from_type(addr_type) - 2, 0);
+}
+
+static bool lowpan_tx_queue_match(const lowpan_tx_queue_t *txq, const buffer_t *buf)
+{
+    return txq->addr_type == buf->dst_sa.addr_type &&
+           txq->lfn_multicast == buf->options.lfn_multicast &&
+           !memcmp(txq->addr, &buf->dst_sa.address[2], lowpan_tx_queue_addr_len(txq->addr_type));
+}
+
+static uint32_t lowpan_tx_queue_key(const buffer_t *buf)
+{
+    int addr_len = lowpan_tx_queue_addr_len(buf->dst_sa.addr_type);
+    uint8_t key[10];
+
+    key[0] = buf->dst_sa.addr_type;
+    key[1] = buf->options.lfn_multicast;
+    memcpy(key + 2, &buf->dst_sa.address[2], addr_len);
+    return hash_table_key(key, 2 + addr_len);
+}
+
+static lowpan_tx_queue_t *lowpan_tx_queue_get(fragmenter_interface_t *interface_ptr, const buffer_t *buf)
+{
+    uint32_t hash = lowpan_tx_queue_key(buf);
+    lowpan_tx_queue_t *txq;
+    struct hash_entry *it;
+
+    hash_table_foreach(&interface_ptr->directTxQueues_index, it, hash) {
+        txq = container_of(it, lowpan_tx_queue_t, hash_entry);
+        if (lowpan_tx_queue_match(txq, buf))
+            return txq;
+    }
+    txq = zalloc(sizeof(lowpan_tx_queue_t));
+    txq->addr_type = buf->dst_sa.addr_type;
+    memcpy(txq->addr, &buf->dst_sa.address[2], lowpan_tx_queue_addr_len(txq->addr_type));
+    txq->lfn_multicast = buf->options.lfn_multicast;
+    ns_list_init(&txq->packets);
+    ns_list_add_to_end(&interface_ptr->directTxQueues, txq);
+    hash_table_insert(&interface_ptr->directTxQueues_index, &txq->hash_entry, hash);
+    return txq;
+}
+
+static void lowpan_tx_queue_free(fragmenter_interface_t *interface_ptr, lowpan_tx_queue_t *txq)
+{
+    ns_list_remove(&interface_ptr->directTxQueues, txq);
+    hash_table_remove(&interface_ptr->directTxQueues_index, &txq->hash_entry);
+    free(txq);
+}
+
+static buffer_t *lowpan_tx_queue_pop(fragmenter_interface_t *interface_ptr, lowpan_tx_queue_t *txq)
+{
+    buffer_t *buf = ns_list_get_first(&txq->packets);
+
+    ns_list_remove(&txq->packets, buf);
+    txq->size--;
+    interface_ptr->directTxQueue_size--;
+    // Queues only exist while they hold packets, so the deficit of an idle
+    // destination is not kept
+    if (!txq->size)
+        lowpan_tx_queue_free(interface_ptr, txq);
+    return buf;
+}
+
+static void lowpan_tx_queues_free(fragmenter_interface_t *interface_ptr)
+{
+    ns_list_foreach_safe(lowpan_tx_queue_t, txq, &interface_ptr->directTxQueues) {
+        buffer_free_list(&txq->packets);
+        lowpan_tx_queue_free(interface_ptr, txq);
+    }
+    interface_ptr->directTxQueue_size = 0;
+    interface_ptr->directTxQueue_level = 0;
+}
+
+// Drop the oldest packet of the longest queue, so the heaviest flow pays for
+// the congestion
+static void lowpan_tx_queues_drop(fragmenter_interface_t *interface_ptr)
+{
+    lowpan_tx_queue_t *longest = NULL;
+
+    ns_list_foreach(lowpan_tx_queue_t, txq, &interface_ptr->directTxQueues)
+        if (!longest || txq->size > longest->size)
+            longest = txq;
+    if (longest)
+        buffer_free(lowpan_tx_queue_pop(interface_ptr, longest));
+}
 
 static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
 {
-    ns_list_add_to_end(&interface_ptr->directTxQueue, buf);
+    lowpan_tx_queue_t *txq = lowpan_tx_queue_get(interface_ptr, buf);
+
+    if (txq->size >= interface_ptr->directTxQueue_max) {
+        if (txq->addr_type == ADDR_802_15_4_LONG)
+            tr_warn("TX queue full for %s: dropping oldest packet", tr_eui64(txq->addr));
+        else if (txq->addr_type == ADDR_802_15_4_SHORT)
+            tr_warn("TX queue full for %04x: dropping oldest packet", read_be16(txq->addr));
+        else
+            tr_warn("TX queue full for %s broadcast: dropping oldest packet", txq->lfn_multicast ? "LFN" : "FFN");
+        buffer_free(lowpan_tx_queue_pop(interface_ptr, txq));
+        // The queue may have been released
+        txq = lowpan_tx_queue_get(interface_ptr, buf);
+    }
+    ns_list_add_to_end(&txq->packets, buf);
+    txq->size++;
     interface_ptr->directTxQueue_size++;
     lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
 }
 
+// The packet is sent before any other queued packet, as before per-destination
+// queues existed: its queue is moved to the head of the round robin and the
+// deficit spent on the packet is given back.
 static void lowpan_adaptation_tx_queue_write_to_front(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
 {
-    ns_list_add_to_start(&interface_ptr->directTxQueue, buf);
+    lowpan_tx_queue_t *txq = lowpan_tx_queue_get(interface_ptr, buf);
+
+    ns_list_remove(&interface_ptr->directTxQueues, txq);
+    ns_list_add_to_start(&interface_ptr->directTxQueues, txq);
+    txq->deficit += buffer_data_length(buf);
+    ns_list_add_to_start(&txq->packets, buf);
+    txq->size++;
     interface_ptr->directTxQueue_size++;
     lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
 }
 
+/*
+ * Deficit round robin: the queue at the head of directTxQueues is credited
+ * with drr_quantum bytes each time its turn comes, and sends packets as long
+ * as its deficit covers their size. Queues which cannot transmit (destination
+ * busy, too many active unicasts...) are skipped without being credited.
+ */
 static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr)
 {
+    int cnt = ns_list_count(&interface_ptr->directTxQueues);
+    lowpan_tx_queue_t *txq;
+    int skipped = 0;
+    buffer_t *buf;
+
     // Currently this function is called only when data confirm is received for previously sent packet.
-    if (!interface_ptr->directTxQueue_size) {
-        return NULL;
-    }
-    ns_list_foreach_safe(buffer_t, buf, &interface_ptr->directTxQueue) {
-        if (lowpan_buffer_tx_allowed(interface_ptr, buf)) {
-            ns_list_remove(&interface_ptr->directTxQueue, buf);
-            interface_ptr->directTxQueue_size--;
-            lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
-            return buf;
+    while (skipped < cnt) {
+        txq = ns_list_get_first(&interface_ptr->directTxQueues);
+        buf = ns_list_get_first(&txq->packets);
+        if (!lowpan_buffer_tx_allowed(interface_ptr, buf)) {
+            ns_list_remove(&interface_ptr->directTxQueues, txq);
+            ns_list_add_to_end(&interface_ptr->directTxQueues, txq);
+            skipped++;
+            continue;
+        }
+        if (txq->deficit < buffer_data_length(buf)) {
+            txq->deficit += interface_ptr->drr_quantum;
+            ns_list_remove(&interface_ptr->directTxQueues, txq);
+            ns_list_add_to_end(&interface_ptr->directTxQueues, txq);
+            skipped = 0;
+            continue;
         }
+        txq->deficit -= buffer_data_length(buf);
+        lowpan_tx_queue_pop(interface_ptr, txq);
+        lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
+        return buf;
     }
     return NULL;
 }
@@ -316,8 +500,10 @@ void lowpan_adaptation_interface_init(int8_t interface_id)
     interface_ptr->msduHandle = rand_get_8bit();
     interface_ptr->local_frag_tag = rand_get_16bit();
 
-    ns_list_init(&interface_ptr->directTxQueue);
+    ns_list_init(&interface_ptr->directTxQueues);
     ns_list_init(&interface_ptr->activeUnicastList);
+    interface_ptr->drr_quantum = LOWPAN_DRR_QUANTUM_DEFAULT;
+    interface_ptr->directTxQueue_max = LOWPAN_TX_QUEUE_MAX_DEFAULT;
 
     ns_list_add_to_end(&fragmenter_interface_list, interface_ptr);
 }
@@ -337,9 +523,8 @@ int8_t lowpan_adaptation_interface_free(int8_t interface_id)
     lowpan_active_buffer_state_reset(&interface_ptr->active_broadcast_tx_buf);
     lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf);
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
+    lowpan_tx_queues_free(interface_ptr);
+    hash_table_free(&interface_ptr->directTxQueues_index);
     //Free Dynamic allocated entries
     free(interface_ptr->fragment_indirect_tx_buffer);
     free(interface_ptr);
@@ -364,9 +549,7 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id)
     //Clean fragmented message flag
     interface_ptr->fragmenter_active = false;
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
+    lowpan_tx_queues_free(interface_ptr);
 
     return 0;
 }
@@ -701,6 +884,18 @@ static bool lowpan_adaptation_interface_check_buffer_timeout(struct net_if *cur,
     return buffer_age_s > LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY;
 }
 
+int8_t lowpan_adaptation_interface_set_tx_queue(int8_t interface_id, int quantum, int queue_max)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
+
+    if (!interface_ptr)
+        return -1;
+    BUG_ON(quantum <= 0 || queue_max <= 0 || queue_max > UINT16_MAX);
+    interface_ptr->drr_quantum = quantum;
+    interface_ptr->directTxQueue_max = queue_max;
+    return 0;
+}
+
 int lowpan_adaptation_queue_size(int8_t interface_id)
 {
     fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
@@ -708,6 +903,15 @@ int lowpan_adaptation_queue_size(int8_t interface_id)
     return interface_ptr->directTxQueue_size;
 }
 
+const uint32_t *lowpan_adaptation_tx_delay_hist(int8_t interface_id)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
+
+    if (!interface_ptr)
+        return NULL;
+    return interface_ptr->tx_delay_hist;
+}
+
 int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
 {
     if (!buf) {
@@ -748,13 +952,7 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
 
         if (red_congestion_check(&cur->random_early_detection)) {
             WARN("congestion detected: dropping oldest packet");
-            // If we need to drop packet we drop oldest normal Priority packet.
-            buffer_t *dropped = ns_list_get_first(&interface_ptr->directTxQueue);
-            if (dropped) {
-                ns_list_remove(&interface_ptr->directTxQueue, dropped);
-                interface_ptr->directTxQueue_size--;
-                buffer_free(dropped);
-            }
+            lowpan_tx_queues_drop(interface_ptr);
         }
         lowpan_adaptation_tx_queue_write(cur, interface_ptr, buf);
         return 0;
@@ -782,6 +980,7 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
         interface_ptr->fragmenter_active = true;
     }
 
+    lowpan_adaptation_tx_delay_record(interface_ptr, buf);
     lowpan_data_request_to_mac(cur, buf, tx_ptr, interface_ptr);
     return 0;
 
@@ -1016,14 +1215,14 @@ int8_t lowpan_adaptation_free_messages_from_queues_by_address(struct net_if *cur
         }
     }
 
-    //Check next directTxQueue there may be pending packets also
-    ns_list_foreach_safe(buffer_t, entry, &interface_ptr->directTxQueue) {
-        if (lowpan_tx_buffer_address_compare(&entry->dst_sa, address_ptr, adr_type)) {
-            ns_list_remove(&interface_ptr->directTxQueue, entry);
-            interface_ptr->directTxQueue_size--;
+    //Check next directTxQueues there may be pending packets also
+    ns_list_foreach_safe(lowpan_tx_queue_t, txq, &interface_ptr->directTxQueues) {
+        if (lowpan_tx_buffer_address_compare(&ns_list_get_first(&txq->packets)->dst_sa, address_ptr, adr_type)) {
+            // The queue is released with its last packet
+            for (int i = txq->size; i; i--)
+                buffer_free(lowpan_tx_queue_pop(interface_ptr, txq));
             //Update Average QUEUE
             lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
-            buffer_free(entry);
         }
     }
 
@@ -29,6 +29,8 @@ struct mpx_api;
 enum buffer_priority;
 typedef enum addrtype addrtype_e;
 
+#define LOWPAN_TX_DELAY_HIST_LEN 8
+
 void lowpan_adaptation_interface_init(int8_t interface_id);
 
 int8_t lowpan_adaptation_interface_free(int8_t interface_id);
@@ -37,8 +39,27 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id);
 
 int8_t lowpan_adaptation_interface_mpx_register(int8_t interface_id, struct mpx_api *mpx_api, uint16_t mpx_user_id);
 
+/**
+ * \brief Configure the per-destination TX queues
+ *
+ * \param quantum Bytes credited to a destination on each deficit round robin turn
+ * \param queue_max Packets queued per destination, the oldest is dropped beyond
+ */
+int8_t lowpan_adaptation_interface_set_tx_queue(int8_t interface_id, int quantum, int queue_max);
+
 int lowpan_adaptation_queue_size(int8_t interface_id);
 
+/**
+ * \brief Histogram of the time packets spent in the adaptation layer before
+ * their first transmission
+ *
+ * Bucket i counts the delays below 100ms << i, the last bucket counts the
+ * longer delays.
+ *
+ * \return LOWPAN_TX_DELAY_HIST_LEN buckets, or NULL if the interface is unknown
+ */
+const uint32_t *lowpan_adaptation_tx_delay_hist(int8_t interface_id);
+
 /**
  * \brief call this before normal TX. This function prepare buffer link specific metadata and verify packet destination
  */
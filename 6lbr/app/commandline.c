@@ -108,6 +108,10 @@ static const struct number_limit valid_lowpan_mtu = {
     LOWPAN_MTU_MIN, LOWPAN_MTU_MAX
 };
 
+static const struct number_limit valid_lowpan_tx_queue_max = {
+    1, UINT16_MAX
+};
+
 // 0xffff is not a valid pan_id and means 'undefined' or 'broadcast'
 // See IEEE 802.15.4
 static const struct number_limit valid_pan_id = {
@@ -498,6 +502,8 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "uart_device",                   config->uart_dev,                          conf_set_string,      (void *)sizeof(config->uart_dev) },
         { "uart_baudrate",                 &config->uart_baudrate,                    conf_set_number,      NULL },
         { "uart_rtscts",                   &config->uart_rtscts,                      conf_set_bool,        NULL },
+        { "uart_tx_batch_size",            &config->uart_tx_batch_size,               conf_set_number,      &valid_unsigned },
+        { "hif_timing",                    &config->hif_timing,                       conf_set_bool,        NULL },
         { "cpc_instance",                  config->cpc_instance,                      conf_set_string,      (void *)sizeof(config->cpc_instance) },
         { "tun_device",                    config->tun_dev,                           conf_set_string,      (void *)sizeof(config->tun_dev) },
         { "tun_autoconf",                  &config->tun_autoconf,                     conf_set_bool,        NULL },
@@ -508,6 +514,7 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "use_tap",                       NULL,                                      conf_deprecated,      NULL },
         { "ipv6_prefix",                   &config->ipv6_prefix,                      conf_set_netmask,     NULL },
         { "storage_prefix",                config->storage_prefix,                    conf_set_string,      (void *)sizeof(config->storage_prefix) },
+        { "storage_log",                   &config->storage_log,                      conf_set_bool,        NULL },
         { "trace",                         &g_enabled_traces,                         conf_add_flags,       &valid_traces },
         { "internal_dhcp",                 &config->internal_dhcp,                    conf_set_bool,        NULL },
         { "radius_server",                 &config->radius_server,                    conf_set_netaddr,     NULL },
@@ -560,6 +567,10 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "async_frag_duration",           &config->ws_async_frag_duration,           conf_set_number,      &valid_async_frag_duration },
         { "join_metrics",                  &config->ws_join_metrics,                  conf_set_flags,       &valid_join_metrics },
         { "lowpan_mtu",                    &config->lowpan_mtu,                       conf_set_number,      &valid_lowpan_mtu },
+        { "lowpan_tx_quantum",             &config->lowpan_tx_quantum,                conf_set_number,      &valid_positive },
+        { "lowpan_tx_queue_max",           &config->lowpan_tx_queue_max,              conf_set_number,      &valid_lowpan_tx_queue_max },
+        { "tun_rx_queue_max",              &config->tun_rx_queue_max,                 conf_set_number,      &valid_positive },
+        { "buffer_pool_max",               &config->buffer_pool_max,                  conf_set_number,      &valid_unsigned },
         { "pan_size",                      &config->pan_size,                         conf_set_number,      &valid_uint16 },
         { "pcap_file",                     config->pcap_file,                         conf_set_string,      (void *)sizeof(config->pcap_file) },
     };
@@ -624,6 +635,7 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
 
     // Keep these values in sync with examples/wsbrd.conf
     config->uart_baudrate = 115200;
+    config->uart_tx_batch_size = 2048;
     config->tun_autoconf = true;
     config->internal_dhcp = true;
     config->ws_class = 0;
@@ -639,6 +651,9 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     config->lfn_bc_sync_period = 5;
     config->bc_dwell_interval = 255;
     config->lowpan_mtu = 2043;
+    config->lowpan_tx_quantum = 1280;
+    config->lowpan_tx_queue_max = 32;
+    config->tun_rx_queue_max = 16;
     config->ws_pmk_lifetime_s = 172800 * 60;
     config->ws_ptk_lifetime_s = 86400 * 60;
     config->ws_gtk_expire_offset_s = 43200 * 60;
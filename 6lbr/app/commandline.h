@@ -33,6 +33,8 @@ struct wsbrd_conf {
     char uart_dev[PATH_MAX];
     int  uart_baudrate;
     bool uart_rtscts;
+    int  uart_tx_batch_size;
+    bool hif_timing;
 
     char tun_dev[IF_NAMESIZE];
     char neighbor_proxy[IF_NAMESIZE];
@@ -61,6 +63,7 @@ struct wsbrd_conf {
     char capture[PATH_MAX];
 
     char storage_prefix[PATH_MAX];
+    bool storage_log;
     bool storage_delete;
     bool storage_exit;
     arm_certificate_entry_s tls_own;
@@ -106,6 +109,10 @@ struct wsbrd_conf {
     uint8_t ws_denied_mac_address_count;
 
     int lowpan_mtu;
+    int lowpan_tx_quantum;
+    int lowpan_tx_queue_max;
+    int tun_rx_queue_max;
+    int buffer_pool_max;
     int pan_size;
     char pcap_file[PATH_MAX];
 };
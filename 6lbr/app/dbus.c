@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #include <errno.h>
+#include <stdarg.h>
 #include <limits.h>
 #include <sys/queue.h>
 #include <arpa/inet.h>
@@ -19,6 +20,9 @@
 #include <math.h>
 #include "app/tun.h"
 #include "common/string_extra.h"
+#include "common/change_journal.h"
+#include "common/fnv_hash.h"
+#include "common/hif.h"
 #include "common/named_values.h"
 #include "common/memutils.h"
 #include "common/version.h"
@@ -34,7 +38,9 @@
 #include "ws/ws_pae_auth.h"
 #include "ws/ws_neigh.h"
 #include "ws/ws_llc.h"
+#include "6lowpan/lowpan_adaptation_interface.h"
 #include "net/protocol.h"
+#include "net/ns_buffer.h"
 #include "security/protocols/sec_prot_keys.h"
 #include "ipv6/ipv6_routing_table.h"
 
@@ -440,20 +446,89 @@ int dbus_deny_mac64(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
     return dbus_set_filter_src64(m, userdata, ret_error, false);
 }
 
-void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt)
+// Clients which have missed more than this number of removals have to
+// retrieve the whole list again.
+#define DBUS_JOURNAL_TOMBSTONE_MAX 4096
+
+// Past this number of keys changed between two calls to
+// dbus_process_changes(), the whole set is walked instead.
+#define DBUS_JOURNAL_PENDING_MAX 1024
+
+struct dbus_journal_pending {
+    uint8_t keys[DBUS_JOURNAL_PENDING_MAX][CHANGE_JOURNAL_KEY_LEN_MAX];
+    int cnt;
+    bool all;
+};
+
+static struct {
+    struct change_journal nodes;
+    struct change_journal routing_graph;
+    // Keys reported since the last call to dbus_process_changes()
+    struct dbus_journal_pending nodes_pending;
+    struct dbus_journal_pending routing_graph_pending;
+    // Generation advertised by the last signal
+    uint64_t nodes_gen_signaled;
+    uint64_t routing_graph_gen_signaled;
+    bool nodes_dirty;
+    bool routing_graph_dirty;
+    // The journals are only maintained once a client has called
+    // GetNodesPage or GetRoutingGraphPage. Until then, the changes are only
+    // reported with PropertiesChanged.
+    bool active;
+    uint8_t br_addr[16];
+} dbus_journal;
+
+static void dbus_journal_pending_add(struct dbus_journal_pending *pending,
+                                     const uint8_t *key, int key_len)
 {
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Nodes", NULL);
+    if (pending->all)
+        return;
+    if (pending->cnt == DBUS_JOURNAL_PENDING_MAX) {
+        pending->all = true;
+        return;
+    }
+    memcpy(pending->keys[pending->cnt++], key, key_len);
 }
 
-void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt)
+// The changes are coalesced and reported by dbus_process_changes()
+void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8])
 {
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "RoutingGraph", NULL);
+    dbus_journal.nodes_dirty = true;
+    if (dbus_journal.active)
+        dbus_journal_pending_add(&dbus_journal.nodes_pending, eui64, 8);
+}
+
+void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt, const uint8_t ipv6[16])
+{
+    dbus_journal.routing_graph_dirty = true;
+    if (dbus_journal.active)
+        dbus_journal_pending_add(&dbus_journal.routing_graph_pending, ipv6, 16);
+}
+
+// Rank 1 LFNs are exposed in the routing graph depending on the role of the
+// 15.4 neighbor, see dbus_ipv6_neigh_is_lfn().
+void dbus_emit_neighbor_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8])
+{
+    struct ipv6_neighbour_cache *cache = &ctxt->net_if.ipv6_neighbour_cache;
+    struct ipv6_neighbour *ipv6_neigh;
+    struct hash_entry *it;
+
+    dbus_emit_nodes_change(ctxt, eui64);
+    hash_table_foreach(&cache->eui64_index, it, hash_table_key(eui64, 8)) {
+        ipv6_neigh = container_of(it, struct ipv6_neighbour, eui64_hash_entry);
+        if (!memcmp(ipv6_neighbour_eui64(cache, ipv6_neigh), eui64, 8))
+            dbus_emit_routing_graph_change(ctxt, ipv6_neigh->ip_address);
+    }
+}
+
+// The address is only retrieved once the TUN interface has been configured
+static const uint8_t *dbus_get_br_addr(struct wsbr_ctxt *ctxt)
+{
+    static const uint8_t addr_unspecified[16] = { };
+
+    if (!memcmp(dbus_journal.br_addr, addr_unspecified, 16))
+        tun_addr_get_global_unicast(ctxt->config.tun_dev, dbus_journal.br_addr);
+    return dbus_journal.br_addr;
 }
 
 static void dbus_message_open_info(sd_bus_message *m, const char *property,
@@ -475,7 +550,7 @@ static int dbus_message_append_node(
     const char *property,
     const uint8_t self[8],
     bool is_br,
-    supp_entry_t *supp,
+    const struct ws_pae_key_storage_supp_info *supp,
     const struct ws_neigh *neighbor)
 {
     int val;
@@ -497,9 +572,9 @@ static int dbus_message_append_node(
             val = true;
             sd_bus_message_append(m, "b", val);
             dbus_message_close_info(m, property);
-            if (ws_common_is_valid_nr(supp->sec_keys.node_role)) {
+            if (ws_common_is_valid_nr(supp->node_role)) {
                 dbus_message_open_info(m, property, "node_role", "y");
-                sd_bus_message_append(m, "y", supp->sec_keys.node_role);
+                sd_bus_message_append(m, "y", supp->node_role);
                 dbus_message_close_info(m, property);
             }
         }
@@ -588,47 +663,45 @@ int dbus_get_nodes(sd_bus *bus, const char *path, const char *interface,
 {
     const struct ws_neigh *neighbor_info;
     struct wsbr_ctxt *ctxt = userdata;
+    uint8_t (*eui64_pae)[8];
     int len_pae;
-    uint8_t eui64_pae[4096][8];
-    supp_entry_t *supp;
 
-    len_pae = ws_pae_auth_supp_list(ctxt->net_if.id, eui64_pae, sizeof(eui64_pae));
+    len_pae = ws_pae_auth_supp_list(ctxt->net_if.id, &eui64_pae);
 
     sd_bus_message_open_container(reply, 'a', "(aya{sv})");
     dbus_message_append_node_br(reply, property, ctxt);
 
     for (int i = 0; i < len_pae; i++) {
         neighbor_info = dbus_get_neighbor_info(ctxt, eui64_pae[i]);
-        if (ws_pae_key_storage_supp_exists(eui64_pae[i]))
-            supp = ws_pae_key_storage_supp_read(NULL, eui64_pae[i], NULL, NULL, NULL);
-        else
-            supp = NULL;
-        dbus_message_append_node(reply, property, eui64_pae[i],
-                                 false, supp, neighbor_info);
-        if (supp)
-            free(supp);
+        dbus_message_append_node(reply, property, eui64_pae[i], false,
+                                 ws_pae_key_storage_supp_info(eui64_pae[i]),
+                                 neighbor_info);
     }
     sd_bus_message_close_container(reply);
+    free(eui64_pae);
     return 0;
 }
 
-static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_target *target, uint8_t pcs)
+// Empty and duplicate transits are not exposed
+static bool dbus_rpl_transit_is_hidden(const struct rpl_target *target, uint8_t i)
 {
-    uint8_t j;
+    if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+        return true;
+    for (uint8_t j = 0; j < i; j++)
+        if (!memcmp(target->transits + i, target->transits + j, sizeof(struct rpl_transit)))
+            return true;
+    return false;
+}
 
+static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_target *target, uint8_t pcs)
+{
     sd_bus_message_open_container(reply, 'r', "aybaay");
     sd_bus_message_append_array(reply, 'y', target->prefix, 16);
     sd_bus_message_append(reply, "b", target->external);
     sd_bus_message_open_container(reply, 'a', "ay");
-    for (uint8_t i = 0; i < pcs + 1; i++) {
-        if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
-            continue;
-        for (j = 0; j < i; j++)
-            if (!memcmp(target->transits + i, target->transits + j, sizeof(struct rpl_transit)))
-                break;
-        if (i == j)
+    for (uint8_t i = 0; i < pcs + 1; i++)
+        if (!dbus_rpl_transit_is_hidden(target, i))
             sd_bus_message_append_array(reply, 'y', target->transits[i].parent, 16);
-    }
     sd_bus_message_close_container(reply);
     sd_bus_message_close_container(reply);
 }
@@ -643,6 +716,22 @@ static void dbus_message_append_ipv6_neigh(sd_bus_message *reply, struct ipv6_ne
     dbus_message_append_rpl_target(reply, &target, root->pcs);
 }
 
+// Since LFN are not routed by RPL, rank 1 LFNs are not RPL targets.
+// This hack allows to expose rank 1 LFNs and relies on their ipv6 address
+// registration.
+static bool dbus_ipv6_neigh_is_lfn(struct wsbr_ctxt *ctxt, struct ipv6_neighbour *ipv6_neigh)
+{
+    struct ws_neigh *ws_neigh;
+
+    if (IN6_IS_ADDR_MULTICAST(ipv6_neigh->ip_address) || IN6_IS_ADDR_LINKLOCAL(ipv6_neigh->ip_address))
+        return false;
+    if (rpl_target_get(&ctxt->net_if.rpl_root, ipv6_neigh->ip_address))
+        return false;
+    ws_neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage,
+                            ipv6_neighbour_eui64(&ctxt->net_if.ipv6_neighbour_cache, ipv6_neigh));
+    return ws_neigh && ws_neigh->node_role == WS_NR_ROLE_LFN;
+}
+
 int dbus_get_routing_graph(sd_bus *bus, const char *path, const char *interface,
                            const char *property, sd_bus_message *reply,
                            void *userdata, sd_bus_error *ret_error)
@@ -650,31 +739,421 @@ int dbus_get_routing_graph(sd_bus *bus, const char *path, const char *interface,
     struct wsbr_ctxt *ctxt = userdata;
     struct rpl_target target_br = { };
     struct rpl_target *target;
-    struct ws_neigh *ws_neigh;
 
     sd_bus_message_open_container(reply, 'a', "(aybaay)");
 
-    tun_addr_get_global_unicast(ctxt->config.tun_dev, target_br.prefix);
+    memcpy(target_br.prefix, dbus_get_br_addr(ctxt), 16);
     dbus_message_append_rpl_target(reply, &target_br, 0);
 
     SLIST_FOREACH(target, &ctxt->net_if.rpl_root.targets, link)
         dbus_message_append_rpl_target(reply, target, ctxt->net_if.rpl_root.pcs);
 
-    // Since LFN are not routed by RPL, rank 1 LFNs are not RPL targets.
-    // This hack allows to expose rank 1 LFNs and relies on their ipv6 address
-    // registration.
-    ns_list_foreach(struct ipv6_neighbour, ipv6_neigh, &ctxt->net_if.ipv6_neighbour_cache.list) {
-        if (IN6_IS_ADDR_MULTICAST(ipv6_neigh->ip_address) || IN6_IS_ADDR_LINKLOCAL(ipv6_neigh->ip_address))
+    ns_list_foreach(struct ipv6_neighbour, ipv6_neigh, &ctxt->net_if.ipv6_neighbour_cache.list)
+        if (dbus_ipv6_neigh_is_lfn(ctxt, ipv6_neigh))
+            dbus_message_append_ipv6_neigh(reply, ipv6_neigh, &ctxt->net_if.rpl_root);
+
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+static uint32_t dbus_hash_int(int val, uint32_t hash)
+{
+    return fnv_hash_reverse_32_update((const uint8_t *)&val, sizeof(val), hash);
+}
+
+// Only the stable values exposed by dbus_message_append_node() are hashed.
+// The link metrics (RSL, LQI) change on every received frame and are left
+// out, otherwise every neighbor would be reported by each refresh. Clients
+// which need up-to-date link metrics have to read the Nodes property.
+static uint32_t dbus_node_digest(const struct ws_pae_key_storage_supp_info *supp,
+                                 const struct ws_neigh *neighbor)
+{
+    uint32_t hash = fnv_hash_reverse_32_init(NULL, 0);
+
+    hash = dbus_hash_int(supp ? supp->node_role : -1, hash);
+    if (!neighbor)
+        return hash;
+    hash = dbus_hash_int(neighbor->pom_ie.mdr_command_capable, hash);
+    return fnv_hash_reverse_32_update(neighbor->pom_ie.phy_op_mode_id,
+                                      neighbor->pom_ie.phy_op_mode_number, hash);
+}
+
+static uint32_t dbus_rpl_target_digest(const struct rpl_target *target, uint8_t pcs)
+{
+    uint32_t hash = fnv_hash_reverse_32_init(NULL, 0);
+
+    hash = dbus_hash_int(target->external, hash);
+    for (uint8_t i = 0; i < pcs + 1; i++)
+        if (!dbus_rpl_transit_is_hidden(target, i))
+            hash = fnv_hash_reverse_32_update(target->transits[i].parent, 16, hash);
+    return hash;
+}
+
+static void dbus_journal_refresh_nodes(struct wsbr_ctxt *ctxt)
+{
+    struct change_journal *journal = &dbus_journal.nodes;
+    uint8_t (*eui64)[8];
+    int len;
+
+    len = ws_pae_auth_supp_list(ctxt->net_if.id, &eui64);
+    change_journal_refresh_start(journal);
+    // The border router entry never changes
+    change_journal_refresh(journal, ctxt->rcp.eui64, 0);
+    for (int i = 0; i < len; i++)
+        change_journal_refresh(journal, eui64[i],
+                               dbus_node_digest(ws_pae_key_storage_supp_info(eui64[i]),
+                                                dbus_get_neighbor_info(ctxt, eui64[i])));
+    change_journal_refresh_end(journal);
+    free(eui64);
+}
+
+static void dbus_journal_update_node(struct wsbr_ctxt *ctxt, const uint8_t eui64[8])
+{
+    struct change_journal *journal = &dbus_journal.nodes;
+
+    if (!memcmp(eui64, ctxt->rcp.eui64, 8))
+        return;
+    if (ws_pae_auth_supp_known(ctxt->net_if.id, eui64))
+        change_journal_update(journal, eui64,
+                              dbus_node_digest(ws_pae_key_storage_supp_info(eui64),
+                                               dbus_get_neighbor_info(ctxt, eui64)));
+    else
+        change_journal_remove(journal, eui64);
+}
+
+static void dbus_journal_refresh_routing_graph(struct wsbr_ctxt *ctxt)
+{
+    struct change_journal *journal = &dbus_journal.routing_graph;
+    struct rpl_root *root = &ctxt->net_if.rpl_root;
+    struct rpl_target *target;
+
+    change_journal_refresh_start(journal);
+    change_journal_refresh(journal, dbus_get_br_addr(ctxt), 0);
+    SLIST_FOREACH(target, &root->targets, link)
+        change_journal_refresh(journal, target->prefix, dbus_rpl_target_digest(target, root->pcs));
+    // Rank 1 LFNs are always attached to the border router
+    ns_list_foreach(struct ipv6_neighbour, ipv6_neigh, &ctxt->net_if.ipv6_neighbour_cache.list)
+        if (dbus_ipv6_neigh_is_lfn(ctxt, ipv6_neigh))
+            change_journal_refresh(journal, ipv6_neigh->ip_address, 1);
+    change_journal_refresh_end(journal);
+}
+
+// Must be consistent with dbus_journal_refresh_routing_graph()
+static void dbus_journal_update_routing_graph(struct wsbr_ctxt *ctxt, const uint8_t ipv6[16])
+{
+    struct change_journal *journal = &dbus_journal.routing_graph;
+    struct rpl_root *root = &ctxt->net_if.rpl_root;
+    struct ipv6_neighbour *ipv6_neigh;
+    struct rpl_target *target;
+
+    target = rpl_target_get(root, ipv6);
+    if (target) {
+        change_journal_update(journal, ipv6, dbus_rpl_target_digest(target, root->pcs));
+        return;
+    }
+    if (!memcmp(ipv6, dbus_get_br_addr(ctxt), 16)) {
+        change_journal_update(journal, ipv6, 0);
+        return;
+    }
+    ipv6_neigh = ipv6_neighbour_lookup(&ctxt->net_if.ipv6_neighbour_cache, ipv6);
+    if (ipv6_neigh && dbus_ipv6_neigh_is_lfn(ctxt, ipv6_neigh))
+        change_journal_update(journal, ipv6, 1);
+    else
+        change_journal_remove(journal, ipv6);
+}
+
+static void dbus_message_append_node_by_eui64(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                              const uint8_t *eui64)
+{
+    if (!memcmp(eui64, ctxt->rcp.eui64, 8))
+        dbus_message_append_node_br(m, "Nodes", ctxt);
+    else
+        dbus_message_append_node(m, "Nodes", eui64, false,
+                                 ws_pae_key_storage_supp_info(eui64),
+                                 dbus_get_neighbor_info(ctxt, eui64));
+}
+
+// Must be consistent with dbus_journal_refresh_routing_graph()
+static void dbus_message_append_routing_graph_by_ipv6(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                                      const uint8_t *ipv6)
+{
+    struct rpl_root *root = &ctxt->net_if.rpl_root;
+    struct rpl_target target_br = { };
+    struct ipv6_neighbour *ipv6_neigh;
+    struct rpl_target *target;
+
+    target = rpl_target_get(root, ipv6);
+    if (target) {
+        dbus_message_append_rpl_target(m, target, root->pcs);
+        return;
+    }
+    ipv6_neigh = ipv6_neighbour_lookup(&ctxt->net_if.ipv6_neighbour_cache, ipv6);
+    if (ipv6_neigh && dbus_ipv6_neigh_is_lfn(ctxt, ipv6_neigh)) {
+        dbus_message_append_ipv6_neigh(m, ipv6_neigh, root);
+        return;
+    }
+    memcpy(target_br.prefix, ipv6, 16);
+    dbus_message_append_rpl_target(m, &target_br, 0);
+}
+
+// Append the generation reached, the entries changed after generation gen
+// and the keys of the entries removed since then. At most limit changes are
+// reported, older first.
+static void dbus_message_append_changes(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                        const struct change_journal *journal,
+                                        uint64_t gen, uint32_t limit, const char *type,
+                                        void (*append)(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                                       const uint8_t *key))
+{
+    struct change_journal_entry *first, *end, *entry;
+    uint64_t gen_end = journal->gen;
+
+    first = change_journal_first_since(journal, gen);
+    end = first;
+    for (uint32_t i = 0; end && i < limit; i++)
+        end = change_journal_next(end);
+    if (end)
+        gen_end = end->gen - 1;
+    sd_bus_message_append(m, "t", gen_end);
+
+    sd_bus_message_open_container(m, 'a', type);
+    for (entry = first; entry != end; entry = change_journal_next(entry))
+        if (!entry->removed)
+            append(m, ctxt, entry->key);
+    sd_bus_message_close_container(m);
+
+    sd_bus_message_open_container(m, 'a', "ay");
+    // Nothing to remove for a client which does not know any entry
+    for (entry = first; gen && entry != end; entry = change_journal_next(entry))
+        if (entry->removed)
+            sd_bus_message_append_array(m, 'y', entry->key, journal->key_len);
+    sd_bus_message_close_container(m);
+}
+
+static int dbus_get_changes(sd_bus_message *m, struct wsbr_ctxt *ctxt, sd_bus_error *ret_error,
+                            const struct change_journal *journal, const char *type,
+                            void (*append)(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                           const uint8_t *key))
+{
+    sd_bus_message *reply;
+    uint32_t limit;
+    uint64_t gen;
+    int ret;
+
+    ret = sd_bus_message_read_basic(m, 't', &gen);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    ret = sd_bus_message_read_basic(m, 'u', &limit);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    if (!limit || gen > journal->gen)
+        return sd_bus_error_set_errno(ret_error, EINVAL);
+    if (change_journal_is_expired(journal, gen))
+        return sd_bus_error_set_errno(ret_error, ESTALE);
+    ret = sd_bus_message_new_method_return(m, &reply);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    dbus_message_append_changes(reply, ctxt, journal, gen, limit, type, append);
+    ret = sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return ret < 0 ? sd_bus_error_set_errno(ret_error, -ret) : 0;
+}
+
+static void dbus_emit_changes(struct wsbr_ctxt *ctxt, const char *property,
+                              const struct change_journal *journal, uint64_t *gen_signaled,
+                              const char *type,
+                              void (*append)(sd_bus_message *m, struct wsbr_ctxt *ctxt,
+                                             const uint8_t *key))
+{
+    char signal[64];
+    sd_bus_message *m;
+    uint64_t gen;
+    int ret;
+
+    sd_bus_emit_properties_changed(ctxt->dbus,
+                       "/com/silabs/Wisun/BorderRouter",
+                       "com.silabs.Wisun.BorderRouter",
+                       property, NULL);
+    if (journal->gen == *gen_signaled)
+        return;
+    snprintf(signal, sizeof(signal), "%sChanged", property);
+    ret = sd_bus_message_new_signal(ctxt->dbus, &m,
+                                    "/com/silabs/Wisun/BorderRouter",
+                                    "com.silabs.Wisun.BorderRouter",
+                                    signal);
+    if (ret < 0) {
+        WARN("%s: %s", __func__, strerror(-ret));
+        return;
+    }
+    gen = change_journal_is_expired(journal, *gen_signaled) ? 0 : *gen_signaled;
+    sd_bus_message_append(m, "t", gen);
+    if (gen) {
+        dbus_message_append_changes(m, ctxt, journal, gen, UINT32_MAX, type, append);
+    } else {
+        // The first signal, or the one following too many changes, would
+        // carry the whole set: only tell clients to resynchronize using the
+        // GetNodesPage and GetRoutingGraphPage methods.
+        sd_bus_message_append(m, "t", journal->gen);
+        sd_bus_message_open_container(m, 'a', type);
+        sd_bus_message_close_container(m);
+        sd_bus_message_open_container(m, 'a', "ay");
+        sd_bus_message_close_container(m);
+    }
+    ret = sd_bus_send(ctxt->dbus, m, NULL);
+    WARN_ON(ret < 0, "%s: %s", __func__, strerror(-ret));
+    sd_bus_message_unref(m);
+    *gen_signaled = journal->gen;
+}
+
+// The journals are only updated once per change event, when the changes are
+// processed or when a client asks for them before they are. Only the keys
+// reported since then are looked up, unless there are too many of them.
+static void dbus_process_nodes_changes(struct wsbr_ctxt *ctxt)
+{
+    struct dbus_journal_pending *pending = &dbus_journal.nodes_pending;
+
+    if (pending->all)
+        dbus_journal_refresh_nodes(ctxt);
+    else
+        for (int i = 0; i < pending->cnt; i++)
+            dbus_journal_update_node(ctxt, pending->keys[i]);
+    pending->all = false;
+    pending->cnt = 0;
+    if (!dbus_journal.nodes_dirty)
+        return;
+    dbus_emit_changes(ctxt, "Nodes", &dbus_journal.nodes,
+                      &dbus_journal.nodes_gen_signaled,
+                      "(aya{sv})", dbus_message_append_node_by_eui64);
+    dbus_journal.nodes_dirty = false;
+}
+
+static void dbus_process_routing_graph_changes(struct wsbr_ctxt *ctxt)
+{
+    struct dbus_journal_pending *pending = &dbus_journal.routing_graph_pending;
+
+    if (pending->all)
+        dbus_journal_refresh_routing_graph(ctxt);
+    else
+        for (int i = 0; i < pending->cnt; i++)
+            dbus_journal_update_routing_graph(ctxt, pending->keys[i]);
+    pending->all = false;
+    pending->cnt = 0;
+    if (!dbus_journal.routing_graph_dirty)
+        return;
+    dbus_emit_changes(ctxt, "RoutingGraph", &dbus_journal.routing_graph,
+                      &dbus_journal.routing_graph_gen_signaled,
+                      "(aybaay)", dbus_message_append_routing_graph_by_ipv6);
+    dbus_journal.routing_graph_dirty = false;
+}
+
+// The first call builds both journals from the whole sets
+static void dbus_journal_activate(void)
+{
+    if (dbus_journal.active)
+        return;
+    dbus_journal.active = true;
+    dbus_journal.nodes_pending.all = true;
+    dbus_journal.routing_graph_pending.all = true;
+}
+
+static int dbus_get_nodes_page(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+
+    dbus_journal_activate();
+    dbus_process_nodes_changes(ctxt);
+    return dbus_get_changes(m, ctxt, ret_error, &dbus_journal.nodes,
+                            "(aya{sv})", dbus_message_append_node_by_eui64);
+}
+
+static int dbus_get_routing_graph_page(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+
+    dbus_journal_activate();
+    dbus_process_routing_graph_changes(ctxt);
+    return dbus_get_changes(m, ctxt, ret_error, &dbus_journal.routing_graph,
+                            "(aybaay)", dbus_message_append_routing_graph_by_ipv6);
+}
+
+void dbus_process_changes(struct wsbr_ctxt *ctxt)
+{
+    if (!ctxt->dbus)
+        return;
+    dbus_process_nodes_changes(ctxt);
+    dbus_process_routing_graph_changes(ctxt);
+}
+
+static void dbus_message_append_stat(sd_bus_message *m, uint64_t val, const char *fmt, ...)
+{
+    char name[64];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(name, sizeof(name), fmt, ap);
+    va_end(ap);
+    sd_bus_message_append(m, "{st}", name, val);
+}
+
+static int dbus_get_statistics(sd_bus *bus, const char *path, const char *interface,
+                               const char *property, sd_bus_message *reply,
+                               void *userdata, sd_bus_error *ret_error)
+{
+    static const char *const tx_delay_names[LOWPAN_TX_DELAY_HIST_LEN] = {
+        "100ms", "200ms", "400ms", "800ms", "1600ms", "3200ms", "6400ms", "inf",
+    };
+    struct wsbr_ctxt *ctxt = userdata;
+    struct buffer_pool_stats pools[8];
+    const uint32_t *tx_delay_hist;
+    int len;
+
+    sd_bus_message_open_container(reply, 'a', "{st}");
+    len = buffer_pools_get_stats(pools, ARRAY_SIZE(pools));
+    for (int i = 0; i < len; i++) {
+        if (!pools[i].size) {
+            dbus_message_append_stat(reply, pools[i].alloc_cnt, "buffer_oversize_alloc");
             continue;
-        if (rpl_target_get(&ctxt->net_if.rpl_root, ipv6_neigh->ip_address))
+        }
+        dbus_message_append_stat(reply, pools[i].in_use,     "buffer_pool_%u_in_use", pools[i].size);
+        dbus_message_append_stat(reply, pools[i].high_water, "buffer_pool_%u_high_water", pools[i].size);
+        dbus_message_append_stat(reply, pools[i].alloc_cnt,  "buffer_pool_%u_alloc", pools[i].size);
+        dbus_message_append_stat(reply, pools[i].limit_cnt,  "buffer_pool_%u_limit_drop", pools[i].size);
+    }
+    if (ctxt->config.uart_dev[0]) {
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.tx_frame_cnt, "uart_tx_frames");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.tx_flush_cnt, "uart_tx_writes");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.tx_flush_frames_max, "uart_tx_writes_frames_max");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.rx_err_hcs,      "uart_rx_err_hcs");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.rx_err_fcs,      "uart_rx_err_fcs");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.rx_err_hdlc_crc, "uart_rx_err_hdlc_crc");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.rx_err_hdlc_len, "uart_rx_err_hdlc_len");
+        dbus_message_append_stat(reply, ctxt->rcp.bus.uart.rx_drop_bytes,   "uart_rx_drop_bytes");
+    }
+    dbus_message_append_stat(reply, ctxt->tun_rx_drop_cnt, "tun_rx_congestion_drop");
+    dbus_message_append_stat(reply, ctxt->tun_rx_nobuf_cnt, "tun_rx_nobuf_drop");
+    tx_delay_hist = lowpan_adaptation_tx_delay_hist(ctxt->net_if.id);
+    for (int i = 0; tx_delay_hist && i < LOWPAN_TX_DELAY_HIST_LEN; i++)
+        dbus_message_append_stat(reply, tx_delay_hist[i], "lowpan_tx_delay_lt_%s", tx_delay_names[i]);
+    dbus_message_append_stat(reply, ctxt->net_if.rpl_root.srh_cache_hit,  "rpl_srh_cache_hit");
+    dbus_message_append_stat(reply, ctxt->net_if.rpl_root.srh_cache_miss, "rpl_srh_cache_miss");
+    dbus_message_append_stat(reply, ctxt->net_if.rpl_root.storage_write_cnt,         "rpl_storage_write");
+    dbus_message_append_stat(reply, ctxt->net_if.rpl_root.storage_write_avoided_cnt, "rpl_storage_write_avoided");
+    dbus_message_append_stat(reply, ctxt->net_if.rpl_root.storage_latency_max_s,     "rpl_storage_latency_max_s");
+    dbus_message_append_stat(reply, ctxt->rcp.tx_data_cnt,        "hif_tx_data");
+    dbus_message_append_stat(reply, ctxt->rcp.tx_data_alloc_cnt,  "hif_tx_data_alloc");
+    dbus_message_append_stat(reply, ctxt->rcp.tx_data_copy_bytes, "hif_tx_data_copy_bytes");
+    dbus_message_append_stat(reply, ctxt->rcp.rx_wakeup_cnt,            "hif_rx_wakeups");
+    dbus_message_append_stat(reply, ctxt->rcp.rx_frame_cnt,             "hif_rx_frames");
+    dbus_message_append_stat(reply, ctxt->rcp.rx_frames_per_wakeup_max, "hif_rx_wakeups_frames_max");
+    for (int i = 0; i < ARRAY_SIZE(ctxt->rcp.cmd_slots); i++) {
+        if (!ctxt->rcp.cmd_slots[i].rx_cnt)
             continue;
-        ws_neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage,
-                                ipv6_neighbour_eui64(&ctxt->net_if.ipv6_neighbour_cache, ipv6_neigh));
-        if (!ws_neigh || ws_neigh->node_role != WS_NR_ROLE_LFN)
+        dbus_message_append_stat(reply, ctxt->rcp.cmd_slots[i].rx_cnt, "hif_rx_%s", hif_cmd_str(i));
+        if (!ctxt->rcp.cmd_timing)
             continue;
-        dbus_message_append_ipv6_neigh(reply, ipv6_neigh, &ctxt->net_if.rpl_root);
+        dbus_message_append_stat(reply, ctxt->rcp.cmd_slots[i].handler_ns,     "hif_rx_%s_ns", hif_cmd_str(i));
+        dbus_message_append_stat(reply, ctxt->rcp.cmd_slots[i].handler_ns_max, "hif_rx_%s_ns_max", hif_cmd_str(i));
     }
-
     sd_bus_message_close_container(reply);
     return 0;
 }
@@ -759,6 +1238,10 @@ static const sd_bus_vtable dbus_vtable[] = {
         SD_BUS_METHOD("IncrementRplDodagVersionNumber", NULL, NULL, dbus_increment_rpl_dodag_version_number, 0),
         SD_BUS_METHOD("AllowMac64",          "aay",    NULL, dbus_allow_mac64, 0),
         SD_BUS_METHOD("DenyMac64",           "aay",    NULL, dbus_deny_mac64, 0),
+        SD_BUS_METHOD("GetNodesPage",        "tu", "ta(aya{sv})aay", dbus_get_nodes_page, 0),
+        SD_BUS_METHOD("GetRoutingGraphPage", "tu", "ta(aybaay)aay",  dbus_get_routing_graph_page, 0),
+        SD_BUS_SIGNAL("NodesChanged",        "tta(aya{sv})aay", 0),
+        SD_BUS_SIGNAL("RoutingGraphChanged", "tta(aybaay)aay",  0),
         SD_BUS_PROPERTY("Gtks", "aay", dbus_get_gtks,
                         offsetof(struct wsbr_ctxt, net_if),
                         SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
@@ -775,6 +1258,7 @@ static const sd_bus_vtable dbus_vtable[] = {
                         SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
         SD_BUS_PROPERTY("RoutingGraph", "a(aybaay)", dbus_get_routing_graph, 0,
                         SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
+        SD_BUS_PROPERTY("Statistics", "a{st}", dbus_get_statistics, 0, 0),
         SD_BUS_PROPERTY("HwAddress", "ay", dbus_get_hw_address,
                         offsetof(struct wsbr_ctxt, rcp.eui64),
                         0),
@@ -808,6 +1292,14 @@ static const sd_bus_vtable dbus_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+static void dbus_on_event(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_dbus);
+
+    if (revents & EPOLLIN)
+        dbus_process(ctxt);
+}
+
 void dbus_register(struct wsbr_ctxt *ctxt)
 {
     int ret;
@@ -831,6 +1323,11 @@ void dbus_register(struct wsbr_ctxt *ctxt)
         return;
     }
 
+    change_journal_init(&dbus_journal.nodes, 8, DBUS_JOURNAL_TOMBSTONE_MAX);
+    change_journal_init(&dbus_journal.routing_graph, 16, DBUS_JOURNAL_TOMBSTONE_MAX);
+    // The journals are empty until the first refresh
+    dbus_journal.nodes_dirty = true;
+    dbus_journal.routing_graph_dirty = true;
     ret = sd_bus_add_object_vtable(ctxt->dbus, NULL, "/com/silabs/Wisun/BorderRouter",
                                    "com.silabs.Wisun.BorderRouter",
                                    dbus_vtable, ctxt);
@@ -848,6 +1345,10 @@ void dbus_register(struct wsbr_ctxt *ctxt)
 
     sd_bus_get_scope(ctxt->dbus, &dbus_scope);
     INFO("Successfully registered to %s DBus", dbus_scope);
+    ctxt->loop_dbus.fd       = sd_bus_get_fd(ctxt->dbus);
+    ctxt->loop_dbus.events   = EPOLLIN;
+    ctxt->loop_dbus.callback = dbus_on_event;
+    event_loop_add(&ctxt->loop, &ctxt->loop_dbus);
 }
 
 int dbus_process(struct wsbr_ctxt *ctxt)
@@ -856,11 +1357,3 @@ int dbus_process(struct wsbr_ctxt *ctxt)
     sd_bus_process(ctxt->dbus, NULL);
     return 0;
 }
-
-int dbus_get_fd(struct wsbr_ctxt *ctxt)
-{
-    if (ctxt->dbus)
-        return sd_bus_get_fd(ctxt->dbus);
-    else
-        return -1;
-}
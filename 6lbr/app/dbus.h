@@ -13,16 +13,18 @@
  */
 #ifndef WSBR_DBUS_H
 #define WSBR_DBUS_H
+#include <stdint.h>
 
 struct wsbr_ctxt;
 
 #ifdef HAVE_LIBSYSTEMD
 
 void dbus_emit_keys_change(struct wsbr_ctxt *ctxt);
-void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt);
-void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt);
+void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8]);
+void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt, const uint8_t ipv6[16]);
+void dbus_emit_neighbor_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8]);
+void dbus_process_changes(struct wsbr_ctxt *ctxt);
 void dbus_register(struct wsbr_ctxt *ctxt);
-int dbus_get_fd(struct wsbr_ctxt *ctxt);
 int dbus_process(struct wsbr_ctxt *ctxt);
 
 #else
@@ -33,24 +35,29 @@ static inline void dbus_emit_keys_change(struct wsbr_ctxt *ctxt)
 {
 }
 
-static inline void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt)
+static inline void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8])
 {
     /* empty */
 }
 
-static inline void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt)
+static inline void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt, const uint8_t ipv6[16])
 {
     /* empty */
 }
 
-static inline void dbus_register(struct wsbr_ctxt *ctxt)
+static inline void dbus_emit_neighbor_change(struct wsbr_ctxt *ctxt, const uint8_t eui64[8])
 {
-    WARN("support for DBus is disabled");
+    /* empty */
 }
 
-static inline int dbus_get_fd(struct wsbr_ctxt *ctxt)
+static inline void dbus_process_changes(struct wsbr_ctxt *ctxt)
 {
-    return -1;
+    /* empty */
+}
+
+static inline void dbus_register(struct wsbr_ctxt *ctxt)
+{
+    WARN("support for DBus is disabled");
 }
 
 static inline int dbus_process(struct wsbr_ctxt *ctxt)
@@ -11,6 +11,8 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <time.h>
+
 #include "common/bits.h"
 #include "common/capture.h"
 #include "common/endian.h"
@@ -32,12 +34,27 @@ uint8_t rcp_rx_buf[4096];
 // [...] the minimum and maximum values are 0 (–174 dBm) and 254 (80 dBm)
 #define RX_POWER_DBM_MAX 80
 
+// Maximum number of frames processed by a single call to rcp_rx(), so other
+// event sources (TUN, timers...) are not starved during RCP bursts.
+#define RCP_RX_BUDGET 16
+
+static void rcp_tx_trace(const uint8_t *cmd, int len)
+{
+    BUG_ON(!len);
+    TRACE(TR_HIF, "hif tx: %s %s", hif_cmd_str(cmd[0]),
+          tr_bytes(cmd + 1, len - 1, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+}
+
+// HIF commands are serialized one at a time, so a single buffer is recycled
+static struct iobuf_write *rcp_tx_buf(struct rcp *rcp)
+{
+    iobuf_reset(&rcp->tx_buf);
+    return &rcp->tx_buf;
+}
+
 static void rcp_tx(struct rcp *rcp, struct iobuf_write *buf)
 {
-    BUG_ON(!buf->len);
-    TRACE(TR_HIF, "hif tx: %s %s", hif_cmd_str(buf->data[0]),
-          tr_bytes(buf->data + 1, buf->len - 1,
-                   NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+    rcp_tx_trace(buf->data, buf->len);
     rcp->bus.tx(&rcp->bus, buf->data, buf->len);
 }
 
@@ -48,12 +65,11 @@ static void rcp_ind_nop(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_req_reset(struct rcp *rcp, bool bootload)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_REQ_RESET);
-    hif_push_bool(&buf, bootload);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_REQ_RESET);
+    hif_push_bool(buf, bootload);
+    rcp_tx(rcp, buf);
 }
 
 static void rcp_ind_reset(struct rcp *rcp, struct iobuf_read *buf)
@@ -99,12 +115,11 @@ static void rcp_ind_fatal(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_set_host_api(struct rcp *rcp, uint32_t host_api_version)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_HOST_API);
-    hif_push_u32(&buf, host_api_version);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_HOST_API);
+    hif_push_u32(buf, host_api_version);
+    rcp_tx(rcp, buf);
 }
 
 #define HIF_MASK_FHSS_TYPE      0x0007
@@ -113,33 +128,51 @@ void rcp_set_host_api(struct rcp *rcp, uint32_t host_api_version)
 #define HIF_MASK_FRAME_COUNTERS 0x1fc0
 #define HIF_MASK_MODE_SWITCH_TYPE 0x2000
 
-void rcp_req_data_tx(struct rcp *rcp,
-                     const uint8_t *frame, int frame_len,
-                     uint8_t handle, uint8_t fhss_type,
-                     const struct fhss_ws_neighbor_timing_info *fhss_data,
-                     const uint32_t frame_counters_min[7],
-                     const struct hif_rate_info rate_list[4], uint8_t ms_mode)
+struct iobuf_write *rcp_req_data_tx_start(struct rcp *rcp, uint8_t handle)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf;
+
+    if (rcp->bus.tx_start)
+        buf = rcp->bus.tx_start(&rcp->bus);
+    else
+        buf = rcp_tx_buf(rcp);
+    rcp->tx_data_size = buf->data_size;
+    rcp->tx_cmd_offset = buf->len;
+    hif_push_u8(buf, HIF_CMD_REQ_DATA_TX);
+    hif_push_u8(buf, handle);
+    rcp->tx_frame_offset = buf->len;
+    hif_push_u16(buf, 0); // Frame length, filled by rcp_req_data_tx_commit()
+    return buf;
+}
+
+void rcp_req_data_tx_commit(struct rcp *rcp, struct iobuf_write *buf,
+                            uint8_t fhss_type,
+                            const struct fhss_ws_neighbor_timing_info *fhss_data,
+                            const uint32_t frame_counters_min[7],
+                            const struct hif_rate_info rate_list[4], uint8_t ms_mode)
+{
+    int frame_len = buf->len - rcp->tx_frame_offset - 2;
     int bitfield_offset;
     uint16_t bitfield;
 
-    hif_push_u8(&buf, HIF_CMD_REQ_DATA_TX);
-    hif_push_u8(&buf, handle);
-    hif_push_data(&buf, frame, frame_len);
+    BUG_ON(frame_len < 0);
+    write_le16(buf->data + rcp->tx_frame_offset, frame_len);
+    TRACE(TR_HIF_EXTRA, "hif tx:     data: %s (%d bytes)",
+          tr_bytes(buf->data + rcp->tx_frame_offset + 2, frame_len,
+                   NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), frame_len);
 
     bitfield = 0;
-    bitfield_offset = buf.len;
-    hif_push_u16(&buf, 0);
+    bitfield_offset = buf->len;
+    hif_push_u16(buf, 0);
 
     bitfield |= FIELD_PREP(HIF_MASK_FHSS_TYPE, fhss_type);
     switch (fhss_type) {
     case HIF_FHSS_TYPE_FFN_UC:
         BUG_ON(!fhss_data);
         BUG_ON(!fhss_data->ffn.uc_dwell_interval_ms);
-        hif_push_u64(&buf, fhss_data->ffn.utt_rx_tstamp_us);
-        hif_push_u24(&buf, fhss_data->ffn.ufsi);
-        hif_push_u8(&buf, fhss_data->ffn.uc_dwell_interval_ms);
+        hif_push_u64(buf, fhss_data->ffn.utt_rx_tstamp_us);
+        hif_push_u24(buf, fhss_data->ffn.ufsi);
+        hif_push_u8(buf, fhss_data->ffn.uc_dwell_interval_ms);
         break;
     case HIF_FHSS_TYPE_FFN_BC:
         bitfield |= HIF_MASK_FHSS_DEFAULT;
@@ -147,10 +180,10 @@ void rcp_req_data_tx(struct rcp *rcp,
     case HIF_FHSS_TYPE_LFN_UC:
         BUG_ON(!fhss_data);
         BUG_ON(!fhss_data->lfn.uc_listen_interval_ms);
-        hif_push_u64(&buf, fhss_data->lfn.lutt_rx_tstamp_us);
-        hif_push_u16(&buf, fhss_data->lfn.uc_slot_number);
-        hif_push_u24(&buf, fhss_data->lfn.uc_interval_offset_ms);
-        hif_push_u24(&buf, fhss_data->lfn.uc_listen_interval_ms);
+        hif_push_u64(buf, fhss_data->lfn.lutt_rx_tstamp_us);
+        hif_push_u16(buf, fhss_data->lfn.uc_slot_number);
+        hif_push_u24(buf, fhss_data->lfn.uc_interval_offset_ms);
+        hif_push_u24(buf, fhss_data->lfn.uc_listen_interval_ms);
         break;
     case HIF_FHSS_TYPE_LFN_BC:
         bitfield |= HIF_MASK_FHSS_DEFAULT;
@@ -161,26 +194,26 @@ void rcp_req_data_tx(struct rcp *rcp,
     case HIF_FHSS_TYPE_LFN_PA:
         BUG_ON(!fhss_data);
         BUG_ON(!fhss_data->lfn.lpa_slot_duration_ms);
-        hif_push_u64(&buf, fhss_data->lfn.lnd_rx_tstamp_us);
-        hif_push_u32(&buf, fhss_data->lfn.lpa_response_delay_ms);
-        hif_push_u8(&buf,  fhss_data->lfn.lpa_slot_duration_ms);
-        hif_push_u8(&buf,  fhss_data->lfn.lpa_slot_count);
-        hif_push_u16(&buf, fhss_data->lfn.lpa_slot_first);
+        hif_push_u64(buf, fhss_data->lfn.lnd_rx_tstamp_us);
+        hif_push_u32(buf, fhss_data->lfn.lpa_response_delay_ms);
+        hif_push_u8(buf,  fhss_data->lfn.lpa_slot_duration_ms);
+        hif_push_u8(buf,  fhss_data->lfn.lpa_slot_count);
+        hif_push_u16(buf, fhss_data->lfn.lpa_slot_first);
         break;
     default:
         BUG();
     }
     if (fhss_type == HIF_FHSS_TYPE_FFN_UC || fhss_type == HIF_FHSS_TYPE_LFN_UC || fhss_type == HIF_FHSS_TYPE_LFN_PA) {
-        hif_push_u8(&buf, fhss_data->uc_chan_func);
+        hif_push_u8(buf, fhss_data->uc_chan_func);
         switch (fhss_data->uc_chan_func) {
         case WS_CHAN_FUNC_FIXED:
-            hif_push_u16(&buf, fhss_data->uc_chan_fixed);
+            hif_push_u16(buf, fhss_data->uc_chan_fixed);
             break;
         case WS_CHAN_FUNC_DH1CF: {
             uint8_t chan_mask_len = roundup(fhss_data->uc_chan_count, 8) / 8;
 
-            hif_push_u8(&buf, chan_mask_len);
-            hif_push_fixed_u8_array(&buf, fhss_data->uc_channel_list, chan_mask_len);
+            hif_push_u8(buf, chan_mask_len);
+            hif_push_fixed_u8_array(buf, fhss_data->uc_channel_list, chan_mask_len);
             break;
         }
         default:
@@ -191,34 +224,41 @@ void rcp_req_data_tx(struct rcp *rcp,
         for (uint8_t i = 0; i < 7; i++) {
             if (frame_counters_min[i] != UINT32_MAX) {
                 bitfield |= FIELD_PREP(HIF_MASK_FRAME_COUNTERS, 1u << i);
-                hif_push_u32(&buf, frame_counters_min[i]);
+                hif_push_u32(buf, frame_counters_min[i]);
             }
         }
     }
     if (rate_list) {
         bitfield |= HIF_MASK_MODE_SWITCH;
         for (int i = 0; i < 4; i++) {
-            hif_push_u8(&buf, rate_list[i].phy_mode_id);
-            hif_push_u8(&buf, rate_list[i].tx_attempts);
-            hif_push_i8(&buf, rate_list[i].tx_power_dbm);
+            hif_push_u8(buf, rate_list[i].phy_mode_id);
+            hif_push_u8(buf, rate_list[i].tx_attempts);
+            hif_push_i8(buf, rate_list[i].tx_power_dbm);
         }
     }
 
     bitfield |= FIELD_PREP(HIF_MASK_MODE_SWITCH_TYPE, ms_mode);
 
-    write_le16(buf.data + bitfield_offset, bitfield);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    write_le16(buf->data + bitfield_offset, bitfield);
+    rcp_tx_trace(buf->data + rcp->tx_cmd_offset, buf->len - rcp->tx_cmd_offset);
+    rcp->tx_data_cnt++;
+    if (buf->data_size != rcp->tx_data_size)
+        rcp->tx_data_alloc_cnt++;
+    if (rcp->bus.tx_end) {
+        rcp->bus.tx_end(&rcp->bus);
+    } else {
+        rcp->bus.tx(&rcp->bus, buf->data, buf->len);
+        rcp->tx_data_copy_bytes += buf->len;
+    }
 }
 
 void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_REQ_DATA_TX_ABORT);
-    hif_push_u8(&buf, handle);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_REQ_DATA_TX_ABORT);
+    hif_push_u8(buf, handle);
+    rcp_tx(rcp, buf);
 }
 
 static void rcp_cnf_data_tx(struct rcp *rcp, struct iobuf_read *buf)
@@ -257,20 +297,18 @@ static void rcp_ind_data_rx(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_req_radio_enable(struct rcp *rcp)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_REQ_RADIO_ENABLE);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_REQ_RADIO_ENABLE);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_req_radio_list(struct rcp *rcp)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_REQ_RADIO_LIST);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_REQ_RADIO_LIST);
+    rcp_tx(rcp, buf);
 }
 
 #define HIF_MASK_RADIO_LIST_GROUP 0x0001
@@ -327,142 +365,135 @@ static void rcp_cnf_radio_list(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_set_radio(struct rcp *rcp, uint8_t radioconf_index, uint8_t ofdm_mcs, bool enable_ms)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
     if (version_older_than(rcp->version_api, 2, 0, 1))
         enable_ms = !enable_ms; // API < 2.0.1 has this inverted
 
-    hif_push_u8(&buf, HIF_CMD_SET_RADIO);
-    hif_push_u8(&buf, radioconf_index);
-    hif_push_u8(&buf, ofdm_mcs);
-    hif_push_bool(&buf, enable_ms);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_RADIO);
+    hif_push_u8(buf, radioconf_index);
+    hif_push_u8(buf, ofdm_mcs);
+    hif_push_bool(buf, enable_ms);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_radio_regulation(struct rcp *rcp, enum hif_reg reg)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_RADIO_REGULATION);
-    hif_push_u8(&buf, reg);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_RADIO_REGULATION);
+    hif_push_u8(buf, reg);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_radio_tx_power(struct rcp *rcp, int8_t power_dbm)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_RADIO_TX_POWER);
-    hif_push_i8(&buf, power_dbm);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_RADIO_TX_POWER);
+    hif_push_i8(buf, power_dbm);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_fhss_uc(struct rcp *rcp, const struct ws_fhss_config *cfg)
 {
     int fixed_channel = ws_common_get_fixed_channel(cfg->uc_chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_FHSS_UC);
-    hif_push_u8(&buf, cfg->uc_dwell_interval);
-    hif_push_u8(&buf, chan_func);
+    hif_push_u8(buf, HIF_CMD_SET_FHSS_UC);
+    hif_push_u8(buf, cfg->uc_dwell_interval);
+    hif_push_u8(buf, chan_func);
     switch (chan_func) {
     case WS_CHAN_FUNC_FIXED:
         if (version_older_than(rcp->version_api, 2, 1, 1))
             FATAL(3, "fixed channel requires RCP API > 2.1.1");
         BUG_ON(fixed_channel < 0);
-        hif_push_u16(&buf, fixed_channel);
+        hif_push_u16(buf, fixed_channel);
         break;
     case WS_CHAN_FUNC_DH1CF:
-        hif_push_u8(&buf, sizeof(cfg->uc_chan_mask));
-        hif_push_fixed_u8_array(&buf, cfg->uc_chan_mask, sizeof(cfg->uc_chan_mask));
+        hif_push_u8(buf, sizeof(cfg->uc_chan_mask));
+        hif_push_fixed_u8_array(buf, cfg->uc_chan_mask, sizeof(cfg->uc_chan_mask));
         break;
     default:
         BUG("unsupported channel function");
         break;
     }
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_fhss_ffn_bc(struct rcp *rcp, const struct ws_fhss_config *cfg)
 {
     int fixed_channel = ws_common_get_fixed_channel(cfg->bc_chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf,  HIF_CMD_SET_FHSS_FFN_BC);
-    hif_push_u24(&buf, cfg->bc_interval);
-    hif_push_u16(&buf, cfg->bsi);
-    hif_push_u8(&buf,  cfg->bc_dwell_interval);
-    hif_push_u8(&buf,  chan_func);
+    hif_push_u8(buf,  HIF_CMD_SET_FHSS_FFN_BC);
+    hif_push_u24(buf, cfg->bc_interval);
+    hif_push_u16(buf, cfg->bsi);
+    hif_push_u8(buf,  cfg->bc_dwell_interval);
+    hif_push_u8(buf,  chan_func);
     switch (chan_func) {
     case WS_CHAN_FUNC_FIXED:
         if (version_older_than(rcp->version_api, 2, 1, 1))
             FATAL(3, "fixed channel requires RCP API > 2.1.1");
         BUG_ON(fixed_channel < 0);
-        hif_push_u16(&buf, fixed_channel);
+        hif_push_u16(buf, fixed_channel);
         break;
     case WS_CHAN_FUNC_DH1CF:
-        hif_push_u8(&buf, sizeof(cfg->bc_chan_mask));
-        hif_push_fixed_u8_array(&buf, cfg->bc_chan_mask, sizeof(cfg->bc_chan_mask));
+        hif_push_u8(buf, sizeof(cfg->bc_chan_mask));
+        hif_push_fixed_u8_array(buf, cfg->bc_chan_mask, sizeof(cfg->bc_chan_mask));
         break;
     default:
         BUG("unsupported channel function");
         break;
     }
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_fhss_lfn_bc(struct rcp *rcp, const struct ws_fhss_config *cfg)
 {
     int fixed_channel = ws_common_get_fixed_channel(cfg->bc_chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
     // FIXME: Some parameters are shared with FFN broadcast
-    hif_push_u8(&buf,  HIF_CMD_SET_FHSS_LFN_BC);
-    hif_push_u24(&buf, cfg->lfn_bc_interval);
-    hif_push_u16(&buf, cfg->bsi);
-    hif_push_u8(&buf,  chan_func);
+    hif_push_u8(buf,  HIF_CMD_SET_FHSS_LFN_BC);
+    hif_push_u24(buf, cfg->lfn_bc_interval);
+    hif_push_u16(buf, cfg->bsi);
+    hif_push_u8(buf,  chan_func);
     switch (chan_func) {
     case WS_CHAN_FUNC_FIXED:
         if (version_older_than(rcp->version_api, 2, 1, 1))
             FATAL(3, "fixed channel requires RCP API > 2.1.1");
         BUG_ON(fixed_channel < 0);
-        hif_push_u16(&buf, fixed_channel);
+        hif_push_u16(buf, fixed_channel);
         break;
     case WS_CHAN_FUNC_DH1CF:
-        hif_push_u8(&buf, sizeof(cfg->bc_chan_mask));
-        hif_push_fixed_u8_array(&buf, cfg->bc_chan_mask, sizeof(cfg->bc_chan_mask));
+        hif_push_u8(buf, sizeof(cfg->bc_chan_mask));
+        hif_push_fixed_u8_array(buf, cfg->bc_chan_mask, sizeof(cfg->bc_chan_mask));
         break;
     default:
         BUG("unsupported channel function");
         break;
     }
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_fhss_async(struct rcp *rcp, const struct ws_fhss_config *cfg)
 {
     uint8_t domain_channel_mask[32];
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
     ws_common_generate_channel_list(domain_channel_mask, cfg->chan_count,
                                     cfg->regional_regulation, cfg->regulatory_domain,
                                     cfg->op_class, cfg->chan_plan_id);
 
-    hif_push_u8(&buf,  HIF_CMD_SET_FHSS_ASYNC);
-    hif_push_u32(&buf, cfg->async_frag_duration_ms);
-    hif_push_u8(&buf, sizeof(domain_channel_mask));
-    hif_push_fixed_u8_array(&buf, domain_channel_mask, sizeof(domain_channel_mask));
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf,  HIF_CMD_SET_FHSS_ASYNC);
+    hif_push_u32(buf, cfg->async_frag_duration_ms);
+    hif_push_u8(buf, sizeof(domain_channel_mask));
+    hif_push_fixed_u8_array(buf, domain_channel_mask, sizeof(domain_channel_mask));
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_sec_key(struct rcp *rcp,
@@ -470,80 +501,86 @@ void rcp_set_sec_key(struct rcp *rcp,
                      const uint8_t key[16],
                      uint32_t frame_counter)
 {
-    struct iobuf_write buf = { };
-
-    hif_push_u8(&buf, HIF_CMD_SET_SEC_KEY);
-    hif_push_u8(&buf, key_index);
-    hif_push_fixed_u8_array(&buf, key ? : (uint8_t[16]){ }, 16);
-    hif_push_u32(&buf, frame_counter);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
+
+    hif_push_u8(buf, HIF_CMD_SET_SEC_KEY);
+    hif_push_u8(buf, key_index);
+    hif_push_fixed_u8_array(buf, key ? : (uint8_t[16]){ }, 16);
+    hif_push_u32(buf, frame_counter);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_filter_pan_id(struct rcp *rcp, uint16_t pan_id)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_FILTER_PANID);
-    hif_push_u16(&buf, pan_id);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_FILTER_PANID);
+    hif_push_u16(buf, pan_id);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_filter_src64(struct rcp *rcp, const uint8_t eui64[][8], uint8_t count, bool allow)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
-    hif_push_u8(&buf, HIF_CMD_SET_FILTER_SRC64);
-    hif_push_bool(&buf, allow);
-    hif_push_u8(&buf, count);
+    hif_push_u8(buf, HIF_CMD_SET_FILTER_SRC64);
+    hif_push_bool(buf, allow);
+    hif_push_u8(buf, count);
     while (count--)
-        hif_push_fixed_u8_array(&buf, *eui64++, 8);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+        hif_push_fixed_u8_array(buf, *eui64++, 8);
+    rcp_tx(rcp, buf);
 }
 
 void rcp_set_filter_dst64(struct rcp *rcp, const uint8_t eui64[8])
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write *buf = rcp_tx_buf(rcp);
 
     memcpy(&rcp->eui64, eui64, 8);
 
-    hif_push_u8(&buf, HIF_CMD_SET_FILTER_DST64);
-    hif_push_fixed_u8_array(&buf, eui64, 8);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    hif_push_u8(buf, HIF_CMD_SET_FILTER_DST64);
+    hif_push_fixed_u8_array(buf, eui64, 8);
+    rcp_tx(rcp, buf);
 }
 
 struct rcp_cmd rcp_cmd_table[] = {
-    { HIF_CMD_IND_NOP,           rcp_ind_nop        },
-    { HIF_CMD_IND_RESET,         rcp_ind_reset      },
-    { HIF_CMD_IND_FATAL,         rcp_ind_fatal      },
-    { HIF_CMD_CNF_DATA_TX,       rcp_cnf_data_tx    },
-    { HIF_CMD_IND_DATA_RX,       rcp_ind_data_rx    },
-    { HIF_CMD_CNF_RADIO_LIST,    rcp_cnf_radio_list },
-    { HIF_CMD_IND_REPLAY_TIMER,  rcp_ind_nop        },
-    { HIF_CMD_IND_REPLAY_SOCKET, rcp_ind_nop        },
+    { HIF_CMD_IND_NOP,           rcp_ind_nop,        RCP_CMD_RUNNING },
+    { HIF_CMD_IND_RESET,         rcp_ind_reset,      RCP_CMD_WAIT_RESET | RCP_CMD_RUNNING },
+    { HIF_CMD_IND_FATAL,         rcp_ind_fatal,      RCP_CMD_RUNNING },
+    { HIF_CMD_CNF_DATA_TX,       rcp_cnf_data_tx,    RCP_CMD_RUNNING },
+    { HIF_CMD_IND_DATA_RX,       rcp_ind_data_rx,    RCP_CMD_RUNNING },
+    { HIF_CMD_CNF_RADIO_LIST,    rcp_cnf_radio_list, RCP_CMD_WAIT_RF_LIST | RCP_CMD_RUNNING },
+    { HIF_CMD_IND_REPLAY_TIMER,  rcp_ind_nop,        RCP_CMD_RUNNING },
+    { HIF_CMD_IND_REPLAY_SOCKET, rcp_ind_nop,        RCP_CMD_RUNNING },
     { 0 }
 };
 
-static bool rcp_init_state_is_valid(struct rcp *rcp, uint8_t cmd)
+void rcp_init(struct rcp *rcp)
 {
-    if (!rcp->has_reset)
-        return cmd == HIF_CMD_IND_RESET;
-    if (!rcp->has_rf_list)
-        return cmd == HIF_CMD_CNF_RADIO_LIST;
-    return true;
+    struct rcp_cmd_slot *slot;
+
+    for (int i = 0; i < ARRAY_SIZE(rcp->cmd_slots); i++) {
+        rcp->cmd_slots[i].fn = NULL;
+        rcp->cmd_slots[i].states = 0;
+    }
+    for (const struct rcp_cmd *cmd = rcp_cmd_table; cmd->fn; cmd++) {
+        slot = &rcp->cmd_slots[cmd->cmd];
+        BUG_ON(slot->fn, "duplicate HIF command 0x%02x", cmd->cmd);
+        slot->fn = cmd->fn;
+        slot->states = cmd->states;
+    }
 }
 
-void rcp_rx(struct rcp *rcp)
+static bool rcp_rx_frame(struct rcp *rcp)
 {
     struct iobuf_read buf = { .data = rcp_rx_buf };
+    struct rcp_cmd_slot *slot;
+    struct timespec t0, t1;
+    uint64_t handler_ns;
     uint32_t cmd;
 
     buf.data_size = rcp->bus.rx(&rcp->bus, rcp_rx_buf, sizeof(rcp_rx_buf));
     if (!buf.data_size)
-        return;
+        return false;
     capture_record_hif(buf.data, buf.data_size);
     cmd = hif_pop_u8(&buf);
     if (cmd == 0xff)
@@ -552,12 +589,48 @@ void rcp_rx(struct rcp *rcp)
         TRACE(TR_HIF, "hif rx: %s %s", hif_cmd_str(cmd),
               tr_bytes(iobuf_ptr(&buf), iobuf_remaining_size(&buf),
                        NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
-    if (!rcp_init_state_is_valid(rcp, cmd)) {
+    slot = &rcp->cmd_slots[cmd];
+    if (!slot->fn) {
+        TRACE(TR_DROP, "drop %-9s: unsupported command 0x%02x", "hif", cmd);
+        return true;
+    }
+    // has_rf_list is only set after has_reset
+    if (!(slot->states & (RCP_CMD_WAIT_RESET << (rcp->has_reset + rcp->has_rf_list)))) {
         TRACE(TR_DROP, "drop %-9s: unexpected command during reset sequence", "hif");
-        return;
+        return true;
+    }
+    slot->rx_cnt++;
+    if (!rcp->cmd_timing) {
+        slot->fn(rcp, &buf);
+        return true;
     }
-    for (int i = 0; i < ARRAY_SIZE(rcp_cmd_table); i++)
-        if (rcp_cmd_table[i].cmd == cmd)
-            return rcp_cmd_table[i].fn(rcp, &buf);
-    TRACE(TR_DROP, "drop %-9s: unsupported command 0x%02x", "hif", cmd);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    slot->fn(rcp, &buf);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    handler_ns = (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec - t0.tv_nsec;
+    slot->handler_ns += handler_ns;
+    if (handler_ns > slot->handler_ns_max)
+        slot->handler_ns_max = MIN(handler_ns, UINT32_MAX);
+    return true;
+}
+
+void rcp_rx(struct rcp *rcp)
+{
+    int cnt = 0;
+
+    // With UART, all the available bytes are read at once, so several frames
+    // may be pending. data_ready indicates that the bus may return another
+    // frame without blocking. CPC always returns a single frame.
+    do {
+        if (!rcp_rx_frame(rcp))
+            break;
+        cnt++;
+    } while (rcp->bus.uart.data_ready && cnt < RCP_RX_BUDGET);
+
+    rcp->rx_wakeup_cnt++;
+    rcp->rx_frame_cnt += cnt;
+    if (cnt > rcp->rx_frames_per_wakeup_max)
+        rcp->rx_frames_per_wakeup_max = cnt;
+    if (cnt > 1)
+        TRACE(TR_HIF, "hif rx: %d frames processed in one wakeup", cnt);
 }
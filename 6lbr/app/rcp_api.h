@@ -27,6 +27,8 @@ struct mcps_data_ind;
 struct mcps_data_rx_ie_list;
 struct bus;
 struct phy_rf_channel_configuration;
+struct iobuf_read;
+struct rcp;
 struct wsbr_ctxt;
 
 struct rcp_rail_config {
@@ -38,6 +40,22 @@ struct rcp_rail_config {
     int      phy_mode_group;
 };
 
+// Steps of the RCP initialization during which a HIF command is accepted
+#define RCP_CMD_WAIT_RESET   0x01
+#define RCP_CMD_WAIT_RF_LIST 0x02
+#define RCP_CMD_RUNNING      0x04
+
+// Entry of the dispatch table of received HIF commands, indexed by command
+// and built from rcp_cmd_table by rcp_init().
+struct rcp_cmd_slot {
+    void (*fn)(struct rcp *rcp, struct iobuf_read *buf);
+    uint8_t states;
+    // Statistics
+    uint64_t rx_cnt;
+    uint64_t handler_ns; // Cumulated time spent in fn, if rcp->cmd_timing
+    uint32_t handler_ns_max;
+};
+
 struct rcp {
     struct bus bus;
 
@@ -52,22 +70,51 @@ struct rcp {
     const char *version_label;
     uint8_t  eui64[8];
     struct rcp_rail_config *rail_config_list;
+
+    // Statistics: rx_frame_cnt / rx_wakeup_cnt gives the average number of
+    // frames processed per call to rcp_rx()
+    uint64_t rx_wakeup_cnt;
+    uint64_t rx_frame_cnt;
+    int      rx_frames_per_wakeup_max;
+    // Measure the time spent in the handlers of the received commands, which
+    // costs two clock_gettime() per frame
+    bool cmd_timing;
+    struct rcp_cmd_slot cmd_slots[256];
+
+    // Data requests are serialized directly in the transmission buffer of the
+    // bus when it provides one (see bus->tx_start). Other HIF commands use
+    // tx_buf, which is kept allocated between commands.
+    struct iobuf_write tx_buf;
+    int tx_data_size;
+    int tx_cmd_offset;
+    int tx_frame_offset;
+    // Statistics on data requests: tx_data_alloc_cnt counts the requests
+    // which needed to grow the transmission buffer, tx_data_copy_bytes the
+    // bytes copied once the request is serialized.
+    uint64_t tx_data_cnt;
+    uint64_t tx_data_alloc_cnt;
+    uint64_t tx_data_copy_bytes;
 };
 
 // Share rx buffer with legacy implementation to not allocate twice
 extern uint8_t rcp_rx_buf[4096];
 
+// Must be called once, before any other function. The statistics are left
+// untouched.
+void rcp_init(struct rcp *rcp);
 void rcp_rx(struct rcp *rcp);
 
 void rcp_req_reset(struct rcp *rcp, bool bootload);
 void rcp_set_host_api(struct rcp *rcp, uint32_t host_api_version);
 
-void rcp_req_data_tx(struct rcp *rcp,
-                     const uint8_t *frame, int frame_len,
-                     uint8_t handle, uint8_t fhss_type,
-                     const struct fhss_ws_neighbor_timing_info *fhss_data,
-                     const uint32_t frame_counters_min[7],
-                     const struct hif_rate_info rate_list[4], uint8_t ms_mode);
+// Start a data request, the 802.15.4 frame has to be appended to the returned
+// buffer before calling rcp_req_data_tx_commit().
+struct iobuf_write *rcp_req_data_tx_start(struct rcp *rcp, uint8_t handle);
+void rcp_req_data_tx_commit(struct rcp *rcp, struct iobuf_write *buf,
+                            uint8_t fhss_type,
+                            const struct fhss_ws_neighbor_timing_info *fhss_data,
+                            const uint32_t frame_counters_min[7],
+                            const struct hif_rate_info rate_list[4], uint8_t ms_mode);
 void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle);
 
 void rcp_req_radio_enable(struct rcp *rcp);
@@ -97,6 +144,7 @@ void rcp_set_filter_dst64(struct rcp *rcp, const uint8_t eui64[8]);
 struct rcp_cmd {
     uint8_t cmd;
     void (*fn)(struct rcp *rcp, struct iobuf_read *buf);
+    uint8_t states;
 };
 extern struct rcp_cmd rcp_cmd_table[];
 
@@ -13,15 +13,49 @@
  */
 #include <sys/timerfd.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "common/capture.h"
 #include "common/log.h"
+#include "common/memutils.h"
 
 #include "net/timers.h"
 
 #include "timers.h"
 #include "wsbr.h"
 
+static uint64_t wsbr_common_timer_now_ms(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000 + tp.tv_nsec / 1000000;
+}
+
+static uint64_t wsbr_common_timer_now_tick(struct wsbr_ctxt *ctxt)
+{
+    return (wsbr_common_timer_now_ms() - ctxt->timer_t0_ms) / WS_TIMER_GLOBAL_PERIOD_MS;
+}
+
+// Timers are armed relative to the current tick of the wheel, which only
+// moves when it is advanced. Catch up with the time spent waiting before
+// anything can arm a timer.
+static void wsbr_common_timer_on_wakeup(struct event_loop *loop)
+{
+    struct wsbr_ctxt *ctxt = container_of(loop, struct wsbr_ctxt, loop);
+
+    if (ctxt->timer_t0_ms)
+        ws_timer_advance(wsbr_common_timer_now_tick(ctxt));
+}
+
+static void wsbr_common_timer_on_event(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_timer);
+
+    if (revents & EPOLLIN)
+        wsbr_common_timer_process(ctxt);
+}
+
 void wsbr_common_timer_init(struct wsbr_ctxt *ctxt)
 {
     int ret;
@@ -33,16 +67,58 @@ void wsbr_common_timer_init(struct wsbr_ctxt *ctxt)
     ctxt->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
     FATAL_ON(ctxt->timerfd < 0, 2, "timerfd_create: %m");
     capture_register_timerfd(ctxt->timerfd);
+    ctxt->loop_timer.fd       = ctxt->timerfd;
+    ctxt->loop_timer.events   = EPOLLIN;
+    ctxt->loop_timer.callback = wsbr_common_timer_on_event;
+    event_loop_add(&ctxt->loop, &ctxt->loop_timer);
+    // The capture records one tick per timerfd read, so the periodic mode is
+    // needed to replay it.
+    if (!ctxt->config.capture[0]) {
+        ctxt->timer_tickless = true;
+        ctxt->timer_next_tick = UINT64_MAX;
+        ctxt->loop.on_wakeup = wsbr_common_timer_on_wakeup;
+        return;
+    }
     ret = timerfd_settime(ctxt->timerfd, 0, &parms, NULL);
     FATAL_ON(ret < 0, 2, "timerfd_settime: %m");
 }
 
+void wsbr_common_timer_rearm(struct wsbr_ctxt *ctxt)
+{
+    uint64_t next = ws_timer_next_tick();
+    struct itimerspec parms = { };
+    uint64_t deadline_ms;
+    int ret;
+
+    if (!ctxt->timer_tickless || next == ctxt->timer_next_tick)
+        return;
+    // Tick 0 is the first time the event loop waits, so the initialization
+    // delay is not accounted to the timers.
+    if (!ctxt->timer_t0_ms)
+        ctxt->timer_t0_ms = wsbr_common_timer_now_ms();
+    ctxt->timer_next_tick = next;
+    if (next != UINT64_MAX) {
+        deadline_ms = ctxt->timer_t0_ms + next * WS_TIMER_GLOBAL_PERIOD_MS;
+        parms.it_value.tv_sec  = deadline_ms / 1000;
+        parms.it_value.tv_nsec = deadline_ms % 1000 * 1000 * 1000;
+    }
+    ret = timerfd_settime(ctxt->timerfd, TFD_TIMER_ABSTIME, &parms, NULL);
+    FATAL_ON(ret < 0, 2, "timerfd_settime: %m");
+}
+
 void wsbr_common_timer_process(struct wsbr_ctxt *ctxt)
 {
     uint64_t val;
     int ret;
 
     ret = xread(ctxt->timerfd, &val, sizeof(val));
+    if (ctxt->timer_tickless) {
+        // The timer may have been re-armed after its expiration, so the read
+        // result is not meaningful. Time is measured instead.
+        ctxt->timer_next_tick = UINT64_MAX;
+        ws_timer_advance(wsbr_common_timer_now_tick(ctxt));
+        return;
+    }
     WARN_ON(ret < sizeof(val), "cancelled timer?");
     WARN_ON(val != 1, "missing timers: %"PRIu64, val - 1);
     ws_timer_global_tick();
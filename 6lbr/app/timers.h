@@ -19,5 +19,8 @@ struct iobuf_read;
 
 void wsbr_common_timer_init(struct wsbr_ctxt *ctxt);
 void wsbr_common_timer_process(struct wsbr_ctxt *ctxt);
+// Program the timerfd for the next timer deadline (no-op in periodic mode).
+// Must be called before waiting for events.
+void wsbr_common_timer_rearm(struct wsbr_ctxt *ctxt);
 
 #endif
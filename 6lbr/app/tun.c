@@ -24,6 +24,7 @@
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <netlink/netlink.h>
+#include <netlink/msg.h>
 #include <netlink/route/link.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/route.h>
@@ -33,10 +34,14 @@
 #include "common/bits.h"
 #include "common/capture.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/endian.h"
+#include "common/hash_table.h"
 #include "common/iobuf.h"
+#include "common/memutils.h"
 #include "common/netinet_in_extra.h"
 #include "common/specs/icmpv6.h"
+#include "common/time_extra.h"
 
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "net/protocol.h"
@@ -111,75 +116,202 @@ int tun_addr_get_global_unicast(const char *if_name, uint8_t ip[16])
     return tun_addr_get(if_name, ip, true, false);
 }
 
+// Netlink requests are batched in a single datagram. The kernel rejects
+// datagrams larger than the socket send buffer.
+#define TUN_NL_BATCH_MAX 16384
+
+// Entries of the mirror are trusted for this long. The kernel entries may be
+// removed behind our back (administrator flushing the tables, interface going
+// down), so they are requested again when a node registers after that delay.
+#define TUN_NL_ENTRY_LIFETIME_S 300
+
+// Mirror of the entries programmed in the kernel for a given address, so a
+// node registering again does not cost a netlink round trip (nor a dump of the
+// kernel neighbor table).
+struct tun_nl_entry {
+    uint8_t addr[16];
+    bool proxy_neigh;
+    bool direct_route;
+    time_t expiration_s;
+    struct hash_entry hash_entry;
+};
+
+static struct tun_nl_entry *tun_nl_entry_get(struct wsbr_ctxt *ctxt, const uint8_t addr[16])
+{
+    uint32_t hash = hash_table_key(addr, 16);
+    time_t now = time_current(CLOCK_MONOTONIC);
+    struct tun_nl_entry *entry;
+    struct hash_entry *it;
+
+    hash_table_foreach(&ctxt->nl_entries, it, hash) {
+        entry = container_of(it, struct tun_nl_entry, hash_entry);
+        if (memcmp(entry->addr, addr, 16))
+            continue;
+        if (now >= entry->expiration_s) {
+            entry->proxy_neigh = false;
+            entry->direct_route = false;
+            entry->expiration_s = now + TUN_NL_ENTRY_LIFETIME_S;
+        }
+        return entry;
+    }
+    entry = zalloc(sizeof(*entry));
+    memcpy(entry->addr, addr, 16);
+    entry->expiration_s = now + TUN_NL_ENTRY_LIFETIME_S;
+    hash_table_insert(&ctxt->nl_entries, &entry->hash_entry, hash);
+    return entry;
+}
+
+static void tun_nl_entry_free(struct wsbr_ctxt *ctxt, struct tun_nl_entry *entry)
+{
+    hash_table_remove(&ctxt->nl_entries, &entry->hash_entry);
+    free(entry);
+}
+
+// Entries of the nodes which left without deregistering are freed once they
+// expired. The table is swept once per TUN_NL_ENTRY_LIFETIME_S.
+static void tun_nl_expire(struct wsbr_ctxt *ctxt)
+{
+    time_t now = time_current(CLOCK_MONOTONIC);
+    struct hash_entry *it, *next;
+    struct tun_nl_entry *entry;
+
+    if (now < ctxt->nl_entries_sweep_s)
+        return;
+    ctxt->nl_entries_sweep_s = now + TUN_NL_ENTRY_LIFETIME_S;
+    for (it = hash_table_iter_first(&ctxt->nl_entries); it; it = next) {
+        next = hash_table_iter_next(&ctxt->nl_entries, it);
+        entry = container_of(it, struct tun_nl_entry, hash_entry);
+        if (now >= entry->expiration_s)
+            tun_nl_entry_free(ctxt, entry);
+    }
+}
+
+// The mirror cannot be trusted anymore, all the entries will be requested
+// again on the next registrations
+static void tun_nl_resync(struct wsbr_ctxt *ctxt)
+{
+    struct hash_entry *it, *next;
+
+    for (it = hash_table_iter_first(&ctxt->nl_entries); it; it = next) {
+        next = hash_table_iter_next(&ctxt->nl_entries, it);
+        tun_nl_entry_free(ctxt, container_of(it, struct tun_nl_entry, hash_entry));
+    }
+}
+
+// The TUN device is not expected to be recreated while wsbrd is running
+static int tun_nl_ifindex(struct wsbr_ctxt *ctxt)
+{
+    if (!ctxt->tun_ifindex) {
+        ctxt->tun_ifindex = if_nametoindex(ctxt->config.tun_dev);
+        if (!ctxt->tun_ifindex)
+            ERROR("if_nametoindex %s: %m", ctxt->config.tun_dev);
+    }
+    return ctxt->tun_ifindex;
+}
+
+static void tun_nl_queue(struct wsbr_ctxt *ctxt, struct nl_msg *msg)
+{
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+
+    // Only failures are reported by the kernel, see wsbr_tun_nl_flush()
+    hdr->nlmsg_flags |= NLM_F_REQUEST;
+    hdr->nlmsg_flags &= ~NLM_F_ACK;
+    hdr->nlmsg_seq = ++ctxt->nl_seq;
+    if (ctxt->nl_batch.len + NLMSG_ALIGN(hdr->nlmsg_len) > TUN_NL_BATCH_MAX)
+        wsbr_tun_nl_flush(ctxt);
+    iobuf_push_data(&ctxt->nl_batch, hdr, hdr->nlmsg_len);
+    iobuf_push_data_reserved(&ctxt->nl_batch, NLMSG_ALIGN(hdr->nlmsg_len) - hdr->nlmsg_len);
+    nlmsg_free(msg);
+}
+
+void wsbr_tun_nl_flush(struct wsbr_ctxt *ctxt)
+{
+    uint8_t buf[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsgerr *nlerr;
+    struct nlmsghdr *hdr;
+    ssize_t len;
+    int ret;
+
+    tun_nl_expire(ctxt);
+    if (!ctxt->nl_batch.len)
+        return;
+    ret = nl_sendto(ctxt->nl_sock, ctxt->nl_batch.data, ctxt->nl_batch.len);
+    iobuf_reset(&ctxt->nl_batch);
+    if (ret < 0) {
+        WARN("nl_sendto: %s", nl_geterror(ret));
+        tun_nl_resync(ctxt);
+        return;
+    }
+
+    // rtnetlink processes the requests synchronously in sendmsg(), so the
+    // errors (if any) are already queued on the socket.
+    while ((len = recv(nl_socket_get_fd(ctxt->nl_sock), buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        for (hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+            if (hdr->nlmsg_type != NLMSG_ERROR)
+                continue;
+            nlerr = NLMSG_DATA(hdr);
+            // The routes may remain from a previous run
+            if (nlerr->error && nlerr->error != -EEXIST) {
+                WARN("netlink request %u: %s", hdr->nlmsg_seq, strerror(-nlerr->error));
+                tun_nl_resync(ctxt);
+            }
+        }
+    }
+    // ENOBUFS: some errors were lost
+    if (len < 0 && errno != EAGAIN) {
+        WARN("recv netlink: %m");
+        tun_nl_resync(ctxt);
+    }
+}
+
 void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16])
 {
     struct wsbr_ctxt *ctxt = &g_ctxt;
+    struct tun_nl_entry *entry;
     struct rtnl_neigh *nl_neigh;
     struct nl_addr *src_ipv6_nl_addr;
-    struct nl_cache *cache;
-    struct nl_sock *sock;
-    int ifindex, err;
+    struct nl_msg *msg;
+    int err;
 
-    if (strlen(ctxt->config.neighbor_proxy) == 0)
+    if (!ctxt->nl_sock || !tun_nl_ifindex(ctxt))
         return;
-
-    ifindex = if_nametoindex(ctxt->config.tun_dev);
-    if (!ifindex) {
-        ERROR("if_nametoindex %s: %m", ctxt->config.tun_dev);
+    entry = tun_nl_entry_get(ctxt, address);
+    if (entry->proxy_neigh)
         return;
-    }
-
-    sock = nl_socket_alloc();
-    BUG_ON(!sock);
-    err = nl_connect(sock, NETLINK_ROUTE);
-    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
 
-    err = rtnl_neigh_alloc_cache(sock, &cache);
-    FATAL_ON(err < 0, 2, "rtnl_neigh_alloc_cache: %s", nl_geterror(err));
     src_ipv6_nl_addr = nl_addr_build(AF_INET6, address, 16);
     FATAL_ON(!src_ipv6_nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
-    nl_neigh = rtnl_neigh_get(cache, ifindex, src_ipv6_nl_addr);
-    nl_cache_put(cache);
-    if (nl_neigh)
-        goto cleanup;
     nl_neigh = rtnl_neigh_alloc();
     BUG_ON(!nl_neigh);
 
-    rtnl_neigh_set_ifindex(nl_neigh, ifindex);
+    rtnl_neigh_set_ifindex(nl_neigh, ctxt->tun_ifindex);
     rtnl_neigh_set_dst(nl_neigh, src_ipv6_nl_addr);
     rtnl_neigh_set_flags(nl_neigh, NTF_PROXY);
     rtnl_neigh_set_flags(nl_neigh, NTF_ROUTER);
-    err = rtnl_neigh_add(sock, nl_neigh, NLM_F_CREATE);
-    FATAL_ON(err < 0, 2, "rtnl_neigh_add: %s", nl_geterror(err));
+    err = rtnl_neigh_build_add_request(nl_neigh, NLM_F_CREATE, &msg);
+    FATAL_ON(err < 0, 2, "rtnl_neigh_build_add_request: %s", nl_geterror(err));
+    tun_nl_queue(ctxt, msg);
+    entry->proxy_neigh = true;
 
-cleanup:
     rtnl_neigh_put(nl_neigh);
     nl_addr_put(src_ipv6_nl_addr);
-    nl_socket_free(sock);
 }
 
 void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16])
 {
     struct wsbr_ctxt *ctxt = &g_ctxt;
     struct rtnl_nexthop* nl_nexthop;
+    struct tun_nl_entry *entry;
     struct rtnl_route *nl_route;
     struct nl_addr *ipv6_nl_addr;
-    struct nl_sock *sock;
-    int ifindex, err;
+    struct nl_msg *msg;
+    int err;
 
-    if (strlen(ctxt->config.neighbor_proxy) == 0)
+    if (!ctxt->nl_sock || !tun_nl_ifindex(ctxt))
         return;
-
-    ifindex = if_nametoindex(ctxt->config.tun_dev);
-    if (!ifindex) {
-        ERROR("if_nametoindex %s: %m", ctxt->config.tun_dev);
+    entry = tun_nl_entry_get(ctxt, address);
+    if (entry->direct_route)
         return;
-    }
-
-    sock = nl_socket_alloc();
-    BUG_ON(!sock);
-    err = nl_connect(sock, NETLINK_ROUTE);
-    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
 
     ipv6_nl_addr = nl_addr_build(AF_INET6, address, 16);
     FATAL_ON(!ipv6_nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
@@ -191,15 +323,34 @@ void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16
     rtnl_route_set_iif(nl_route, AF_INET6);
     err = rtnl_route_set_dst(nl_route, ipv6_nl_addr);
     FATAL_ON(err < 0, 2, "rtnl_route_set_dst: %s", nl_geterror(err));
-    rtnl_route_nh_set_ifindex(nl_nexthop, ifindex);
+    rtnl_route_nh_set_ifindex(nl_nexthop, ctxt->tun_ifindex);
     rtnl_route_add_nexthop(nl_route, nl_nexthop);
-    err = rtnl_route_add(sock, nl_route, 0);
-    if (err < 0 && err != -NLE_EXIST)
-        FATAL(2, "rtnl_route_add: %s", nl_geterror(err));
+    err = rtnl_route_build_add_request(nl_route, 0, &msg);
+    FATAL_ON(err < 0, 2, "rtnl_route_build_add_request: %s", nl_geterror(err));
+    tun_nl_queue(ctxt, msg);
+    entry->direct_route = true;
 
     rtnl_route_put(nl_route);
     nl_addr_put(ipv6_nl_addr);
-    nl_socket_free(sock);
+}
+
+// The kernel entries are kept: the node may come back, and an entry still
+// used for another reason (RPL target and ARO registration) must not be
+// removed. Only the mirror forgets them, so they are requested again (and
+// EEXIST ignored) if the node registers again.
+void tun_del_node(struct net_if *if_entry, const uint8_t address[16])
+{
+    struct wsbr_ctxt *ctxt = &g_ctxt;
+    struct tun_nl_entry *entry;
+    struct hash_entry *it;
+
+    hash_table_foreach(&ctxt->nl_entries, it, hash_table_key(address, 16)) {
+        entry = container_of(it, struct tun_nl_entry, hash_entry);
+        if (!memcmp(entry->addr, address, 16)) {
+            tun_nl_entry_free(ctxt, entry);
+            return;
+        }
+    }
 }
 
 static void tun_addr_add(struct nl_sock *sock, int ifindex, const uint8_t ipv6_prefix[8], const uint8_t hw_mac_addr[8], bool register_proxy_ndp)
@@ -246,7 +397,8 @@ static int wsbr_tun_open(char *devname, const uint8_t hw_mac[8], uint8_t ipv6_pr
 
     if (devname && *devname)
         strcpy(ifr.ifr_name, devname);
-    fd = open("/dev/net/tun", O_RDWR);
+    // Non-blocking, so wsbr_tun_read() can drain the packets until EAGAIN
+    fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
     if (fd < 0)
         FATAL(2, "tun open: %m");
     if (ioctl(fd, TUNSETIFF, &ifr))
@@ -368,8 +520,26 @@ int wsbr_tun_leave_mcast_group(int sock_mcast, const char *if_name, const uint8_
     return ret;
 }
 
+static void wsbr_tun_on_event(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_tun);
+
+    if (revents & EPOLLIN)
+        wsbr_tun_read(ctxt);
+}
+
 void wsbr_tun_init(struct wsbr_ctxt *ctxt)
 {
+    int err;
+
+    // The socket is kept open to program the proxy neighbors and the routes
+    // of the nodes
+    if (strlen(ctxt->config.neighbor_proxy)) {
+        ctxt->nl_sock = nl_socket_alloc();
+        BUG_ON(!ctxt->nl_sock);
+        err = nl_connect(ctxt->nl_sock, NETLINK_ROUTE);
+        FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    }
     ctxt->tun_fd = wsbr_tun_open(ctxt->config.tun_dev, ctxt->rcp.eui64,
                                  ctxt->config.ipv6_prefix, ctxt->config.tun_autoconf,
                                  strlen(ctxt->config.neighbor_proxy));
@@ -381,6 +551,12 @@ void wsbr_tun_init(struct wsbr_ctxt *ctxt)
         wsbr_sysctl_set("/proc/sys/net/ipv6/neigh", ctxt->config.neighbor_proxy, "proxy_delay", '0');
     }
     wsbr_tun_mcast_init(&ctxt->sock_mcast, ctxt->config.tun_dev);
+    wsbr_tun_nl_flush(ctxt);
+    // Enabled by the main loop according to wsbr_tun_rx_budget()
+    ctxt->loop_tun.fd       = ctxt->tun_fd;
+    ctxt->loop_tun.events   = 0;
+    ctxt->loop_tun.callback = wsbr_tun_on_event;
+    event_loop_add(&ctxt->loop, &ctxt->loop_tun);
 }
 
 static bool is_icmpv6_type_supported_by_wisun(uint8_t iv6t)
@@ -399,30 +575,58 @@ static bool is_icmpv6_type_supported_by_wisun(uint8_t iv6t)
         return false;
 }
 
-void wsbr_tun_read(struct wsbr_ctxt *ctxt)
+int wsbr_tun_rx_budget(struct wsbr_ctxt *ctxt)
+{
+    int queue_size = lowpan_adaptation_queue_size(ctxt->net_if.id);
+    int queue_max = ctxt->config.tun_rx_queue_max;
+
+    // Above queue_max, only the priority packets are kept
+    if (queue_size >= 2 * queue_max)
+        return 0;
+    if (queue_size >= queue_max)
+        return MIN(TUN_RX_BUDGET, 2 * queue_max - queue_size);
+    return MIN(TUN_RX_BUDGET, queue_max - queue_size);
+}
+
+// Control traffic: ICMPv6 (RPL, echo, errors) and the network control DSCPs
+// (CS6 and CS7, see RFC 4594)
+static bool wsbr_tun_is_priority(uint8_t traffic_class, uint8_t nxthdr)
+{
+    return nxthdr == SOL_ICMPV6 || traffic_class >> 2 >= 48;
+}
+
+// Return false if there is no packet left to read
+static bool wsbr_tun_recv(struct wsbr_ctxt *ctxt)
 {
     uint8_t buf[1504]; // Max ethernet frame size + TUN header
     struct iobuf_read iobuf = { .data = buf };
-    uint8_t ip_version, nxthdr;
+    uint8_t ip_version, traffic_class, nxthdr;
     buffer_t *buf_6lowpan;
+    uint32_t ip_hdr;
     uint8_t type;
 
     iobuf.data_size = xread(ctxt->tun_fd, buf, sizeof(buf));
     if (iobuf.data_size < 0) {
-        WARN("%s: read: %m", __func__);
-        return;
+        if (errno != EAGAIN)
+            WARN("%s: read: %m", __func__);
+        return false;
     }
     TRACE(TR_TUN, "rx-tun: %i bytes", iobuf.data_size);
 
-    ip_version = FIELD_GET(IPV6_VERSION_MASK, iobuf_pop_be32(&iobuf));
+    ip_hdr = iobuf_pop_be32(&iobuf);
+    ip_version    = FIELD_GET(IPV6_VERSION_MASK, ip_hdr);
+    traffic_class = FIELD_GET(IPV6_TRAFFIC_CLASS_MASK, ip_hdr);
     if (ip_version != 6) {
         TRACE(TR_DROP, "drop %-9s: unsupported IPv%u", "tun", ip_version);
-        return;
+        return true;
     }
 
     buf_6lowpan = buffer_get_minimal(iobuf.data_size);
-    if (!buf_6lowpan)
-        FATAL(1,"could not allocate tun buffer_t");
+    if (!buf_6lowpan) {
+        TRACE(TR_DROP, "drop %-9s: buffer limit reached", "tun");
+        ctxt->tun_rx_nobuf_cnt++;
+        return true;
+    }
     buf_6lowpan->interface = &ctxt->net_if;
     buffer_data_add(buf_6lowpan, iobuf.data, iobuf.data_size);
 
@@ -438,7 +642,7 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
         if(!addr_am_group_member_on_interface(&ctxt->net_if, buf_6lowpan->dst_sa.address)) {
             TRACE(TR_DROP, "drop %-9s: unsupported dst=%s", "tun", tr_ipv6(buf_6lowpan->dst_sa.address));
             buffer_free(buf_6lowpan);
-            return;
+            return true;
         }
         if (!memcmp(buf_6lowpan->dst_sa.address, ADDR_ALL_MPL_FORWARDERS, 16))
             buf_6lowpan->options.mpl_fwd_workaround = true;
@@ -452,10 +656,30 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
         if (!is_icmpv6_type_supported_by_wisun(type)) {
             TRACE(TR_DROP, "drop %-9s: unsupported ICMPv6 type %u", "tun", type);
             buffer_free(buf_6lowpan);
-            return;
+            return true;
         }
     }
 
+    if (lowpan_adaptation_queue_size(ctxt->net_if.id) >= ctxt->config.tun_rx_queue_max &&
+        !wsbr_tun_is_priority(traffic_class, nxthdr)) {
+        TRACE(TR_DROP, "drop %-9s: congestion", "tun");
+        ctxt->tun_rx_drop_cnt++;
+        buffer_free(buf_6lowpan);
+        return true;
+    }
+
     buf_6lowpan->info = (buffer_info_t)(B_DIR_DOWN | B_FROM_IPV6_FWD | B_TO_IPV6_FWD);
     protocol_push(buf_6lowpan);
+    return true;
+}
+
+void wsbr_tun_read(struct wsbr_ctxt *ctxt)
+{
+    int budget = wsbr_tun_rx_budget(ctxt);
+
+    // Packets left in the kernel are read on the next wakeup, once the
+    // adaptation layer has made some room
+    for (int i = 0; i < budget; i++)
+        if (!wsbr_tun_recv(ctxt))
+            break;
 }
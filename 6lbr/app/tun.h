@@ -19,7 +19,20 @@
 struct wsbr_ctxt;
 struct net_if;
 
+// Packets are read from the TUN interface as long as the adaptation layer
+// queue holds less than tun_rx_queue_max packets (see wsbrd.conf), so they
+// can be prioritized or dropped by the adaptation layer rather than held in
+// the kernel. Up to twice tun_rx_queue_max, the TUN interface is still read
+// but only the control packets are kept (see wsbr_tun_is_priority()), so they
+// do not wait behind the bulk traffic queued in the kernel. The others are
+// dropped. Beyond, the TUN interface is not read anymore. At most
+// TUN_RX_BUDGET packets are read per wakeup so other event sources are not
+// starved.
+#define TUN_RX_BUDGET    8
+
 void wsbr_tun_init(struct wsbr_ctxt *ctxt);
+// Number of packets wsbr_tun_read() is allowed to read
+int wsbr_tun_rx_budget(struct wsbr_ctxt *ctxt);
 void wsbr_tun_read(struct wsbr_ctxt *ctxt);
 int tun_addr_get_link_local(const char *if_name, uint8_t ip[16]);
 int tun_addr_get_global_unicast(const char *if_name, uint8_t ip[16]);
@@ -27,8 +40,14 @@ int wsbr_tun_join_mcast_group(int sock_mcast, const char *if_name, const uint8_t
 int wsbr_tun_leave_mcast_group(int sock_mcast, const char *if_name, const uint8_t mcast_group[16]);
 ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len);
 
+// Proxy neighbors and routes are programmed asynchronously: the requests are
+// queued and sent to the kernel in a single batch by wsbr_tun_nl_flush().
+void wsbr_tun_nl_flush(struct wsbr_ctxt *ctxt);
+
 void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16]);
 void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16]);
+// Forget the proxy neighbor and route of a node which left the network
+void tun_del_node(struct net_if *if_entry, const uint8_t address[16]);
 
 #endif
 
@@ -13,13 +13,18 @@
  */
 #define _GNU_SOURCE
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include "common/bus_uart.h"
 #include "common/bus_cpc.h"
 #include "common/capture.h"
 #include "common/dhcp_server.h"
+#include "common/event_loop.h"
 #include "common/events_scheduler.h"
 #include "common/bus.h"
 #include "common/ws_regdb.h"
@@ -49,6 +54,7 @@
 #include "net/ns_address_internal.h"
 #include "net/netaddr_types.h"
 #include "net/protocol.h"
+#include "net/ns_buffer.h"
 #include "rpl/rpl_glue.h"
 #include "rpl/rpl_storage.h"
 #include "rpl/rpl.h"
@@ -76,10 +82,11 @@ static void wsbr_handle_reset(struct rcp *rcp);
 static void wsbr_rpl_target_add(struct rpl_root *root, struct rpl_target *target);
 static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target);
 static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *target, bool updated_transit);
+static void wsbr_rpl_timer(struct rpl_root *root);
 
 // See warning in wsbr.h
 struct wsbr_ctxt g_ctxt = {
-    .scheduler.event_fd = { -1, -1 },
+    .scheduler.event_fd = -1,
 
     .rcp.on_reset = wsbr_handle_reset,
     .rcp.on_tx_cnf = wsbr_tx_cnf,
@@ -108,6 +115,7 @@ struct wsbr_ctxt g_ctxt = {
     .net_if.rpl_root.on_target_add    = wsbr_rpl_target_add,
     .net_if.rpl_root.on_target_del    = wsbr_rpl_target_del,
     .net_if.rpl_root.on_target_update = wsbr_rpl_target_update,
+    .net_if.rpl_root.on_timer         = wsbr_rpl_timer,
 
     .net_if.llc_random_early_detection.weight = RED_AVERAGE_WEIGHT_EIGHTH,
     .net_if.llc_random_early_detection.threshold_min = MAX_SIMULTANEOUS_SECURITY_NEGOTIATIONS_TX_QUEUE_MIN,
@@ -144,6 +152,7 @@ static void wsbr_rpl_target_add(struct rpl_root *root, struct rpl_target *target
                              0);                  // pref
     tun_add_node_to_proxy_neightbl(&ctxt->net_if, target->prefix);
     tun_add_ipv6_direct_route(&ctxt->net_if, target->prefix);
+    dbus_emit_routing_graph_change(ctxt, target->prefix);
 }
 
 static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target)
@@ -157,9 +166,9 @@ static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target
                                 ROUTE_RPL_DAO_SR,    // source
                                 (void *)root,        // info
                                 0);                  // source id
+    tun_del_node(&ctxt->net_if, target->prefix);
     rpl_storage_del_target(root, target);
-    dbus_emit_nodes_change(ctxt);
-    dbus_emit_routing_graph_change(ctxt);
+    dbus_emit_routing_graph_change(ctxt, target->prefix);
 }
 
 static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *target, bool updated_transit)
@@ -173,8 +182,7 @@ static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *tar
     if (!updated_transit)
         return;
 
-    dbus_emit_nodes_change(ctxt);
-    dbus_emit_routing_graph_change(ctxt);
+    dbus_emit_routing_graph_change(ctxt, target->prefix);
 
     /*
      * HACK: Delete the neighbor cache entry in case the node did not
@@ -191,6 +199,11 @@ static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *tar
     }
 }
 
+static void wsbr_rpl_timer(struct rpl_root *root)
+{
+    rpl_storage_flush(root, false);
+}
+
 static void ws_enable_mac_filtering(struct wsbr_ctxt *ctxt)
 {
     BUG_ON(ctxt->config.ws_allowed_mac_address_count && ctxt->config.ws_denied_mac_address_count);
@@ -417,6 +430,65 @@ static void wsbr_check_link_local_addr(struct wsbr_ctxt *ctxt)
         tr_ipv6(addr_ws0), tr_ipv6(addr_tun), ctxt->config.tun_dev);
 }
 
+static void wsbr_loop_register(struct wsbr_ctxt *ctxt, struct event_loop_src *src, int fd,
+                               void (*callback)(struct event_loop_src *src, uint32_t revents))
+{
+    src->fd       = fd;
+    src->events   = EPOLLIN;
+    src->callback = callback;
+    event_loop_add(&ctxt->loop, src);
+}
+
+static void wsbr_on_dhcp_server(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_dhcp_server);
+
+    if (revents & EPOLLIN)
+        dhcp_recv(&ctxt->dhcp_server);
+}
+
+static void wsbr_on_rpl(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_rpl);
+
+    if (revents & EPOLLIN)
+        rpl_recv(&ctxt->net_if.rpl_root);
+}
+
+static void wsbr_on_br_eapol_relay(struct event_loop_src *src, uint32_t revents)
+{
+    if (revents & EPOLLIN)
+        ws_eapol_relay_socket_cb(src->fd);
+}
+
+static void wsbr_on_eapol_relay(struct event_loop_src *src, uint32_t revents)
+{
+    if (revents & EPOLLIN)
+        ws_eapol_auth_relay_socket_cb(src->fd);
+}
+
+static void wsbr_on_pae_auth(struct event_loop_src *src, uint32_t revents)
+{
+    if (revents & EPOLLIN)
+        kmp_socket_if_pae_socket_cb(src->fd);
+}
+
+static void wsbr_on_radius(struct event_loop_src *src, uint32_t revents)
+{
+    if (revents & EPOLLIN)
+        kmp_socket_if_radius_socket_cb(src->fd);
+}
+
+// The sockets of the authenticator and of the EAPOL relays are opened by
+// ws_bootstrap_6lbr_init()
+static void wsbr_pae_register(struct wsbr_ctxt *ctxt)
+{
+    wsbr_loop_register(ctxt, &ctxt->loop_br_eapol_relay, ws_eapol_relay_get_socket_fd(),      wsbr_on_br_eapol_relay);
+    wsbr_loop_register(ctxt, &ctxt->loop_eapol_relay,    ws_eapol_auth_relay_get_socket_fd(), wsbr_on_eapol_relay);
+    wsbr_loop_register(ctxt, &ctxt->loop_pae_auth,       kmp_socket_if_get_pae_socket_fd(),   wsbr_on_pae_auth);
+    wsbr_loop_register(ctxt, &ctxt->loop_radius,         kmp_socket_if_get_radius_sockfd(),   wsbr_on_radius);
+}
+
 static void wsbr_network_init(struct wsbr_ctxt *ctxt)
 {
     uint8_t ipv6[16];
@@ -425,6 +497,9 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
     protocol_core_init();
     address_module_init();
     protocol_init(&ctxt->net_if, &ctxt->rcp, ctxt->config.lowpan_mtu);
+    lowpan_adaptation_interface_set_tx_queue(ctxt->net_if.id, ctxt->config.lowpan_tx_quantum,
+                                             ctxt->config.lowpan_tx_queue_max);
+    buffer_pools_set_max(ctxt->config.buffer_pool_max);
     ret = ws_bootstrap_init(ctxt->net_if.id);
     BUG_ON(ret);
 
@@ -434,8 +509,10 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
 
     ws_bootstrap_up(&ctxt->net_if, ipv6);
     wsbr_check_link_local_addr(ctxt);
-    if (ctxt->config.internal_dhcp)
+    if (ctxt->config.internal_dhcp) {
         dhcp_start(&ctxt->dhcp_server, ctxt->config.tun_dev, ctxt->rcp.eui64, ipv6);
+        wsbr_loop_register(ctxt, &ctxt->loop_dhcp_server, ctxt->dhcp_server.fd, wsbr_on_dhcp_server);
+    }
 
     memcpy(ctxt->net_if.rpl_root.dodag_id, ipv6, 16);
     rpl_storage_load(&ctxt->net_if.rpl_root);
@@ -450,6 +527,7 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
     }
     rpl_glue_init(&ctxt->net_if);
     rpl_start(&ctxt->net_if.rpl_root, ctxt->config.tun_dev);
+    wsbr_loop_register(ctxt, &ctxt->loop_rpl, ctxt->net_if.rpl_root.sockfd, wsbr_on_rpl);
     rpl_storage_store_config(&ctxt->net_if.rpl_root);
 }
 
@@ -470,15 +548,66 @@ static void wsbr_handle_reset(struct rcp *rcp)
         FATAL(3, "RCP API < 2.0.0 (too old)");
 }
 
+// Set by kill_handler() during the initialization, then by wsbr_on_signal().
+// The main loop exits at the end of the iteration.
+static volatile sig_atomic_t wsbr_exit_signal;
+
 void kill_handler(int signal)
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
+    // Only async-signal-safe functions can be called here, the cleanup is
+    // done by wsbr_exit(). The signal interrupts the synchronous waits of the
+    // initialization, which check wsbr_exit_signal.
+    wsbr_exit_signal = signal;
+}
 
+static void wsbr_exit(struct wsbr_ctxt *ctxt)
+{
     if (ctxt->config.uart_dev[0])
         uart_tx_flush(&ctxt->rcp.bus);
+    rpl_storage_flush(&ctxt->net_if.rpl_root, true);
+    storage_log_sync();
     exit(0);
 }
 
+static void wsbr_on_signal(struct event_loop_src *src, uint32_t revents)
+{
+    struct signalfd_siginfo info;
+
+    if (!(revents & EPOLLIN))
+        return;
+    if (read(src->fd, &info, sizeof(info)) == sizeof(info))
+        wsbr_exit_signal = info.ssi_signo;
+}
+
+// With a signal handler, a signal received between the test of
+// wsbr_exit_signal and epoll_wait() would only be noticed on the next wakeup.
+// Once the initialization is done, the signals are blocked and read from a
+// signalfd instead. A signal already delivered to kill_handler() is still
+// seen by the main loop.
+static void wsbr_signal_init(struct wsbr_ctxt *ctxt)
+{
+    sigset_t mask;
+    int ret, fd;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGTERM);
+    ret = sigprocmask(SIG_BLOCK, &mask, NULL);
+    FATAL_ON(ret < 0, 2, "sigprocmask: %m");
+    fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    FATAL_ON(fd < 0, 2, "signalfd: %m");
+    wsbr_loop_register(ctxt, &ctxt->loop_signal, fd, wsbr_on_signal);
+}
+
+// Used while waiting for the RCP synchronously
+static void wsbr_rcp_rx_sync(struct wsbr_ctxt *ctxt)
+{
+    rcp_rx(&ctxt->rcp);
+    if (wsbr_exit_signal)
+        wsbr_exit(ctxt);
+}
+
 void sig_error_handler(int signal)
 {
      __PRINT(91, "bug: %s", strsignal(signal));
@@ -491,7 +620,7 @@ static void wsbr_rcp_init(struct wsbr_ctxt *ctxt)
     rcp_set_host_api(&ctxt->rcp, version_daemon_api);
     rcp_req_radio_list(&ctxt->rcp);
     while (!ctxt->rcp.has_rf_list)
-        rcp_rx(&ctxt->rcp);
+        wsbr_rcp_rx_sync(ctxt);
 
     if (ctxt->config.list_rf_configs) {
         rail_print_config_list(ctxt);
@@ -504,6 +633,16 @@ static void wsbr_rcp_init(struct wsbr_ctxt *ctxt)
         rcp_set_filter_dst64(&ctxt->rcp, ctxt->config.ws_mac_address);
 }
 
+static void wsbr_on_rcp(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_rcp);
+
+    FATAL_ON(revents & EPOLLERR, 3, "RCP bus error");
+    FATAL_ON(revents & EPOLLHUP, 3, "RCP bus closed");
+    if (revents & EPOLLIN)
+        rcp_rx(&ctxt->rcp);
+}
+
 static void wsbr_rcp_reset(struct wsbr_ctxt *ctxt)
 {
     struct pollfd pfd = { };
@@ -514,6 +653,8 @@ static void wsbr_rcp_reset(struct wsbr_ctxt *ctxt)
         ctxt->rcp.version_api  = VERSION(2, 0, 0); // default assumed version
         ctxt->rcp.bus.tx    = uart_tx;
         ctxt->rcp.bus.rx    = uart_rx;
+        ctxt->rcp.bus.tx_start = uart_tx_start;
+        ctxt->rcp.bus.tx_end   = uart_tx_end;
         rcp_req_reset(&ctxt->rcp, false);
     } else if (ctxt->config.cpc_instance[0]) {
         ctxt->rcp.bus.tx = cpc_tx;
@@ -526,90 +667,47 @@ static void wsbr_rcp_reset(struct wsbr_ctxt *ctxt)
     } else {
         BUG();
     }
+    wsbr_loop_register(ctxt, &ctxt->loop_rcp, ctxt->rcp.bus.fd, wsbr_on_rcp);
 
     pfd.fd = ctxt->rcp.bus.fd;
     pfd.events = POLLIN;
     ret = poll(&pfd, 1, 5000);
-    FATAL_ON(ret < 0, 2, "%s poll: %m", __func__);
+    FATAL_ON(ret < 0 && errno != EINTR, 2, "%s poll: %m", __func__);
+    if (wsbr_exit_signal)
+        wsbr_exit(ctxt);
     WARN_ON(!ret, "RCP is not responding");
 
     ctxt->rcp.bus.uart.init_phase = true;
     while (!ctxt->rcp.has_reset)
-        rcp_rx(&ctxt->rcp);
+        wsbr_rcp_rx_sync(ctxt);
     ctxt->rcp.bus.uart.init_phase = false;
 }
 
-static void wsbr_fds_init(struct wsbr_ctxt *ctxt)
-{
-    ctxt->fds[POLLFD_DBUS].fd = dbus_get_fd(ctxt);
-    ctxt->fds[POLLFD_DBUS].events = POLLIN;
-    ctxt->fds[POLLFD_RCP].fd = ctxt->rcp.bus.fd;
-    ctxt->fds[POLLFD_RCP].events = POLLIN;
-    ctxt->fds[POLLFD_TUN].fd = ctxt->tun_fd;
-    ctxt->fds[POLLFD_TUN].events = 0;
-    ctxt->fds[POLLFD_EVENT].fd = ctxt->scheduler.event_fd[0];
-    ctxt->fds[POLLFD_EVENT].events = POLLIN;
-    ctxt->fds[POLLFD_TIMER].fd = ctxt->timerfd;
-    ctxt->fds[POLLFD_TIMER].events = POLLIN;
-    ctxt->fds[POLLFD_DHCP_SERVER].fd = ctxt->dhcp_server.fd;
-    ctxt->fds[POLLFD_DHCP_SERVER].events = POLLIN;
-    ctxt->fds[POLLFD_RPL].fd = ctxt->net_if.rpl_root.sockfd;
-    ctxt->fds[POLLFD_RPL].events = POLLIN;
-    ctxt->fds[POLLFD_BR_EAPOL_RELAY].fd = ws_eapol_relay_get_socket_fd();
-    ctxt->fds[POLLFD_BR_EAPOL_RELAY].events = POLLIN;
-    ctxt->fds[POLLFD_EAPOL_RELAY].fd = ws_eapol_auth_relay_get_socket_fd();
-    ctxt->fds[POLLFD_EAPOL_RELAY].events = POLLIN;
-    ctxt->fds[POLLFD_PAE_AUTH].fd = kmp_socket_if_get_pae_socket_fd();
-    ctxt->fds[POLLFD_PAE_AUTH].events = POLLIN;
-    ctxt->fds[POLLFD_RADIUS].fd = kmp_socket_if_get_radius_sockfd();
-    ctxt->fds[POLLFD_RADIUS].events = POLLIN;
-}
-
 static void wsbr_poll(struct wsbr_ctxt *ctxt)
 {
-    uint64_t val;
-    int ret;
-
-    if (lowpan_adaptation_queue_size(ctxt->net_if.id) > 2)
-        ctxt->fds[POLLFD_TUN].events = 0;
+    if (wsbr_tun_rx_budget(ctxt))
+        event_loop_set_events(&ctxt->loop, &ctxt->loop_tun, EPOLLIN);
     else
-        ctxt->fds[POLLFD_TUN].events = POLLIN;
+        event_loop_set_events(&ctxt->loop, &ctxt->loop_tun, 0);
 
+    // A complete frame may remain in the UART buffer without the file
+    // descriptor being readable.
     if (ctxt->rcp.bus.uart.data_ready)
-        ret = poll(ctxt->fds, POLLFD_COUNT, 0);
-    else
-        ret = poll(ctxt->fds, POLLFD_COUNT, -1);
-    FATAL_ON(ret < 0, 2, "poll: %m");
-
-    if (ctxt->fds[POLLFD_DBUS].revents & POLLIN)
-        dbus_process(ctxt);
-    if (ctxt->fds[POLLFD_DHCP_SERVER].revents & POLLIN)
-        dhcp_recv(&ctxt->dhcp_server);
-    if (ctxt->fds[POLLFD_RPL].revents & POLLIN)
-        rpl_recv(&ctxt->net_if.rpl_root);
-    if (ctxt->fds[POLLFD_BR_EAPOL_RELAY].revents & POLLIN)
-        ws_eapol_relay_socket_cb(ctxt->fds[POLLFD_BR_EAPOL_RELAY].fd);
-    if (ctxt->fds[POLLFD_EAPOL_RELAY].revents & POLLIN)
-        ws_eapol_auth_relay_socket_cb(ctxt->fds[POLLFD_EAPOL_RELAY].fd);
-    if (ctxt->fds[POLLFD_PAE_AUTH].revents & POLLIN)
-        kmp_socket_if_pae_socket_cb(ctxt->fds[POLLFD_PAE_AUTH].fd);
-    if (ctxt->fds[POLLFD_RADIUS].revents & POLLIN)
-        kmp_socket_if_radius_socket_cb(ctxt->fds[POLLFD_RADIUS].fd);
-    if (ctxt->fds[POLLFD_TUN].revents & POLLIN)
-        wsbr_tun_read(ctxt);
-    if (ctxt->fds[POLLFD_EVENT].revents & POLLIN) {
-        read(ctxt->scheduler.event_fd[0], &val, sizeof(val));
-        WARN_ON(val != 'W');
-        event_scheduler_run_until_idle();
-    }
-    if (ctxt->fds[POLLFD_RCP].revents & POLLIN ||
-        ctxt->fds[POLLFD_RCP].revents & POLLERR ||
-        ctxt->rcp.bus.uart.data_ready)
         rcp_rx(&ctxt->rcp);
-    if (ctxt->fds[POLLFD_TIMER].revents & POLLIN)
-        wsbr_common_timer_process(ctxt);
-    if (ctxt->fds[POLLFD_PCAP].revents & POLLERR)
-        wsbr_pcapng_closed(ctxt);
+
+    wsbr_common_timer_rearm(ctxt);
+    // Frames queued by the previous iteration
+    uart_tx_commit(&ctxt->rcp.bus);
+    // Netlink requests queued by the previous iteration
+    wsbr_tun_nl_flush(ctxt);
+    // Changes made by the previous iteration
+    dbus_process_changes(ctxt);
+    // Storage records written by the previous iteration
+    storage_log_sync();
+    if (ctxt->rcp.bus.uart.data_ready)
+        event_loop_dispatch(&ctxt->loop, 0);
+    else
+        event_loop_dispatch(&ctxt->loop, -1);
 }
 
 int wsbr_main(int argc, char *argv[])
@@ -643,8 +741,13 @@ int wsbr_main(int argc, char *argv[])
     if (ctxt->config.color_output != -1)
         g_enable_color_traces = ctxt->config.color_output;
     wsbr_check_mbedtls_features();
-    event_scheduler_init(&ctxt->scheduler);
+    event_loop_init(&ctxt->loop);
+    event_scheduler_init(&ctxt->scheduler, &ctxt->loop);
     g_storage_prefix = ctxt->config.storage_prefix;
+    if (ctxt->config.storage_log)
+        storage_log_open(files);
+    else if (storage_log_exists())
+        WARN("storage_log is disabled, the content of %sstorage.log is ignored", g_storage_prefix);
     if (ctxt->config.storage_delete) {
         INFO("deleting storage");
         storage_delete(files);
@@ -656,6 +759,9 @@ int wsbr_main(int argc, char *argv[])
     if (ctxt->config.capture[0])
         capture_start(ctxt->config.capture);
 
+    // The HIF statistics are kept across RCP resets
+    rcp_init(&ctxt->rcp);
+    ctxt->rcp.cmd_timing = ctxt->config.hif_timing;
     wsbr_rcp_reset(ctxt);
     wsbr_rcp_init(ctxt);
     wsbr_tun_init(ctxt);
@@ -670,12 +776,19 @@ int wsbr_main(int argc, char *argv[])
                               ctxt->net_if.ws_info.pan_information.pan_version,
                               ctxt->net_if.ws_info.pan_information.lfn_version, ctxt->net_if.ws_info.network_name);
     ws_bootstrap_6lbr_init(&ctxt->net_if);
-    wsbr_fds_init(ctxt);
+    wsbr_pae_register(ctxt);
+
+    // During initialization, wsbrd waits for RCP answers synchronously so
+    // batching is only enabled afterwards.
+    if (ctxt->config.uart_dev[0])
+        ctxt->rcp.bus.uart.tx_batch_size = ctxt->config.uart_tx_batch_size;
 
+    wsbr_signal_init(ctxt);
     INFO("Wi-SUN Border Router is ready");
 
-    while (true)
+    while (!wsbr_exit_signal)
         wsbr_poll(ctxt);
+    wsbr_exit(ctxt);
 
     return 0;
 }
@@ -17,7 +17,6 @@
 #include <sys/types.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <poll.h>
 #ifdef HAVE_LIBSYSTEMD
 #  include <systemd/sd-bus.h>
 #else
@@ -25,32 +24,32 @@ typedef struct sd_bus sd_bus;
 #endif
 
 #include "common/dhcp_server.h"
+#include "common/event_loop.h"
 #include "common/events_scheduler.h"
+#include "common/iobuf.h"
+#include "common/hash_table.h"
 #include "net/protocol.h"
 #include "rcp_api.h"
 
 #include "commandline.h"
 
 struct iobuf_read;
-
-enum {
-    POLLFD_TUN,
-    POLLFD_RCP,
-    POLLFD_DBUS,
-    POLLFD_EVENT,
-    POLLFD_TIMER,
-    POLLFD_DHCP_SERVER,
-    POLLFD_RPL,
-    POLLFD_BR_EAPOL_RELAY,
-    POLLFD_EAPOL_RELAY,
-    POLLFD_PAE_AUTH,
-    POLLFD_RADIUS,
-    POLLFD_PCAP,
-    POLLFD_COUNT,
-};
+struct nl_sock;
 
 struct wsbr_ctxt {
-    struct pollfd fds[POLLFD_COUNT];
+    struct event_loop loop;
+    struct event_loop_src loop_tun;
+    struct event_loop_src loop_rcp;
+    struct event_loop_src loop_dbus;
+    struct event_loop_src loop_timer;
+    struct event_loop_src loop_dhcp_server;
+    struct event_loop_src loop_rpl;
+    struct event_loop_src loop_br_eapol_relay;
+    struct event_loop_src loop_eapol_relay;
+    struct event_loop_src loop_pae_auth;
+    struct event_loop_src loop_radius;
+    struct event_loop_src loop_pcapng;
+    struct event_loop_src loop_signal;
     struct events_scheduler scheduler;
     struct wsbrd_conf config;
     struct dhcp_server dhcp_server;
@@ -58,10 +57,23 @@ struct wsbr_ctxt {
     sd_bus *dbus;
 
     int timerfd;
+    bool timer_tickless;
+    uint64_t timer_t0_ms;
+    uint64_t timer_next_tick;
 
     int  tun_fd;
+    uint64_t tun_rx_drop_cnt; // Packets dropped by the TUN congestion policy
+    uint64_t tun_rx_nobuf_cnt; // Packets dropped because of buffer_pool_max
     int  sock_mcast;
 
+    // Netlink requests to the kernel, see tun.c
+    struct nl_sock *nl_sock;
+    int tun_ifindex;
+    uint32_t nl_seq;
+    struct hash_table nl_entries;
+    time_t nl_entries_sweep_s;
+    struct iobuf_write nl_batch;
+
     struct rcp rcp;
 
     int spinel_tid;
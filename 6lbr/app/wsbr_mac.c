@@ -64,7 +64,7 @@ void wsbr_data_req_ext(struct net_if *cur,
         .hif.handle = data->msduHandle,
         .hif.status = HIF_STATUS_TIMEDOUT,
     };
-    struct iobuf_write frame = { };
+    struct iobuf_write *buf;
 
     BUG_ON(data->TxAckReq && data->fhss_type == HIF_FHSS_TYPE_ASYNC);
     BUG_ON(data->DstAddrMode != MAC_ADDR_MODE_NONE &&
@@ -82,13 +82,13 @@ void wsbr_data_req_ext(struct net_if *cur,
         return;
     }
 
-    wsbr_data_req_rebuild(&frame, cur->rcp, data, ie_ext, cur->ws_info.pan_information.pan_id);
-    rcp_req_data_tx(cur->rcp, frame.data, frame.len,
-                    data->msduHandle,  data->fhss_type, neighbor_ws ? &neighbor_ws->fhss_data_unsecured : NULL,
-                    neighbor_ws ? neighbor_ws->frame_counter_min : NULL,
-                    data->rate_list[0].phy_mode_id ? data->rate_list : NULL,
-                    data->ms_mode == WS_MODE_SWITCH_MAC ? HIF_MODE_SWITCH_TYPE_MAC : HIF_MODE_SWITCH_TYPE_PHY);
-    iobuf_free(&frame);
+    buf = rcp_req_data_tx_start(cur->rcp, data->msduHandle);
+    wsbr_data_req_rebuild(buf, cur->rcp, data, ie_ext, cur->ws_info.pan_information.pan_id);
+    rcp_req_data_tx_commit(cur->rcp, buf,
+                           data->fhss_type, neighbor_ws ? &neighbor_ws->fhss_data_unsecured : NULL,
+                           neighbor_ws ? neighbor_ws->frame_counter_min : NULL,
+                           data->rate_list[0].phy_mode_id ? data->rate_list : NULL,
+                           data->ms_mode == WS_MODE_SWITCH_MAC ? HIF_MODE_SWITCH_TYPE_MAC : HIF_MODE_SWITCH_TYPE_PHY);
 }
 
 void wsbr_tx_cnf(struct rcp *rcp, const struct hif_tx_cnf *cnf)
@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _DEFAULT_SOURCE
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -19,6 +20,7 @@
 
 #include "common/bits.h"
 #include "common/endian.h"
+#include "common/event_loop.h"
 #include "common/log.h"
 #include "common/memutils.h"
 #include "common/ieee802154_frame.h"
@@ -32,15 +34,28 @@
 #include "frame_helpers.h"
 #include "wsbr.h"
 
-void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt)
+static void wsbr_pcapng_closed(struct event_loop_src *src, uint32_t revents)
 {
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, loop_pcapng);
     int ret;
 
+    if (!(revents & EPOLLERR))
+        return;
     WARN("stopped pcapng capture");
+    event_loop_del(&ctxt->loop, &ctxt->loop_pcapng);
     ret = close(ctxt->pcapng_fd);
     FATAL_ON(ret < 0, 2, "close pcapng: %m");
     ctxt->pcapng_fd = -1;
-    ctxt->fds[POLLFD_PCAP].fd = -1;
+}
+
+// The file descriptor is only monitored to detect when the reader of the FIFO
+// goes away.
+static void wsbr_pcapng_register(struct wsbr_ctxt *ctxt)
+{
+    ctxt->loop_pcapng.fd       = ctxt->pcapng_fd;
+    ctxt->loop_pcapng.events   = 0;
+    ctxt->loop_pcapng.callback = wsbr_pcapng_closed;
+    event_loop_add(&ctxt->loop, &ctxt->loop_pcapng);
 }
 
 static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt);
@@ -55,7 +70,7 @@ static void wsbr_pcapng_write(struct wsbr_ctxt *ctxt, const struct iobuf_write *
         if (ctxt->pcapng_fd < 0)
             return;
         WARN("restarted pcapng capture");
-        ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
+        wsbr_pcapng_register(ctxt);
         wsbr_pcapng_write_start(ctxt);
     }
 
@@ -105,15 +120,17 @@ void wsbr_pcapng_init(struct wsbr_ctxt *ctxt)
         FATAL_ON(ctxt->pcapng_fd < 0, 2, "open %s: %m", ctxt->config.pcap_file);
     }
 
-    ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
+    wsbr_pcapng_register(ctxt);
     wsbr_pcapng_write_start(ctxt);
 }
 
 void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
                              const void *frame, size_t frame_len)
 {
-    struct iobuf_write iobuf_pcapng = { };
-    struct iobuf_write iobuf_frame = { };
+    struct iobuf_write iobuf_pcapng;
+    struct iobuf_write iobuf_frame;
+    uint8_t pcapng_buf[2176];
+    uint8_t frame_buf[2048];
     struct iobuf_read ie_payload;
     struct iobuf_read ie_header;
     struct ieee802154_hdr hdr;
@@ -125,6 +142,10 @@ void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
         return;
     hdr.key_index = 0; // Strip the Auxiliary Security Header
 
+    // Sized for the largest 802.15.4 frames, so captures do not allocate
+    iobuf_init_storage(&iobuf_frame, frame_buf, sizeof(frame_buf));
+    iobuf_init_storage(&iobuf_pcapng, pcapng_buf, sizeof(pcapng_buf));
+
     ieee802154_frame_write_hdr(&iobuf_frame, &hdr);
     iobuf_push_data(&iobuf_frame, ie_header.data, ie_header.data_size);
     if (ie_payload.data_size) {
@@ -22,7 +22,6 @@ struct mcps_data_ind;
 struct mcps_data_rx_ie_list;
 
 void wsbr_pcapng_init(struct wsbr_ctxt *ctxt);
-void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt);
 void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
                              const void *frame, size_t frame_len);
 
@@ -31,6 +31,7 @@
 #include "common/specs/ip.h"
 
 #include "net/protocol.h"
+#include "net/timers.h"
 #include "mpl/mpl.h"
 #include "ipv6/ipv6_routing_table.h"
 #include "ipv6/ipv6_routing_table.h"
@@ -166,6 +167,8 @@ buffer_t *icmpv6_error(buffer_t *buf, struct net_if *cur, uint8_t type, uint8_t
         return buffer_free(buf);
     }
     cur->icmp_tokens--;
+    if (!ws_timer_is_running(WS_TIMER_ICMP_FAST))
+        ws_timer_start(WS_TIMER_ICMP_FAST);
 
     /* Include as much of the original packet as possible, without exceeding
      * minimum MTU of 1280. */
@@ -20,6 +20,7 @@
 #include <glob.h>
 
 #include "common/key_value_storage.h"
+#include "common/hash_table.h"
 #include "common/time_extra.h"
 #include "common/memutils.h"
 #include "common/parsers.h"
@@ -45,7 +46,9 @@ void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *
     char ipv6_str[INET6_ADDRSTRLEN];
     char time_str[STR_MAX_LEN_DATE];
     struct storage_parse_info *nvm;
+    struct ipv6_neighbour *cur;
     char filename[PATH_MAX];
+    struct hash_entry *it;
     time_t ts;
     int i = 0;
 
@@ -58,7 +61,9 @@ void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *
         return;
     }
 
-    ns_list_foreach(struct ipv6_neighbour, cur, &cache->list) {
+    // Entries sharing an EUI-64 are walked in the order of the cache list
+    hash_table_foreach(&cache->eui64_index, it, hash_table_key(eui64, 8)) {
+        cur = container_of(it, struct ipv6_neighbour, eui64_hash_entry);
         if (memcmp(eui64, ipv6_neighbour_eui64(cache, cur), 8))
             continue;
         if (!cur->lifetime_s || !cur->expiration_s)
@@ -163,7 +168,7 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
         memcpy(ll_addr.address + PAN_ID_LEN, eui64, 8);
         // the neighbor state is set to stale
         ipv6_neighbour_entry_update_unsolicited(cache, ipv6_neigh, ll_addr.addr_type, ll_addr.address);
-        ipv6_neigh->type = IP_NEIGHBOUR_REGISTERED;
+        ipv6_neighbour_set_type(cache, ipv6_neigh, IP_NEIGHBOUR_REGISTERED);
     }
 
     storage_close(nvm);
@@ -172,17 +177,16 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
 
 void ipv6_neigh_storage_load(struct ipv6_neighbour_cache *cache)
 {
-    char pattern[PATH_MAX];
     glob_t globbuf;
     int ret;
 
-    sprintf(pattern, "%s%s", g_storage_prefix, "neighbor-*");
-    ret = glob(pattern, 0, NULL, &globbuf);
+    ret = storage_glob("neighbor-*", &globbuf);
     if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, pattern, ret);
+        WARN("%s: glob %s returned %u", __func__, "neighbor-*", ret);
     if (ret)
         return;
 
     for (int i = 0; globbuf.gl_pathv[i]; i++)
         ipv6_neigh_storage_load_neigh(cache, globbuf.gl_pathv[i]);
+    storage_globfree(&globbuf);
 }
@@ -40,6 +40,8 @@
 #include <netinet/in.h>
 #include "common/rand.h"
 #include "common/bits.h"
+#include "common/hash_table.h"
+#include "common/lpm_trie.h"
 #include "common/memutils.h"
 #include "common/log_legacy.h"
 #include "common/string_extra.h"
@@ -48,11 +50,14 @@
 #include "ipv6/icmpv6.h"
 #include "ipv6/ipv6_resolution.h"
 #include "net/protocol.h"
+#include "net/timers.h"
 #include "common/time_extra.h"
 
 #include "ipv6/ipv6_neigh_storage.h"
 #include "ipv6/ipv6_routing_table.h"
 #include "net/protocol_abstract.h"
+#include "app/dbus.h" // FIXME
+#include "app/wsbr.h" // FIXME
 
 #define TRACE_GROUP "rout"
 
@@ -78,6 +83,8 @@
 
 static NS_LIST_DEFINE(ipv6_destination_cache, ipv6_destination_t, link);
 static NS_LIST_DEFINE(ipv6_routing_table, ipv6_route_t, link);
+// Same routes as ipv6_routing_table, indexed by prefix
+static struct lpm_trie ipv6_routing_trie;
 
 static void ipv6_destination_cache_forget_neighbour(const ipv6_neighbour_t *neighbour);
 static bool ipv6_destination_release(ipv6_destination_t *dest);
@@ -101,6 +108,14 @@ static uint32_t next_probe_time(ipv6_neighbour_cache_t *cache, uint_fast8_t retr
     return rand_randomise_base(t, 0x4000, 0xBFFF);
 }
 
+// The fast timer stops itself when no entry has a running timer
+static void ipv6_neighbour_timer_start(ipv6_neighbour_t *entry, uint32_t ms)
+{
+    entry->timer = ms;
+    if (ms && !ws_timer_is_running(WS_TIMER_6LOWPAN_NEIGHBOR_FAST))
+        ws_timer_start(WS_TIMER_6LOWPAN_NEIGHBOR_FAST);
+}
+
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id)
 {
     /* Init Double linked Routing Table */
@@ -130,11 +145,36 @@ void ipv6_neighbour_cache_flush(ipv6_neighbour_cache_t *cache)
 }
 
 
+// Entries sharing a key are walked from the most recently inserted, or moved
+// to the front by ipv6_neighbour_used()
+static void ipv6_neighbour_hash_insert(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    hash_table_insert(&cache->addr_index, &entry->addr_hash_entry, hash_table_key(entry->ip_address, 16));
+    // The EUI-64 is only stored if recv_addr_reg is set
+    entry->eui64_indexed = cache->recv_addr_reg;
+    if (entry->eui64_indexed)
+        hash_table_insert(&cache->eui64_index, &entry->eui64_hash_entry,
+                          hash_table_key(ipv6_neighbour_eui64(cache, entry), 8));
+}
+
+static void ipv6_neighbour_hash_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    hash_table_remove(&cache->addr_index, &entry->addr_hash_entry);
+    if (entry->eui64_indexed)
+        hash_table_remove(&cache->eui64_index, &entry->eui64_hash_entry);
+    entry->eui64_indexed = false;
+}
+
 ipv6_neighbour_t *ipv6_neighbour_lookup(ipv6_neighbour_cache_t *cache, const uint8_t *address)
 {
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    struct hash_entry *it;
+    ipv6_neighbour_t *cur;
+
+    hash_table_foreach(&cache->addr_index, it, hash_table_key(address, 16)) {
+        cur = container_of(it, ipv6_neighbour_t, addr_hash_entry);
         if (addr_ipv6_equal(cur->ip_address, address))
             return cur;
+    }
 
     return NULL;
 }
@@ -148,6 +188,11 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
      * the entry.
      */
     ns_list_remove(&cache->list, entry);
+    if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
+        ns_list_remove(&cache->gc_list, entry);
+        cache->gc_count--;
+    }
+    ipv6_neighbour_hash_remove(cache, entry);
     switch (entry->state) {
         case IP_NEIGHBOUR_NEW:
         case IP_NEIGHBOUR_INCOMPLETE:
@@ -160,8 +205,10 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
             break;
     }
     ipv6_destination_cache_forget_neighbour(entry);
-    if (!IN6_IS_ADDR_MULTICAST(entry->ip_address))
+    if (!IN6_IS_ADDR_MULTICAST(entry->ip_address)) {
         ipv6_route_delete(entry->ip_address, 128, net_if->id, entry->ip_address, ROUTE_ARO);
+        dbus_emit_routing_graph_change(&g_ctxt, entry->ip_address);
+    }
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor del %s / %s",
         tr_eui64(ipv6_neighbour_eui64(cache, entry)), tr_ipv6(entry->ip_address));
     ipv6_neigh_storage_save(cache, ipv6_neighbour_eui64(cache, entry));
@@ -170,35 +217,31 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
 
 ipv6_neighbour_t *ipv6_neighbour_lookup_mc(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64)
 {
+    struct hash_entry *it;
+    ipv6_neighbour_t *cur;
+
     if (!IN6_IS_ADDR_MULTICAST(address))
         return NULL;
 
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    hash_table_foreach(&cache->addr_index, it, hash_table_key(address, 16)) {
+        cur = container_of(it, ipv6_neighbour_t, addr_hash_entry);
         if (addr_ipv6_equal(cur->ip_address, address)) {
             if (memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8))
                 continue;
             return cur;
         }
+    }
 
     return NULL;
 }
 
 ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64)
 {
-    uint_fast16_t count = 0;
     ipv6_neighbour_t *entry = NULL;
-    ipv6_neighbour_t *garbage_possible_entry = NULL;
-
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list) {
-        if (cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
-            garbage_possible_entry = cur;
-            count++;
-        }
-    }
 
-    if (count >= NCACHE_MAX_ABSOLUTE && garbage_possible_entry) {
+    if (cache->gc_count >= NCACHE_MAX_ABSOLUTE) {
         //Remove Last storaged IP_NEIGHBOUR_GARBAGE_COLLECTIBLE type entry
-        ipv6_neighbour_entry_remove(cache, garbage_possible_entry);
+        ipv6_neighbour_entry_remove(cache, ns_list_get_last(&cache->gc_list));
     }
 
     // Allocate new - note we have a basic size, plus enough for the LL address,
@@ -210,12 +253,28 @@ ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uin
     if (cache->recv_addr_reg)
         memcpy(ipv6_neighbour_eui64(cache, entry), eui64, 8);
     ns_list_add_to_start(&cache->list, entry);
+    // New entries are garbage-collectible until registered
+    ns_list_add_to_start(&cache->gc_list, entry);
+    cache->gc_count++;
+    ipv6_neighbour_hash_insert(cache, entry);
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor add %s / %s",
           tr_eui64(ipv6_neighbour_eui64(cache, entry)), tr_ipv6(entry->ip_address));
 
     return entry;
 }
 
+// Entries never become garbage-collectible again once registered, so they
+// only have to leave gc_list.
+void ipv6_neighbour_set_type(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, ip_neighbour_cache_type_e type)
+{
+    BUG_ON(type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE && entry->type != type);
+    if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE && type != entry->type) {
+        ns_list_remove(&cache->gc_list, entry);
+        cache->gc_count--;
+    }
+    entry->type = type;
+}
+
 ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
 {
     /* Reset the GC life, if it's a GC entry */
@@ -228,6 +287,13 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
     if (entry != ns_list_get_first(&cache->list)) {
         ns_list_remove(&cache->list, entry);
         ns_list_add_to_start(&cache->list, entry);
+        if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
+            ns_list_remove(&cache->gc_list, entry);
+            ns_list_add_to_start(&cache->gc_list, entry);
+        }
+        hash_table_move_to_head(&cache->addr_index, &entry->addr_hash_entry);
+        if (entry->eui64_indexed)
+            hash_table_move_to_head(&cache->eui64_index, &entry->eui64_hash_entry);
     }
 
     /* If the entry is stale, prepare delay timer for active NUD probe */
@@ -237,7 +303,7 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
 
     /* Special case for Registered Unreachable entries - restart the probe timer if stopped */
     else if (entry->state == IP_NEIGHBOUR_UNREACHABLE && entry->timer == 0) {
-        entry->timer = next_probe_time(cache, entry->retrans_count);
+        ipv6_neighbour_timer_start(entry, next_probe_time(cache, entry->retrans_count));
     }
 
     return entry;
@@ -257,22 +323,32 @@ static bool ipv6_neighbour_update_ll(ipv6_neighbour_t *entry, addrtype_e ll_type
 
 bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    struct hash_entry *it;
+    ipv6_neighbour_t *cur;
+
+    hash_table_foreach(&cache->eui64_index, it, hash_table_key(eui64, 8)) {
+        cur = container_of(it, ipv6_neighbour_t, eui64_hash_entry);
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address))
             return true;
+    }
     return false;
 }
 
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    struct hash_entry *it;
+    ipv6_neighbour_t *cur;
+
+    hash_table_foreach(&cache->eui64_index, it, hash_table_key(eui64, 8)) {
+        cur = container_of(it, ipv6_neighbour_t, eui64_hash_entry);
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address) &&
             !IN6_IS_ADDR_LINKLOCAL(cur->ip_address))
             return cur;
+    }
     return NULL;
 }
 
@@ -281,20 +357,20 @@ void ipv6_neighbour_set_state(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *e
     switch (state) {
         case IP_NEIGHBOUR_INCOMPLETE:
             entry->retrans_count = 0;
-            entry->timer = cache->retrans_timer;
+            ipv6_neighbour_timer_start(entry, cache->retrans_timer);
             break;
         case IP_NEIGHBOUR_STALE:
             entry->timer = 0;
             break;
         case IP_NEIGHBOUR_DELAY:
-            entry->timer = DELAY_FIRST_PROBE_TIME;
+            ipv6_neighbour_timer_start(entry, DELAY_FIRST_PROBE_TIME);
             break;
         case IP_NEIGHBOUR_PROBE:
             entry->retrans_count = 0;
-            entry->timer = next_probe_time(cache, 0);
+            ipv6_neighbour_timer_start(entry, next_probe_time(cache, 0));
             break;
         case IP_NEIGHBOUR_REACHABLE:
-            entry->timer = cache->reachable_time;
+            ipv6_neighbour_timer_start(entry, cache->reachable_time);
             break;
         case IP_NEIGHBOUR_UNREACHABLE:
             /* Progress to this from PROBE - timers continue */
@@ -386,6 +462,7 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
 {
     ipv6_neighbour_cache_t *cache = &protocol_stack_interface_info_get()->ipv6_neighbour_cache;
     uint32_t ms = (uint32_t) ticks * 100;
+    bool running = false;
 
     ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
         if (cur->timer == 0) {
@@ -394,6 +471,7 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
 
         if (cur->timer > ms) {
             cur->timer -= ms;
+            running = true;
             continue;
         }
 
@@ -409,6 +487,7 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
                     /* Should be safe for registration - Tentative/Registered entries can't be INCOMPLETE */
                     ipv6_destination_cache_forget_neighbour(cur);
                     ipv6_neighbour_entry_remove(cache, cur);
+                    continue;
                 } else {
                     ipv6_interface_resolve_send_ns(cache, cur, false, cur->retrans_count);
                     cur->timer = cache->retrans_timer;
@@ -435,6 +514,7 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
 
                 if (cur->retrans_count >= MAX_UNICAST_SOLICIT && cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
                     ipv6_neighbour_entry_remove(cache, cur);
+                    continue;
                 } else {
                     ipv6_interface_resolve_send_ns(cache, cur, true, cur->retrans_count);
                     if (cur->retrans_count >= MAX_UNICAST_SOLICIT - 1) {
@@ -453,7 +533,11 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
                 }
                 break;
         }
+        if (cur->timer)
+            running = true;
     }
+    if (!running)
+        ws_timer_stop(WS_TIMER_6LOWPAN_NEIGHBOR_FAST);
 }
 
 void ipv6_destination_cache_print()
@@ -690,6 +774,7 @@ static void ipv6_route_entry_remove(ipv6_route_t *route)
         free(route->info.info);
     }
     ns_list_remove(&ipv6_routing_table, route);
+    lpm_trie_remove(&ipv6_routing_trie, &route->trie_entry);
     free(route);
 }
 
@@ -721,36 +806,49 @@ static bool ipv6_route_is_better(const ipv6_route_t *a, const ipv6_route_t *b)
 /* Find the "best" route regardless of reachability, but respecting the skip flag and predicates */
 static ipv6_route_t *ipv6_route_find_best(const uint8_t *addr, int8_t interface_id)
 {
-    ipv6_route_t *best = NULL;
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        /* We mustn't be skipping this route */
-        if (route->search_skip) {
-            continue;
-        }
+    struct lpm_trie_entry *entry;
+    struct lpm_trie_node *node;
+    ipv6_route_t *route, *best;
+
+    /* Longer prefixes are always better, so the first prefix length with an
+     * usable route is the answer. */
+    for (node = lpm_trie_lookup(&ipv6_routing_trie, addr); node; node = lpm_trie_lookup_next(node)) {
+        best = NULL;
+        LIST_FOREACH(entry, &node->entries, link) {
+            route = container_of(entry, ipv6_route_t, trie_entry);
+
+            /* We mustn't be skipping this route */
+            if (route->search_skip) {
+                continue;
+            }
 
-        /* Interface must match, if caller specified */
-        if (interface_id != -1 && interface_id != route->info.interface_id) {
-            continue;
-        }
+            /* Interface must match, if caller specified */
+            if (interface_id != -1 && interface_id != route->info.interface_id) {
+                continue;
+            }
 
-        /* Prefix must match */
-        if (bitcmp(addr, route->prefix, route->prefix_len)) {
-            continue;
+            if (!best || ipv6_route_is_better(route, best)) {
+                best = route;
+            }
         }
-
-        if (!best || ipv6_route_is_better(route, best)) {
-            best = route;
+        if (best) {
+            return best;
         }
     }
-    return best;
+    return NULL;
 }
 
 ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_id)
 {
+    struct lpm_trie_entry *entry;
+    struct lpm_trie_node *node;
     ipv6_route_t *best = NULL;
 
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        route->search_skip = false;
+    /* Only the routes matching dest can be considered */
+    for (node = lpm_trie_lookup(&ipv6_routing_trie, dest); node; node = lpm_trie_lookup_next(node)) {
+        LIST_FOREACH(entry, &node->entries, link) {
+            container_of(entry, ipv6_route_t, trie_entry)->search_skip = false;
+        }
     }
 
     /* Search algorithm from RFC 4191, S3.2:
@@ -812,8 +910,17 @@ ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_i
 
 ipv6_route_t *ipv6_route_lookup_with_info(const uint8_t *prefix, uint8_t prefix_len, int8_t interface_id, const uint8_t *next_hop, ipv6_route_src_t source, void *info, int_fast16_t src_id)
 {
-    ns_list_foreach(ipv6_route_t, r, &ipv6_routing_table) {
-        if (interface_id == r->info.interface_id && prefix_len == r->prefix_len && !bitcmp(prefix, r->prefix, prefix_len)) {
+    struct lpm_trie_node *node = lpm_trie_find(&ipv6_routing_trie, prefix, prefix_len);
+    struct lpm_trie_entry *entry;
+    ipv6_route_t *r;
+
+    if (!node) {
+        return NULL;
+    }
+
+    LIST_FOREACH(entry, &node->entries, link) {
+        r = container_of(entry, ipv6_route_t, trie_entry);
+        if (interface_id == r->info.interface_id) {
             if (source != ROUTE_ANY) {
                 if (source != r->info.source) {
                     continue;
@@ -940,6 +1047,8 @@ ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, i
         /* Doesn't matter much where they start off, but put them at the */
         /* beginning so new routes tend to get tried first. */
         ns_list_add_to_start(&ipv6_routing_table, route);
+        route->trie_entry.node = NULL;
+        lpm_trie_insert(&ipv6_routing_trie, &route->trie_entry, route->prefix, prefix_len);
         changed_info = NEW;
     } else { /* updating a route - only lifetime and metric can be changing */
         route->lifetime = lifetime;
@@ -26,6 +26,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include "common/hash_table.h"
+#include "common/lpm_trie.h"
 #include "common/ns_list.h"
 
 #include "net/netaddr_types.h"
@@ -100,6 +102,10 @@ typedef struct ipv6_neighbour {
     uint32_t                        lifetime_s;
     time_t                          expiration_s;
     ns_list_link_t                  link;                       /*!< List link */
+    ns_list_link_t                  gc_link;
+    struct hash_entry               addr_hash_entry;
+    struct hash_entry               eui64_hash_entry;
+    bool                            eui64_indexed;
     uint8_t                         ll_address[];
 } ipv6_neighbour_t;
 
@@ -129,6 +135,17 @@ typedef struct ipv6_neighbour_cache {
     ipv6_route_interface_info_t             route_if_info;
     //uint8_t                                   num_entries;
     NS_LIST_HEAD(ipv6_neighbour_t, link)    list;
+    // Garbage-collectible entries, in the order of list, so the least
+    // recently used one can be evicted without walking the cache
+    NS_LIST_HEAD(ipv6_neighbour_t, gc_link) gc_list;
+    int                                     gc_count;
+    // Entries are also indexed by IPv6 address, and by EUI-64 if recv_addr_reg
+    // is set. Several entries may share a key (multicast addresses, or several
+    // addresses registered by the same node). Entries sharing a key are kept
+    // in the order of list (most recently used first), so lookups return the
+    // same entry as a list walk.
+    struct hash_table                       addr_index;
+    struct hash_table                       eui64_index;
 } ipv6_neighbour_cache_t;
 
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id);
@@ -139,6 +156,7 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
 ipv6_neighbour_t *ipv6_neighbour_lookup(ipv6_neighbour_cache_t *cache, const uint8_t *address);
 ipv6_neighbour_t *ipv6_neighbour_lookup_mc(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64);
 ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64);
+void ipv6_neighbour_set_type(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, ip_neighbour_cache_type_e type);
 void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry);
 bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
@@ -183,6 +201,7 @@ typedef struct ipv6_route {
     ipv6_route_info_t   info;
     uint32_t            lifetime;           // (seconds); 0xFFFFFFFF means permanent
     ns_list_link_t      link;
+    struct lpm_trie_entry trie_entry;
     uint8_t             prefix[];           // variable length
 } ipv6_route_t;
 
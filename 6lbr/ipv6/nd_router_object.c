@@ -22,12 +22,16 @@
 #include "common/string_extra.h"
 #include "common/time_extra.h"
 #include "common/iobuf.h"
+#include "common/hash_table.h"
+#include "common/memutils.h"
 #include "common/log.h"
 #include "common/bits.h"
 #include "common/specs/icmpv6.h"
 #include "common/specs/ipv6.h"
 
+#include "app/dbus.h" // FIXME
 #include "app/tun.h" // FIXME
+#include "app/wsbr.h" // FIXME
 #include "net/protocol.h"
 #include "ipv6/icmpv6.h"
 #include "6lowpan/bootstraps/protocol_6lowpan.h"
@@ -55,7 +59,10 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
 
     /* We are about to send an ARO response - update our Neighbour Cache accordingly */
     if (aro->status == ARO_SUCCESS && aro->lifetime != 0) {
-        neigh->type = IP_NEIGHBOUR_REGISTERED;
+        // Rank 1 LFNs are part of the routing graph
+        if (neigh->type != IP_NEIGHBOUR_REGISTERED)
+            dbus_emit_routing_graph_change(&g_ctxt, neigh->ip_address);
+        ipv6_neighbour_set_type(&cur_interface->ipv6_neighbour_cache, neigh, IP_NEIGHBOUR_REGISTERED);
         neigh->lifetime_s = aro->lifetime * UINT32_C(60);
         neigh->expiration_s = time_current(CLOCK_MONOTONIC) + neigh->lifetime_s;
         ipv6_neighbour_set_state(&cur_interface->ipv6_neighbour_cache, neigh, IP_NEIGHBOUR_STALE);
@@ -65,8 +72,10 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
     } else {
         // ipv6_neighbor entry will be released by garbage collector
         neigh->lifetime_s = 0;
+        dbus_emit_routing_graph_change(&g_ctxt, neigh->ip_address);
         ipv6_neighbour_set_state(&cur_interface->ipv6_neighbour_cache, neigh, IP_NEIGHBOUR_STALE);
         if (!IN6_IS_ADDR_MULTICAST(neigh->ip_address)) {
+            tun_del_node(cur_interface, neigh->ip_address);
             target = rpl_target_get(&cur_interface->rpl_root, neigh->ip_address);
             if (target)
                 rpl_target_del(&cur_interface->rpl_root, target);
@@ -77,20 +86,30 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
 
 void nd_remove_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, neigh, &net_if->ipv6_neighbour_cache.list)
+    struct hash_entry *it;
+    ipv6_neighbour_t *neigh;
+
+    hash_table_foreach(&net_if->ipv6_neighbour_cache.eui64_index, it, hash_table_key(eui64, 8)) {
+        neigh = container_of(it, ipv6_neighbour_t, eui64_hash_entry);
         if ((neigh->type == IP_NEIGHBOUR_REGISTERED || neigh->type == IP_NEIGHBOUR_TENTATIVE) &&
             !memcmp(ipv6_neighbour_eui64(&net_if->ipv6_neighbour_cache, neigh), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(neigh->ip_address))
             ipv6_route_delete(neigh->ip_address, 128, net_if->id, neigh->ip_address, ROUTE_ARO);
+    }
 }
 
 void nd_restore_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, neigh, &net_if->ipv6_neighbour_cache.list)
+    struct hash_entry *it;
+    ipv6_neighbour_t *neigh;
+
+    hash_table_foreach(&net_if->ipv6_neighbour_cache.eui64_index, it, hash_table_key(eui64, 8)) {
+        neigh = container_of(it, ipv6_neighbour_t, eui64_hash_entry);
         if ((neigh->type == IP_NEIGHBOUR_REGISTERED || neigh->type == IP_NEIGHBOUR_TENTATIVE) &&
             !memcmp(ipv6_neighbour_eui64(&net_if->ipv6_neighbour_cache, neigh), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(neigh->ip_address))
             nd_add_ipv6_neigh_route(net_if, neigh);
+    }
 }
 
 /* Process ICMP Neighbor Solicitation (RFC 4861 + RFC 6775 + RFC 8505 + draft-ietf-6lo-multicast-registration-15) EARO. */
@@ -249,7 +268,7 @@ bool nd_ns_earo_handler(struct net_if *cur_interface, const uint8_t *earo_ptr, s
     }
 
     if (neigh->type != IP_NEIGHBOUR_REGISTERED) {
-        neigh->type = IP_NEIGHBOUR_TENTATIVE;
+        ipv6_neighbour_set_type(&cur_interface->ipv6_neighbour_cache, neigh, IP_NEIGHBOUR_TENTATIVE);
         neigh->lifetime_s = TENTATIVE_NCE_LIFETIME;
     }
 
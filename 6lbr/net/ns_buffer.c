@@ -22,7 +22,10 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <sys/socket.h>
+#include <byteswap.h>
+#include <endian.h>
 #include "common/log_legacy.h"
+#include "common/memutils.h"
 
 #include "net/netaddr_types.h"
 
@@ -32,6 +35,138 @@
 
 volatile unsigned int buffer_count = 0;
 
+/*
+ * Packet buffers are recycled through one free list per size class instead of
+ * going back to the system allocator. The size of a pooled buffer is exactly
+ * the size of its class, so buffer_t.size is enough to find the class on
+ * release. Buffers bigger than the largest class use malloc()/free().
+ *
+ * The classes cover small control packets, an IPv6 MTU (1280 bytes) plus
+ * headroom for the 6LoWPAN and MAC headers, and the largest 802.15.4 frames
+ * (2047 bytes). A hard cap on the number of buffers in use in each class can
+ * be set with buffer_pools_set_max() (0 means no limit).
+ */
+static struct buffer_pool {
+    uint16_t size;
+    uint16_t prealloc;
+    unsigned int max;
+    buffer_list_t free_list;
+    // Statistics
+    unsigned int in_use;
+    unsigned int high_water;
+    unsigned int alloc_cnt;     // Buffers obtained from malloc()
+    unsigned int limit_cnt;     // Allocations refused because of max
+} buffer_pools[] = {
+    { .size =  256, .prealloc = 32 },
+    { .size =  512, .prealloc = 16 },
+    { .size = 1536, .prealloc = 16 },
+    { .size = 2560, .prealloc =  8 },
+};
+static bool buffer_pools_ready;
+static unsigned int buffer_oversize_cnt;
+
+void buffer_pools_set_max(unsigned int max)
+{
+    for (int i = 0; i < ARRAY_SIZE(buffer_pools); i++)
+        buffer_pools[i].max = max;
+}
+
+int buffer_pools_get_stats(struct buffer_pool_stats *stats, int stats_len)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(buffer_pools) && i < stats_len; i++) {
+        stats[i].size       = buffer_pools[i].size;
+        stats[i].in_use     = buffer_pools[i].in_use;
+        stats[i].high_water = buffer_pools[i].high_water;
+        stats[i].alloc_cnt  = buffer_pools[i].alloc_cnt;
+        stats[i].limit_cnt  = buffer_pools[i].limit_cnt;
+    }
+    if (i == stats_len)
+        return i;
+    memset(&stats[i], 0, sizeof(stats[i]));
+    stats[i].alloc_cnt = buffer_oversize_cnt;
+    return i + 1;
+}
+
+static struct buffer_pool *buffer_pool_find(uint32_t size)
+{
+    for (int i = 0; i < ARRAY_SIZE(buffer_pools); i++)
+        if (size <= buffer_pools[i].size)
+            return &buffer_pools[i];
+    return NULL;
+}
+
+static void buffer_pools_init(void)
+{
+    buffer_t *buf;
+
+    for (int i = 0; i < ARRAY_SIZE(buffer_pools); i++) {
+        ns_list_init(&buffer_pools[i].free_list);
+        for (int j = 0; j < buffer_pools[i].prealloc; j++) {
+            buf = malloc(sizeof(buffer_t) + buffer_pools[i].size);
+            FATAL_ON(!buf, 2);
+            ns_list_add_to_start(&buffer_pools[i].free_list, buf);
+            buffer_pools[i].alloc_cnt++;
+        }
+    }
+    buffer_pools_ready = true;
+}
+
+/*
+ * Return an uninitialized buffer with a data area of at least size bytes, and
+ * set buf->size accordingly. Return NULL if the limit of the size class is
+ * reached.
+ */
+static buffer_t *buffer_alloc(uint32_t size)
+{
+    struct buffer_pool *pool;
+    buffer_t *buf;
+
+    if (!buffer_pools_ready)
+        buffer_pools_init();
+    pool = buffer_pool_find(size);
+    if (!pool) {
+        buf = malloc(sizeof(buffer_t) + size);
+        FATAL_ON(!buf, 2);
+        buffer_oversize_cnt++;
+        buf->size = size;
+        return buf;
+    }
+    if (pool->max && pool->in_use >= pool->max) {
+        pool->limit_cnt++;
+        TRACE(TR_DROP, "drop %-9s: %u buffers of %u bytes in use", "buffer", pool->in_use, pool->size);
+        return NULL;
+    }
+    buf = ns_list_get_first(&pool->free_list);
+    if (buf) {
+        ns_list_remove(&pool->free_list, buf);
+    } else {
+        buf = malloc(sizeof(buffer_t) + pool->size);
+        FATAL_ON(!buf, 2);
+        pool->alloc_cnt++;
+    }
+    pool->in_use++;
+    if (pool->in_use > pool->high_water)
+        pool->high_water = pool->in_use;
+    buf->size = pool->size;
+    return buf;
+}
+
+static void buffer_release(buffer_t *buf)
+{
+    struct buffer_pool *pool = buffer_pool_find(buf->size);
+
+    if (!pool) {
+        free(buf);
+        return;
+    }
+    BUG_ON(pool->size != buf->size);
+    BUG_ON(!pool->in_use);
+    pool->in_use--;
+    ns_list_add_to_start(&pool->free_list, buf);
+}
+
 uint8_t *buffer_corrupt_check(buffer_t *buf)
 {
     if (buf == NULL) {
@@ -82,8 +217,11 @@ buffer_t *buffer_get_specific(uint16_t headroom, uint16_t size, uint16_t minspac
 
     // Note - as well as this alloc+init, buffers can also be "realloced"
     // in buffer_headroom()
-    buf = malloc(sizeof(buffer_t) + total_size);
-    FATAL_ON(!buf, 2);
+    buf = buffer_alloc(total_size);
+    if (!buf)
+        return NULL;
+    // The size class may give more room than requested
+    total_size = buf->size;
 
     buffer_count++;
     memset(buf, 0, sizeof(buffer_t));
@@ -119,8 +257,12 @@ buffer_t *buffer_headroom(buffer_t *buf, uint16_t size)
         /* This buffer isn't big enough at all - allocate a new block */
         // TODO - should we be giving them extra? probably
         uint32_t new_total = (curr_len + size + 3) & ~ 3;
-        new_buf = malloc(sizeof(buffer_t) + new_total);
-        FATAL_ON(!new_buf, 2);
+        new_buf = buffer_alloc(new_total);
+        if (!new_buf) {
+            buffer_free(buf);
+            return NULL;
+        }
+        new_total = new_buf->size;
         // Copy the buffer_t header
         *new_buf = *buf;
         // Set new pointers, leaving specified headroom
@@ -129,7 +271,7 @@ buffer_t *buffer_headroom(buffer_t *buf, uint16_t size)
         new_buf->size = new_total;
         // Copy the current data
         memcpy(buffer_data_pointer(new_buf), buffer_data_pointer(buf), curr_len);
-        free(buf);
+        buffer_release(buf);
         buf = new_buf;
     } else if (buf->buf_ptr < size) {
         /* This buffer is big enough, but not enough headroom - shuffle */
@@ -172,7 +314,7 @@ buffer_t *buffer_free(buffer_t *buf)
         }
 
         buf = buffer_free_route(buf);
-        free(buf);
+        buffer_release(buf);
 
     } else {
         tr_error("nullp F");
@@ -275,37 +417,55 @@ buffer_t *buffer_clone(buffer_t *buf)
     return result_ptr;
 }
 
+// One's complement sum (RFC 1071) of data, in native byte order. 32-bit words
+// are summed in a 64-bit accumulator, so carries only need to be folded at the
+// end (and the compiler is free to vectorize the loop).
+static uint16_t ip_csum_partial(const uint8_t *data, size_t len)
+{
+    uint64_t acc64 = 0;
+    uint32_t word;
+
+    while (len >= 4) {
+        memcpy(&word, data, 4);
+        acc64 += word;
+        data += 4;
+        len -= 4;
+    }
+    if (len) {
+        word = 0;
+        memcpy(&word, data, len);
+        acc64 += word;
+    }
+
+    acc64 = (acc64 >> 32) + (acc64 & 0xffffffff);
+    acc64 = (acc64 >> 16) + (acc64 & 0xffff);
+    acc64 = (acc64 >> 16) + (acc64 & 0xffff);
+    return (acc64 >> 16) + (acc64 & 0xffff);
+}
+
 static uint16_t ip_fcf_v(uint_fast8_t count, const struct iovec vec[count])
 {
     uint_fast32_t acc32 = 0;
     bool odd = false;
+    uint16_t sum16;
+
     while (count) {
-        const uint8_t *data_ptr = vec->iov_base;
-        uint_fast16_t data_length = vec->iov_len;
-        if (odd && data_length > 0) {
-            acc32 += *data_ptr++;
-            data_length--;
-            odd = false;
-        }
-        while (data_length >= 2) {
-            acc32 += (uint_fast16_t) data_ptr[0] << 8 | data_ptr[1];
-            data_ptr += 2;
-            data_length -= 2;
-        }
-        if (data_length) {
-            acc32 += (uint_fast16_t) data_ptr[0] << 8;
-            odd = true;
-        }
+        sum16 = ip_csum_partial(vec->iov_base, vec->iov_len);
+        // Bytes of a chunk starting at an odd offset are paired the other way
+        // around, see RFC 1071 - 2. (B) Byte Order Independence
+        acc32 += odd ? bswap_16(sum16) : sum16;
+        odd ^= vec->iov_len & 1;
         vec++;
         count--;
     }
 
-    // Fold down up to 0xffff carries in the 32-bit accumulator
+    // Fold down the carries in the 32-bit accumulator (count <= 255)
     acc32 = (acc32 >> 16) + (acc32 & 0xffff);
 
     // Could be one more carry from the previous addition (result <= 0x1fffe)
-    uint16_t sum16 = (uint16_t)((acc32 >> 16) + (acc32 & 0xffff));
-    return ~sum16;
+    sum16 = (uint16_t)((acc32 >> 16) + (acc32 & 0xffff));
+    // The sum is computed in native byte order
+    return ~be16toh(sum16);
 }
 
 static uint16_t ipv6_fcf(const uint8_t src_address[16],
@@ -175,6 +175,7 @@ typedef struct buffer {
     uint16_t            size;                   /*!< Buffer size */
     uint16_t            offset;                 /*!< Offset indicator (used in some upward paths) */
     bool                ip_routed_up: 1;
+    bool                adaptation_delay_recorded: 1; /*!< First transmission accounted in the adaptation layer statistics */
     uint32_t            adaptation_timestamp;   /*!< Timestamp when buffer pushed to adaptation interface. Unit 100ms */
     buffer_link_info_t  link_specific;
     uint16_t            mpl_option_data_offset;
@@ -186,6 +187,20 @@ typedef struct buffer {
 typedef NS_LIST_HEAD(buffer_t, link) buffer_list_t;
 static_assert(offsetof(buffer_t, link) == 0, "Some use NS_LIST_HEAD_INCOMPLETE");
 
+struct buffer_pool_stats {
+    uint16_t size;              // 0 for the buffers bigger than all the classes
+    unsigned int in_use;
+    unsigned int high_water;
+    unsigned int alloc_cnt;     // Buffers obtained from malloc()
+    unsigned int limit_cnt;     // Allocations refused because of the limit
+};
+
+// Limit the number of buffers in use in each size class, 0 for no limit.
+void buffer_pools_set_max(unsigned int max);
+// Fill up to stats_len entries (one per size class, then the oversized
+// buffers) and return the number of entries filled.
+int buffer_pools_get_stats(struct buffer_pool_stats *stats, int stats_len);
+
 #define SYST_WDCLEAR    0xff
 #define SYST_TX_TO      0xfe
 
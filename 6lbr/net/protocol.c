@@ -56,8 +56,10 @@ void icmp_fast_timer(int ticks)
 
     /* This gives us the RFC 4443 default (10 tokens/s, bucket size 10) */
     cur->icmp_tokens += ticks;
-    if (cur->icmp_tokens > 10) {
+    if (cur->icmp_tokens >= 10) {
         cur->icmp_tokens = 10;
+        // Restarted by icmpv6.c when a token is consumed
+        ws_timer_stop(WS_TIMER_ICMP_FAST);
     }
 }
 
@@ -84,7 +86,6 @@ void update_reachable_time(int seconds)
 
 void protocol_core_init(void)
 {
-    ws_timer_start(WS_TIMER_MONOTONIC_TIME);
     ws_timer_start(WS_TIMER_MPL);
     ws_timer_start(WS_TIMER_PAE_FAST);
     ws_timer_start(WS_TIMER_PAE_SLOW);
@@ -138,6 +139,7 @@ void protocol_init(struct net_if *entry, struct rcp *rcp, int mtu)
     ns_list_init(&entry->ip_addresses);
     ns_list_init(&entry->ip_groups);
     ns_list_init(&entry->ipv6_neighbour_cache.list);
+    ns_list_init(&entry->ipv6_neighbour_cache.gc_list);
     ipv6_neighbour_cache_init(&entry->ipv6_neighbour_cache, entry->id);
     protocol_set_eui64(entry, rcp->eui64);
     ns_list_add_to_start(&protocol_interface_info_list, entry);
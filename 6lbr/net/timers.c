@@ -28,23 +28,21 @@
 
 #include "timers.h"
 
+// Derived from the timer wheel instead of being updated by a periodic timer,
+// so keeping it up to date does not require to wake up.
 int g_monotonic_time_100ms = 0;
 
-static void timer_update_monotonic_time(int ticks)
-{
-    g_monotonic_time_100ms += ticks;
-}
-
 static void timer_refresh_neighbors(int time_update)
 {
     struct net_if *interface = protocol_stack_interface_info_get();
     ws_neigh_table_expire(&interface->ws_info.neighbor_storage, time_update);
 }
 
+static void ws_timer_expire(struct timer_wheel_entry *entry);
+
 #define timer_entry(name, callback, period_ms, is_periodic) \
-    [WS_TIMER_##name] = { #name, callback, period_ms, is_periodic, 0 }
+    [WS_TIMER_##name] = { #name, callback, period_ms, is_periodic, { ws_timer_expire } }
 struct ws_timer g_timers[] = {
-    timer_entry(MONOTONIC_TIME,         timer_update_monotonic_time,                100,                     true),
     timer_entry(MPL,                    mpl_timer,                                  1000,                    true),
     timer_entry(RPL,                    rpl_timer,                                  1000,                    true),
     timer_entry(IPV6_DESTINATION,       ipv6_destination_cache_timer,               DCACHE_GC_PERIOD * 1000, true),
@@ -64,30 +62,64 @@ struct ws_timer g_timers[] = {
 };
 static_assert(ARRAY_SIZE(g_timers) == WS_TIMER_COUNT, "missing timer declarations");
 
+static struct timer_wheel g_timer_wheel;
+
+static void ws_timer_update_monotonic_time(void)
+{
+    g_monotonic_time_100ms = g_timer_wheel.now * WS_TIMER_GLOBAL_PERIOD_MS / 100;
+}
+
+static void ws_timer_expire(struct timer_wheel_entry *entry)
+{
+    struct ws_timer *timer = container_of(entry, struct ws_timer, wheel_entry);
+
+    ws_timer_update_monotonic_time();
+    // Re-armed first, so the callback can stop the timer once it is idle
+    if (timer->periodic)
+        ws_timer_start(timer - g_timers);
+    timer->callback(1);
+    TRACE(TR_TIMERS, "timer: %s", timer->trace_name);
+}
+
+void ws_timer_start_timeout(enum timer_id id, int timeout_ms)
+{
+    int ticks = timeout_ms / WS_TIMER_GLOBAL_PERIOD_MS;
+
+    if (ticks)
+        timer_wheel_arm(&g_timer_wheel, &g_timers[id].wheel_entry, ticks);
+    else
+        ws_timer_stop(id);
+}
+
 void ws_timer_start(enum timer_id id)
 {
     BUG_ON(g_timers[id].period_ms % WS_TIMER_GLOBAL_PERIOD_MS);
-    g_timers[id].timeout = g_timers[id].period_ms / WS_TIMER_GLOBAL_PERIOD_MS;
+    ws_timer_start_timeout(id, g_timers[id].period_ms);
 }
 
 void ws_timer_stop(enum timer_id id)
 {
-    g_timers[id].timeout = 0;
+    timer_wheel_cancel(&g_timer_wheel, &g_timers[id].wheel_entry);
+}
+
+bool ws_timer_is_running(enum timer_id id)
+{
+    return timer_wheel_is_armed(&g_timers[id].wheel_entry);
+}
+
+void ws_timer_advance(uint64_t tick)
+{
+    timer_wheel_advance(&g_timer_wheel, tick);
+    ws_timer_update_monotonic_time();
 }
 
 void ws_timer_global_tick()
 {
-    for (int i = 0; i < ARRAY_SIZE(g_timers); i++) {
-        if (!g_timers[i].timeout)
-            continue;
-
-        g_timers[i].timeout--; // Always advance one tick at a time
-        if (g_timers[i].timeout)
-            continue;
-
-        g_timers[i].callback(1);
-        TRACE(TR_TIMERS, "timer: %s", g_timers[i].trace_name);
-        if (g_timers[i].periodic)
-            ws_timer_start(i);
-    }
+    timer_wheel_advance(&g_timer_wheel, g_timer_wheel.now + 1);
+    ws_timer_update_monotonic_time();
+}
+
+uint64_t ws_timer_next_tick()
+{
+    return timer_wheel_next(&g_timer_wheel);
 }
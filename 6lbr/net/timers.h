@@ -15,11 +15,13 @@
 #define WS_TIMERS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "common/timer_wheel.h"
 
 #define WS_TIMER_GLOBAL_PERIOD_MS 50
 
 enum timer_id {
-    WS_TIMER_MONOTONIC_TIME,
     WS_TIMER_MPL,
     WS_TIMER_RPL,
     WS_TIMER_IPV6_DESTINATION,
@@ -45,6 +47,7 @@ enum timer_id {
     WS_TIMER_COUNT,
 };
 
+// Time elapsed since tick 0, in units of 100ms
 extern int g_monotonic_time_100ms;
 
 // Expose timer array to avoid boilerplate API functions when "low level"
@@ -54,13 +57,25 @@ struct ws_timer {
     void (*callback)(int);
     int period_ms;
     bool periodic;
-    int timeout;
+    struct timer_wheel_entry wheel_entry;
 };
 extern struct ws_timer g_timers[WS_TIMER_COUNT];
 
+// Periodic timers are re-armed before their callback is called, so a
+// callback can stop its own timer when it has nothing left to do.
 void ws_timer_start(enum timer_id id);
+// Start a timer with a custom timeout instead of its period.
+void ws_timer_start_timeout(enum timer_id id, int timeout_ms);
 void ws_timer_stop(enum timer_id id);
+bool ws_timer_is_running(enum timer_id id);
 
+// Timers are driven by ticks of WS_TIMER_GLOBAL_PERIOD_MS. The tick counter
+// starts at 0.
 void ws_timer_global_tick();
+// Process all the ticks up to tick. Idle periods are skipped.
+void ws_timer_advance(uint64_t tick);
+// Return the tick of the next timer event, or UINT64_MAX if no timer is
+// running.
+uint64_t ws_timer_next_tick();
 
 #endif
@@ -22,6 +22,7 @@
 #include "common/capture.h"
 #include "common/iobuf.h"
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/named_values.h"
 #include "common/seqno.h"
 #include "common/string_extra.h"
@@ -31,6 +32,7 @@
 #include "common/specs/icmpv6.h"
 #include "common/specs/rpl.h"
 #include "rpl_lollipop.h"
+#include "rpl_srh.h"
 #include "rpl.h"
 
 struct rpl_opt_target {
@@ -66,10 +68,13 @@ static const char *tr_icmp_rpl(uint8_t code)
 struct rpl_target *rpl_target_get(struct rpl_root *root, const uint8_t prefix[16])
 {
     struct rpl_target *target;
+    struct hash_entry *it;
 
-    SLIST_FOREACH(target, &root->targets, link)
+    hash_table_foreach(&root->targets_index, it, hash_table_key(prefix, 16)) {
+        target = container_of(it, struct rpl_target, hash_entry);
         if (!memcmp(target->prefix, prefix, 16))
             return target;
+    }
     return NULL;
 }
 
@@ -77,8 +82,10 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
 {
     struct rpl_target *target = zalloc(sizeof(struct rpl_target));
 
+    BUG_ON(rpl_target_get(root, prefix));
     memcpy(target->prefix, prefix, 16);
     SLIST_INSERT_HEAD(&root->targets, target, link);
+    hash_table_insert(&root->targets_index, &target->hash_entry, hash_table_key(prefix, 16));
     if (root->on_target_add)
         root->on_target_add(root, target);
     return target;
@@ -87,7 +94,9 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
 void rpl_target_del(struct rpl_root *root, struct rpl_target *target)
 {
     TRACE(TR_RPL, "rpl: target  remove prefix=%s", tr_ipv6_prefix(target->prefix, 128));
+    hash_table_remove(&root->targets_index, &target->hash_entry);
     SLIST_REMOVE(&root->targets, target, rpl_target, link);
+    rpl_srh_cache_del(root, target);
     if (root->on_target_del)
         root->on_target_del(root, target);
     free(target);
@@ -95,7 +104,7 @@ void rpl_target_del(struct rpl_root *root, struct rpl_target *target)
 
 uint16_t rpl_target_count(struct rpl_root *root)
 {
-    return SLIST_SIZE(&root->targets, link);
+    return root->targets_index.entry_cnt;
 }
 
 struct rpl_transit *rpl_transit_preferred(struct rpl_root *root, struct rpl_target *target)
@@ -429,6 +438,9 @@ static void rpl_transit_update(struct rpl_root *root,
     }
 
     WARN_ON(opt_transit->external != target->external);
+    // The flag changes the source routing header, see rpl_srh_build()
+    if (opt_transit->external != target->external)
+        updated_transit = true;
     target->external = opt_transit->external;
 
     for (uint8_t i = 0; i < root->pcs + 1; i++) {
@@ -444,6 +456,8 @@ static void rpl_transit_update(struct rpl_root *root,
         TRACE(TR_RPL, "rpl: transit new    target=%s parent=%s path-ctl-bit=%u",
               tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
     }
+    if (updated_transit)
+        rpl_srh_cache_update(root, target);
     if ((updated_lifetime || updated_transit) && root->on_target_update)
         root->on_target_update(root, target, updated_transit);
 }
@@ -598,6 +612,8 @@ void rpl_recv_srh_err(struct rpl_root *root,
                   tr_ipv6_prefix(dst, 128), tr_ipv6(src), i);
         }
     }
+    if (updated)
+        rpl_srh_cache_update(root, target);
     if (updated && root->on_target_update)
         root->on_target_update(root, target, true);
 }
@@ -695,6 +711,7 @@ void rpl_start(struct rpl_root *root, const char ifname[IF_NAMESIZE])
     // The RPLInstanceID MUST be of the global form.
     BUG_ON(FIELD_GET(RPL_MASK_INSTANCE_ID_TYPE, root->instance_id) != RPL_INSTANCE_ID_TYPE_GLOBAL);
 
+    TAILQ_INIT(&root->storage_dirty);
     root->sockfd = socket(PF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
     FATAL_ON(root->sockfd < 0, 2, "%s: socket: %m", __func__);
     capture_register_netfd(root->sockfd);
@@ -738,6 +755,7 @@ void rpl_timer(int ticks)
             TRACE(TR_RPL, "rpl: transit expire target=%s parent=%s path-ctl-bit=%u",
                   tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
             memset(target->transits + i, 0, sizeof(struct rpl_transit));
+            rpl_srh_cache_update(root, target);
             updated = false;
         }
         if (!memzcmp(target->transits, sizeof(target->transits)))
@@ -745,4 +763,6 @@ void rpl_timer(int ticks)
         else if (updated && root->on_target_update)
             root->on_target_update(root, target, true);
     }
+    if (root->on_timer)
+        root->on_timer(root);
 }
@@ -16,9 +16,12 @@
 
 #include <sys/queue.h>
 #include <net/if.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
+#include "common/hash_table.h"
 #include "common/trickle.h"
 
 /*
@@ -85,7 +88,20 @@ struct rpl_target {
     // bit maps to a 0-initialized transit.
     struct rpl_transit transits[8];
 
+    // See rpl_srh.h
+    struct rpl_srh_cache *srh_cache;
+    bool srh_external;
+    bool srh_has_parent;
+    uint8_t srh_parent[16];
+    struct hash_entry srh_entry;
+
+    // See rpl_storage.h
+    bool storage_dirty;
+    time_t storage_dirty_tstamp_s;
+    TAILQ_ENTRY(rpl_target) storage_link;
+
     SLIST_ENTRY(rpl_target) link;
+    struct hash_entry hash_entry;
 };
 
 // Declare struct rpl_target_list
@@ -113,6 +129,8 @@ struct rpl_root {
     void (*on_target_add)(struct rpl_root *root, struct rpl_target *target);
     void (*on_target_del)(struct rpl_root *root, struct rpl_target *target);
     void (*on_target_update)(struct rpl_root *root, struct rpl_target *target, bool updated_transit);
+    // Called at the end of rpl_timer()
+    void (*on_timer)(struct rpl_root *root);
 
     // When enabled, some parts of the specification are ignored in order to
     // hopefully improve interoperability with faulty devices.
@@ -123,6 +141,18 @@ struct rpl_root {
     bool compat;
 
     struct rpl_target_list targets;
+    // Targets indexed by prefix
+    struct hash_table targets_index;
+    // Targets indexed by their preferred parent, see rpl_srh.h
+    struct hash_table srh_children;
+    uint64_t srh_cache_hit;
+    uint64_t srh_cache_miss;
+
+    // Targets waiting to be written, see rpl_storage.h
+    TAILQ_HEAD(, rpl_target) storage_dirty;
+    uint64_t storage_write_cnt;
+    uint64_t storage_write_avoided_cnt;
+    time_t storage_latency_max_s;
 };
 
 extern const uint8_t rpl_all_nodes[16]; // ff02::1a
@@ -75,9 +75,9 @@ static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage,
     struct rpl_root *root = buf->route->route_info.info;
     const uint8_t *rpl_dst = buf->dst_sa.address;
     struct rpl_transit *transit;
-    struct rpl_srh_decmpr srh;
     struct rpl_target *target;
     const uint8_t *nxthop;
+    int seg_count;
 
     *res = 0;
 
@@ -109,13 +109,13 @@ static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage,
         }
     }
 
-    if (rpl_srh_build(root, rpl_dst, &srh, &nxthop) < 0) {
+    seg_count = rpl_srh_build_push(root, rpl_dst, &srh_buf, buf->options.type, &nxthop);
+    if (seg_count < 0) {
         *res = -1;
         return buf;
     }
-    if (!srh.seg_count)
+    if (!seg_count)
         return buf; // TODO: add hop-by-hop option
-    rpl_srh_push(&srh_buf, &srh, nxthop, buf->options.type, root->compat);
 
     switch (stage) {
     case IPV6_EXTHDR_SIZE:
@@ -11,19 +11,24 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "common/bits.h"
 #include "common/iobuf.h"
 #include "common/log.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/specs/rpl.h"
 #include "common/specs/ipv6.h"
 #include "rpl_srh.h"
 #include "rpl.h"
 
-int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
-                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+// Fixed part, segments (uncompressed), and padding
+#define RPL_SRH_SIZE_MAX(seg_count) (8 + 16 * (seg_count) + 7)
+
+static int rpl_srh_compute(struct rpl_root *root, const uint8_t dst[16],
+                           struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
 {
     const uint8_t *seg_list[WS_RPL_SRH_MAXSEG];
     struct rpl_transit *transit;
@@ -64,15 +69,139 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
         nxthop = transit->parent;
     }
 
+    *nxthop_ret = nxthop;
+    srh->seg_count = seg_count;
+    srh->seg_left  = seg_count;
+    for (uint8_t i = 0; i < seg_count; i++)
+        memcpy(srh->seg_list[i], seg_list[seg_count - i - 1], 16);
+    return seg_count;
+}
+
+// The encoded header is stored right after the segment list
+static uint8_t *rpl_srh_cache_hdr(struct rpl_srh_cache *cache)
+{
+    return (uint8_t *)(cache->seg_list + cache->seg_count);
+}
+
+// Return the cached route to dst, computing it again if it was invalidated.
+// Failures are not cached.
+static struct rpl_srh_cache *rpl_srh_cache_get(struct rpl_root *root, const uint8_t dst[16])
+{
+    struct rpl_srh_decmpr srh;
+    struct rpl_target *target;
+    struct rpl_srh_cache *cache;
+    const uint8_t *nxthop;
+
+    target = rpl_target_get(root, dst);
+    if (target && target->srh_cache) {
+        root->srh_cache_hit++;
+        return target->srh_cache;
+    }
+    root->srh_cache_miss++;
+    if (rpl_srh_compute(root, dst, &srh, &nxthop) < 0)
+        return NULL;
+    BUG_ON(!target);
+
+    free(target->srh_cache);
+    cache = xalloc(sizeof(*cache) + sizeof(cache->seg_list[0]) * srh.seg_count +
+                   RPL_SRH_SIZE_MAX(srh.seg_count));
+    memcpy(cache->nxthop, nxthop, 16);
+    cache->seg_count = srh.seg_count;
+    memcpy(cache->seg_list, srh.seg_list, sizeof(cache->seg_list[0]) * srh.seg_count);
+    cache->hdr_len = 0;
+    target->srh_cache = cache;
+    return cache;
+}
+
+int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
+                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+{
+    struct rpl_srh_cache *cache = rpl_srh_cache_get(root, dst);
+
+    if (!cache)
+        return -1;
     if (nxthop_ret)
-        *nxthop_ret = nxthop;
+        *nxthop_ret = cache->nxthop;
     if (srh) {
-        srh->seg_count = seg_count;
-        srh->seg_left  = seg_count;
-        for (uint8_t i = 0; i < seg_count; i++)
-            memcpy(srh->seg_list[i], seg_list[seg_count - i - 1], 16);
+        srh->seg_count = cache->seg_count;
+        srh->seg_left  = cache->seg_count;
+        memcpy(srh->seg_list, cache->seg_list, sizeof(cache->seg_list[0]) * cache->seg_count);
     }
-    return seg_count;
+    return cache->seg_count;
+}
+
+int rpl_srh_build_push(struct rpl_root *root, const uint8_t dst[16], struct iobuf_write *buf,
+                       uint8_t nxthdr, const uint8_t **nxthop_ret)
+{
+    struct rpl_srh_cache *cache = rpl_srh_cache_get(root, dst);
+    struct iobuf_write hdr = { };
+    struct rpl_srh_decmpr srh;
+
+    if (!cache)
+        return -1;
+    if (nxthop_ret)
+        *nxthop_ret = cache->nxthop;
+    if (!cache->seg_count)
+        return 0;
+    if (!cache->hdr_len) {
+        srh.seg_count = cache->seg_count;
+        srh.seg_left  = cache->seg_count;
+        memcpy(srh.seg_list, cache->seg_list, sizeof(cache->seg_list[0]) * cache->seg_count);
+        // Next Header is the only field which depends on the packet
+        rpl_srh_push(&hdr, &srh, cache->nxthop, 0, root->compat);
+        BUG_ON(hdr.len > RPL_SRH_SIZE_MAX(cache->seg_count));
+        memcpy(rpl_srh_cache_hdr(cache), hdr.data, hdr.len);
+        cache->hdr_len = hdr.len;
+        iobuf_free(&hdr);
+    }
+    iobuf_push_u8(buf, nxthdr);
+    iobuf_push_data(buf, rpl_srh_cache_hdr(cache) + 1, cache->hdr_len - 1);
+    return cache->seg_count;
+}
+
+static void rpl_srh_cache_invalidate(struct rpl_root *root, struct rpl_target *target, int depth)
+{
+    struct rpl_target *child;
+    struct hash_entry *it;
+
+    free(target->srh_cache);
+    target->srh_cache = NULL;
+    // Routes are at most WS_RPL_SRH_MAXSEG hops long, this also stops the walk
+    // on loops.
+    if (depth > WS_RPL_SRH_MAXSEG)
+        return;
+    hash_table_foreach(&root->srh_children, it, hash_table_key(target->prefix, 16)) {
+        child = container_of(it, struct rpl_target, srh_entry);
+        if (!memcmp(child->srh_parent, target->prefix, 16))
+            rpl_srh_cache_invalidate(root, child, depth + 1);
+    }
+}
+
+void rpl_srh_cache_update(struct rpl_root *root, struct rpl_target *target)
+{
+    struct rpl_transit *transit = rpl_transit_preferred(root, target);
+
+    if (target->srh_external == target->external &&
+        target->srh_has_parent == (bool)transit &&
+        (!transit || !memcmp(target->srh_parent, transit->parent, 16)))
+        return;
+    if (target->srh_has_parent)
+        hash_table_remove(&root->srh_children, &target->srh_entry);
+    target->srh_external = target->external;
+    target->srh_has_parent = transit;
+    if (transit) {
+        memcpy(target->srh_parent, transit->parent, 16);
+        hash_table_insert(&root->srh_children, &target->srh_entry, hash_table_key(transit->parent, 16));
+    }
+    rpl_srh_cache_invalidate(root, target, 0);
+}
+
+void rpl_srh_cache_del(struct rpl_root *root, struct rpl_target *target)
+{
+    if (target->srh_has_parent)
+        hash_table_remove(&root->srh_children, &target->srh_entry);
+    target->srh_has_parent = false;
+    rpl_srh_cache_invalidate(root, target, 0);
 }
 
 // RFC 6554 - 3. Format of the RPL Routing Header
@@ -19,6 +19,7 @@
 
 struct iobuf_write;
 struct rpl_root;
+struct rpl_target;
 
 //   Wi-SUN FAN 1.1v06 - 4.1.1 General
 // The FAN MUST support mesh networking with FAN nodes being up to 24 hops from
@@ -32,9 +33,36 @@ struct rpl_srh_decmpr {
     uint8_t seg_list[WS_RPL_SRH_MAXSEG][16];
 };
 
+/*
+ * The route computed for a target is cached in struct rpl_target, along with
+ * its encoded SRH. A route only depends on the preferred parent and on the
+ * external flag of the targets along the path, which are copied in
+ * struct rpl_target when they change. Targets are indexed by preferred parent
+ * so that a change only invalidates the routes going through the target, that
+ * is the routes of its sub-DODAG. Refreshing a transit or modifying a backup
+ * parent keeps the cache.
+ */
+struct rpl_srh_cache {
+    uint8_t nxthop[16];
+    uint8_t seg_count;
+    uint16_t hdr_len; // 0 until rpl_srh_build_push() is called
+    uint8_t seg_list[][16]; // Followed by the encoded SRH
+};
+
+// Return the number of segments, or -1 if no route is found. The returned
+// next hop remains valid until the route to dst is computed again.
 int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
                   struct rpl_srh_decmpr *srh, const uint8_t **nxthop);
 void rpl_srh_push(struct iobuf_write *buf, const struct rpl_srh_decmpr *srh,
                   const uint8_t dst[16], uint8_t nxthdr, bool cmpri_eq_cmpre);
+// Same as rpl_srh_build() followed by rpl_srh_push() (if there is at least one
+// segment), but the encoded header is cached as well.
+int rpl_srh_build_push(struct rpl_root *root, const uint8_t dst[16], struct iobuf_write *buf,
+                       uint8_t nxthdr, const uint8_t **nxthop);
+
+// Must be called whenever the transits or the external flag of a target
+// change, and before a target is removed.
+void rpl_srh_cache_update(struct rpl_root *root, struct rpl_target *target);
+void rpl_srh_cache_del(struct rpl_root *root, struct rpl_target *target);
 
 #endif
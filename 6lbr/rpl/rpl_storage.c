@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <glob.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <limits.h>
 #include <stdio.h>
@@ -23,10 +24,17 @@
 #include "common/key_value_storage.h"
 #include "common/time_extra.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/string_extra.h"
 #include "rpl_storage.h"
+#include "rpl_srh.h"
 #include "rpl.h"
 
+// Delay before writing a modified target
+#define RPL_STORAGE_FLUSH_DELAY_S 5
+// Maximum number of targets written per call to rpl_storage_flush()
+#define RPL_STORAGE_FLUSH_BUDGET 64
+
 void rpl_storage_store_config(const struct rpl_root *root)
 {
     char ipv6_str[STR_MAX_LEN_IPV6];
@@ -76,7 +84,7 @@ void rpl_storage_load_config(struct rpl_root *root, const char *filename)
     storage_close(nvm);
 }
 
-void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_target *target)
+static void rpl_storage_write_target(const struct rpl_root *root, const struct rpl_target *target)
 {
     char time_str[STR_MAX_LEN_DATE];
     char ipv6_str[STR_MAX_LEN_IPV6];
@@ -110,10 +118,50 @@ void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_targ
     storage_close(nvm);
 }
 
-void rpl_storage_del_target(const struct rpl_root *root, const struct rpl_target *target)
+void rpl_storage_store_target(struct rpl_root *root, struct rpl_target *target)
+{
+    if (target->storage_dirty) {
+        root->storage_write_avoided_cnt++;
+        return;
+    }
+    target->storage_dirty = true;
+    target->storage_dirty_tstamp_s = time_current(CLOCK_MONOTONIC);
+    TAILQ_INSERT_TAIL(&root->storage_dirty, target, storage_link);
+}
+
+void rpl_storage_flush(struct rpl_root *root, bool force)
+{
+    time_t now = time_current(CLOCK_MONOTONIC);
+    struct rpl_target *target;
+    int cnt = 0;
+
+    // Targets are sorted by time of modification
+    while ((target = TAILQ_FIRST(&root->storage_dirty))) {
+        if (!force && cnt >= RPL_STORAGE_FLUSH_BUDGET)
+            break;
+        if (!force && now < target->storage_dirty_tstamp_s + RPL_STORAGE_FLUSH_DELAY_S)
+            break;
+        TAILQ_REMOVE(&root->storage_dirty, target, storage_link);
+        target->storage_dirty = false;
+        root->storage_latency_max_s = MAX(root->storage_latency_max_s, now - target->storage_dirty_tstamp_s);
+        rpl_storage_write_target(root, target);
+        root->storage_write_cnt++;
+        cnt++;
+    }
+    if (cnt)
+        TRACE(TR_RPL, "rpl: storage flush %d targets (total %"PRIu64" written, %"PRIu64" avoided)",
+              cnt, root->storage_write_cnt, root->storage_write_avoided_cnt);
+}
+
+void rpl_storage_del_target(struct rpl_root *root, struct rpl_target *target)
 {
     char filename[PATH_MAX];
 
+    if (target->storage_dirty) {
+        TAILQ_REMOVE(&root->storage_dirty, target, storage_link);
+        target->storage_dirty = false;
+    }
+
     strcpy(filename, "rpl-");
     str_ipv6(target->prefix, filename + strlen(filename));
     storage_delete((const char *[]){ filename, NULL });
@@ -137,8 +185,11 @@ void rpl_storage_load_target(struct rpl_root *root, const char *filename)
         WARN("%s %s failure", __func__, filename);
         return;
     }
+    if (rpl_target_get(root, prefix)) {
+        WARN("%s %s duplicate", __func__, filename);
+        return;
+    }
     target = rpl_target_new(root, prefix);
-    BUG_ON(!target);
 
     nvm = storage_open(filename, "r");
     if (!nvm) {
@@ -167,20 +218,19 @@ void rpl_storage_load_target(struct rpl_root *root, const char *filename)
         }
     }
     storage_close(nvm);
+    rpl_srh_cache_update(root, target);
 }
 
 void rpl_storage_load(struct rpl_root *root)
 {
-    char globexpr[PATH_MAX];
     glob_t globbuf;
     int ret;
 
     if (!g_storage_prefix)
         return;
-    snprintf(globexpr, sizeof(globexpr), "%s%s", g_storage_prefix, "rpl-*");
-    ret = glob(globexpr, 0, NULL, &globbuf);
+    ret = storage_glob("rpl-*", &globbuf);
     if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, globexpr, ret);
+        WARN("%s: glob %s returned %u", __func__, "rpl-*", ret);
     if (ret)
         return;
     for (int i = 0; globbuf.gl_pathv[i]; i++) {
@@ -189,5 +239,5 @@ void rpl_storage_load(struct rpl_root *root)
         else
             rpl_storage_load_target(root, globbuf.gl_pathv[i]);
     }
-    globfree(&globbuf);
+    storage_globfree(&globbuf);
 }
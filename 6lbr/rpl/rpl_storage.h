@@ -14,17 +14,28 @@
 #ifndef RPL_STORAGE_H
 #define RPL_STORAGE_H
 
+#include <stdbool.h>
+
 struct rpl_root;
 struct rpl_target;
 
 /*
  * Functions for (re)storing RPL data from/to Non-Volatile Memory (NVM).
  * A file is created per target, containing transits with the relevant data.
+ *
+ * rpl_storage_store_target() only marks the target as dirty. Dirty targets are
+ * written by rpl_storage_flush() (called every second from the on_timer() hook
+ * of struct rpl_root) a few seconds later, with a limited number of writes per
+ * call. So a target updated several times in a row (typically during a DAO
+ * storm) is written only once, and the writes are spread over time.
  */
 
 void rpl_storage_store_config(const struct rpl_root *root);
-void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_target *target);
-void rpl_storage_del_target(const struct rpl_root *root, const struct rpl_target *target);
+void rpl_storage_store_target(struct rpl_root *root, struct rpl_target *target);
+void rpl_storage_del_target(struct rpl_root *root, struct rpl_target *target);
+// Write the dirty targets. If force is set, ignore the delay and the write
+// budget (typically before exiting).
+void rpl_storage_flush(struct rpl_root *root, bool force);
 
 void rpl_storage_load_config(struct rpl_root *root, const char *filename);
 void rpl_storage_load_target(struct rpl_root *root, const char *filename);
@@ -71,9 +71,13 @@
 
 static void ws_bootstrap_neighbor_delete(struct net_if *interface, struct ws_neigh *neighbor)
 {
-    ws_neigh_del(&interface->ws_info.neighbor_storage, neighbor->mac64);
+    uint8_t eui64[8];
+
+    memcpy(eui64, neighbor->mac64, 8);
+    ws_neigh_del(&interface->ws_info.neighbor_storage, eui64);
     if (!ws_neigh_lfn_count(&interface->ws_info.neighbor_storage))
         ws_timer_stop(WS_TIMER_LTS);
+    dbus_emit_neighbor_change(&g_ctxt, eui64);
 }
 
 bool ws_bootstrap_nd_ns_transmit(struct net_if *cur, ipv6_neighbour_t *entry,  bool unicast, uint8_t seq)
@@ -141,19 +145,21 @@ struct ws_neigh *ws_bootstrap_neighbor_add(struct net_if *net_if, const uint8_t
     struct ipv6_neighbour *ipv6_neighbor;
 
     ws_neigh = ws_neigh_get(&net_if->ws_info.neighbor_storage, eui64);
-    if (!ws_neigh)
+    if (!ws_neigh) {
         ws_neigh = ws_neigh_add(&net_if->ws_info.neighbor_storage,
                                 eui64, role, net_if->ws_info.tx_power_dbm,
                                 net_if->ws_info.key_index_mask);
+        dbus_emit_neighbor_change(&g_ctxt, eui64);
+    }
 
     BUG_ON(!ws_neigh);
-    if (role == WS_NR_ROLE_LFN && !g_timers[WS_TIMER_LTS].timeout)
+    if (role == WS_NR_ROLE_LFN && !ws_timer_is_running(WS_TIMER_LTS))
         ws_timer_start(WS_TIMER_LTS);
 
     ipv6_neighbor = ipv6_neighbour_lookup_gua_by_eui64(&net_if->ipv6_neighbour_cache, eui64);
     if (ipv6_neighbor) {
-        ws_neigh_trust(ws_neigh);
-        ws_neigh_refresh(ws_neigh, ipv6_neighbor->lifetime_s);
+        ws_neigh_trust(&net_if->ws_info.neighbor_storage, ws_neigh);
+        ws_neigh_refresh(&net_if->ws_info.neighbor_storage, ws_neigh, ipv6_neighbor->lifetime_s);
         nd_restore_aro_routes_by_eui64(net_if, eui64);
     }
     return ws_neigh;
@@ -189,7 +195,7 @@ static void ws_bootstrap_nw_key_set(struct net_if *cur,
     } else {
         cur->ws_info.key_index_mask &= ~(1u << key_index);
     }
-    SLIST_FOREACH(neigh, & cur->ws_info.neighbor_storage.neigh_list, link)
+    LIST_FOREACH(neigh, &cur->ws_info.neighbor_storage.neigh_list, link)
         neigh->frame_counter_min[key_index - 1] = key ? 0 : UINT32_MAX;
 }
 
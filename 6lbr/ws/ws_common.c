@@ -148,7 +148,7 @@ uint8_t ws_common_allow_child_registration(struct net_if *interface, const uint8
         return ARO_SUCCESS;
     }
 
-    ws_neigh_refresh(ws_neigh, lifetime_s);
+    ws_neigh_refresh(&interface->ws_info.neighbor_storage, ws_neigh, lifetime_s);
     return ARO_SUCCESS;
 }
 
@@ -159,7 +159,7 @@ bool ws_common_negative_aro_mark(struct net_if *interface, const uint8_t *eui64)
     if (!ws_neigh)
         return false;
 
-    ws_neigh_refresh(ws_neigh, WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME);
+    ws_neigh_refresh(&interface->ws_info.neighbor_storage, ws_neigh, WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME);
     return true;
 }
 
@@ -25,6 +25,7 @@
 #include "common/ieee802154_ie.h"
 #include "common/iobuf.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/ws_regdb.h"
 #include "common/specs/ieee802154.h"
 #include "common/specs/ws.h"
@@ -583,57 +584,160 @@ void ws_wp_nested_jm_write(struct iobuf_write *buf, const struct ws_jm_ie *jm)
     ieee802154_ie_fill_len_nested(buf, offset, false);
 }
 
-static void ws_wh_find_subid(const uint8_t *data, uint16_t length, uint8_t subid, struct iobuf_read *wh_content)
+static void ws_ie_index_wh(struct ws_ie_index *ie, const uint8_t *data, uint16_t length)
 {
-    const uint8_t *end = data + length;
+    struct iobuf_read input = {
+        .data_size = length,
+        .data = data,
+    };
+    const uint8_t *ie_data;
+    uint16_t ie_hdr;
+    uint8_t subid;
+    int ie_len;
 
-    do {
-        ieee802154_ie_find_header(data, length, IEEE802154_IE_ID_WH, wh_content);
-        if (iobuf_pop_u8(wh_content) == subid)
+    ie->wh_base = data;
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        if (FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) != IEEE802154_IE_TYPE_HEADER)
             return;
-        if (wh_content->err)
+        ie_len = FIELD_GET(IEEE802154_IE_HEADER_LEN_MASK, ie_hdr);
+        ie_data = iobuf_pop_data_ptr(&input, ie_len);
+        if (!ie_data)
             return;
-        length -= wh_content->data + wh_content->data_size - data;
-        data = wh_content->data + wh_content->data_size;
-    } while (data < end);
-    wh_content->err = true;
+        if (FIELD_GET(IEEE802154_IE_HEADER_ID_MASK, ie_hdr) != IEEE802154_IE_ID_WH)
+            continue;
+        if (!ie_len)
+            return;
+        subid = ie_data[0];
+        if (bittest(ie->wh_present, subid))
+            continue;
+        bitset(ie->wh_present, subid);
+        ie->wh[subid].offset = ie_data + 1 - data;
+        ie->wh[subid].len    = ie_len - 1;
+    }
+}
+
+static void ws_ie_index_wp(struct ws_ie_index *ie, const uint8_t *data, uint16_t length)
+{
+    struct iobuf_read input = {
+        .data_size = length,
+        .data = data,
+    };
+    struct ws_ie_slot slot;
+    const uint8_t *ie_data;
+    uint16_t ie_hdr;
+    bool is_long;
+    int id;
+
+    ie->wp_base = data;
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        is_long = FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) == IEEE802154_IE_TYPE_NESTED_LONG;
+        if (is_long) {
+            id       = FIELD_GET(IEEE802154_IE_NESTED_LONG_ID_MASK,  ie_hdr);
+            slot.len = FIELD_GET(IEEE802154_IE_NESTED_LONG_LEN_MASK, ie_hdr);
+        } else {
+            id       = FIELD_GET(IEEE802154_IE_NESTED_SHORT_ID_MASK,  ie_hdr);
+            slot.len = FIELD_GET(IEEE802154_IE_NESTED_SHORT_LEN_MASK, ie_hdr);
+        }
+        ie_data = iobuf_pop_data_ptr(&input, slot.len);
+        if (!ie_data)
+            return;
+        slot.offset = ie_data - data;
+        if (is_long && id == WS_WPIE_LCP && ie->lcp_cnt < ARRAY_SIZE(ie->lcp))
+            ie->lcp[ie->lcp_cnt++] = slot;
+        if (is_long && !(ie->wp_long_present & (1u << id))) {
+            ie->wp_long_present |= 1u << id;
+            ie->wp_long[id] = slot;
+        } else if (!is_long && !bittest(ie->wp_short_present, id)) {
+            bitset(ie->wp_short_present, id);
+            ie->wp_short[id] = slot;
+        }
+    }
 }
 
-bool ws_wh_utt_read(const uint8_t *data, uint16_t length, struct ws_utt_ie *utt_ie)
+void ws_ie_index_build(struct ws_ie_index *ie,
+                       const uint8_t *header_ies, uint16_t header_len,
+                       const uint8_t *payload_ies, uint16_t payload_len)
+{
+    struct iobuf_read ie_wp;
+
+    memset(ie->wh_present, 0, sizeof(ie->wh_present));
+    memset(ie->wp_short_present, 0, sizeof(ie->wp_short_present));
+    ie->wp_long_present = 0;
+    ie->lcp_cnt = 0;
+    ie->wp_base = NULL;
+    ws_ie_index_wh(ie, header_ies, header_len);
+    ieee802154_ie_find_payload(payload_ies, payload_len, IEEE802154_IE_ID_WP, &ie_wp);
+    ie->has_wp = !ie_wp.err;
+    if (ie->has_wp)
+        ws_ie_index_wp(ie, ie_wp.data, ie_wp.data_size);
+}
+
+static void ws_ie_slot_get(const uint8_t *base, const struct ws_ie_slot *slot, struct iobuf_read *ie_buf)
+{
+    memset(ie_buf, 0, sizeof(*ie_buf));
+    ie_buf->data      = base + slot->offset;
+    ie_buf->data_size = slot->len;
+}
+
+static void ws_ie_index_get_wh(const struct ws_ie_index *ie, uint8_t subid, struct iobuf_read *ie_buf)
+{
+    if (bittest(ie->wh_present, subid)) {
+        ws_ie_slot_get(ie->wh_base, &ie->wh[subid], ie_buf);
+    } else {
+        memset(ie_buf, 0, sizeof(*ie_buf));
+        ie_buf->err = true;
+    }
+}
+
+static void ws_ie_index_get_wp(const struct ws_ie_index *ie, uint8_t id, struct iobuf_read *ie_buf, bool is_long)
+{
+    if (is_long && (ie->wp_long_present & (1u << id))) {
+        ws_ie_slot_get(ie->wp_base, &ie->wp_long[id], ie_buf);
+    } else if (!is_long && bittest(ie->wp_short_present, id)) {
+        ws_ie_slot_get(ie->wp_base, &ie->wp_short[id], ie_buf);
+    } else {
+        memset(ie_buf, 0, sizeof(*ie_buf));
+        ie_buf->err = true;
+    }
+}
+
+bool ws_wh_utt_read(const struct ws_ie_index *ie, struct ws_utt_ie *utt_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_UTT, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_UTT, &ie_buf);
     utt_ie->message_type = iobuf_pop_u8(&ie_buf);
     utt_ie->ufsi         = iobuf_pop_le24(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_bt_read(const uint8_t *data, uint16_t length, struct ws_bt_ie *bt_ie)
+bool ws_wh_bt_read(const struct ws_ie_index *ie, struct ws_bt_ie *bt_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_BT, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_BT, &ie_buf);
     bt_ie->broadcast_slot_number     = iobuf_pop_le16(&ie_buf);
     bt_ie->broadcast_interval_offset = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_fc_read(const uint8_t *data, uint16_t length, struct ws_fc_ie *fc_ie)
+bool ws_wh_fc_read(const struct ws_ie_index *ie, struct ws_fc_ie *fc_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_FC, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_FC, &ie_buf);
     fc_ie->tx_flow_ctrl = iobuf_pop_u8(&ie_buf);
     fc_ie->rx_flow_ctrl = iobuf_pop_u8(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_rsl_read(const uint8_t *data, uint16_t length, int *rsl)
+bool ws_wh_rsl_read(const struct ws_ie_index *ie, int *rsl)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_RSL, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_RSL, &ie_buf);
     // Wi-SUN FAN 1.1v07 - 6.3.2.3.1.4 Received Signal Level Information Element
     // The RSL field MUST be set to the 8 bit unsigned value (units of dB)
     // calculated as specified in section 6.2.3.1.6.1.
@@ -641,61 +745,61 @@ bool ws_wh_rsl_read(const uint8_t *data, uint16_t length, int *rsl)
     return !ie_buf.err;
 }
 
-bool ws_wh_ea_read(const uint8_t *data, uint16_t length, uint8_t eui64[8])
+bool ws_wh_ea_read(const struct ws_ie_index *ie, uint8_t eui64[8])
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_EA, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_EA, &ie_buf);
     iobuf_pop_data(&ie_buf, eui64, 8);
     return !ie_buf.err;
 }
 
-bool ws_wh_lutt_read(const uint8_t *data, uint16_t length, struct ws_lutt_ie *lutt_ie)
+bool ws_wh_lutt_read(const struct ws_ie_index *ie, struct ws_lutt_ie *lutt_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LUTT, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LUTT, &ie_buf);
     lutt_ie->message_type    = iobuf_pop_u8(&ie_buf);
     lutt_ie->slot_number     = iobuf_pop_le16(&ie_buf);
     lutt_ie->interval_offset = iobuf_pop_le24(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_lus_read(const uint8_t *data, uint16_t length, struct ws_lus_ie *lus_ie)
+bool ws_wh_lus_read(const struct ws_ie_index *ie, struct ws_lus_ie *lus_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LUS, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LUS, &ie_buf);
     lus_ie->listen_interval  = iobuf_pop_le24(&ie_buf);
     lus_ie->channel_plan_tag = iobuf_pop_u8(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_flus_read(const uint8_t *data, uint16_t length, struct ws_flus_ie *flus_ie)
+bool ws_wh_flus_read(const struct ws_ie_index *ie, struct ws_flus_ie *flus_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_FLUS, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_FLUS, &ie_buf);
     flus_ie->dwell_interval   = iobuf_pop_u8(&ie_buf);
     flus_ie->channel_plan_tag = iobuf_pop_u8(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_lbt_read(const uint8_t *data, uint16_t length, struct ws_lbt_ie *lbt_ie)
+bool ws_wh_lbt_read(const struct ws_ie_index *ie, struct ws_lbt_ie *lbt_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LBT, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LBT, &ie_buf);
     lbt_ie->slot_number     = iobuf_pop_le16(&ie_buf);
     lbt_ie->interval_offset = iobuf_pop_le24(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_lbs_read(const uint8_t *data, uint16_t length, struct ws_lbs_ie *lbs_ie)
+bool ws_wh_lbs_read(const struct ws_ie_index *ie, struct ws_lbs_ie *lbs_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LBS, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LBS, &ie_buf);
     lbs_ie->broadcast_interval     = iobuf_pop_le24(&ie_buf);
     lbs_ie->broadcast_scheduler_id = iobuf_pop_le16(&ie_buf);
     lbs_ie->channel_plan_tag       = iobuf_pop_u8(&ie_buf);
@@ -703,11 +807,11 @@ bool ws_wh_lbs_read(const uint8_t *data, uint16_t length, struct ws_lbs_ie *lbs_
     return !ie_buf.err;
 }
 
-bool ws_wh_nr_read(const uint8_t *data, uint16_t length, struct ws_nr_ie *nr_ie)
+bool ws_wh_nr_read(const struct ws_ie_index *ie, struct ws_nr_ie *nr_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_NR, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_NR, &ie_buf);
     nr_ie->node_role       = FIELD_GET(WS_WHIE_NR_NODE_ROLE_ID_MASK, iobuf_pop_u8(&ie_buf));
     nr_ie->clock_drift     = iobuf_pop_u8(&ie_buf);
     nr_ie->timing_accuracy = iobuf_pop_u8(&ie_buf);
@@ -718,11 +822,11 @@ bool ws_wh_nr_read(const uint8_t *data, uint16_t length, struct ws_nr_ie *nr_ie)
     return !ie_buf.err;
 }
 
-bool ws_wh_lnd_read(const uint8_t *data, uint16_t length, struct ws_lnd_ie *lnd_ie)
+bool ws_wh_lnd_read(const struct ws_ie_index *ie, struct ws_lnd_ie *lnd_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LND, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LND, &ie_buf);
     lnd_ie->response_threshold   = iobuf_pop_u8(&ie_buf);
     lnd_ie->response_delay       = iobuf_pop_le24(&ie_buf);
     lnd_ie->discovery_slot_time  = iobuf_pop_u8(&ie_buf);
@@ -731,30 +835,30 @@ bool ws_wh_lnd_read(const uint8_t *data, uint16_t length, struct ws_lnd_ie *lnd_
     return !ie_buf.err;
 }
 
-bool ws_wh_lto_read(const uint8_t *data, uint16_t length, struct ws_lto_ie *lto_ie)
+bool ws_wh_lto_read(const struct ws_ie_index *ie, struct ws_lto_ie *lto_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LTO, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LTO, &ie_buf);
     lto_ie->offset                      = iobuf_pop_le24(&ie_buf);
     lto_ie->adjusted_listening_interval = iobuf_pop_le24(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_panid_read(const uint8_t *data, uint16_t length, struct ws_panid_ie *panid_ie)
+bool ws_wh_panid_read(const struct ws_ie_index *ie, struct ws_panid_ie *panid_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_PANID, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_PANID, &ie_buf);
     panid_ie->panid = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wh_lbc_read(const uint8_t *data, uint16_t length, struct ws_lbc_ie *lbc_ie)
+bool ws_wh_lbc_read(const struct ws_ie_index *ie, struct ws_lbc_ie *lbc_ie)
 {
     struct iobuf_read ie_buf;
 
-    ws_wh_find_subid(data, length, WS_WHIE_LBC, &ie_buf);
+    ws_ie_index_get_wh(ie, WS_WHIE_LBC, &ie_buf);
     lbc_ie->lfn_broadcast_interval = iobuf_pop_le24(&ie_buf);
     lbc_ie->broadcast_sync_period  = iobuf_pop_u8(&ie_buf);
     return !ie_buf.err;
@@ -827,12 +931,12 @@ static void ws_channel_excluded_read(struct iobuf_read *ie_buf, struct ws_generi
     }
 }
 
-bool ws_wp_nested_us_read(const uint8_t *data, uint16_t length, struct ws_us_ie *us_ie)
+bool ws_wp_nested_us_read(const struct ws_ie_index *ie, struct ws_us_ie *us_ie)
 {
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_US, &ie_buf, true);
+    ws_ie_index_get_wp(ie, WS_WPIE_US, &ie_buf, true);
     us_ie->dwell_interval  = iobuf_pop_u8(&ie_buf);
     us_ie->clock_drift     = iobuf_pop_u8(&ie_buf);
     us_ie->timing_accuracy = iobuf_pop_u8(&ie_buf);
@@ -846,12 +950,12 @@ bool ws_wp_nested_us_read(const uint8_t *data, uint16_t length, struct ws_us_ie
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_bs_read(const uint8_t *data, uint16_t length, struct ws_bs_ie *bs_ie)
+bool ws_wp_nested_bs_read(const struct ws_ie_index *ie, struct ws_bs_ie *bs_ie)
 {
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_BS, &ie_buf, true);
+    ws_ie_index_get_wp(ie, WS_WPIE_BS, &ie_buf, true);
     bs_ie->broadcast_interval            = iobuf_pop_le32(&ie_buf);
     bs_ie->broadcast_schedule_identifier = iobuf_pop_le16(&ie_buf);
     bs_ie->dwell_interval                = iobuf_pop_u8(&ie_buf);
@@ -867,12 +971,12 @@ bool ws_wp_nested_bs_read(const uint8_t *data, uint16_t length, struct ws_bs_ie
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_pan_read(const uint8_t *data, uint16_t length, struct ws_pan_ie *pan_ie)
+bool ws_wp_nested_pan_read(const struct ws_ie_index *ie, struct ws_pan_ie *pan_ie)
 {
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PAN, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_PAN, &ie_buf, false);
     pan_ie->pan_size = iobuf_pop_le16(&ie_buf);
     pan_ie->routing_cost = iobuf_pop_le16(&ie_buf);
     tmp8 = iobuf_pop_u8(&ie_buf);
@@ -883,29 +987,29 @@ bool ws_wp_nested_pan_read(const uint8_t *data, uint16_t length, struct ws_pan_i
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_panver_read(const uint8_t *data, uint16_t length, uint16_t *pan_version)
+bool ws_wp_nested_panver_read(const struct ws_ie_index *ie, uint16_t *pan_version)
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PANVER, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_PANVER, &ie_buf, false);
     *pan_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_gtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t gtkhash[4])
+bool ws_wp_nested_gtkhash_read(const struct ws_ie_index *ie, gtkhash_t gtkhash[4])
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_GTKHASH, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_GTKHASH, &ie_buf, false);
     iobuf_pop_data(&ie_buf, (uint8_t *)gtkhash, 4 * 8);
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_netname_read(const uint8_t *data, uint16_t length, struct ws_wp_netname *network_name)
+bool ws_wp_nested_netname_read(const struct ws_ie_index *ie, struct ws_wp_netname *network_name)
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_NETNAME, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_NETNAME, &ie_buf, false);
     network_name->network_name_length = iobuf_remaining_size(&ie_buf);
     network_name->network_name = iobuf_ptr(&ie_buf);
     if (network_name->network_name_length > 32)
@@ -913,12 +1017,12 @@ bool ws_wp_nested_netname_read(const uint8_t *data, uint16_t length, struct ws_w
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_pom_read(const uint8_t *data, uint16_t length, struct ws_pom_ie *pom_ie)
+bool ws_wp_nested_pom_read(const struct ws_ie_index *ie, struct ws_pom_ie *pom_ie)
 {
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_POM, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_POM, &ie_buf, false);
     tmp8 = iobuf_pop_u8(&ie_buf);
     pom_ie->phy_op_mode_number  = FIELD_GET(WS_WPIE_POM_PHY_OP_MODE_NUMBER_MASK, tmp8);
     pom_ie->mdr_command_capable = FIELD_GET(WS_WPIE_POM_MDR_CAPABLE_MASK,        tmp8);
@@ -926,25 +1030,27 @@ bool ws_wp_nested_pom_read(const uint8_t *data, uint16_t length, struct ws_pom_i
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_lfnver_read(const uint8_t *data, uint16_t length, struct ws_lfnver_ie *ws_lfnver)
+bool ws_wp_nested_lfnver_read(const struct ws_ie_index *ie, struct ws_lfnver_ie *ws_lfnver)
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LFNVER, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_LFNVER, &ie_buf, false);
     ws_lfnver->lfn_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_lgtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t lgtkhash[3], unsigned *active_lgtk_index)
+bool ws_wp_nested_lgtkhash_read(const struct ws_ie_index *ie, gtkhash_t lgtkhash[3], unsigned *active_lgtk_index)
 {
     struct iobuf_read ie_buf;
     unsigned valid_hashs;
+    uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LGTKHASH, &ie_buf, false);
+    ws_ie_index_get_wp(ie, WS_WPIE_LGTKHASH, &ie_buf, false);
+    tmp8 = iobuf_pop_u8(&ie_buf);
     valid_hashs = FIELD_GET(WS_WPIE_LGTKHASH_INCLUDE_LGTK0_MASK |
                             WS_WPIE_LGTKHASH_INCLUDE_LGTK1_MASK |
-                            WS_WPIE_LGTKHASH_INCLUDE_LGTK2_MASK, *data);
-    *active_lgtk_index = FIELD_GET(WS_WPIE_LGTKHASH_ACTIVE_INDEX_MASK, *data);
+                            WS_WPIE_LGTKHASH_INCLUDE_LGTK2_MASK, tmp8);
+    *active_lgtk_index = FIELD_GET(WS_WPIE_LGTKHASH_ACTIVE_INDEX_MASK, tmp8);
     for (int i = 0; i < 3; i++) {
         if (valid_hashs & (1 << i))
             iobuf_pop_data(&ie_buf, lgtkhash[i], 8);
@@ -954,41 +1060,34 @@ bool ws_wp_nested_lgtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t
     return !ie_buf.err;
 }
 
-bool ws_wp_nested_lbats_read(const uint8_t *data, uint16_t length, struct ws_lbats_ie *lbats_ie)
+bool ws_wp_nested_lbats_read(const struct ws_ie_index *ie, struct ws_lbats_ie *lbats_ie)
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LBATS, &ie_buf, true);
+    ws_ie_index_get_wp(ie, WS_WPIE_LBATS, &ie_buf, true);
     lbats_ie->additional_transmissions = iobuf_pop_u8(&ie_buf);
     lbats_ie->next_transmit_delay      = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
 
 // LCP-IE can appear several times with different tag values
-static void ws_wp_nested_lcp_find_tag(const uint8_t *data, uint16_t length, uint8_t tag, struct iobuf_read *ie_content)
+static void ws_wp_nested_lcp_find_tag(const struct ws_ie_index *ie, uint8_t tag, struct iobuf_read *ie_content)
 {
-    const uint8_t *end = data + length;
-
-    do {
-        ieee802154_ie_find_nested(data, length, WS_WPIE_LCP, ie_content, true);
-        if (iobuf_pop_u8(ie_content) == tag) {
-            ie_content->cnt = 0;
+    for (int i = 0; i < ie->lcp_cnt; i++) {
+        ws_ie_slot_get(ie->wp_base, &ie->lcp[i], ie_content);
+        if (ie->lcp[i].len && ie_content->data[0] == tag)
             return;
-        }
-        if (ie_content->err)
-            return;
-        length -= ie_content->data + ie_content->data_size - data;
-        data = ie_content->data + ie_content->data_size;
-    } while (data < end);
+    }
+    memset(ie_content, 0, sizeof(*ie_content));
     ie_content->err = true;
 }
 
-bool ws_wp_nested_lcp_read(const uint8_t *data, uint16_t length, uint8_t tag, struct ws_lcp_ie *ws_lcp)
+bool ws_wp_nested_lcp_read(const struct ws_ie_index *ie, uint8_t tag, struct ws_lcp_ie *ws_lcp)
 {
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ws_wp_nested_lcp_find_tag(data, length, tag, &ie_buf);
+    ws_wp_nested_lcp_find_tag(ie, tag, &ie_buf);
     ws_lcp->lfn_channel_plan_tag = iobuf_pop_u8(&ie_buf);
     tmp8 = iobuf_pop_u8(&ie_buf);
     ws_lcp->chan_plan.channel_plan          = FIELD_GET(WS_WPIE_SCHEDULE_CHAN_PLAN_MASK,     tmp8);
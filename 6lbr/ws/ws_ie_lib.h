@@ -23,6 +23,7 @@
 #include "common/int24.h"
 #include "security/protocols/sec_prot.h"
 
+struct iobuf_read;
 struct iobuf_write;
 struct ws_fhss_config;
 struct ws_phy_config;
@@ -242,22 +243,57 @@ void ws_wh_panid_write(struct iobuf_write *buf, uint16_t panid);
 void   ws_wh_lbc_write(struct iobuf_write *buf, uint24_t interval, uint8_t sync_period);
 
 
-bool ws_wh_utt_read(const uint8_t *data, uint16_t length, struct ws_utt_ie *utt_ie);
-bool ws_wh_bt_read(const uint8_t *data, uint16_t length, struct ws_bt_ie *bt_ie);
-bool ws_wh_fc_read(const uint8_t *data, uint16_t length, struct ws_fc_ie *fc_ie);
-bool ws_wh_rsl_read(const uint8_t *data, uint16_t length, int *rsl);
-bool ws_wh_ea_read(const uint8_t *data, uint16_t length, uint8_t eui64[8]);
+/*
+ * Location of the Wi-SUN IEs of a received frame, built with a single pass
+ * over the IE lists by ws_ie_index_build(). The ws_*_read() functions then
+ * retrieve their IE in constant time, instead of scanning the lists again.
+ *
+ * Only the first occurrence of an IE is indexed, except for LCP-IE which can
+ * appear several times with different tags. Only the slots flagged in the
+ * bitmaps are initialized, so building the index does not depend on its
+ * size.
+ */
+#define WS_IE_INDEX_LCP_MAX 8
+
+struct ws_ie_slot {
+    uint16_t offset; // From the start of the IE list
+    uint16_t len;
+};
+
+struct ws_ie_index {
+    const uint8_t *wh_base;     // Header IE list
+    const uint8_t *wp_base;     // Content of the WP-IE
+    bool has_wp;
+    uint8_t wh_present[256 / 8];
+    uint8_t wp_short_present[128 / 8];
+    uint16_t wp_long_present;
+    struct ws_ie_slot wh[256];  // Indexed by sub-ID, content after the sub-ID
+    struct ws_ie_slot wp_short[128];
+    struct ws_ie_slot wp_long[16];
+    struct ws_ie_slot lcp[WS_IE_INDEX_LCP_MAX];
+    int lcp_cnt;
+};
+
+void ws_ie_index_build(struct ws_ie_index *ie,
+                       const uint8_t *header_ies, uint16_t header_len,
+                       const uint8_t *payload_ies, uint16_t payload_len);
+
+bool ws_wh_utt_read(const struct ws_ie_index *ie, struct ws_utt_ie *utt_ie);
+bool ws_wh_bt_read(const struct ws_ie_index *ie, struct ws_bt_ie *bt_ie);
+bool ws_wh_fc_read(const struct ws_ie_index *ie, struct ws_fc_ie *fc_ie);
+bool ws_wh_rsl_read(const struct ws_ie_index *ie, int *rsl);
+bool ws_wh_ea_read(const struct ws_ie_index *ie, uint8_t eui64[8]);
 /*Wi-SUN FAN 1.1 */
-bool ws_wh_lutt_read(const uint8_t *data, uint16_t length, struct ws_lutt_ie *lutt_ie);
-bool ws_wh_lus_read(const uint8_t *data, uint16_t length, struct ws_lus_ie *lus_ie);
-bool ws_wh_flus_read(const uint8_t *data, uint16_t length, struct ws_flus_ie *flus_ie);
-bool ws_wh_lbt_read(const uint8_t *data, uint16_t length, struct ws_lbt_ie *lbt_ie);
-bool ws_wh_lbs_read(const uint8_t *data, uint16_t length, struct ws_lbs_ie *lbs_ie);
-bool ws_wh_lbc_read(const uint8_t *data, uint16_t length, struct ws_lbc_ie *lbc_ie);
-bool ws_wh_nr_read(const uint8_t *data, uint16_t length, struct ws_nr_ie *nr_ie);
-bool ws_wh_lnd_read(const uint8_t *data, uint16_t length, struct ws_lnd_ie *lnd_ie);
-bool ws_wh_lto_read(const uint8_t *data, uint16_t length, struct ws_lto_ie *lto_ie);
-bool ws_wh_panid_read(const uint8_t *data, uint16_t length, struct ws_panid_ie *panid_ie);
+bool ws_wh_lutt_read(const struct ws_ie_index *ie, struct ws_lutt_ie *lutt_ie);
+bool ws_wh_lus_read(const struct ws_ie_index *ie, struct ws_lus_ie *lus_ie);
+bool ws_wh_flus_read(const struct ws_ie_index *ie, struct ws_flus_ie *flus_ie);
+bool ws_wh_lbt_read(const struct ws_ie_index *ie, struct ws_lbt_ie *lbt_ie);
+bool ws_wh_lbs_read(const struct ws_ie_index *ie, struct ws_lbs_ie *lbs_ie);
+bool ws_wh_lbc_read(const struct ws_ie_index *ie, struct ws_lbc_ie *lbc_ie);
+bool ws_wh_nr_read(const struct ws_ie_index *ie, struct ws_nr_ie *nr_ie);
+bool ws_wh_lnd_read(const struct ws_ie_index *ie, struct ws_lnd_ie *lnd_ie);
+bool ws_wh_lto_read(const struct ws_ie_index *ie, struct ws_lto_ie *lto_ie);
+bool ws_wh_panid_read(const struct ws_ie_index *ie, struct ws_panid_ie *panid_ie);
 
 /* WS_WP_NESTED PAYLOD IE */
 void       ws_wp_nested_us_write(struct iobuf_write *buf, const struct ws_phy_config *phy_config, const struct ws_fhss_config *fhss_config);
@@ -275,18 +311,18 @@ void ws_wp_nested_lgtkhash_write(struct iobuf_write *buf, const gtkhash_t lgtkha
 void      ws_wp_nested_lcp_write(struct iobuf_write *buf, uint8_t tag, struct ws_phy_config *phy_config, const struct ws_fhss_config *fhss_config);
 void       ws_wp_nested_jm_write(struct iobuf_write *buf, const struct ws_jm_ie *jm);
 
-bool ws_wp_nested_us_read(const uint8_t *data, uint16_t length, struct ws_us_ie *us_ie);
-bool ws_wp_nested_bs_read(const uint8_t *data, uint16_t length, struct ws_bs_ie *bs_ie);
-bool ws_wp_nested_pan_read(const uint8_t *data, uint16_t length, struct ws_pan_ie *pan_ie);
-bool ws_wp_nested_panver_read(const uint8_t *data, uint16_t length, uint16_t *pan_version);
-bool ws_wp_nested_netname_read(const uint8_t *data, uint16_t length, struct ws_wp_netname *network_name);
-bool ws_wp_nested_gtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t gtkhash[4]);
+bool ws_wp_nested_us_read(const struct ws_ie_index *ie, struct ws_us_ie *us_ie);
+bool ws_wp_nested_bs_read(const struct ws_ie_index *ie, struct ws_bs_ie *bs_ie);
+bool ws_wp_nested_pan_read(const struct ws_ie_index *ie, struct ws_pan_ie *pan_ie);
+bool ws_wp_nested_panver_read(const struct ws_ie_index *ie, uint16_t *pan_version);
+bool ws_wp_nested_netname_read(const struct ws_ie_index *ie, struct ws_wp_netname *network_name);
+bool ws_wp_nested_gtkhash_read(const struct ws_ie_index *ie, gtkhash_t gtkhash[4]);
 /* Wi-SUN FAN 1.1 */
-bool ws_wp_nested_pom_read(const uint8_t *data, uint16_t length, struct ws_pom_ie *pom_ie);
-bool ws_wp_nested_lbats_read(const uint8_t *data, uint16_t length, struct ws_lbats_ie *lbats_ie);
-bool ws_wp_nested_lfnver_read(const uint8_t *data, uint16_t length, struct ws_lfnver_ie *ws_lfnver);
-bool ws_wp_nested_lgtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t lgtkhash[3], unsigned *active_lgtk_index);
-bool ws_wp_nested_lcp_read(const uint8_t *data, uint16_t length, uint8_t tag, struct ws_lcp_ie *ws_lcp_ie);
+bool ws_wp_nested_pom_read(const struct ws_ie_index *ie, struct ws_pom_ie *pom_ie);
+bool ws_wp_nested_lbats_read(const struct ws_ie_index *ie, struct ws_lbats_ie *lbats_ie);
+bool ws_wp_nested_lfnver_read(const struct ws_ie_index *ie, struct ws_lfnver_ie *ws_lfnver);
+bool ws_wp_nested_lgtkhash_read(const struct ws_ie_index *ie, gtkhash_t lgtkhash[3], unsigned *active_lgtk_index);
+bool ws_wp_nested_lcp_read(const struct ws_ie_index *ie, uint8_t tag, struct ws_lcp_ie *ws_lcp_ie);
 
 
 #endif
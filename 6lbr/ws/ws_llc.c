@@ -40,6 +40,7 @@
 #include "common/specs/ws.h"
 #include "common/random_early_detection.h"
 
+#include "app/dbus.h"
 #include "app/wsbr.h"
 #include "app/wsbr_mac.h"
 #include "app/rcp_api_legacy.h"
@@ -336,7 +337,7 @@ static void ws_llc_eapol_confirm(struct llc_data_base *base, struct llc_message
 
     mlme_status = mlme_status_from_hif(confirm->hif.status);
     if (ws_neigh && mlme_status == MLME_SUCCESS)
-        ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
+        ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
 
     mpx_usr = ws_llc_mpx_user_discover(&base->mpx_data_base, MPX_ID_KMP);
     if (mpx_usr && mpx_usr->data_confirm) {
@@ -431,6 +432,7 @@ static void ws_llc_data_confirm(struct llc_data_base *base, struct llc_message *
     struct mcps_data_cnf mpx_confirm;
     struct mpx_user *mpx_usr;
     struct ws_lutt_ie ie_lutt;
+    struct ws_ie_index ie;
     struct ws_utt_ie ie_utt;
     int ie_rsl;
 
@@ -442,16 +444,18 @@ static void ws_llc_data_confirm(struct llc_data_base *base, struct llc_message *
                 break;
             if (ws_neigh->lifetime_s == WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME)
                 break;
-            if (ws_wh_utt_read(confirm_data->headerIeList, confirm_data->headerIeListLength, &ie_utt)) {
+            ws_ie_index_build(&ie, confirm_data->headerIeList, confirm_data->headerIeListLength,
+                              confirm_data->payloadIeList, confirm_data->payloadIeListLength);
+            if (ws_wh_utt_read(&ie, &ie_utt)) {
                 if (mlme_status == MLME_SUCCESS)
-                    ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
+                    ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
                 ws_neigh_ut_update(&ws_neigh->fhss_data, ie_utt.ufsi, confirm->hif.timestamp_us, ws_neigh->mac64);
                 ws_neigh_ut_update(&ws_neigh->fhss_data_unsecured, ie_utt.ufsi, confirm->hif.timestamp_us, ws_neigh->mac64);
             }
-            if (ws_wh_lutt_read(confirm_data->headerIeList, confirm_data->headerIeListLength, &ie_lutt))
+            if (ws_wh_lutt_read(&ie, &ie_lutt))
                 if (mlme_status == MLME_SUCCESS)
-                    ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
-            if (ws_wh_rsl_read(confirm_data->headerIeList, confirm_data->headerIeListLength, &ie_rsl)) {
+                    ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
+            if (ws_wh_rsl_read(&ie, &ie_rsl)) {
                 ws_neigh->rsl_out_dbm = ws_common_rsl_calc(ws_neigh->rsl_out_dbm, ie_rsl);
                 rate = ws_llc_success_rate(msg->rate_list, confirm->hif.tx_retries + 1);
                 ws_llc_update_txpow(ws_info, ws_neigh,
@@ -602,14 +606,14 @@ static mpx_user_t *ws_llc_mpx_header_parse(llc_data_base_t *base,
 }
 
 static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *data,
-                                const struct mcps_data_rx_ie_list *ie_ext)
+                                const struct mcps_data_rx_ie_list *ie_ext,
+                                const struct ws_ie_index *ie)
 {
     llc_data_base_t *base = ws_llc_mpx_frame_common_validates(net_if, data, WS_FT_DATA);
     struct ws_neigh *ws_neigh;
     mcps_data_ind_t data_ind = *data;
     bool has_us, has_bs, has_pom;
     struct ws_utt_ie ie_utt;
-    struct iobuf_read ie_wp;
     struct ws_pom_ie ie_pom;
     struct ws_us_ie ie_us;
     struct ws_bs_ie ie_bs;
@@ -628,14 +632,12 @@ static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *da
         return;
     }
 
-    ieee802154_ie_find_payload(ie_ext->payloadIeList, ie_ext->payloadIeListLength, IEEE802154_IE_ID_WP, &ie_wp);
-    has_us = ws_wp_nested_us_read(ie_wp.data, ie_wp.data_size, &ie_us);
-    has_bs = ws_wp_nested_bs_read(ie_wp.data, ie_wp.data_size, &ie_bs);
-    has_pom = ws_wp_nested_pom_read(ie_wp.data, ie_wp.data_size, &ie_pom);
+    has_us = ws_wp_nested_us_read(ie, &ie_us);
+    has_bs = ws_wp_nested_bs_read(ie, &ie_bs);
+    has_pom = ws_wp_nested_pom_read(ie, &ie_pom);
 
     if (has_us && !ws_ie_validate_us(&base->interface_ptr->ws_info, &ie_us))
         return;
-    has_bs = ws_wp_nested_bs_read(ie_wp.data, ie_wp.data_size, &ie_bs);
     if (has_bs && !ws_ie_validate_bs(&base->interface_ptr->ws_info, &ie_bs))
         return;
 
@@ -661,7 +663,7 @@ static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *da
             return;
         }
 
-        if (!ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_utt))
+        if (!ws_wh_utt_read(ie, &ie_utt))
             BUG("missing UTT-IE in data frame from FFN");
         ws_neigh_ut_update(&ws_neigh->fhss_data, ie_utt.ufsi, data->hif.timestamp_us, data->SrcAddr);
         ws_neigh_ut_update(&ws_neigh->fhss_data_unsecured, ie_utt.ufsi, data->hif.timestamp_us, data->SrcAddr);
@@ -683,9 +685,10 @@ static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *da
         ws_neigh->lqi_unsecured = data->hif.lqi;
 
         if (data->Key.SecurityLevel)
-            ws_neigh_trust(ws_neigh);
-        if (has_pom && base->interface_ptr->ws_info.phy_config.phy_op_modes[0])
-            ws_neigh->pom_ie = ie_pom;
+            ws_neigh_trust(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh);
+        if (has_pom && base->interface_ptr->ws_info.phy_config.phy_op_modes[0] &&
+            ws_neigh_pom_update(ws_neigh, &ie_pom))
+            dbus_emit_nodes_change(&g_ctxt, ws_neigh->mac64);
     }
 
     if (!ws_neigh)
@@ -696,14 +699,14 @@ static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *da
 }
 
 static void ws_llc_data_lfn_ind(const struct net_if *net_if, const mcps_data_ind_t *data,
-                                const struct mcps_data_rx_ie_list *ie_ext)
+                                const struct mcps_data_rx_ie_list *ie_ext,
+                                const struct ws_ie_index *ie)
 {
     llc_data_base_t *base = ws_llc_mpx_frame_common_validates(net_if, data, WS_FT_DATA);
     struct ws_neigh *ws_neigh;
     mcps_data_ind_t data_ind = *data;
     bool has_lus, has_lcp, has_pom;
     struct ws_lutt_ie ie_lutt;
-    struct iobuf_read ie_wp;
     struct ws_lus_ie ie_lus;
     struct ws_lcp_ie ie_lcp;
     struct ws_pom_ie ie_pom;
@@ -717,13 +720,11 @@ static void ws_llc_data_lfn_ind(const struct net_if *net_if, const mcps_data_ind
         return;
 
     // TODO: Factorize this code with LPCS and EAPOL LFN indication
-    has_lus = ws_wh_lus_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lus);
-    ieee802154_ie_find_payload(ie_ext->payloadIeList, ie_ext->payloadIeListLength, IEEE802154_IE_ID_WP, &ie_wp);
-    has_pom = ws_wp_nested_pom_read(ie_wp.data, ie_wp.data_size, &ie_pom);
+    has_lus = ws_wh_lus_read(ie, &ie_lus);
+    has_pom = ws_wp_nested_pom_read(ie, &ie_pom);
     has_lcp = false;
     if (has_lus && ie_lus.channel_plan_tag != WS_CHAN_PLAN_TAG_CURRENT) {
-        has_lcp = ws_wp_nested_lcp_read(ie_ext->headerIeList, ie_ext->headerIeListLength,
-                                        ie_lus.channel_plan_tag, &ie_lcp);
+        has_lcp = ws_wp_nested_lcp_read(ie, ie_lus.channel_plan_tag, &ie_lcp);
         if (!has_lcp) {
             TRACE(TR_DROP, "drop %-9s: missing LCP-IE required by LUS-IE", tr_ws_frame(WS_FT_DATA));
             return;
@@ -744,7 +745,7 @@ static void ws_llc_data_lfn_ind(const struct net_if *net_if, const mcps_data_ind
         return;
     }
 
-    if (!ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lutt))
+    if (!ws_wh_lutt_read(ie, &ie_lutt))
         BUG("Missing LUTT-IE in ULAD frame from LFN");
     if (has_lus) {
         ws_neigh_lut_update(&ws_neigh->fhss_data, ie_lutt.slot_number, ie_lutt.interval_offset,
@@ -772,13 +773,13 @@ static void ws_llc_data_lfn_ind(const struct net_if *net_if, const mcps_data_ind
     ws_neigh->lqi_unsecured = data->hif.lqi;
 
     if (data->Key.SecurityLevel)
-        ws_neigh_trust(ws_neigh);
+        ws_neigh_trust(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh);
     if (ws_neigh->lifetime_s == WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME)
-        ws_neigh_refresh(ws_neigh, WS_NEIGHBOR_LINK_TIMEOUT);
+        ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, WS_NEIGHBOR_LINK_TIMEOUT);
     else
-        ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
-    if (has_pom)
-        ws_neigh->pom_ie = ie_pom;
+        ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
+    if (has_pom && ws_neigh_pom_update(ws_neigh, &ie_pom))
+        dbus_emit_nodes_change(&g_ctxt, ws_neigh->mac64);
 
     data_ind.msdu_ptr = mpx_frame.frame_ptr;
     data_ind.msduLength = mpx_frame.frame_length;
@@ -796,13 +797,13 @@ static struct ws_neigh *ws_llc_neigh_fetch(llc_data_base_t *base, const mcps_dat
 }
 
 static void ws_llc_eapol_ffn_ind(const struct net_if *net_if, const mcps_data_ind_t *data,
-                                 const struct mcps_data_rx_ie_list *ie_ext)
+                                 const struct mcps_data_rx_ie_list *ie_ext,
+                                 const struct ws_ie_index *ie)
 {
     llc_data_base_t *base = ws_llc_mpx_frame_common_validates(net_if, data, WS_FT_EAPOL);
     struct ws_neigh *ws_neigh = NULL;
     mcps_data_ind_t data_ind = *data;
     struct ws_utt_ie ie_utt;
-    struct iobuf_read ie_wp;
     struct ws_us_ie ie_us;
     struct ws_bs_ie ie_bs;
     mpx_user_t *mpx_user;
@@ -815,11 +816,10 @@ static void ws_llc_eapol_ffn_ind(const struct net_if *net_if, const mcps_data_in
     if (!mpx_user)
         return;
 
-    ieee802154_ie_find_payload(ie_ext->payloadIeList, ie_ext->payloadIeListLength, IEEE802154_IE_ID_WP, &ie_wp);
-    has_us = ws_wp_nested_us_read(ie_wp.data, ie_wp.data_size, &ie_us);
+    has_us = ws_wp_nested_us_read(ie, &ie_us);
     if (has_us && !ws_ie_validate_us(&base->interface_ptr->ws_info, &ie_us))
         return;
-    has_bs = ws_wp_nested_bs_read(ie_wp.data, ie_wp.data_size, &ie_bs);
+    has_bs = ws_wp_nested_bs_read(ie, &ie_bs);
     if (has_bs && !ws_ie_validate_bs(&base->interface_ptr->ws_info, &ie_bs))
         return;
 
@@ -827,12 +827,12 @@ static void ws_llc_eapol_ffn_ind(const struct net_if *net_if, const mcps_data_in
     if (!ws_neigh)
         return;
 
-    ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
+    ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
     ws_neigh->rsl_in_dbm_unsecured = ws_common_rsl_calc(ws_neigh->rsl_in_dbm_unsecured, data->hif.rx_power_dbm);
     ws_neigh->rx_power_dbm_unsecured = data->hif.rx_power_dbm;
     ws_neigh->lqi_unsecured = data->hif.lqi;
 
-    if (!ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_utt))
+    if (!ws_wh_utt_read(ie, &ie_utt))
         BUG("missing UTT-IE in EAPOL frame from FFN");
     ws_neigh_ut_update(&ws_neigh->fhss_data_unsecured, ie_utt.ufsi, data->hif.timestamp_us, data->SrcAddr);
     if (has_us)
@@ -845,14 +845,14 @@ static void ws_llc_eapol_ffn_ind(const struct net_if *net_if, const mcps_data_in
 }
 
 static void ws_llc_eapol_lfn_ind(const struct net_if *net_if, const mcps_data_ind_t *data,
-                                 const struct mcps_data_rx_ie_list *ie_ext)
+                                 const struct mcps_data_rx_ie_list *ie_ext,
+                                 const struct ws_ie_index *ie)
 {
     llc_data_base_t *base = ws_llc_mpx_frame_common_validates(net_if, data, WS_FT_EAPOL);
     struct ws_neigh *ws_neigh = NULL;
     mcps_data_ind_t data_ind = *data;
     struct ws_lutt_ie ie_lutt;
     struct ws_lus_ie ie_lus;
-    struct iobuf_read ie_wp;
     struct ws_lcp_ie ie_lcp;
     bool has_lus, has_lcp;
     mpx_user_t *mpx_user;
@@ -864,13 +864,11 @@ static void ws_llc_eapol_lfn_ind(const struct net_if *net_if, const mcps_data_in
     if (!mpx_user)
         return;
 
-    has_lus = ws_wh_lus_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lus);
-    ieee802154_ie_find_payload(ie_ext->payloadIeList, ie_ext->payloadIeListLength, IEEE802154_IE_ID_WP, &ie_wp);
+    has_lus = ws_wh_lus_read(ie, &ie_lus);
     has_lcp = false;
     // TODO: Factorize this code with LPCS and MPX LFN indication
     if (has_lus && ie_lus.channel_plan_tag != WS_CHAN_PLAN_TAG_CURRENT) {
-        has_lcp = ws_wp_nested_lcp_read(ie_ext->headerIeList, ie_ext->headerIeListLength,
-                                        ie_lus.channel_plan_tag, &ie_lcp);
+        has_lcp = ws_wp_nested_lcp_read(ie, ie_lus.channel_plan_tag, &ie_lcp);
         if (!has_lcp) {
             TRACE(TR_DROP, "drop %-9s: missing LCP-IE required by LUS-IE", tr_ws_frame(WS_FT_EAPOL));
             return;
@@ -883,12 +881,12 @@ static void ws_llc_eapol_lfn_ind(const struct net_if *net_if, const mcps_data_in
     if (!ws_neigh)
         return;
 
-    ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
+    ws_neigh_refresh(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh, ws_neigh->lifetime_s);
     ws_neigh->rsl_in_dbm_unsecured = ws_common_rsl_calc(ws_neigh->rsl_in_dbm_unsecured, data->hif.rx_power_dbm);
     ws_neigh->rx_power_dbm_unsecured = data->hif.rx_power_dbm;
     ws_neigh->lqi_unsecured = data->hif.lqi;
 
-    if (!ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lutt))
+    if (!ws_wh_lutt_read(ie, &ie_lutt))
         BUG("Missing LUTT-IE in EAPOL frame from LFN");
     if (has_lus) {
         ws_neigh_lut_update(&ws_neigh->fhss_data_unsecured, ie_lutt.slot_number, ie_lutt.interval_offset,
@@ -904,28 +902,18 @@ static void ws_llc_eapol_lfn_ind(const struct net_if *net_if, const mcps_data_in
 }
 
 static void ws_llc_mngt_ind(const struct net_if *net_if, const mcps_data_ind_t *data,
-                            const struct mcps_data_rx_ie_list *ie_ext, uint8_t frame_type)
+                            const struct ws_ie_index *ie, uint8_t frame_type)
 {
     struct llc_data_base *base = ws_llc_discover_by_interface(net_if);
-    struct mcps_data_rx_ie_list ie_list;
-    struct iobuf_read ie_buf;
 
     if (!base || !base->mngt_ind)
         return;
 
-    ieee802154_ie_find_payload(ie_ext->payloadIeList, ie_ext->payloadIeListLength, IEEE802154_IE_ID_WP, &ie_buf);
-    if (ie_buf.err) {
+    if (!ie->has_wp) {
         TRACE(TR_DROP, "drop %-9s: missing WP-IE", tr_ws_frame(frame_type));
         return;
     }
-
-    ie_list.headerIeList = ie_ext->headerIeList,
-    ie_list.headerIeListLength = ie_ext->headerIeListLength;
-    // FIXME: Despite the member being called "payloadIeList", we are storing
-    // the content of the WP-IE instead.
-    ie_list.payloadIeList       = ie_buf.data;
-    ie_list.payloadIeListLength = ie_buf.data_size;
-    base->mngt_ind(base->interface_ptr, data, &ie_list, frame_type);
+    base->mngt_ind(base->interface_ptr, data, ie, frame_type);
 }
 
 static const struct name_value ws_frames[] = {
@@ -968,7 +956,7 @@ static void ws_trace_llc_mac_req(const mcps_data_req_t *data, const llc_message_
 }
 
 static void ws_trace_llc_mac_ind(const mcps_data_ind_t *data,
-                                 const struct mcps_data_rx_ie_list *ie_ext)
+                                 const struct ws_ie_index *ie)
 {
     struct ws_lutt_ie ws_lutt;
     struct ws_utt_ie ws_utt;
@@ -976,9 +964,9 @@ static void ws_trace_llc_mac_ind(const mcps_data_ind_t *data,
     int message_type;
     int trace_domain;
 
-    if (ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ws_utt))
+    if (ws_wh_utt_read(ie, &ws_utt))
         message_type = ws_utt.message_type;
-    else if (ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ws_lutt))
+    else if (ws_wh_lutt_read(ie, &ws_lutt))
         message_type = ws_lutt.message_type;
     else
         message_type = -1;
@@ -1017,15 +1005,18 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
 {
     struct ws_neigh *neigh;
     struct ws_lutt_ie ie_lutt;
+    struct ws_ie_index ie;
     struct ws_utt_ie ie_utt;
     struct ws_fc_ie ie_fc;
     bool has_utt, has_lutt;
     uint8_t frame_type;
 
-    ws_trace_llc_mac_ind(data, ie_ext);
+    ws_ie_index_build(&ie, ie_ext->headerIeList, ie_ext->headerIeListLength,
+                      ie_ext->payloadIeList, ie_ext->payloadIeListLength);
+    ws_trace_llc_mac_ind(data, &ie);
 
-    has_utt  = ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_utt);
-    has_lutt = ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lutt);
+    has_utt  = ws_wh_utt_read(&ie, &ie_utt);
+    has_lutt = ws_wh_lutt_read(&ie, &ie_lutt);
     if (!has_utt && !has_lutt) {
         TRACE(TR_DROP, "drop %-9s: missing (L)UTT-IE", "15.4");
         return;
@@ -1054,7 +1045,7 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
     }
 
     // HACK: In FAN 1.0 the source address is elided in EDFE response frames
-    if (ws_wh_fc_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_fc)) {
+    if (ws_wh_fc_read(&ie, &ie_fc)) {
         if (data->SrcAddrMode == MAC_ADDR_MODE_64_BIT) {
             memcpy(net_if->ws_info.edfe_src, data->SrcAddr, 8);
         } else {
@@ -1064,17 +1055,17 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
     }
 
     if (ws_is_frame_mngt(frame_type)) {
-        ws_llc_mngt_ind(net_if, data, ie_ext, frame_type);
+        ws_llc_mngt_ind(net_if, data, &ie, frame_type);
     } else if (frame_type == WS_FT_DATA) {
         if (has_utt)
-            ws_llc_data_ffn_ind(net_if, data, ie_ext);
+            ws_llc_data_ffn_ind(net_if, data, ie_ext, &ie);
         else
-            ws_llc_data_lfn_ind(net_if, data, ie_ext);
+            ws_llc_data_lfn_ind(net_if, data, ie_ext, &ie);
     } else if (frame_type == WS_FT_EAPOL) {
         if (has_utt)
-            ws_llc_eapol_ffn_ind(net_if, data, ie_ext);
+            ws_llc_eapol_ffn_ind(net_if, data, ie_ext, &ie);
         else
-            ws_llc_eapol_lfn_ind(net_if, data, ie_ext);
+            ws_llc_eapol_lfn_ind(net_if, data, ie_ext, &ie);
     } else {
         TRACE(TR_DROP, "drop %-9s: unsupported frame type (0x%02x)", "15.4", frame_type);
     }
@@ -1919,7 +1910,7 @@ void ws_llc_timer_seconds(struct net_if *interface, uint16_t seconds_update)
         return;
     }
 
-    SLIST_FOREACH(entry, &interface->ws_info.neighbor_storage.neigh_list, link) {
+    LIST_FOREACH(entry, &interface->ws_info.neighbor_storage.neigh_list, link) {
         if (entry->eapol_temp_info.eapol_rx_relay_filter == 0) {
             //No active filter period
             continue;
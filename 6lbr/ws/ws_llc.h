@@ -29,6 +29,7 @@
 struct net_if;
 struct mcps_data_ind;
 struct mcps_data_rx_ie_list;
+struct ws_ie_index;
 struct ws_phy_config;
 struct ws_neigh;
 struct ws_neighbor_temp_class;
@@ -74,7 +75,7 @@ struct ws_llc_mngt_req {
     struct mlme_security security;
 };
 
-typedef void ws_llc_mngt_ind_cb(struct net_if *net_if, const struct mcps_data_ind *data, const struct mcps_data_rx_ie_list *ie, uint8_t frame_type);
+typedef void ws_llc_mngt_ind_cb(struct net_if *net_if, const struct mcps_data_ind *data, const struct ws_ie_index *ie, uint8_t frame_type);
 typedef void ws_llc_mngt_cnf_cb(struct net_if *net_if, uint8_t frame_type);
 
 int8_t ws_llc_create(struct net_if *interface,
@@ -20,6 +20,8 @@
 #include "common/mathutils.h"
 #include "common/specs/ws.h"
 
+#include "app/dbus.h"
+#include "app/wsbr.h"
 #include "net/timers.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "ws/ws_pan_info_storage.h"
@@ -31,11 +33,11 @@
 #include "ws/ws_llc.h"
 #include "net/protocol.h"
 
-static bool ws_mngt_ie_utt_validate(const struct mcps_data_rx_ie_list *ie_ext,
+static bool ws_mngt_ie_utt_validate(const struct ws_ie_index *ie,
                                     struct ws_utt_ie *ie_utt,
                                     uint8_t frame_type)
 {
-    if (!ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, ie_utt)) {
+    if (!ws_wh_utt_read(ie, ie_utt)) {
         TRACE(TR_DROP, "drop %-9s: missing UTT-IE", tr_ws_frame(frame_type));
         return false;
     }
@@ -44,12 +46,11 @@ static bool ws_mngt_ie_utt_validate(const struct mcps_data_rx_ie_list *ie_ext,
 }
 
 static bool ws_mngt_ie_us_validate(struct net_if *net_if,
-                                   const struct mcps_data_rx_ie_list *ie_ext,
+                                   const struct ws_ie_index *ie,
                                    struct ws_us_ie *ie_us,
                                    uint8_t frame_type)
 {
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_us_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, ie_us)) {
+    if (!ws_wp_nested_us_read(ie, ie_us)) {
         TRACE(TR_DROP, "drop %-9s: missing US-IE", tr_ws_frame(frame_type));
         return false;
     }
@@ -57,13 +58,12 @@ static bool ws_mngt_ie_us_validate(struct net_if *net_if,
 }
 
 static bool ws_mngt_ie_netname_validate(struct net_if *net_if,
-                                        const struct mcps_data_rx_ie_list *ie_ext,
+                                        const struct ws_ie_index *ie,
                                         uint8_t frame_type)
 {
     struct ws_wp_netname ie_netname;
 
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_netname_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, &ie_netname)) {
+    if (!ws_wp_nested_netname_read(ie, &ie_netname)) {
         TRACE(TR_DROP, "drop %-9s: missing NETNAME-IE", tr_ws_frame(frame_type));
         return false;
     }
@@ -72,16 +72,17 @@ static bool ws_mngt_ie_netname_validate(struct net_if *net_if,
 
 static void ws_mngt_ie_pom_handle(struct net_if *net_if,
                                   const struct mcps_data_ind *data,
-                                  const struct mcps_data_rx_ie_list *ie_ext)
+                                  const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh = ws_neigh_get(&net_if->ws_info.neighbor_storage, data->SrcAddr);
     struct ws_pom_ie ie_pom;
 
     if (!ws_neigh)
         return;
-    if (!ws_wp_nested_pom_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, &ie_pom))
+    if (!ws_wp_nested_pom_read(ie, &ie_pom))
         return;
-    ws_neigh->pom_ie = ie_pom;
+    if (ws_neigh_pom_update(ws_neigh, &ie_pom))
+        dbus_emit_nodes_change(&g_ctxt, ws_neigh->mac64);
 }
 
 static struct ws_neigh *ws_mngt_neigh_fetch(struct net_if *net_if, const uint8_t *mac64, uint8_t role)
@@ -95,23 +96,22 @@ static struct ws_neigh *ws_mngt_neigh_fetch(struct net_if *net_if, const uint8_t
 
 void ws_mngt_pa_analyze(struct net_if *net_if,
                         const struct mcps_data_ind *data,
-                        const struct mcps_data_rx_ie_list *ie_ext)
+                        const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh;
     struct ws_pan_ie ie_pan;
     struct ws_utt_ie ie_utt;
     struct ws_us_ie ie_us;
 
-    if (!ws_mngt_ie_utt_validate(ie_ext, &ie_utt, WS_FT_PA))
+    if (!ws_mngt_ie_utt_validate(ie, &ie_utt, WS_FT_PA))
         return;
-    if (!ws_mngt_ie_us_validate(net_if, ie_ext, &ie_us, WS_FT_PA))
+    if (!ws_mngt_ie_us_validate(net_if, ie, &ie_us, WS_FT_PA))
         return;
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_pan_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, &ie_pan)) {
+    if (!ws_wp_nested_pan_read(ie, &ie_pan)) {
         TRACE(TR_DROP, "drop %-9s: missing PAN-IE", tr_ws_frame(WS_FT_PA));
         return;
     }
-    if (!ws_mngt_ie_netname_validate(net_if, ie_ext, WS_FT_PA))
+    if (!ws_mngt_ie_netname_validate(net_if, ie, WS_FT_PA))
         return;
 
     if (data->SrcPANId != net_if->ws_info.pan_information.pan_id) {
@@ -119,7 +119,7 @@ void ws_mngt_pa_analyze(struct net_if *net_if,
         return;
     }
 
-    ws_mngt_ie_pom_handle(net_if, data, ie_ext);
+    ws_mngt_ie_pom_handle(net_if, data, ie);
     if (!ie_pan.use_parent_bs_ie)
         TRACE(TR_IGNORE, "ignore %-9s: unsupported local BS-IE", "15.4");
     if (!ie_pan.routing_method)
@@ -140,20 +140,20 @@ void ws_mngt_pa_analyze(struct net_if *net_if,
 
 void ws_mngt_pas_analyze(struct net_if *net_if,
                          const struct mcps_data_ind *data,
-                         const struct mcps_data_rx_ie_list *ie_ext)
+                         const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh;
     struct ws_utt_ie ie_utt;
     struct ws_us_ie ie_us;
 
-    if (!ws_mngt_ie_utt_validate(ie_ext, &ie_utt, WS_FT_PAS))
+    if (!ws_mngt_ie_utt_validate(ie, &ie_utt, WS_FT_PAS))
         return;
-    if (!ws_mngt_ie_us_validate(net_if, ie_ext, &ie_us, WS_FT_PAS))
+    if (!ws_mngt_ie_us_validate(net_if, ie, &ie_us, WS_FT_PAS))
         return;
-    if (!ws_mngt_ie_netname_validate(net_if, ie_ext, WS_FT_PAS))
+    if (!ws_mngt_ie_netname_validate(net_if, ie, WS_FT_PAS))
         return;
 
-    ws_mngt_ie_pom_handle(net_if, data, ie_ext);
+    ws_mngt_ie_pom_handle(net_if, data, ie);
     trickle_inconsistent_heard(&net_if->ws_info.mngt.trickle_pa,
                                &net_if->ws_info.mngt.trickle_params);
     ws_neigh = ws_mngt_neigh_fetch(net_if, data->SrcAddr, WS_NR_ROLE_ROUTER);
@@ -166,7 +166,7 @@ void ws_mngt_pas_analyze(struct net_if *net_if,
 
 void ws_mngt_pc_analyze(struct net_if *net_if,
                         const struct mcps_data_ind *data,
-                        const struct mcps_data_rx_ie_list *ie_ext)
+                        const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh;
     uint16_t ws_pan_version;
@@ -180,21 +180,19 @@ void ws_mngt_pc_analyze(struct net_if *net_if,
         return;
     }
 
-    if (!ws_mngt_ie_utt_validate(ie_ext, &ie_utt, WS_FT_PC))
+    if (!ws_mngt_ie_utt_validate(ie, &ie_utt, WS_FT_PC))
         return;
-    if (!ws_wh_bt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_bt)) {
+    if (!ws_wh_bt_read(ie, &ie_bt)) {
         TRACE(TR_DROP, "drop %-9s: missing BT-IE", tr_ws_frame(WS_FT_PC));
         return;
     }
-    if (!ws_mngt_ie_us_validate(net_if, ie_ext, &ie_us, WS_FT_PC))
+    if (!ws_mngt_ie_us_validate(net_if, ie, &ie_us, WS_FT_PC))
         return;
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_bs_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, &ie_bs)) {
+    if (!ws_wp_nested_bs_read(ie, &ie_bs)) {
         TRACE(TR_DROP, "drop %-9s: missing BS-IE", tr_ws_frame(WS_FT_PC));
         return;
     }
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_panver_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, &ws_pan_version)) {
+    if (!ws_wp_nested_panver_read(ie, &ws_pan_version)) {
         TRACE(TR_DROP, "drop %-9s: missing PANVER-IE", tr_ws_frame(WS_FT_PC));
         return;
     }
@@ -223,17 +221,17 @@ void ws_mngt_pc_analyze(struct net_if *net_if,
 
 void ws_mngt_pcs_analyze(struct net_if *net_if,
                          const struct mcps_data_ind *data,
-                         const struct mcps_data_rx_ie_list *ie_ext)
+                         const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh;
     struct ws_utt_ie ie_utt;
     struct ws_us_ie ie_us;
 
-    if (!ws_mngt_ie_utt_validate(ie_ext, &ie_utt, WS_FT_PCS))
+    if (!ws_mngt_ie_utt_validate(ie, &ie_utt, WS_FT_PCS))
         return;
-    if (!ws_mngt_ie_us_validate(net_if, ie_ext, &ie_us, WS_FT_PCS))
+    if (!ws_mngt_ie_us_validate(net_if, ie, &ie_us, WS_FT_PCS))
         return;
-    if (!ws_mngt_ie_netname_validate(net_if, ie_ext, WS_FT_PCS))
+    if (!ws_mngt_ie_netname_validate(net_if, ie, WS_FT_PCS))
         return;
 
     if (data->SrcPANId != net_if->ws_info.pan_information.pan_id) {
@@ -289,13 +287,12 @@ static void ws_mngt_lpa_schedule(struct net_if *net_if, struct ws_lnd_ie *ie_lnd
     // delays likely implies that the slot is missed and one of the later
     // slots is used instead (if any).
     memcpy(net_if->ws_info.mngt.lpa_dst, eui64, 8);
-    // Start timer
-    g_timers[WS_TIMER_LPA].timeout = timeout / WS_TIMER_GLOBAL_PERIOD_MS;
+    ws_timer_start_timeout(WS_TIMER_LPA, timeout);
 }
 
 void ws_mngt_lpas_analyze(struct net_if *net_if,
                           const struct mcps_data_ind *data,
-                          const struct mcps_data_rx_ie_list *ie_ext)
+                          const struct ws_ie_index *ie)
 {
     int fixed_channel = ws_common_get_fixed_channel(net_if->ws_info.fhss_config.uc_chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
@@ -307,31 +304,30 @@ void ws_mngt_lpas_analyze(struct net_if *net_if,
     struct ws_nr_ie ie_nr;
     bool add_neighbor;
 
-    if (g_timers[WS_TIMER_LPA].timeout) {
+    if (ws_timer_is_running(WS_TIMER_LPA)) {
         TRACE(TR_DROP, "drop %-9s: LPA already queued for %s",
               tr_ws_frame(WS_FT_LPAS), tr_eui64(net_if->ws_info.mngt.lpa_dst));
         return;
     }
 
-    if (!ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lutt)) {
+    if (!ws_wh_lutt_read(ie, &ie_lutt)) {
         TRACE(TR_DROP, "drop %-9s: missing LUTT-IE", tr_ws_frame(WS_FT_LPAS));
         return;
     }
     BUG_ON(ie_lutt.message_type != WS_FT_LPAS);
-    if (!ws_wh_lus_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lus)) {
+    if (!ws_wh_lus_read(ie, &ie_lus)) {
         TRACE(TR_DROP, "drop %-9s: missing LUS-IE", tr_ws_frame(WS_FT_LPAS));
         return;
     }
-    if (!ws_wh_nr_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_nr)) {
+    if (!ws_wh_nr_read(ie, &ie_nr)) {
         TRACE(TR_DROP, "drop %-9s: missing NR-IE", tr_ws_frame(WS_FT_LPAS));
         return;
     }
-    if (!ws_wh_lnd_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lnd)) {
+    if (!ws_wh_lnd_read(ie, &ie_lnd)) {
         TRACE(TR_DROP, "drop %-9s: missing LND-IE", tr_ws_frame(WS_FT_LPAS));
         return;
     }
-    // FIXME: see comment in ws_llc_mngt_ind
-    if (!ws_wp_nested_lcp_read(ie_ext->payloadIeList, ie_ext->payloadIeListLength, ie_lus.channel_plan_tag, &ie_lcp)) {
+    if (!ws_wp_nested_lcp_read(ie, ie_lus.channel_plan_tag, &ie_lcp)) {
         TRACE(TR_DROP, "drop %-9s: missing LCP-IE required by LUS-IE", tr_ws_frame(WS_FT_LPAS));
         return;
     }
@@ -341,7 +337,7 @@ void ws_mngt_lpas_analyze(struct net_if *net_if,
     }
     if (!ws_ie_validate_lcp(&net_if->ws_info, &ie_lcp))
         return;
-    if (!ws_mngt_ie_netname_validate(net_if, ie_ext, WS_FT_LPAS))
+    if (!ws_mngt_ie_netname_validate(net_if, ie, WS_FT_LPAS))
         return;
 
     // [...] an FFN MUST ignore the LPAS if [...]
@@ -404,7 +400,7 @@ void ws_mngt_lpc_pae_cb(struct net_if *net_if)
 
 void ws_mngt_lpcs_analyze(struct net_if *net_if,
                           const struct mcps_data_ind *data,
-                          const struct mcps_data_rx_ie_list *ie_ext)
+                          const struct ws_ie_index *ie)
 {
     struct ws_neigh *ws_neigh;
     struct ws_lutt_ie ie_lutt;
@@ -412,20 +408,19 @@ void ws_mngt_lpcs_analyze(struct net_if *net_if,
     struct ws_lcp_ie ie_lcp;
     bool has_lus, has_lcp;
 
-    if (!ws_wh_lutt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lutt)) {
+    if (!ws_wh_lutt_read(ie, &ie_lutt)) {
         TRACE(TR_DROP, "drop %-9s: missing LUTT-IE", tr_ws_frame(WS_FT_LPCS));
         return;
     }
     BUG_ON(ie_lutt.message_type != WS_FT_LPCS);
-    if (!ws_mngt_ie_netname_validate(net_if, ie_ext, WS_FT_LPCS))
+    if (!ws_mngt_ie_netname_validate(net_if, ie, WS_FT_LPCS))
         return;
 
     // TODO: Factorize this code with EAPOL and MPX LFN indication
-    has_lus = ws_wh_lus_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_lus);
+    has_lus = ws_wh_lus_read(ie, &ie_lus);
     has_lcp = false;
     if (has_lus && ie_lus.channel_plan_tag != WS_CHAN_PLAN_TAG_CURRENT) {
-        has_lcp = ws_wp_nested_lcp_read(ie_ext->headerIeList, ie_ext->headerIeListLength,
-                                        ie_lus.channel_plan_tag, &ie_lcp);
+        has_lcp = ws_wp_nested_lcp_read(ie, ie_lus.channel_plan_tag, &ie_lcp);
         if (!has_lcp) {
             TRACE(TR_DROP, "drop %-9s: missing LCP-IE required by LUS-IE", tr_ws_frame(WS_FT_LPCS));
             return;
@@ -452,7 +447,7 @@ void ws_mngt_lpcs_analyze(struct net_if *net_if,
 }
 
 void ws_mngt_ind(struct net_if *cur, const struct mcps_data_ind *data,
-                 const struct mcps_data_rx_ie_list *ie_ext, uint8_t message_type)
+                 const struct ws_ie_index *ie, uint8_t message_type)
 {
     if (data->SrcAddrMode != MAC_ADDR_MODE_64_BIT) {
         // Not from long address
@@ -461,22 +456,22 @@ void ws_mngt_ind(struct net_if *cur, const struct mcps_data_ind *data,
     //Handle Message's
     switch (message_type) {
         case WS_FT_PA:
-            ws_mngt_pa_analyze(cur, data, ie_ext);
+            ws_mngt_pa_analyze(cur, data, ie);
             break;
         case WS_FT_PAS:
-            ws_mngt_pas_analyze(cur, data, ie_ext);
+            ws_mngt_pas_analyze(cur, data, ie);
             break;
         case WS_FT_PC:
-            ws_mngt_pc_analyze(cur, data, ie_ext);
+            ws_mngt_pc_analyze(cur, data, ie);
             break;
         case WS_FT_PCS:
-            ws_mngt_pcs_analyze(cur, data, ie_ext);
+            ws_mngt_pcs_analyze(cur, data, ie);
             break;
         case WS_FT_LPAS:
-            ws_mngt_lpas_analyze(cur, data, ie_ext);
+            ws_mngt_lpas_analyze(cur, data, ie);
             break;
         case WS_FT_LPCS:
-            ws_mngt_lpcs_analyze(cur, data, ie_ext);
+            ws_mngt_lpcs_analyze(cur, data, ie);
             break;
         case WS_FT_LPA:
         case WS_FT_LPC:
@@ -18,7 +18,7 @@
 #include <stdint.h>
 #include "common/trickle.h"
 
-struct mcps_data_rx_ie_list;
+struct ws_ie_index;
 struct mcps_data_ind;
 struct net_if;
 
@@ -41,7 +41,7 @@ struct ws_mngt {
  *   - LFN Time Sync (LTS)
  */
 void ws_mngt_ind(struct net_if *cur, const struct mcps_data_ind *data,
-                 const struct mcps_data_rx_ie_list *ie_ext, uint8_t message_type);
+                 const struct ws_ie_index *ie, uint8_t message_type);
 
 void ws_mngt_cnf(struct net_if *interface, uint8_t asynch_message);
 
@@ -20,7 +20,6 @@
 #include <math.h>
 #include <inttypes.h>
 #include <limits.h>
-#include "common/sys_queue_extra.h"
 #include "common/time_extra.h"
 #include "common/ws_regdb.h"
 #include "common/version.h"
@@ -39,6 +38,86 @@
 
 #define LFN_SCHEDULE_GUARD_TIME_MS 300
 
+static void ws_neigh_heap_set(struct ws_neigh_table *table, int i, struct ws_neigh *neigh)
+{
+    table->expire_heap[i] = neigh;
+    neigh->heap_index = i;
+}
+
+static void ws_neigh_heap_sift_up(struct ws_neigh_table *table, int i)
+{
+    struct ws_neigh *neigh = table->expire_heap[i];
+    int parent;
+
+    while (i) {
+        parent = (i - 1) / 2;
+        if (table->expire_heap[parent]->expiration_s <= neigh->expiration_s)
+            break;
+        ws_neigh_heap_set(table, i, table->expire_heap[parent]);
+        i = parent;
+    }
+    ws_neigh_heap_set(table, i, neigh);
+}
+
+static void ws_neigh_heap_sift_down(struct ws_neigh_table *table, int i)
+{
+    struct ws_neigh *neigh = table->expire_heap[i];
+    int child;
+
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= table->heap_len)
+            break;
+        if (child + 1 < table->heap_len &&
+            table->expire_heap[child + 1]->expiration_s < table->expire_heap[child]->expiration_s)
+            child++;
+        if (neigh->expiration_s <= table->expire_heap[child]->expiration_s)
+            break;
+        ws_neigh_heap_set(table, i, table->expire_heap[child]);
+        i = child;
+    }
+    ws_neigh_heap_set(table, i, neigh);
+}
+
+static void ws_neigh_heap_push(struct ws_neigh_table *table, struct ws_neigh *neigh)
+{
+    if (table->heap_len == table->heap_capacity) {
+        table->heap_capacity = table->heap_capacity ? table->heap_capacity * 2 : 16;
+        table->expire_heap = reallocarray(table->expire_heap, table->heap_capacity, sizeof(*table->expire_heap));
+        FATAL_ON(!table->expire_heap, 2, "%s: %m", __func__);
+    }
+    ws_neigh_heap_set(table, table->heap_len, neigh);
+    table->heap_len++;
+    ws_neigh_heap_sift_up(table, neigh->heap_index);
+}
+
+static void ws_neigh_heap_remove(struct ws_neigh_table *table, struct ws_neigh *neigh)
+{
+    struct ws_neigh *last;
+
+    if (neigh->heap_index < 0)
+        return;
+    table->heap_len--;
+    if (neigh->heap_index != table->heap_len) {
+        last = table->expire_heap[table->heap_len];
+        ws_neigh_heap_set(table, neigh->heap_index, last);
+        ws_neigh_heap_sift_up(table, last->heap_index);
+        ws_neigh_heap_sift_down(table, last->heap_index);
+    }
+    neigh->heap_index = -1;
+}
+
+// Must be called each time neigh->expiration_s is modified
+static void ws_neigh_heap_update(struct ws_neigh_table *table, struct ws_neigh *neigh)
+{
+    if (neigh->heap_index < 0) {
+        ws_neigh_heap_push(table, neigh);
+        return;
+    }
+    ws_neigh_heap_sift_up(table, neigh->heap_index);
+    ws_neigh_heap_sift_down(table, neigh->heap_index);
+}
+
 struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
                          const uint8_t mac64[8],
                          uint8_t role, int8_t tx_power_dbm,
@@ -46,6 +125,7 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
 {
     struct ws_neigh *neigh = zalloc(sizeof(struct ws_neigh));
 
+    BUG_ON(ws_neigh_get(table, mac64));
     neigh->node_role = role;
     for (uint8_t key_index = 1; key_index <= 7; key_index++)
         if (!(key_index_mask & (1u << key_index)))
@@ -62,7 +142,12 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
     neigh->lqi_unsecured = INT_MAX;
     neigh->apc_txpow_dbm = tx_power_dbm;
     neigh->apc_txpow_dbm_ofdm = tx_power_dbm;
-    SLIST_INSERT_HEAD(&table->neigh_list, neigh, link);
+    LIST_INSERT_HEAD(&table->neigh_list, neigh, link);
+    hash_table_insert(&table->index, &neigh->hash_entry, hash_table_key(mac64, 8));
+    table->count++;
+    ws_neigh_heap_push(table, neigh);
+    if (neigh->node_role == WS_NR_ROLE_LFN)
+        table->lfn_count++;
     TRACE(TR_NEIGH_15_4, "15.4 neighbor add %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
     return neigh;
 }
@@ -70,11 +155,13 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
 struct ws_neigh *ws_neigh_get(struct ws_neigh_table *table, const uint8_t *mac64)
 {
     struct ws_neigh *neigh;
+    struct hash_entry *it;
 
-    SLIST_FOREACH(neigh, &table->neigh_list, link)
+    hash_table_foreach(&table->index, it, hash_table_key(mac64, 8)) {
+        neigh = container_of(it, struct ws_neigh, hash_entry);
         if (!memcmp(neigh->mac64, mac64, 8))
             return neigh;
-
+    }
     return NULL;
 }
 
@@ -82,27 +169,37 @@ void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64)
 {
     struct ws_neigh *neigh = ws_neigh_get(table, mac64);
 
-    if (neigh) {
-        SLIST_REMOVE(&table->neigh_list, neigh, ws_neigh, link);
-        TRACE(TR_NEIGH_15_4, "15.4 neighbor del %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
-        free(neigh);
-    }
+    if (!neigh)
+        return;
+    hash_table_remove(&table->index, &neigh->hash_entry);
+    table->count--;
+    ws_neigh_heap_remove(table, neigh);
+    LIST_REMOVE(neigh, link);
+    if (neigh->node_role == WS_NR_ROLE_LFN)
+        table->lfn_count--;
+    TRACE(TR_NEIGH_15_4, "15.4 neighbor del %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
+    free(neigh);
 }
 
 void ws_neigh_table_expire(struct ws_neigh_table *table, int time_update)
 {
+    time_t now = time_current(CLOCK_MONOTONIC);
     struct ws_neigh *neigh;
-    struct ws_neigh *tmp;
 
-    SLIST_FOREACH_SAFE(neigh, &table->neigh_list, link, tmp)
-        if (time_current(CLOCK_MONOTONIC) >= neigh->expiration_s)
-            if (table->on_expire)
-                table->on_expire(neigh->mac64);
+    if (!table->on_expire)
+        return;
+    while (table->heap_len && now >= table->expire_heap[0]->expiration_s) {
+        neigh = table->expire_heap[0];
+        // If the callback keeps the neighbor, it is not considered again
+        // until its lifetime is refreshed.
+        ws_neigh_heap_remove(table, neigh);
+        table->on_expire(neigh->mac64);
+    }
 }
 
 size_t ws_neigh_get_neigh_count(struct ws_neigh_table *table)
 {
-    return SLIST_SIZE(&table->neigh_list, link);
+    return table->count;
 }
 
 static void ws_neigh_calculate_ufsi_drift(struct fhss_ws_neighbor_timing_info *fhss_data, uint24_t ufsi,
@@ -202,6 +299,18 @@ void ws_neigh_nr_update(struct ws_neigh *neigh, struct ws_nr_ie *nr_ie)
     neigh->lto_info.uc_interval_max_ms = nr_ie->listen_interval_max;
 }
 
+bool ws_neigh_pom_update(struct ws_neigh *neigh, const struct ws_pom_ie *pom_ie)
+{
+    bool changed;
+
+    // Only the first phy_op_mode_number entries are filled by the parser
+    changed = neigh->pom_ie.phy_op_mode_number  != pom_ie->phy_op_mode_number ||
+              neigh->pom_ie.mdr_command_capable != pom_ie->mdr_command_capable ||
+              memcmp(neigh->pom_ie.phy_op_mode_id, pom_ie->phy_op_mode_id, pom_ie->phy_op_mode_number);
+    neigh->pom_ie = *pom_ie;
+    return changed;
+}
+
 static void ws_neigh_excluded_mask_by_range(uint8_t channel_mask[32],
                                             const struct ws_excluded_channel_range *range_info,
                                             uint16_t number_of_channels)
@@ -470,28 +579,24 @@ bool ws_neigh_duplicate_packet_check(struct ws_neigh *neigh, uint8_t mac_dsn, ui
 
 int ws_neigh_lfn_count(struct ws_neigh_table *table)
 {
-    struct ws_neigh *neigh;
-    int cnt = 0;
-
-    SLIST_FOREACH(neigh, &table->neigh_list, link)
-        if (neigh->node_role == WS_NR_ROLE_LFN)
-            cnt++;
-    return cnt;
+    return table->lfn_count;
 }
 
-void ws_neigh_trust(struct ws_neigh *neigh)
+void ws_neigh_trust(struct ws_neigh_table *table, struct ws_neigh *neigh)
 {
     if (neigh->trusted_device)
         return;
 
     neigh->expiration_s = time_current(CLOCK_MONOTONIC) + neigh->lifetime_s;
+    ws_neigh_heap_update(table, neigh);
     neigh->trusted_device = true;
     TRACE(TR_NEIGH_15_4, "15.4 neighbor trusted %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
 }
 
-void ws_neigh_refresh(struct ws_neigh *neigh, uint32_t lifetime_s)
+void ws_neigh_refresh(struct ws_neigh_table *table, struct ws_neigh *neigh, uint32_t lifetime_s)
 {
     neigh->lifetime_s = lifetime_s;
     neigh->expiration_s = time_current(CLOCK_MONOTONIC) + lifetime_s;
+    ws_neigh_heap_update(table, neigh);
     TRACE(TR_NEIGH_15_4, "15.4 neighbor refresh %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
 }
@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <time.h>
 #include "common/int24.h"
+#include "common/hash_table.h"
 
 #include "6lbr/ws/ws_ie_lib.h"
 
@@ -123,15 +124,30 @@ struct ws_neigh {
     uint8_t edfe_mode;
     bool trusted_device: 1;                                /*!< True mean use normal group key, false for enable pairwise key */
     struct eapol_temporary_info eapol_temp_info;
-    SLIST_ENTRY(ws_neigh) link;
+    LIST_ENTRY(ws_neigh) link;
+    struct hash_entry hash_entry;
+    int heap_index;                                        /*!< Position in ws_neigh_table.expire_heap, -1 if expired */
 };
-SLIST_HEAD(ws_neigh_list, ws_neigh);
+LIST_HEAD(ws_neigh_list, ws_neigh);
 
 /**
  * Neighbor hopping info data base
+ *
+ * Neighbors are indexed by EUI-64 in a hash table, and ordered by expiration
+ * time in a binary min-heap, so lookup, insertion and removal do not depend on
+ * the number of neighbors. Both structures are allocated on first insertion
+ * and grow with the table.
  */
 struct ws_neigh_table {
     struct ws_neigh_list neigh_list;
+    struct hash_table index;
+    // Min-heap on expiration_s. Expired neighbors are removed from the heap
+    // before on_expire() is called.
+    struct ws_neigh **expire_heap;
+    int heap_len;
+    int heap_capacity;
+    int count;
+    int lfn_count;
     void (*on_expire)(const uint8_t *mac64);              /*!< Neighbor Remove Callback notify */
 };
 
@@ -167,6 +183,9 @@ uint24_t ws_neigh_calc_lfn_offset(uint24_t adjusted_listening_interval, uint32_t
 // Node Role update (LFN only)
 void ws_neigh_nr_update(struct ws_neigh *neigh, struct ws_nr_ie *nr_ie);
 
+// Return true if the PHY operating modes advertised by the neighbor changed
+bool ws_neigh_pom_update(struct ws_neigh *neigh, const struct ws_pom_ie *pom_ie);
+
 bool ws_neigh_duplicate_packet_check(struct ws_neigh *neigh, uint8_t mac_dsn, uint64_t rx_timestamp);
 
 int ws_neigh_lfn_count(struct ws_neigh_table *table);
@@ -180,8 +199,8 @@ void ws_neigh_table_expire(struct ws_neigh_table *table, int time_update);
 
 size_t ws_neigh_get_neigh_count(struct ws_neigh_table *table);
 
-void ws_neigh_trust(struct ws_neigh *neigh);
+void ws_neigh_trust(struct ws_neigh_table *table, struct ws_neigh *neigh);
 
-void ws_neigh_refresh(struct ws_neigh *neigh, uint32_t lifetime_s);
+void ws_neigh_refresh(struct ws_neigh_table *table, struct ws_neigh *neigh, uint32_t lifetime_s);
 
 #endif
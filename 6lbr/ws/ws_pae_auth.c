@@ -28,6 +28,9 @@
 #include "common/time_extra.h"
 #include "common/specs/ws.h"
 
+#include "app/dbus.h"
+#include "app/wsbr.h"
+
 #include "net/ns_address.h"
 #include "net/timers.h"
 #include "net/protocol.h"
@@ -145,8 +148,8 @@ static bool ws_pae_auth_next_kmp_trigger(pae_auth_t *pae_auth, supp_entry_t *sup
 static kmp_type_e ws_pae_auth_next_protocol_get(pae_auth_t *pae_auth, supp_entry_t *supp_entry);
 static kmp_api_t *ws_pae_auth_kmp_create_and_start(kmp_service_t *service, kmp_type_e type, uint8_t socked_msg_if_instance_id, supp_entry_t *supp_entry, sec_cfg_t *sec_cfg);
 static void ws_pae_auth_kmp_api_finished(kmp_api_t *kmp);
-static void ws_pae_auth_active_supp_deleted(void *pae_auth);
-static void ws_pae_auth_waiting_supp_deleted(void *pae_auth);
+static void ws_pae_auth_active_supp_deleted(void *pae_auth, const uint8_t eui_64[8]);
+static void ws_pae_auth_waiting_supp_deleted(void *pae_auth, const uint8_t eui_64[8]);
 
 static int8_t tasklet_id = -1;
 static NS_LIST_DEFINE(pae_auth_list, pae_auth_t, link);
@@ -679,6 +682,8 @@ static void ws_pae_auth_tasklet_handler(struct event_payload *event)
 
 void ws_pae_auth_fast_timer(uint16_t ticks)
 {
+    bool running = false;
+
     ns_list_foreach(pae_auth_t, pae_auth, &pae_auth_list) {
         if (!ws_pae_auth_timer_running(pae_auth)) {
             continue;
@@ -690,6 +695,13 @@ void ws_pae_auth_fast_timer(uint16_t ticks)
         if (!active_running && !wait_running) {
             ws_pae_auth_timer_stop(pae_auth);
         }
+        if (ws_pae_auth_timer_running(pae_auth)) {
+            running = true;
+        }
+    }
+    // Restarted by ws_pae_auth_timer_start()
+    if (!running) {
+        ws_timer_stop(WS_TIMER_PAE_FAST);
     }
 }
 
@@ -928,6 +940,8 @@ static int8_t ws_pae_auth_shared_comp_remove(kmp_service_t *service, kmp_shared_
 static int8_t ws_pae_auth_timer_start(pae_auth_t *pae_auth)
 {
     pae_auth->timer_running = true;
+    if (!ws_timer_is_running(WS_TIMER_PAE_FAST))
+        ws_timer_start(WS_TIMER_PAE_FAST);
     return 0;
 }
 
@@ -1033,6 +1047,8 @@ static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t m
     supp_entry_t *supp_entry = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->active_supp_list, kmp_address_eui_64_get(addr));
 
     if (!supp_entry) {
+        // Supplicants are listed in the Nodes property as soon as they start authenticating
+        dbus_emit_nodes_change(&g_ctxt, kmp_address_eui_64_get(addr));
         // Check if supplicant is already on the the waiting supplicant list
         supp_entry = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->waiting_supp_list, kmp_address_eui_64_get(addr));
         if (supp_entry) {
@@ -1411,11 +1427,12 @@ static void ws_pae_auth_kmp_api_finished(kmp_api_t *kmp)
     ws_pae_lib_kmp_list_delete(&supp_entry->kmp_list, kmp);
 }
 
-static void ws_pae_auth_active_supp_deleted(void *pae_auth_ptr)
+static void ws_pae_auth_active_supp_deleted(void *pae_auth_ptr, const uint8_t eui_64[8])
 {
     pae_auth_t *pae_auth = pae_auth_ptr;
 
     tr_info("Supplicant deleted");
+    dbus_emit_nodes_change(&g_ctxt, eui_64);
 
     if (ws_pae_auth_active_limit_reached(pae_auth)) {
         WARN("%s: congestion detected, leaving supplicant waiting list as is", __func__);
@@ -1433,19 +1450,24 @@ static void ws_pae_auth_active_supp_deleted(void *pae_auth_ptr)
     }
 }
 
-static void ws_pae_auth_waiting_supp_deleted(void *pae_auth_ptr)
+static void ws_pae_auth_waiting_supp_deleted(void *pae_auth_ptr, const uint8_t eui_64[8])
 {
     pae_auth_t *pae_auth = pae_auth_ptr;
     pae_auth->waiting_supp_list_size--;
+    dbus_emit_nodes_change(&g_ctxt, eui_64);
 }
 
-int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len)
+// Return the supplicants known from the storage or currently authenticating.
+// The returned array has to be freed by the caller.
+int ws_pae_auth_supp_list(int8_t interface_id, uint8_t (**eui64)[8])
 {
+    const struct ws_pae_key_storage_supp_info *stored;
     struct net_if *interface_ptr;
     supp_list_t *supp_lists[2];
     pae_auth_t *pae_auth;
-    int len_ret, j;
+    int len_stored, len;
 
+    *eui64 = NULL;
     interface_ptr = protocol_stack_interface_info_get_by_id(interface_id);
     if (!interface_ptr)
         return 0;
@@ -1456,23 +1478,35 @@ int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len)
     supp_lists[0] = &pae_auth->active_supp_list;
     supp_lists[1] = &pae_auth->waiting_supp_list;
 
-    len_ret = ws_pae_key_storage_list(eui64, len);
-    if (len_ret == len)
-        return len_ret;
-
-    for (int i = 0; i < ARRAY_SIZE(supp_lists); i++) {
-        ns_list_foreach(supp_entry_t, cur, supp_lists[i]) {
-            for (j = 0; j < len_ret; j++)
-                if (!memcmp(cur->addr.eui_64, eui64[j], 8))
-                    break;
-            if (j != len_ret)
-                continue;
-            memcpy(eui64[len_ret++], cur->addr.eui_64, 8);
-            if (len_ret == len)
-                return len_ret;
-        }
-    }
-    return len_ret;
+    stored = ws_pae_key_storage_supp_list(&len_stored);
+    len = len_stored + ns_list_count(supp_lists[0]) + ns_list_count(supp_lists[1]);
+    if (!len)
+        return 0;
+    *eui64 = xalloc(len * sizeof(**eui64));
+    for (len = 0; len < len_stored; len++)
+        memcpy((*eui64)[len], stored[len].eui64, 8);
+    for (int i = 0; i < ARRAY_SIZE(supp_lists); i++)
+        ns_list_foreach(supp_entry_t, cur, supp_lists[i])
+            if (!ws_pae_key_storage_supp_info(cur->addr.eui_64))
+                memcpy((*eui64)[len++], cur->addr.eui_64, 8);
+    return len;
+}
+
+// True if the supplicant is part of the list returned by ws_pae_auth_supp_list()
+bool ws_pae_auth_supp_known(int8_t interface_id, const uint8_t eui64[8])
+{
+    struct net_if *interface_ptr;
+    pae_auth_t *pae_auth;
+
+    interface_ptr = protocol_stack_interface_info_get_by_id(interface_id);
+    if (!interface_ptr)
+        return false;
+    pae_auth = ws_pae_auth_get(interface_ptr);
+    if (!pae_auth)
+        return false;
+    return ws_pae_key_storage_supp_info(eui64) ||
+           ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->active_supp_list, eui64) ||
+           ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->waiting_supp_list, eui64);
 }
 
 void ws_pae_auth_gtk_install(int8_t interface_id, const uint8_t key[GTK_LEN], bool is_lgtk)
@@ -256,7 +256,8 @@ void ws_pae_auth_cb_register(struct net_if *interface_ptr,
                              ws_pae_auth_ip_addr_get *ip_addr_get,
                              ws_pae_auth_congestion_get *congestion_get);
 
-int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len);
+int ws_pae_auth_supp_list(int8_t interface_id, uint8_t (**eui64)[8]);
+bool ws_pae_auth_supp_known(int8_t interface_id, const uint8_t eui64[8]);
 void ws_pae_auth_gtk_install(int8_t interface_id, const uint8_t key[GTK_LEN], bool is_lgtk);
 
 #endif
@@ -32,6 +32,9 @@
 #include "common/time_extra.h"
 #include "common/specs/ws.h"
 
+#include "app/dbus.h"
+#include "app/wsbr.h"
+
 #include "security/protocols/sec_prot_keys.h"
 #include "ws/ws_pae_lib.h"
 
@@ -47,6 +50,109 @@ static const struct name_value nr_values[] = {
     { NULL, 0 }
 };
 
+// In-memory copy of the information needed to list the supplicants, so the
+// key files do not have to be read on every D-Bus request. Sorted by EUI-64.
+// Loaded from the storage on first use, then kept in sync by
+// ws_pae_key_storage_supp_write() and ws_pae_key_storage_supp_delete().
+static struct {
+    bool loaded;
+    struct ws_pae_key_storage_supp_info *entries;
+    int len;
+    int size;
+} supp_cache;
+
+// Return the index of eui64, or the index where it would be inserted
+static int ws_pae_key_storage_cache_find(const uint8_t eui64[8], bool *found)
+{
+    int lo = 0, hi = supp_cache.len, mid, ret;
+
+    *found = false;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        ret = memcmp(supp_cache.entries[mid].eui64, eui64, 8);
+        if (!ret) {
+            *found = true;
+            return mid;
+        }
+        if (ret < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void ws_pae_key_storage_cache_update(const uint8_t eui64[8], uint8_t node_role)
+{
+    bool found;
+    int i;
+
+    if (!supp_cache.loaded)
+        return;
+    i = ws_pae_key_storage_cache_find(eui64, &found);
+    if (!found) {
+        if (supp_cache.len == supp_cache.size) {
+            supp_cache.size = supp_cache.size ? 2 * supp_cache.size : 64;
+            supp_cache.entries = reallocarray(supp_cache.entries, supp_cache.size, sizeof(*supp_cache.entries));
+            FATAL_ON(!supp_cache.entries, 2, "%s: cannot allocate memory", __func__);
+        }
+        memmove(supp_cache.entries + i + 1, supp_cache.entries + i,
+                (supp_cache.len - i) * sizeof(*supp_cache.entries));
+        memcpy(supp_cache.entries[i].eui64, eui64, 8);
+        supp_cache.len++;
+    } else if (supp_cache.entries[i].node_role == node_role) {
+        return;
+    }
+    supp_cache.entries[i].node_role = node_role;
+    dbus_emit_nodes_change(&g_ctxt, eui64);
+}
+
+static void ws_pae_key_storage_cache_remove(const uint8_t eui64[8])
+{
+    bool found;
+    int i;
+
+    if (!supp_cache.loaded)
+        return;
+    i = ws_pae_key_storage_cache_find(eui64, &found);
+    if (!found)
+        return;
+    supp_cache.len--;
+    memmove(supp_cache.entries + i, supp_cache.entries + i + 1,
+            (supp_cache.len - i) * sizeof(*supp_cache.entries));
+    dbus_emit_nodes_change(&g_ctxt, eui64);
+}
+
+static void ws_pae_key_storage_cache_load(void)
+{
+    const char *pattern = "keys-*:*:*:*:*:*:*:*";
+    supp_entry_t *pae_supp;
+    uint8_t eui64[8];
+    glob_t globbuf;
+    int ret;
+
+    if (supp_cache.loaded)
+        return;
+    supp_cache.loaded = true;
+    if (!g_storage_prefix) {
+        WARN("storage disabled, cannot retrieve EUI64");
+        return;
+    }
+    ret = storage_glob(pattern, &globbuf);
+    if (ret) {
+        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", pattern);
+        return;
+    }
+    for (int i = 0; globbuf.gl_pathv[i]; i++) {
+        if (parse_byte_array(eui64, 8, strrchr(globbuf.gl_pathv[i], '-') + 1))
+            continue;
+        pae_supp = ws_pae_key_storage_supp_read(NULL, eui64, NULL, NULL, NULL);
+        ws_pae_key_storage_cache_update(eui64, pae_supp->sec_keys.node_role);
+        free(pae_supp);
+    }
+    storage_globfree(&globbuf);
+}
+
 bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64)
 {
     char filename[256];
@@ -57,7 +163,9 @@ bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64)
         return true;
     str_key(eui64, 8, str_buf, sizeof(str_buf));
     snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, str_buf);
-    ret = unlink(filename);
+    ret = storage_remove(filename);
+    if (!ret)
+        ws_pae_key_storage_cache_remove(eui64);
 
     return !ret;
 }
@@ -105,6 +213,7 @@ int8_t ws_pae_key_storage_supp_write(const void *instance, supp_entry_t *pae_sup
     }
     fprintf(info->file, "node_role = %s\n", val_to_str(pae_supp->sec_keys.node_role, nr_values, "unknown"));
     storage_close(info);
+    ws_pae_key_storage_cache_update(pae_supp->addr.eui_64, pae_supp->sec_keys.node_role);
     return 0;
 }
 
@@ -182,38 +291,21 @@ supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *
     return pae_supp;
 }
 
-int ws_pae_key_storage_list(uint8_t eui64[][8], int len)
+const struct ws_pae_key_storage_supp_info *ws_pae_key_storage_supp_list(int *len)
 {
-    char filename[PATH_MAX];
-    glob_t globbuf;
-    int i, ret;
-
-    if (!g_storage_prefix) {
-        WARN("storage disabled, cannot retrieve EUI64");
-        return 0;
-    }
-    snprintf(filename, sizeof(filename), "%skeys-*:*:*:*:*:*:*:*", g_storage_prefix);
-    ret = glob(filename, 0, NULL, &globbuf);
-    if (ret) {
-        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", filename);
-        return 0;
-    }
-    for (i = 0; globbuf.gl_pathv[i] && i < len; i++)
-        parse_byte_array(eui64[i], 8, strrchr(globbuf.gl_pathv[i], '-') + 1);
-    globfree(&globbuf);
-    return i;
+    ws_pae_key_storage_cache_load();
+    *len = supp_cache.len;
+    return supp_cache.entries;
 }
 
-bool ws_pae_key_storage_supp_exists(const uint8_t eui64[8])
+const struct ws_pae_key_storage_supp_info *ws_pae_key_storage_supp_info(const uint8_t eui64[8])
 {
-    char eui64_str[STR_MAX_LEN_EUI64];
-    char filename[PATH_MAX];
-    int ret;
+    bool found;
+    int i;
 
-    str_eui64(eui64, eui64_str);
-    ret = snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, eui64_str);
-    BUG_ON(ret >= sizeof(filename), "g_storage_prefix too big");
-    return !access(filename, F_OK);
+    ws_pae_key_storage_cache_load();
+    i = ws_pae_key_storage_cache_find(eui64, &found);
+    return found ? &supp_cache.entries[i] : NULL;
 }
 
 uint16_t ws_pae_key_storage_storing_interval_get(void)
@@ -78,7 +78,15 @@ bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64);
  */
 uint16_t ws_pae_key_storage_storing_interval_get(void);
 
-int ws_pae_key_storage_list(uint8_t eui64[][8], int len);
-bool ws_pae_key_storage_supp_exists(const uint8_t eui64[8]);
+struct ws_pae_key_storage_supp_info {
+    uint8_t eui64[8];
+    uint8_t node_role;
+};
+
+// Supplicants present in the storage, sorted by EUI-64. These functions are
+// served from memory and do not access the storage (except on first call).
+const struct ws_pae_key_storage_supp_info *ws_pae_key_storage_supp_list(int *len);
+// Return NULL if eui64 is not present in the storage.
+const struct ws_pae_key_storage_supp_info *ws_pae_key_storage_supp_info(const uint8_t eui64[8]);
 
 #endif
@@ -182,6 +182,9 @@ supp_entry_t *ws_pae_lib_supp_list_add(supp_list_t *supp_list, const kmp_addr_t
 
 int8_t ws_pae_lib_supp_list_remove(void *instance, supp_list_t *supp_list, supp_entry_t *supp, ws_pae_lib_supp_deleted supp_deleted)
 {
+    uint8_t eui_64[8];
+
+    memcpy(eui_64, supp->addr.eui_64, 8);
     ns_list_remove(supp_list, supp);
 
     ws_pae_lib_supp_delete(supp);
@@ -189,7 +192,7 @@ int8_t ws_pae_lib_supp_list_remove(void *instance, supp_list_t *supp_list, supp_
     free(supp);
 
     if (supp_deleted != NULL) {
-        supp_deleted(instance);
+        supp_deleted(instance, eui_64);
     }
 
     return 0;
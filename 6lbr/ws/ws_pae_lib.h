@@ -198,9 +198,10 @@ supp_entry_t *ws_pae_lib_supp_list_add(supp_list_t *supp_list, const kmp_addr_t
  * ws_pae_lib_supp_deleted supplicant delete callback
  *
  * \param instance Instance
+ * \param eui_64 EUI-64 of the deleted supplicant
  *
  */
-typedef void ws_pae_lib_supp_deleted(void *instance);
+typedef void ws_pae_lib_supp_deleted(void *instance, const uint8_t eui_64[8]);
 
 /**
  *  ws_pae_lib_supp_list_add removes entry from supplicant list
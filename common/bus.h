@@ -24,6 +24,9 @@ struct slist;
 struct bus {
     int  (*tx)(struct bus *bus, const void *buf, unsigned int len);
     int  (*rx)(struct bus *bus, void *buf, unsigned int len);
+    // Optional, see uart_tx_start()
+    struct iobuf_write *(*tx_start)(struct bus *bus);
+    int  (*tx_end)(struct bus *bus);
 
     int     fd;
     int     spinel_tid;
@@ -11,13 +11,13 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
-#include <sys/uio.h>
 
 #include "common/bits.h"
 #include "common/endian.h"
@@ -92,9 +92,20 @@ static void uart_read(struct bus *bus)
 {
     ssize_t size;
 
+    // Bytes before rx_buf_off have already been consumed. Reclaim their space
+    // once per read() rather than once per frame.
+    if (bus->uart.rx_buf_off) {
+        memmove(bus->uart.rx_buf, bus->uart.rx_buf + bus->uart.rx_buf_off,
+                bus->uart.rx_buf_len - bus->uart.rx_buf_off);
+        bus->uart.rx_buf_len -= bus->uart.rx_buf_off;
+        bus->uart.rx_buf_off = 0;
+    }
     size = read(bus->fd,
                 bus->uart.rx_buf + bus->uart.rx_buf_len,
                 sizeof(bus->uart.rx_buf) - bus->uart.rx_buf_len);
+    // Interrupted by a signal, the caller decides whether to exit
+    if (size < 0 && errno == EINTR)
+        return;
     FATAL_ON(size < 0, 2, "%s: read: %m", __func__);
     FATAL_ON(!size, 2, "%s: read: Empty read", __func__);
     TRACE(TR_BUS, "bus rx: %s (%zd bytes)",
@@ -103,32 +114,115 @@ static void uart_read(struct bus *bus)
     bus->uart.rx_buf_len += size;
 }
 
-int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
+// A batch of frames may not fit in the kernel buffer of the serial port, so
+// short writes are expected.
+static void uart_write(struct bus *bus, const uint8_t *buf, size_t buf_len)
 {
-    uint8_t hdr[4], fcs[2];
-    const struct iovec iov[] = {
-        { .iov_base = hdr,         .iov_len = sizeof(hdr) },
-        { .iov_base = (void *)buf, .iov_len = buf_len     },
-        { .iov_base = fcs,         .iov_len = sizeof(fcs) },
+    struct pollfd pfd = {
+        .fd = bus->fd,
+        .events = POLLOUT,
     };
     ssize_t ret;
 
+    while (buf_len) {
+        ret = write(bus->fd, buf, buf_len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && errno == EAGAIN) {
+            ret = poll(&pfd, 1, -1);
+            FATAL_ON(ret < 0 && errno != EINTR, 2, "%s: poll: %m", __func__);
+            continue;
+        }
+        FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+        FATAL_ON(!ret, 2, "%s: write: Empty write", __func__);
+        if (ret < buf_len)
+            TRACE(TR_BUS, "bus tx: short write (%zd/%zu bytes)", ret, buf_len);
+        buf += ret;
+        buf_len -= ret;
+    }
+}
+
+void uart_tx_commit(struct bus *bus)
+{
+    struct iobuf_write *queue = &bus->uart.tx_queue;
+
+    if (!queue->len)
+        return;
+    uart_write(bus, queue->data, queue->len);
+    bus->uart.tx_frame_cnt += bus->uart.tx_queue_frames;
+    bus->uart.tx_flush_cnt++;
+    if (bus->uart.tx_queue_frames > bus->uart.tx_flush_frames_max)
+        bus->uart.tx_flush_frames_max = bus->uart.tx_queue_frames;
+    if (bus->uart.tx_batch_size)
+        TRACE(TR_BUS, "bus tx: flush %d frames (%d bytes)", bus->uart.tx_queue_frames, queue->len);
+    // Keep the allocation for the next frames
+    queue->len = 0;
+    bus->uart.tx_queue_frames = 0;
+}
+
+struct iobuf_write *uart_tx_start(struct bus *bus)
+{
+    struct iobuf_write *queue = &bus->uart.tx_queue;
+
+    BUG_ON(bus->uart.tx_frame_pending, "unterminated frame");
+    bus->uart.tx_frame_pending = true;
+    bus->uart.tx_frame_offset = queue->len;
+    iobuf_push_data_reserved(queue, 4); // Length + HCS
+    return queue;
+}
+
+int uart_tx_end(struct bus *bus)
+{
+    struct iobuf_write *queue = &bus->uart.tx_queue;
+    int offset = bus->uart.tx_frame_offset;
+    const uint8_t *hdr, *buf;
+    int frame_len, buf_len;
+
+    BUG_ON(!bus->uart.tx_frame_pending, "no frame started");
+    bus->uart.tx_frame_pending = false;
+    buf_len = queue->len - offset - 4;
     BUG_ON(buf_len > FIELD_MAX(UART_HDR_LEN_MASK));
-    write_le16(hdr,     buf_len);
-    write_le16(hdr + 2, crc16(CRC_INIT_HCS, hdr, 2));
-    write_le16(fcs,     crc16(CRC_INIT_FCS, buf, buf_len));
+    write_le16(queue->data + offset, buf_len);
+    write_le16(queue->data + offset + 2, crc16(CRC_INIT_HCS, queue->data + offset, 2));
+    iobuf_push_le16(queue, crc16(CRC_INIT_FCS, queue->data + offset + 4, buf_len));
+    bus->uart.tx_queue_frames++;
+    frame_len = queue->len - offset;
+
+    hdr = queue->data + offset;
+    buf = hdr + 4;
+    TRACE(TR_BUS, "bus tx: %s %s %02x %02x (%d bytes)",
+          tr_bytes(hdr, 4,       NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
+          tr_bytes(buf, buf_len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
+          hdr[4 + buf_len], hdr[5 + buf_len], frame_len);
+
+    if (queue->len >= bus->uart.tx_batch_size)
+        uart_tx_commit(bus);
+    return frame_len;
+}
 
-    ret = writev(bus->fd, iov, ARRAY_SIZE(iov));
-    FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
-    if (ret != sizeof(hdr) + buf_len + sizeof(fcs))
-        FATAL(2 ,"%s: write: Short write", __func__);
+int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
+{
+    iobuf_push_data(uart_tx_start(bus), buf, buf_len);
+    return uart_tx_end(bus);
+}
 
-    TRACE(TR_BUS, "bus tx: %s %s %02x %02x (%zd bytes)",
-          tr_bytes(hdr, sizeof(hdr), NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
-          tr_bytes(buf, buf_len,     NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
-          fcs[0], fcs[1], sizeof(hdr) + buf_len + sizeof(fcs));
+/*
+ * Discard the bytes preceding the next valid header, starting the search at
+ * offset start. The bytes are only examined once, so recovering from line
+ * noise is linear in the amount of received data.
+ */
+static void uart_rx_resync(struct bus *bus, int start)
+{
+    int i;
 
-    return ret;
+    for (i = start; i + 4 <= bus->uart.rx_buf_len; i++)
+        if (crc_check(CRC_INIT_HCS, bus->uart.rx_buf + i, 2, read_le16(bus->uart.rx_buf + i + 2)))
+            break;
+    // If no header is found, the last 3 bytes are kept since they may be the
+    // beginning of the next one.
+    bus->uart.rx_drop_bytes += i - bus->uart.rx_buf_off;
+    bus->uart.rx_buf_off = i;
+    bus->uart.data_ready = i + 4 <= bus->uart.rx_buf_len;
 }
 
 int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
@@ -140,19 +234,17 @@ int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
     if (!bus->uart.data_ready)
         uart_read(bus);
     bus->uart.data_ready = false;
-    iobuf.data      = bus->uart.rx_buf;
-    iobuf.data_size = bus->uart.rx_buf_len;
+    iobuf.data      = bus->uart.rx_buf + bus->uart.rx_buf_off;
+    iobuf.data_size = bus->uart.rx_buf_len - bus->uart.rx_buf_off;
     hdr = iobuf_pop_data_ptr(&iobuf, 4);
     if (iobuf.err)
         return 0;
     if (!crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2))) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
-        bus->uart.data_ready = true;
-        if (bus->uart.init_phase)
-            TRACE(TR_DROP, "drop %-9s: bad hcs", "uart");
-        else
+        bus->uart.rx_err_hcs++;
+        if (!bus->uart.init_phase)
             FATAL(3, "%s: bad hcs", __func__);
+        TRACE(TR_DROP, "drop %-9s: bad hcs", "uart");
+        uart_rx_resync(bus, bus->uart.rx_buf_off + 1);
         return 0;
     }
     len = FIELD_GET(UART_HDR_LEN_MASK, read_le16(hdr));
@@ -163,16 +255,14 @@ int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
         return 0; // Frame not fully received
     bus->uart.data_ready = true;
     if (!crc_check(CRC_INIT_FCS, buf, len, fcs)) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
-        if (bus->uart.init_phase)
-            TRACE(TR_DROP, "drop %-9s: bad fcs", "uart");
-        else
+        bus->uart.rx_err_fcs++;
+        if (!bus->uart.init_phase)
             FATAL(3, "%s: bad fcs", __func__);
+        TRACE(TR_DROP, "drop %-9s: bad fcs", "uart");
+        uart_rx_resync(bus, bus->uart.rx_buf_off + 1);
         return 0;
     }
-    memmove(bus->uart.rx_buf, iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf));
-    bus->uart.rx_buf_len = iobuf_remaining_size(&iobuf);
+    bus->uart.rx_buf_off += iobuf.cnt;
     return len;
 }
 
@@ -208,15 +298,13 @@ int uart_legacy_tx(struct bus *bus, const void *buf, unsigned int buf_len)
     uint16_t crc = crc16(CRC_INIT_LEGACY, buf, buf_len) ^ CRC_XOROUT_LEGACY;
     uint8_t *frame = xalloc(buf_len * 2 + 3);
     int frame_len;
-    int ret;
 
     frame_len = uart_legacy_encode_hdlc(frame, buf, buf_len, crc);
     TRACE(TR_BUS, "bus tx: %s (%d bytes)",
           tr_bytes(frame, frame_len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), frame_len);
     TRACE(TR_HDLC, "hdlc tx: %s (%d bytes)",
           tr_bytes(buf, buf_len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), buf_len);
-    ret = write(bus->fd, frame, frame_len);
-    BUG_ON(ret != frame_len, "write: %m");
+    uart_write(bus, frame, frame_len);
     free(frame);
 
     return frame_len;
@@ -233,48 +321,62 @@ static size_t uart_legacy_rx_hdlc(struct bus *bus, uint8_t *buf, size_t buf_len)
     if (!bus->uart.data_ready)
         uart_read(bus);
 
-    i = 0;
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
+    i = bus->uart.rx_buf_off;
+    while (i < bus->uart.rx_buf_len && bus->uart.rx_buf[i] == 0x7E)
         i++;
     frame_start = i;
-    while (bus->uart.rx_buf[i] != 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && bus->uart.rx_buf[i] != 0x7E)
         i++;
     frame_len = i - frame_start + 1;
     if (bus->uart.init_phase && i >= bus->uart.rx_buf_len)
         bus->uart.data_ready = false;
     BUG_ON(bus->uart.data_ready && i >= bus->uart.rx_buf_len);
-    if (i >= bus->uart.rx_buf_len)
+    if (i >= bus->uart.rx_buf_len) {
+        // Leading flags can be consumed already
+        bus->uart.rx_buf_off = frame_start;
+        // No room left to receive the end of the frame
+        if (!frame_start && i == sizeof(bus->uart.rx_buf)) {
+            bus->uart.rx_err_hdlc_len++;
+            bus->uart.rx_drop_bytes += i;
+            bus->uart.rx_buf_off = i;
+            WARN("frame length > %zu, frame dropped", sizeof(bus->uart.rx_buf));
+        }
         return 0;
+    }
 
-    BUG_ON(buf_len < frame_len);
-    memcpy(buf, bus->uart.rx_buf + frame_start, frame_len);
-
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
-        i++;
-    memmove(bus->uart.rx_buf, bus->uart.rx_buf + i, bus->uart.rx_buf_len - i);
-    bus->uart.rx_buf_len -= i;
+    if (frame_len > buf_len) {
+        bus->uart.rx_err_hdlc_len++;
+        bus->uart.rx_drop_bytes += frame_len;
+        WARN("frame length > %zu, frame dropped", buf_len);
+        frame_len = 0;
+    } else {
+        memcpy(buf, bus->uart.rx_buf + frame_start, frame_len);
+    }
 
-    i = 0;
-    bus->uart.data_ready = false;
-    while (i < bus->uart.rx_buf_len) {
-        if (bus->uart.rx_buf[i] == 0x7E) {
-            bus->uart.data_ready = true;
-            break;
-        }
+    while (i < bus->uart.rx_buf_len && bus->uart.rx_buf[i] == 0x7E)
         i++;
-    }
+    bus->uart.rx_buf_off = i;
+    // memchr() stops at the end of the next frame, so the data is only
+    // scanned a constant number of times.
+    bus->uart.data_ready = memchr(bus->uart.rx_buf + i, 0x7E, bus->uart.rx_buf_len - i);
 
     return frame_len;
 }
 
-static size_t uart_legacy_decode_hdlc(uint8_t *out, size_t out_len,
-                                      const uint8_t *in, size_t in_len,
-                                      bool inhibit_crc_warning)
+static size_t uart_legacy_decode_hdlc(struct bus *bus,
+                                      uint8_t *out, size_t out_len,
+                                      const uint8_t *in, size_t in_len)
 {
     int i = 0, frame_len = 0;
 
     while (i < in_len - 1) {
-        BUG_ON(frame_len > out_len);
+        // The RCP controls the frame length, it must not be able to trigger
+        // a BUG() (or to overflow out)
+        if (frame_len >= out_len) {
+            bus->uart.rx_err_hdlc_len++;
+            WARN("frame length > %zu, frame dropped", out_len);
+            return 0;
+        }
         if (in[i] == 0x7D) {
             i++;
             out[frame_len++] = in[i] ^ 0x20;
@@ -285,13 +387,15 @@ static size_t uart_legacy_decode_hdlc(uint8_t *out, size_t out_len,
         i++;
     }
     if (frame_len <= 2) {
+        bus->uart.rx_err_hdlc_len++;
         WARN("frame length < 2, frame dropped");
         return 0;
     } else {
         frame_len -= sizeof(uint16_t);
         if (!crc_check(CRC_INIT_LEGACY, out, frame_len,
                        read_le16(out + frame_len) ^ CRC_XOROUT_LEGACY)) {
-            if (!inhibit_crc_warning)
+            bus->uart.rx_err_hdlc_crc++;
+            if (!bus->uart.init_phase)
                 WARN("bad crc, frame dropped");
             return 0;
         }
@@ -303,13 +407,13 @@ static size_t uart_legacy_decode_hdlc(uint8_t *out, size_t out_len,
 
 int uart_legacy_rx(struct bus *bus, void *buf, unsigned int buf_len)
 {
-    uint8_t frame[4096];
+    uint8_t frame[sizeof(bus->uart.rx_buf)];
     size_t frame_len;
 
     frame_len = uart_legacy_rx_hdlc(bus, frame, sizeof(frame));
     if (!frame_len)
         return 0;
-    frame_len = uart_legacy_decode_hdlc(buf, buf_len, frame, frame_len, bus->uart.init_phase);
+    frame_len = uart_legacy_decode_hdlc(bus, buf, buf_len, frame, frame_len);
     return frame_len;
 }
 
@@ -332,7 +436,7 @@ bool uart_detect_v2(struct bus *bus)
             return false;
         uart_read(bus);
         bus->uart.data_ready = true;
-        for (int i = 0; i < bus->uart.rx_buf_len - 4; i++)
+        for (int i = bus->uart.rx_buf_off; i < bus->uart.rx_buf_len - 4; i++)
             if (crc_check(CRC_INIT_HCS, bus->uart.rx_buf + i, 2,
                           read_le16(bus->uart.rx_buf + i + 2)))
                 return true;
@@ -350,6 +454,7 @@ static inline int uart_txqlen(struct bus *bus)
 
 void uart_tx_flush(struct bus *bus)
 {
+    uart_tx_commit(bus);
     while (uart_txqlen(bus))
         usleep(1000);
 }
@@ -17,20 +17,55 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "common/iobuf.h"
+
 struct bus;
 
 #define UART_HDR_LEN_MASK 0x07ff
 
 struct bus_uart {
     bool    data_ready;
+    // rx_buf[rx_buf_off] to rx_buf[rx_buf_len - 1] contains the received data
+    // not processed yet. The consumed bytes are reclaimed on the next read().
+    int     rx_buf_off;
     int     rx_buf_len;
-    uint8_t rx_buf[2048];
+    uint8_t rx_buf[8192];
     bool    init_phase;
+    // Statistics on receive errors
+    uint64_t rx_err_hcs;
+    uint64_t rx_err_fcs;
+    uint64_t rx_err_hdlc_crc;
+    uint64_t rx_err_hdlc_len;
+    uint64_t rx_drop_bytes; // Bytes discarded while resynchronizing
+
+    // Frames are queued in tx_queue and sent in a single write() by
+    // uart_tx_commit(), or as soon as tx_batch_size bytes are pending.
+    // 0 disables batching.
+    int     tx_batch_size;
+    struct iobuf_write tx_queue;
+    int     tx_queue_frames;
+    // Frame being serialized in tx_queue, see uart_tx_start()
+    bool    tx_frame_pending;
+    int     tx_frame_offset;
+    // Statistics: tx_frame_cnt / tx_flush_cnt gives the average number of
+    // frames per write()
+    uint64_t tx_frame_cnt;
+    uint64_t tx_flush_cnt;
+    int      tx_flush_frames_max;
 };
 
 int uart_open(const char *device, int bitrate, bool hardflow);
 
 int uart_tx(struct bus *bus, const void *buf, unsigned int len);
+// Serialize a frame directly in the transmission queue: uart_tx_start()
+// reserves room for the UART header and returns the queue, where the caller
+// appends the frame payload. uart_tx_end() then fills the header and the FCS.
+// The queue may be reallocated in between, so pointers into it must not be
+// kept.
+struct iobuf_write *uart_tx_start(struct bus *bus);
+int uart_tx_end(struct bus *bus);
+// Send the frames queued by uart_tx(). No-op if the queue is empty.
+void uart_tx_commit(struct bus *bus);
 int uart_rx(struct bus *bus, void *buf, unsigned int len);
 
 int uart_legacy_tx(struct bus *bus, const void *buf, unsigned int len);
@@ -39,7 +74,8 @@ int uart_legacy_rx(struct bus *bus, void *buf, unsigned int len);
 // Try to find a valid APIv2 header within the first bytes received.
 bool uart_detect_v2(struct bus *bus);
 
-// Wait for the kernel transmission queue to send all of its content.
+// Send the pending frames and wait for the kernel transmission queue to send
+// all of its content.
 void uart_tx_flush(struct bus *bus);
 
 #endif
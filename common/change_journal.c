@@ -0,0 +1,174 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "common/log.h"
+#include "common/memutils.h"
+
+#include "change_journal.h"
+
+void change_journal_init(struct change_journal *journal, int key_len, int tombstone_max)
+{
+    BUG_ON(key_len <= 0 || key_len > CHANGE_JOURNAL_KEY_LEN_MAX);
+    memset(journal, 0, sizeof(*journal));
+    journal->key_len = key_len;
+    journal->tombstone_max = tombstone_max;
+    TAILQ_INIT(&journal->entries);
+    TAILQ_INIT(&journal->tombstones);
+}
+
+static struct change_journal_entry *change_journal_find(const struct change_journal *journal,
+                                                        const uint8_t *key, uint32_t hash)
+{
+    struct change_journal_entry *entry;
+    struct hash_entry *it;
+
+    hash_table_foreach(&journal->index, it, hash) {
+        entry = container_of(it, struct change_journal_entry, hash_entry);
+        if (!memcmp(entry->key, key, journal->key_len))
+            return entry;
+    }
+    return NULL;
+}
+
+// Give a new generation to the entry, and move it to the end of the journal
+static void change_journal_bump(struct change_journal *journal, struct change_journal_entry *entry)
+{
+    TAILQ_REMOVE(&journal->entries, entry, link);
+    entry->gen = ++journal->gen;
+    TAILQ_INSERT_TAIL(&journal->entries, entry, link);
+}
+
+static void change_journal_drop(struct change_journal *journal, struct change_journal_entry *entry)
+{
+    BUG_ON(!entry->removed);
+    journal->gen_expired = entry->gen;
+    TAILQ_REMOVE(&journal->tombstones, entry, tombstone_link);
+    journal->tombstone_cnt--;
+    TAILQ_REMOVE(&journal->entries, entry, link);
+    hash_table_remove(&journal->index, &entry->hash_entry);
+    free(entry);
+}
+
+static void change_journal_tombstone(struct change_journal *journal, struct change_journal_entry *entry)
+{
+    entry->removed = true;
+    TAILQ_INSERT_TAIL(&journal->tombstones, entry, tombstone_link);
+    journal->tombstone_cnt++;
+    change_journal_bump(journal, entry);
+}
+
+static void change_journal_gc(struct change_journal *journal)
+{
+    while (journal->tombstone_cnt > journal->tombstone_max)
+        change_journal_drop(journal, TAILQ_FIRST(&journal->tombstones));
+}
+
+static struct change_journal_entry *change_journal_set(struct change_journal *journal,
+                                                       struct change_journal_entry *entry,
+                                                       const uint8_t *key, uint32_t hash,
+                                                       uint32_t digest)
+{
+    if (!entry) {
+        entry = zalloc(sizeof(*entry));
+        memcpy(entry->key, key, journal->key_len);
+        entry->digest = digest;
+        entry->gen = ++journal->gen;
+        hash_table_insert(&journal->index, &entry->hash_entry, hash);
+        TAILQ_INSERT_TAIL(&journal->entries, entry, link);
+    } else if (entry->removed) {
+        TAILQ_REMOVE(&journal->tombstones, entry, tombstone_link);
+        journal->tombstone_cnt--;
+        entry->removed = false;
+        entry->digest = digest;
+        change_journal_bump(journal, entry);
+    } else if (entry->digest != digest) {
+        entry->digest = digest;
+        change_journal_bump(journal, entry);
+    }
+    return entry;
+}
+
+void change_journal_update(struct change_journal *journal, const uint8_t *key, uint32_t digest)
+{
+    uint32_t hash = hash_table_key(key, journal->key_len);
+
+    change_journal_set(journal, change_journal_find(journal, key, hash), key, hash, digest);
+}
+
+void change_journal_remove(struct change_journal *journal, const uint8_t *key)
+{
+    struct change_journal_entry *entry;
+
+    entry = change_journal_find(journal, key, hash_table_key(key, journal->key_len));
+    if (!entry || entry->removed)
+        return;
+    change_journal_tombstone(journal, entry);
+    change_journal_gc(journal);
+}
+
+void change_journal_refresh_start(struct change_journal *journal)
+{
+    struct change_journal_entry *entry;
+
+    TAILQ_FOREACH(entry, &journal->entries, link)
+        entry->seen = false;
+}
+
+void change_journal_refresh(struct change_journal *journal, const uint8_t *key, uint32_t digest)
+{
+    uint32_t hash = hash_table_key(key, journal->key_len);
+    struct change_journal_entry *entry = change_journal_find(journal, key, hash);
+
+    // Reported twice, the first report wins
+    if (entry && entry->seen)
+        return;
+    entry = change_journal_set(journal, entry, key, hash, digest);
+    entry->seen = true;
+}
+
+void change_journal_refresh_end(struct change_journal *journal)
+{
+    struct change_journal_entry *entry, *next, *last;
+
+    // Removed entries are moved to the end, stop once the entries present
+    // at the beginning of the walk have been processed
+    last = TAILQ_LAST(&journal->entries, change_journal_entry_list);
+    for (entry = TAILQ_FIRST(&journal->entries); entry; entry = next) {
+        next = entry == last ? NULL : TAILQ_NEXT(entry, link);
+        if (entry->seen || entry->removed)
+            continue;
+        change_journal_tombstone(journal, entry);
+    }
+    change_journal_gc(journal);
+}
+
+struct change_journal_entry *change_journal_first_since(const struct change_journal *journal, uint64_t gen)
+{
+    struct change_journal_entry *entry, *first = NULL;
+
+    // Recent changes are at the end
+    TAILQ_FOREACH_REVERSE(entry, &journal->entries, change_journal_entry_list, link) {
+        if (entry->gen <= gen)
+            break;
+        first = entry;
+    }
+    return first;
+}
+
+struct change_journal_entry *change_journal_next(const struct change_journal_entry *entry)
+{
+    return TAILQ_NEXT(entry, link);
+}
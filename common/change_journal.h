@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef CHANGE_JOURNAL_H
+#define CHANGE_JOURNAL_H
+#include <sys/queue.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/hash_table.h"
+
+/*
+ * Generation-numbered journal of the changes of a set of entries identified
+ * by a key (up to 16 bytes). It allows to only send the entries which have
+ * changed to clients which have already retrieved the set once.
+ *
+ * The owner of the set reports each entry with a digest of its content.
+ * Entries which are new or whose digest has changed receive a new generation.
+ * The owner can either report each change with change_journal_update() and
+ * change_journal_remove(), or, when it cannot track the changes, report the
+ * whole set with change_journal_refresh(): entries which have not been
+ * reported during the refresh are then removed. The journal keeps the entries
+ * sorted by generation, so retrieving the changes since a given generation
+ * only costs the number of changed entries.
+ *
+ * Removed entries are kept as tombstones (up to tombstone_max) so they can be
+ * reported to clients. Once a tombstone has been dropped, clients which are
+ * older than its generation cannot be updated anymore and have to retrieve
+ * the full set again (see change_journal_is_expired()).
+ *
+ * The journal has to be initialized with change_journal_init().
+ */
+
+#define CHANGE_JOURNAL_KEY_LEN_MAX 16
+
+struct change_journal_entry {
+    uint8_t key[CHANGE_JOURNAL_KEY_LEN_MAX];
+    uint64_t gen;
+    bool removed;
+
+    // Internal fields
+    uint32_t digest;
+    bool seen;
+    TAILQ_ENTRY(change_journal_entry) link;
+    TAILQ_ENTRY(change_journal_entry) tombstone_link;
+    struct hash_entry hash_entry;
+};
+
+struct change_journal {
+    int key_len;
+    int tombstone_max;
+    // Generation of the most recent change, 0 if the set was always empty
+    uint64_t gen;
+    // Changes up to this generation are not available anymore
+    uint64_t gen_expired;
+
+    // Internal fields
+    TAILQ_HEAD(change_journal_entry_list, change_journal_entry) entries;
+    TAILQ_HEAD(, change_journal_entry) tombstones;
+    struct hash_table index;
+    int tombstone_cnt;
+};
+
+void change_journal_init(struct change_journal *journal, int key_len, int tombstone_max);
+
+// Report a single entry, added, modified or removed. Both are no-ops if the
+// entry did not change.
+void change_journal_update(struct change_journal *journal, const uint8_t *key, uint32_t digest);
+void change_journal_remove(struct change_journal *journal, const uint8_t *key);
+
+// Report the whole set: call change_journal_refresh_start(), then
+// change_journal_refresh() for every entry, then change_journal_refresh_end().
+void change_journal_refresh_start(struct change_journal *journal);
+void change_journal_refresh(struct change_journal *journal, const uint8_t *key, uint32_t digest);
+void change_journal_refresh_end(struct change_journal *journal);
+
+// A client knowing the state at generation gen cannot be updated anymore.
+// Generation 0 (nothing known) never expires.
+static inline bool change_journal_is_expired(const struct change_journal *journal, uint64_t gen)
+{
+    return gen && gen < journal->gen_expired;
+}
+
+// Return the oldest entry changed after generation gen, or NULL. The next
+// ones are retrieved with change_journal_next().
+struct change_journal_entry *change_journal_first_since(const struct change_journal *journal, uint64_t gen);
+struct change_journal_entry *change_journal_next(const struct change_journal_entry *entry);
+
+#endif
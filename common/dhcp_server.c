@@ -262,8 +262,9 @@ static int dhcp_handle_request_fwd(struct dhcp_server *dhcp,
                                     struct iobuf_read *req, struct iobuf_write *reply)
 {
     struct iobuf_read opt_interface_id, opt_relay;
-    struct iobuf_write relay_reply = { };
+    struct iobuf_write relay_reply;
     const uint8_t *linkaddr, *peeraddr;
+    uint8_t relay_buf[512];
     uint8_t hopcount;
 
     hopcount = iobuf_pop_u8(req);
@@ -284,8 +285,11 @@ static int dhcp_handle_request_fwd(struct dhcp_server *dhcp,
         TRACE(TR_DROP, "drop %-9s: missing relay option", "dhcp");
         return -EINVAL;
     }
-    if (dhcp_handle_request(dhcp, &opt_relay, &relay_reply))
+    iobuf_init_storage(&relay_reply, relay_buf, sizeof(relay_buf));
+    if (dhcp_handle_request(dhcp, &opt_relay, &relay_reply)) {
+        iobuf_free(&relay_reply);
         return -EINVAL;
+    }
     iobuf_push_be16(reply, DHCPV6_OPT_RELAY);
     iobuf_push_be16(reply, relay_reply.len);
     iobuf_push_data(reply, relay_reply.data, relay_reply.len);
@@ -338,7 +342,8 @@ void dhcp_recv(struct dhcp_server *dhcp)
     socklen_t src_addr_len = sizeof(struct sockaddr_in6);
     struct sockaddr_in6 src_addr;
     struct iobuf_read req = { };
-    struct iobuf_write reply = { };
+    struct iobuf_write reply;
+    uint8_t reply_buf[1024];
     uint8_t buf[1024];
 
     req.data = buf;
@@ -351,6 +356,7 @@ void dhcp_recv(struct dhcp_server *dhcp)
     TRACE(TR_DHCP, "rx-dhcp %-9s src:%s",
           val_to_str(req.data[0], dhcp_frames, "[UNK]"),
           tr_ipv6(src_addr.sin6_addr.s6_addr));
+    iobuf_init_storage(&reply, reply_buf, sizeof(reply_buf));
     if (!dhcp_handle_request(dhcp, &req, &reply))
         dhcp_send_reply(dhcp, &src_addr, &reply);
     iobuf_free(&reply);
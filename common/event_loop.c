@@ -0,0 +1,139 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <errno.h>
+
+#include "common/log.h"
+#include "common/memutils.h"
+
+#include "event_loop.h"
+
+void event_loop_init(struct event_loop *loop)
+{
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    FATAL_ON(loop->epoll_fd < 0, 2, "epoll_create1: %m");
+    SLIST_INIT(&loop->always_ready);
+    loop->on_wakeup = NULL;
+    loop->pending = NULL;
+    loop->pending_cnt = 0;
+    loop->always_ready_next = NULL;
+}
+
+void event_loop_add(struct event_loop *loop, struct event_loop_src *src)
+{
+    struct epoll_event ev = {
+        .events   = src->events,
+        .data.ptr = src,
+    };
+    int ret;
+
+    BUG_ON(src->registered);
+    BUG_ON(!src->callback);
+    if (src->fd < 0)
+        return;
+    ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, src->fd, &ev);
+    if (ret < 0 && errno == EPERM) {
+        src->always_ready = true;
+        SLIST_INSERT_HEAD(&loop->always_ready, src, link);
+    } else {
+        FATAL_ON(ret < 0, 2, "epoll_ctl add fd=%d: %m", src->fd);
+    }
+    src->registered = true;
+}
+
+void event_loop_del(struct event_loop *loop, struct event_loop_src *src)
+{
+    int ret;
+
+    if (!src->registered)
+        return;
+    // Do not dispatch the source anymore in the current iteration
+    for (int i = 0; i < loop->pending_cnt; i++)
+        if (loop->pending[i].data.ptr == src)
+            loop->pending[i].data.ptr = NULL;
+    if (loop->always_ready_next == src)
+        loop->always_ready_next = SLIST_NEXT(src, link);
+    if (src->always_ready) {
+        SLIST_REMOVE(&loop->always_ready, src, event_loop_src, link);
+        src->always_ready = false;
+    } else {
+        ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+        FATAL_ON(ret < 0, 2, "epoll_ctl del fd=%d: %m", src->fd);
+    }
+    src->registered = false;
+}
+
+void event_loop_set_events(struct event_loop *loop, struct event_loop_src *src, uint32_t events)
+{
+    struct epoll_event ev = {
+        .events   = events,
+        .data.ptr = src,
+    };
+    int ret;
+
+    if (src->events == events)
+        return;
+    src->events = events;
+    if (!src->registered || src->always_ready)
+        return;
+    ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, src->fd, &ev);
+    FATAL_ON(ret < 0, 2, "epoll_ctl mod fd=%d: %m", src->fd);
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms)
+{
+    struct epoll_event ev[EVENT_LOOP_BATCH_SIZE];
+    struct event_loop_src *src;
+    uint32_t revents;
+    int cnt = 0;
+    int ret;
+
+    BUG_ON(loop->pending, "recursive dispatch");
+    // Regular files are always ready for reading and writing
+    SLIST_FOREACH(src, &loop->always_ready, link)
+        if (src->events & (EPOLLIN | EPOLLOUT))
+            timeout_ms = 0;
+
+    ret = epoll_wait(loop->epoll_fd, ev, ARRAY_SIZE(ev), timeout_ms);
+    if (ret < 0 && errno == EINTR)
+        return 0;
+    FATAL_ON(ret < 0, 2, "epoll_wait: %m");
+    if (loop->on_wakeup)
+        loop->on_wakeup(loop);
+
+    loop->pending = ev;
+    loop->pending_cnt = ret;
+    for (int i = 0; i < ret; i++) {
+        src = ev[i].data.ptr;
+        // The source may have been removed by a previous callback
+        if (!src)
+            continue;
+        ev[i].data.ptr = NULL;
+        src->callback(src, ev[i].events);
+        cnt++;
+    }
+    loop->pending = NULL;
+    loop->pending_cnt = 0;
+
+    // Sources added by the callbacks are inserted at the head, and are only
+    // dispatched on the next iteration.
+    for (src = SLIST_FIRST(&loop->always_ready); src; src = loop->always_ready_next) {
+        loop->always_ready_next = SLIST_NEXT(src, link);
+        revents = src->events & (EPOLLIN | EPOLLOUT);
+        if (!revents)
+            continue;
+        src->callback(src, revents);
+        cnt++;
+    }
+    return cnt;
+}
@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+#include <sys/epoll.h>
+#include <sys/queue.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * File descriptor multiplexer based on epoll(7).
+ *
+ * Each event source embeds a struct event_loop_src, fills the fields fd,
+ * events (EPOLLIN, EPOLLOUT...) and callback, and registers itself using
+ * event_loop_add(). event_loop_dispatch() waits for activity and only calls
+ * the callbacks of the sources which are ready, so the cost of a wakeup does
+ * not depend on the number of registered sources. The callback can retrieve
+ * its context using container_of().
+ *
+ * epoll(7) refuses regular files, which poll(2) always reports as ready. Such
+ * file descriptors (typically used for replay) are kept on a side list and
+ * are dispatched on every iteration, which preserves the poll(2) semantics.
+ *
+ * Sources can be added, modified and removed from the callbacks.
+ */
+
+struct event_loop_src {
+    int fd;
+    uint32_t events;
+    void (*callback)(struct event_loop_src *src, uint32_t revents);
+
+    // Internal fields
+    bool registered;
+    bool always_ready;
+    SLIST_ENTRY(event_loop_src) link;
+};
+
+// Number of events retrieved per epoll_wait() call. Remaining events are
+// reported on the next call.
+#define EVENT_LOOP_BATCH_SIZE 16
+
+struct event_loop {
+    int epoll_fd;
+    SLIST_HEAD(, event_loop_src) always_ready;
+    // Optional, called after each wait and before any callback, so the
+    // callbacks see a state consistent with the current time.
+    void (*on_wakeup)(struct event_loop *loop);
+
+    // Internal fields. Sources not dispatched yet by the current
+    // event_loop_dispatch() call, updated by event_loop_del() so callbacks
+    // can remove (and free) any source.
+    struct epoll_event *pending;
+    int pending_cnt;
+    struct event_loop_src *always_ready_next;
+};
+
+void event_loop_init(struct event_loop *loop);
+
+// Sources with a negative fd are silently ignored.
+void event_loop_add(struct event_loop *loop, struct event_loop_src *src);
+void event_loop_del(struct event_loop *loop, struct event_loop_src *src);
+// No-op if events did not change.
+void event_loop_set_events(struct event_loop *loop, struct event_loop_src *src, uint32_t events);
+
+// Wait up to timeout_ms (-1 for infinite) and call the callbacks of the ready
+// sources. Return the number of callbacks called.
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms);
+
+#endif
@@ -12,70 +12,61 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <sys/eventfd.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
-#include <fcntl.h>
 
-#include "common/ns_list.h"
 #include "common/log.h"
 #include "common/memutils.h"
 
 #include "events_scheduler.h"
 
+// Initial number of events in the ring
+#define EVENT_QUEUE_SIZE_MIN 64
+
 struct events_scheduler *g_event_scheduler;
 
-static struct event_tasklet *event_tasklet_handler_get(uint8_t tasklet_id)
+int8_t event_handler_create(void (*handler_func_ptr)(struct event_payload *))
 {
     struct events_scheduler *ctxt = g_event_scheduler;
 
     BUG_ON(!ctxt);
-    ns_list_foreach(struct event_tasklet, cur, &ctxt->event_tasklet_list) {
-        if (cur->id == tasklet_id) {
-            return cur;
-        }
-    }
-    return NULL;
+    if (ctxt->tasklets_cnt >= ARRAY_SIZE(ctxt->tasklets))
+        return -1;
+    ctxt->tasklets[ctxt->tasklets_cnt] = handler_func_ptr;
+    return ctxt->tasklets_cnt++;
 }
 
-static int8_t event_tasklet_get_free_id(void)
+// Double the size of the ring, and move the events to the start of the new one
+static void event_queue_grow(struct events_scheduler *ctxt)
 {
-    /*(Note use of uint8_t to avoid overflow if we reach 0x7F)*/
-    for (uint8_t i = 0; i <= INT8_MAX; i++) {
-        if (!event_tasklet_handler_get(i)) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-int8_t event_handler_create(void (*handler_func_ptr)(struct event_payload *))
-{
-    struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_tasklet *new = zalloc(sizeof(struct event_tasklet));
-
-    BUG_ON(!ctxt);
-    new->id = event_tasklet_get_free_id();
-    new->func_ptr = handler_func_ptr;
-    ns_list_add_to_end(&ctxt->event_tasklet_list, new);
-
-    return new->id;
+    unsigned int size = ctxt->queue_size ? ctxt->queue_size * 2 : EVENT_QUEUE_SIZE_MIN;
+    struct event_payload *queue = xalloc(size * sizeof(struct event_payload));
+    unsigned int mask = ctxt->queue_size - 1;
+
+    for (unsigned int i = 0; i < ctxt->queue_len; i++)
+        queue[i] = ctxt->queue[(ctxt->queue_head + i) & mask];
+    free(ctxt->queue);
+    ctxt->queue = queue;
+    ctxt->queue_size = size;
+    ctxt->queue_head = 0;
 }
 
 int8_t event_send(const struct event_payload *event)
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_payload *event_dup;
 
     BUG_ON(!ctxt);
-    if (!event_tasklet_handler_get(event->receiver))
+    if (event->receiver < 0 || event->receiver >= ctxt->tasklets_cnt)
         return -1;
 
-    event_dup = xalloc(sizeof(struct event_payload));
-    memcpy(event_dup, event, sizeof(struct event_payload));
-    ns_list_add_to_end(&ctxt->event_queue, event_dup);
+    if (ctxt->queue_len == ctxt->queue_size)
+        event_queue_grow(ctxt);
+    ctxt->queue[(ctxt->queue_head + ctxt->queue_len) & (ctxt->queue_size - 1)] = *event;
+    ctxt->queue_len++;
     event_scheduler_signal();
     return 0;
 }
@@ -83,44 +74,56 @@ int8_t event_send(const struct event_payload *event)
 bool event_scheduler_dispatch_event(void)
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_payload *event = ns_list_get_first(&ctxt->event_queue);
-    struct event_tasklet *tasklet;
+    struct event_payload event;
 
     BUG_ON(!ctxt);
-    if (!event)
+    if (!ctxt->queue_len)
         return false;
-    ns_list_remove(&ctxt->event_queue, event);
-    tasklet = event_tasklet_handler_get(event->receiver);
-    if (tasklet) {
-        tasklet->func_ptr(event);
-    } else {
-        WARN();
-    }
-    free(event);
-
+    // The tasklet may send events (and reallocate the ring), so it works on a
+    // copy
+    event = ctxt->queue[ctxt->queue_head];
+    ctxt->queue_head = (ctxt->queue_head + 1) & (ctxt->queue_size - 1);
+    ctxt->queue_len--;
+    ctxt->tasklets[event.receiver](&event);
     return true;
 }
 
 void event_scheduler_run_until_idle(void)
 {
     while (event_scheduler_dispatch_event());
+    // Events sent from now on need a new wakeup
+    g_event_scheduler->wakeup_pending = false;
 }
 
 void event_scheduler_signal()
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    uint64_t val = 'W';
+    uint64_t val = 1;
 
-    write(ctxt->event_fd[1], &val, sizeof(val));
+    if (ctxt->wakeup_pending)
+        return;
+    write(ctxt->event_fd, &val, sizeof(val));
+    ctxt->wakeup_pending = true;
 }
 
-void event_scheduler_init(struct events_scheduler *ctxt)
+static void event_scheduler_on_event(struct event_loop_src *src, uint32_t revents)
 {
-    g_event_scheduler = ctxt;
-    pipe(ctxt->event_fd);
-    fcntl(ctxt->event_fd[1], F_SETPIPE_SZ, sizeof(uint64_t) * 2);
-    fcntl(ctxt->event_fd[1], F_SETFL, O_NONBLOCK);
+    struct events_scheduler *ctxt = container_of(src, struct events_scheduler, loop_src);
+    uint64_t val;
 
-    ns_list_init(&ctxt->event_queue);
-    ns_list_init(&ctxt->event_tasklet_list);
+    if (!(revents & EPOLLIN))
+        return;
+    read(ctxt->event_fd, &val, sizeof(val));
+    event_scheduler_run_until_idle();
+}
+
+void event_scheduler_init(struct events_scheduler *ctxt, struct event_loop *loop)
+{
+    g_event_scheduler = ctxt;
+    ctxt->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FATAL_ON(ctxt->event_fd < 0, 2, "eventfd: %m");
+    ctxt->loop_src.fd       = ctxt->event_fd;
+    ctxt->loop_src.events   = EPOLLIN;
+    ctxt->loop_src.callback = event_scheduler_on_event;
+    event_loop_add(loop, &ctxt->loop_src);
 }
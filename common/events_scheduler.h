@@ -16,32 +16,41 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#include "common/ns_list.h"
+#include "common/event_loop.h"
 
 struct event_payload {
     int8_t receiver;    /* Tasklet ID */
     uint8_t event_id;
     void *data_ptr;
-    ns_list_link_t link;
-};
-
-struct event_tasklet {
-    int8_t id;
-    void (*func_ptr)(struct event_payload *);
-    ns_list_link_t link;
 };
 
+/*
+ * Events are queued in a ring of payloads which is only reallocated (doubled)
+ * when it is full, so sending an event does not allocate in steady state.
+ * Tasklets are indexed by their ID.
+ *
+ * The event file descriptor (an eventfd) is only written when no wakeup is
+ * pending, so a burst of events costs a single wakeup of the main loop.
+ */
 struct events_scheduler {
-    int event_fd[2];
-    NS_LIST_HEAD(struct event_tasklet, link) event_tasklet_list;
-    NS_LIST_HEAD(struct event_payload, link) event_queue;
+    int event_fd;
+    struct event_loop_src loop_src;
+    bool wakeup_pending;
+    void (*tasklets[INT8_MAX + 1])(struct event_payload *);
+    int tasklets_cnt;
+    struct event_payload *queue;
+    unsigned int queue_size; // Power of 2
+    unsigned int queue_head;
+    unsigned int queue_len;
 };
 
 /**
  * \brief Initialise event scheduler.
  *
+ * The event file descriptor is registered in loop, which runs the events
+ * when it becomes readable.
  */
-void event_scheduler_init(struct events_scheduler *ctxt);
+void event_scheduler_init(struct events_scheduler *ctxt, struct event_loop *loop);
 
 /**
  * Process one event from event queue.
@@ -53,6 +62,8 @@ bool event_scheduler_dispatch_event(void);
 
 /**
  * \brief Process events until no more events to process.
+ *
+ * The caller is expected to have consumed event_fd beforehand.
  */
 void event_scheduler_run_until_idle(void);
 
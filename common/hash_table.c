@@ -0,0 +1,143 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+
+#include "hash_table.h"
+
+// Keys are usually addresses (8 or 16 bytes), they are mixed a word at a time
+// and the result goes through the MurmurHash3 finalizer so the low bits used
+// to select the bucket depend on all the bytes of the key.
+uint32_t hash_table_key(const void *key, size_t len)
+{
+    const uint8_t *data = key;
+    uint64_t hash = len;
+    uint64_t word;
+
+    while (len) {
+        word = 0;
+        memcpy(&word, data, MIN(len, sizeof(word)));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+        hash ^= hash >> 32;
+        data += MIN(len, sizeof(word));
+        len -= MIN(len, sizeof(word));
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static struct hash_bucket *hash_table_bucket(const struct hash_table *table, uint32_t hash)
+{
+    return &table->buckets[hash & (table->bucket_cnt - 1)];
+}
+
+static void hash_table_grow(struct hash_table *table)
+{
+    struct hash_bucket *buckets = table->buckets;
+    int bucket_cnt = table->bucket_cnt;
+    struct hash_entry *entry;
+
+    table->bucket_cnt = bucket_cnt ? bucket_cnt * 2 : 64;
+    table->buckets = xalloc(table->bucket_cnt * sizeof(*table->buckets));
+    for (int i = 0; i < table->bucket_cnt; i++)
+        TAILQ_INIT(&table->buckets[i]);
+    // The entries of an old bucket are split between 2 new buckets, inserting
+    // them at the tail keeps their order
+    for (int i = 0; i < bucket_cnt; i++) {
+        while ((entry = TAILQ_FIRST(&buckets[i]))) {
+            TAILQ_REMOVE(&buckets[i], entry, link);
+            TAILQ_INSERT_TAIL(hash_table_bucket(table, entry->hash), entry, link);
+        }
+    }
+    free(buckets);
+}
+
+void hash_table_insert(struct hash_table *table, struct hash_entry *entry, uint32_t hash)
+{
+    if (table->entry_cnt >= table->bucket_cnt)
+        hash_table_grow(table);
+    entry->hash = hash;
+    TAILQ_INSERT_HEAD(hash_table_bucket(table, hash), entry, link);
+    table->entry_cnt++;
+}
+
+void hash_table_remove(struct hash_table *table, struct hash_entry *entry)
+{
+    BUG_ON(!table->entry_cnt);
+    TAILQ_REMOVE(hash_table_bucket(table, entry->hash), entry, link);
+    table->entry_cnt--;
+}
+
+void hash_table_move_to_head(struct hash_table *table, struct hash_entry *entry)
+{
+    struct hash_bucket *bucket = hash_table_bucket(table, entry->hash);
+
+    if (TAILQ_FIRST(bucket) == entry)
+        return;
+    TAILQ_REMOVE(bucket, entry, link);
+    TAILQ_INSERT_HEAD(bucket, entry, link);
+}
+
+void hash_table_free(struct hash_table *table)
+{
+    free(table->buckets);
+    memset(table, 0, sizeof(*table));
+}
+
+static struct hash_entry *hash_table_match(const struct hash_entry *entry, uint32_t hash)
+{
+    while (entry && entry->hash != hash)
+        entry = TAILQ_NEXT(entry, link);
+    return (struct hash_entry *)entry;
+}
+
+struct hash_entry *hash_table_first(const struct hash_table *table, uint32_t hash)
+{
+    if (!table->bucket_cnt)
+        return NULL;
+    return hash_table_match(TAILQ_FIRST(hash_table_bucket(table, hash)), hash);
+}
+
+struct hash_entry *hash_table_next(const struct hash_entry *entry)
+{
+    return hash_table_match(TAILQ_NEXT(entry, link), entry->hash);
+}
+
+static struct hash_entry *hash_table_iter_from(const struct hash_table *table, int bucket)
+{
+    for (; bucket < table->bucket_cnt; bucket++)
+        if (!TAILQ_EMPTY(&table->buckets[bucket]))
+            return TAILQ_FIRST(&table->buckets[bucket]);
+    return NULL;
+}
+
+struct hash_entry *hash_table_iter_first(const struct hash_table *table)
+{
+    return hash_table_iter_from(table, 0);
+}
+
+struct hash_entry *hash_table_iter_next(const struct hash_table *table, const struct hash_entry *entry)
+{
+    if (TAILQ_NEXT(entry, link))
+        return TAILQ_NEXT(entry, link);
+    return hash_table_iter_from(table, (entry->hash & (table->bucket_cnt - 1)) + 1);
+}
@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+#include <sys/queue.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Chained hash table indexing entries owned by the caller, which usually
+ * embeds struct hash_entry and uses container_of().
+ *
+ * The table does not know about keys: the caller provides the hash of the key
+ * on insertion (typically with hash_table_key()), and compares the keys of the
+ * entries returned by hash_table_first()/hash_table_next(). Several entries
+ * may share a key. The hash is stored in the entry, so removal and growth do
+ * not depend on the key, which may change once the entry is inserted.
+ *
+ * Entries are inserted at the head of their bucket and growing the table keeps
+ * their relative order, so entries sharing a key are walked in reverse
+ * insertion order. An entry is moved to the head with hash_table_move_to_head().
+ *
+ * Buckets are allocated on the first insertion and their number is doubled
+ * when the table holds more entries than buckets. The table has to be
+ * initialized with zeros and is released with hash_table_free().
+ */
+
+struct hash_entry {
+    // Internal fields
+    uint32_t hash;
+    TAILQ_ENTRY(hash_entry) link;
+};
+
+TAILQ_HEAD(hash_bucket, hash_entry);
+
+struct hash_table {
+    int entry_cnt;
+
+    // Internal fields
+    struct hash_bucket *buckets;
+    int bucket_cnt; // Power of 2
+};
+
+uint32_t hash_table_key(const void *key, size_t len);
+
+void hash_table_insert(struct hash_table *table, struct hash_entry *entry, uint32_t hash);
+void hash_table_remove(struct hash_table *table, struct hash_entry *entry);
+// Walk entry first among the entries sharing its key
+void hash_table_move_to_head(struct hash_table *table, struct hash_entry *entry);
+// Entries still present are not released
+void hash_table_free(struct hash_table *table);
+
+// Return the first entry inserted with hash, or NULL. The next ones are
+// retrieved with hash_table_next().
+struct hash_entry *hash_table_first(const struct hash_table *table, uint32_t hash);
+struct hash_entry *hash_table_next(const struct hash_entry *entry);
+
+// Walk all the entries, in no particular order. To remove the current entry,
+// retrieve the next one first.
+struct hash_entry *hash_table_iter_first(const struct hash_table *table);
+struct hash_entry *hash_table_iter_next(const struct hash_table *table, const struct hash_entry *entry);
+
+#define hash_table_foreach(table, entry, hash) \
+    for ((entry) = hash_table_first(table, hash); (entry); (entry) = hash_table_next(entry))
+
+#endif
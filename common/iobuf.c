@@ -21,11 +21,23 @@
 #include "iobuf.h"
 
 static void iobuf_enlarge_buffer(struct iobuf_write *buf, size_t new_data_size) {
-    if (buf->data_size < buf->len + new_data_size) {
-        buf->data_size = MAX(64, buf->len + new_data_size);
-        buf->data = realloc(buf->data, buf->data_size);
-        BUG_ON(!buf->data);
+    uint8_t *data;
+    int size;
+
+    if (buf->data_size >= buf->len + new_data_size)
+        return;
+    size = MAX(64, MAX(buf->len + new_data_size, buf->data_size * 2));
+    if (buf->ext_storage) {
+        data = malloc(size);
+        BUG_ON(!data);
+        memcpy(data, buf->data, buf->len);
+        buf->ext_storage = false;
+    } else {
+        data = realloc(buf->data, size);
+        BUG_ON(!data);
     }
+    buf->data = data;
+    buf->data_size = size;
 }
 
 void iobuf_push_u8(struct iobuf_write *buf, uint8_t val) {
@@ -96,10 +108,19 @@ void iobuf_push_data_reserved(struct iobuf_write *buf, const int num)
 }
 
 void iobuf_free(struct iobuf_write *buf) {
-    free(buf->data);
+    if (!buf->ext_storage)
+        free(buf->data);
     memset(buf, 0, sizeof(struct iobuf_write));
 }
 
+void iobuf_init_storage(struct iobuf_write *buf, void *storage, int size)
+{
+    buf->data = storage;
+    buf->data_size = size;
+    buf->len = 0;
+    buf->ext_storage = true;
+}
+
 static bool iobuf_validate(struct iobuf_read *buf, size_t data_size)
 {
     if (buf->err || iobuf_remaining_size(buf) < data_size) {
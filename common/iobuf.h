@@ -25,9 +25,16 @@
  *
  * For writing, the underlying buffer is allocated on first call to iobuf_push_*
  * and is enlarged each time it is necessary (thus, users do not have to compute
- * the size of the buffer to be allocated). iobuf_free() MUST be called to
- * release the memory. At anytime, the user can retrieve the content of the
- * buffer with the fields data and len.
+ * the size of the buffer to be allocated). The allocation grows geometrically,
+ * so building a buffer with many small pushes only reallocates a few times.
+ * iobuf_free() MUST be called to release the memory. At anytime, the user can
+ * retrieve the content of the buffer with the fields data and len.
+ *
+ * To avoid allocations on hot paths, a buffer can either be recycled with
+ * iobuf_reset() (the allocation is kept for the next message), or start on
+ * storage provided by the caller with iobuf_init_storage() (typically an array
+ * on the stack). In the latter case, the content is moved to the heap if the
+ * storage becomes too small, so iobuf_free() is still required.
  *
  * For reading, the caller has to set the fields data/data_size to the start/len
  * of the buffer he wants to parse. It is possible to have several iobufs
@@ -45,6 +52,8 @@ struct iobuf_write {
     int data_size;
     int len;
     uint8_t *data;
+    // Internal: data points to the storage given to iobuf_init_storage()
+    bool ext_storage;
 };
 
 struct iobuf_read {
@@ -66,6 +75,12 @@ void iobuf_push_le64(struct iobuf_write *buf, uint64_t val);
 void iobuf_push_data(struct iobuf_write *buf, const void *val, int num);
 void iobuf_push_data_reserved(struct iobuf_write *buf, const int num);
 void iobuf_free(struct iobuf_write *buf);
+void iobuf_init_storage(struct iobuf_write *buf, void *storage, int size);
+
+static inline void iobuf_reset(struct iobuf_write *buf)
+{
+    buf->len = 0;
+}
 
 uint8_t iobuf_pop_u8(struct iobuf_read *buf);
 uint16_t iobuf_pop_be16(struct iobuf_read *buf);
@@ -12,18 +12,75 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <sys/queue.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <fnmatch.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <glob.h>
 
+#include "common/crc.h"
+#include "common/endian.h"
+#include "common/hash_table.h"
 #include "common/log.h"
 #include "common/memutils.h"
 
 #include "key_value_storage.h"
 
+/*
+ * Layout of the log: an 8 bytes magic followed by records:
+ *
+ *   type (1) | name length (1) | CRC (2) | data length (4) | name | data
+ *
+ * The CRC covers the whole record (with the CRC field zeroed). A record of
+ * type PUT replaces the whole content of the file "name", a record of type
+ * DEL removes it. The log is read entirely on startup, and only the offset of
+ * the last version of each file is kept in memory. An invalid record (usually
+ * caused by a write interrupted by a crash) truncates the log.
+ *
+ * Once obsolete records make up more than half of the log, the live records
+ * are copied to a new file which atomically replaces the log.
+ *
+ * Records are flushed to the disk in batches by storage_log_sync(), which is
+ * called once per main loop iteration, so a crash loses at most the records
+ * of the last iteration. The directory is synced once the log is created or
+ * replaced.
+ */
+#define STORAGE_LOG_FILENAME "storage.log"
+#define STORAGE_LOG_MAGIC    "wsbrdkv1"
+#define STORAGE_LOG_HDR_LEN  8
+#define STORAGE_LOG_CRC_INIT 0xffff
+#define STORAGE_LOG_DATA_MAX (1024 * 1024)
+#define STORAGE_LOG_COMPACT_MIN_SIZE (64 * 1024)
+
+enum {
+    STORAGE_LOG_PUT = 1,
+    STORAGE_LOG_DEL = 2,
+};
+
+struct storage_log_entry {
+    char *name;
+    off_t offset; // Offset of the data in the log
+    uint32_t len;
+    struct hash_entry hash_entry;
+};
+
+static struct {
+    int fd;
+    char filename[PATH_MAX];
+    off_t size;
+    off_t live_size; // Size of the records which are not obsolete
+    bool sync_pending;
+    struct hash_table entries;
+} storage_log = {
+    .fd = -1,
+};
+
 const char *g_storage_prefix = NULL;
 
 int storage_check_access(const char *storage_prefix)
@@ -40,13 +97,446 @@ int storage_check_access(const char *storage_prefix)
     }
 }
 
+static size_t storage_log_record_len(const char *name, uint32_t len)
+{
+    return STORAGE_LOG_HDR_LEN + strlen(name) + len;
+}
+
+// Return the name of the file in the log, or NULL if filename is not stored
+// in the log
+static const char *storage_log_name(const char *filename)
+{
+    size_t prefix_len;
+
+    if (storage_log.fd < 0)
+        return NULL;
+    prefix_len = strlen(g_storage_prefix);
+    if (strncmp(filename, g_storage_prefix, prefix_len))
+        return NULL;
+    return filename + prefix_len;
+}
+
+static uint32_t storage_log_hash(const char *name)
+{
+    return hash_table_key(name, strlen(name));
+}
+
+static struct storage_log_entry *storage_log_find(const char *name)
+{
+    struct storage_log_entry *entry;
+    struct hash_entry *it;
+
+    hash_table_foreach(&storage_log.entries, it, storage_log_hash(name)) {
+        entry = container_of(it, struct storage_log_entry, hash_entry);
+        if (!strcmp(entry->name, name))
+            return entry;
+    }
+    return NULL;
+}
+
+// Walk all the entries, in no particular order
+static struct storage_log_entry *storage_log_next(struct storage_log_entry *entry)
+{
+    struct hash_entry *it;
+
+    if (entry)
+        it = hash_table_iter_next(&storage_log.entries, &entry->hash_entry);
+    else
+        it = hash_table_iter_first(&storage_log.entries);
+    return it ? container_of(it, struct storage_log_entry, hash_entry) : NULL;
+}
+
+static void storage_log_index(const char *name, off_t offset, uint32_t len)
+{
+    struct storage_log_entry *entry = storage_log_find(name);
+
+    if (entry) {
+        storage_log.live_size -= storage_log_record_len(entry->name, entry->len);
+    } else {
+        entry = zalloc(sizeof(*entry));
+        entry->name = strdup(name);
+        FATAL_ON(!entry->name, 2, "%s: cannot allocate memory", __func__);
+        hash_table_insert(&storage_log.entries, &entry->hash_entry, storage_log_hash(name));
+    }
+    entry->offset = offset;
+    entry->len = len;
+    storage_log.live_size += storage_log_record_len(entry->name, entry->len);
+}
+
+static void storage_log_unindex(struct storage_log_entry *entry)
+{
+    storage_log.live_size -= storage_log_record_len(entry->name, entry->len);
+    hash_table_remove(&storage_log.entries, &entry->hash_entry);
+    free(entry->name);
+    free(entry);
+}
+
+static void storage_log_encode_hdr(uint8_t hdr[STORAGE_LOG_HDR_LEN], uint8_t type,
+                                   const char *name, const void *data, uint32_t len)
+{
+    uint16_t crc;
+
+    hdr[0] = type;
+    hdr[1] = strlen(name);
+    write_le16(hdr + 2, 0);
+    write_le32(hdr + 4, len);
+    crc = crc16(STORAGE_LOG_CRC_INIT, hdr, STORAGE_LOG_HDR_LEN);
+    crc = crc16(crc, (const uint8_t *)name, hdr[1]);
+    crc = crc16(crc, data, len);
+    write_le16(hdr + 2, crc);
+}
+
+static int storage_log_write(int fd, uint8_t type, const char *name, const void *data, uint32_t len)
+{
+    uint8_t hdr[STORAGE_LOG_HDR_LEN];
+    struct iovec iov[] = {
+        { hdr,           sizeof(hdr)  },
+        { (void *)name,  strlen(name) },
+        { (void *)data,  len          },
+    };
+    ssize_t ret;
+
+    storage_log_encode_hdr(hdr, type, name, data, len);
+    ret = writev(fd, iov, ARRAY_SIZE(iov));
+    if (ret < 0)
+        return -1;
+    if (ret != storage_log_record_len(name, len)) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+// Make the creation or the replacement of the log durable
+static void storage_log_sync_dir(void)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    strcpy(path, storage_log.filename);
+    fd = open(dirname(path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0)
+        WARN("fsync %s: %m", path);
+    if (fd >= 0)
+        close(fd);
+}
+
+static void storage_log_compact(void)
+{
+    struct storage_log_entry *entry;
+    char filename[PATH_MAX + 4];
+    off_t *offsets, size;
+    int fd, i, ret;
+    void *data;
+
+    snprintf(filename, sizeof(filename), "%s.tmp", storage_log.filename);
+    fd = open(filename, O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        WARN("open %s: %m", filename);
+        return;
+    }
+    // Offsets are only updated once the new log is in place
+    offsets = xalloc(storage_log.entries.entry_cnt * sizeof(*offsets));
+    size = strlen(STORAGE_LOG_MAGIC);
+    ret = write(fd, STORAGE_LOG_MAGIC, size);
+    if (ret >= 0 && ret != size) {
+        errno = ENOSPC;
+        ret = -1;
+    }
+    i = 0;
+    for (entry = storage_log_next(NULL); entry && ret >= 0; entry = storage_log_next(entry)) {
+        data = xalloc(entry->len);
+        ret = pread(storage_log.fd, data, entry->len, entry->offset);
+        if (ret == entry->len) {
+            ret = storage_log_write(fd, STORAGE_LOG_PUT, entry->name, data, entry->len);
+        } else if (ret >= 0) {
+            errno = EIO;
+            ret = -1;
+        }
+        free(data);
+        if (ret < 0)
+            break;
+        offsets[i++] = size + STORAGE_LOG_HDR_LEN + strlen(entry->name);
+        size += storage_log_record_len(entry->name, entry->len);
+    }
+    if (ret >= 0)
+        ret = fsync(fd);
+    if (ret >= 0)
+        ret = rename(filename, storage_log.filename);
+    if (ret < 0) {
+        WARN("%s: %m", __func__);
+        unlink(filename);
+        close(fd);
+        free(offsets);
+        return;
+    }
+    storage_log_sync_dir();
+    close(storage_log.fd);
+    storage_log.fd = fd;
+    storage_log.sync_pending = false;
+    i = 0;
+    for (entry = storage_log_next(NULL); entry; entry = storage_log_next(entry))
+        entry->offset = offsets[i++];
+    free(offsets);
+    storage_log.size = size;
+    storage_log.live_size = size - strlen(STORAGE_LOG_MAGIC);
+}
+
+static int storage_log_append(uint8_t type, const char *name, const void *data, uint32_t len)
+{
+    struct storage_log_entry *entry;
+
+    if (strlen(name) > UINT8_MAX || len > STORAGE_LOG_DATA_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (storage_log_write(storage_log.fd, type, name, data, len) < 0) {
+        WARN("write %s: %m", storage_log.filename);
+        // Drop the partial record, if any
+        if (ftruncate(storage_log.fd, storage_log.size) < 0)
+            WARN("ftruncate %s: %m", storage_log.filename);
+        return -1;
+    }
+    storage_log.sync_pending = true;
+    if (type == STORAGE_LOG_PUT) {
+        storage_log_index(name, storage_log.size + STORAGE_LOG_HDR_LEN + strlen(name), len);
+    } else {
+        entry = storage_log_find(name);
+        if (entry)
+            storage_log_unindex(entry);
+    }
+    storage_log.size += storage_log_record_len(name, len);
+    if (storage_log.size > STORAGE_LOG_COMPACT_MIN_SIZE && storage_log.size > 2 * storage_log.live_size)
+        storage_log_compact();
+    return 0;
+}
+
+// Read the whole log and build the index
+static void storage_log_load(void)
+{
+    size_t magic_len = strlen(STORAGE_LOG_MAGIC);
+    struct storage_log_entry *entry;
+    uint8_t hdr_check[STORAGE_LOG_HDR_LEN];
+    uint8_t *data, *hdr, *end;
+    char name[UINT8_MAX + 1];
+    const char *err = NULL;
+    uint8_t name_len, type;
+    off_t size, offset;
+    uint32_t len;
+    uint16_t crc;
+    ssize_t ret;
+
+    size = lseek(storage_log.fd, 0, SEEK_END);
+    FATAL_ON(size < 0, 2, "lseek %s: %m", storage_log.filename);
+    data = xalloc(size ? size : 1);
+    for (offset = 0; offset < size; offset += ret) {
+        ret = pread(storage_log.fd, data + offset, size - offset, offset);
+        FATAL_ON(ret <= 0, 2, "read %s: %m", storage_log.filename);
+    }
+    FATAL_ON(size < magic_len || memcmp(data, STORAGE_LOG_MAGIC, magic_len), 1,
+             "%s: invalid storage log", storage_log.filename);
+
+    hdr = data + magic_len;
+    end = data + size;
+    while (hdr + STORAGE_LOG_HDR_LEN <= end) {
+        type     = hdr[0];
+        name_len = hdr[1];
+        crc      = read_le16(hdr + 2);
+        len      = read_le32(hdr + 4);
+        if (!name_len || len > STORAGE_LOG_DATA_MAX || len > end - hdr - STORAGE_LOG_HDR_LEN - name_len) {
+            err = "truncated record";
+            break;
+        }
+        memcpy(name, hdr + STORAGE_LOG_HDR_LEN, name_len);
+        name[name_len] = '\0';
+        // The header is rebuilt separately to keep the buffer intact
+        storage_log_encode_hdr(hdr_check, type, name, hdr + STORAGE_LOG_HDR_LEN + name_len, len);
+        if (read_le16(hdr_check + 2) != crc) {
+            err = "bad CRC";
+            break;
+        }
+        if (type == STORAGE_LOG_PUT) {
+            storage_log_index(name, hdr - data + STORAGE_LOG_HDR_LEN + name_len, len);
+        } else if (type == STORAGE_LOG_DEL) {
+            entry = storage_log_find(name);
+            if (entry)
+                storage_log_unindex(entry);
+        } else {
+            err = "unknown record type";
+            break;
+        }
+        hdr += STORAGE_LOG_HDR_LEN + name_len + len;
+    }
+    storage_log.size = hdr - data;
+    if (storage_log.size != size) {
+        // The records following an invalid one cannot be trusted either, they
+        // are dropped along with it.
+        WARN("%s: %s at offset %jd, truncate %jd bytes", storage_log.filename,
+             err ? err : "truncated record", (intmax_t)storage_log.size, (intmax_t)(size - storage_log.size));
+        FATAL_ON(ftruncate(storage_log.fd, storage_log.size) < 0, 2, "ftruncate %s: %m", storage_log.filename);
+        FATAL_ON(fdatasync(storage_log.fd) < 0, 2, "fdatasync %s: %m", storage_log.filename);
+    }
+    free(data);
+}
+
+// Move the files from the legacy layout (one file per entity) to the log.
+// The log is built under a temporary name and only renamed once complete, so
+// an interrupted import is restarted from scratch on the next start. The
+// legacy files are removed afterwards.
+static void storage_log_import(const char *files[])
+{
+    char filename[PATH_MAX + 4];
+    char pattern[PATH_MAX];
+    glob_t imported = { };
+    char *data, *name;
+    glob_t globbuf;
+    size_t len;
+    FILE *file;
+    int ret;
+
+    snprintf(filename, sizeof(filename), "%s.tmp", storage_log.filename);
+    storage_log.fd = open(filename, O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    FATAL_ON(storage_log.fd < 0, 2, "open %s: %m", filename);
+    ret = write(storage_log.fd, STORAGE_LOG_MAGIC, strlen(STORAGE_LOG_MAGIC));
+    FATAL_ON(ret != strlen(STORAGE_LOG_MAGIC), 2, "write %s: %m", filename);
+    storage_log.size = ret;
+    for (; *files; files++) {
+        snprintf(pattern, sizeof(pattern), "%s%s", g_storage_prefix, *files);
+        ret = glob(pattern, 0, NULL, &globbuf);
+        if (ret == GLOB_NOMATCH)
+            continue;
+        if (ret) {
+            WARN("glob %s returned an error", pattern);
+            continue;
+        }
+        for (int i = 0; globbuf.gl_pathv[i]; i++) {
+            name = globbuf.gl_pathv[i] + strlen(g_storage_prefix);
+            file = fopen(globbuf.gl_pathv[i], "r");
+            if (!file) {
+                WARN("open %s: %m", globbuf.gl_pathv[i]);
+                continue;
+            }
+            fseek(file, 0, SEEK_END);
+            len = ftell(file);
+            rewind(file);
+            data = xalloc(len + 1);
+            ret = fread(data, 1, len, file) == len ? 0 : -1;
+            fclose(file);
+            if (!ret)
+                ret = storage_log_append(STORAGE_LOG_PUT, name, data, len);
+            if (!ret) {
+                imported.gl_pathv = reallocarray(imported.gl_pathv, imported.gl_pathc + 1, sizeof(char *));
+                FATAL_ON(!imported.gl_pathv, 2, "%s: %m", __func__);
+                imported.gl_pathv[imported.gl_pathc++] = strdup(globbuf.gl_pathv[i]);
+            }
+            free(data);
+        }
+        globfree(&globbuf);
+    }
+    FATAL_ON(fdatasync(storage_log.fd) < 0, 2, "fdatasync %s: %m", filename);
+    FATAL_ON(rename(filename, storage_log.filename) < 0, 2, "rename %s: %m", filename);
+    storage_log_sync_dir();
+    storage_log.sync_pending = false;
+    // The records are on the disk, the legacy files can go
+    for (int i = 0; i < imported.gl_pathc; i++) {
+        unlink(imported.gl_pathv[i]);
+        free(imported.gl_pathv[i]);
+    }
+    free(imported.gl_pathv);
+    if (imported.gl_pathc)
+        INFO("storage: imported %zu files into %s", imported.gl_pathc, storage_log.filename);
+}
+
+void storage_log_open(const char *files[])
+{
+    BUG_ON(storage_log.fd >= 0);
+    if (!g_storage_prefix || !strlen(g_storage_prefix))
+        return;
+    snprintf(storage_log.filename, sizeof(storage_log.filename), "%s%s",
+             g_storage_prefix, STORAGE_LOG_FILENAME);
+    storage_log.fd = open(storage_log.filename, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (storage_log.fd < 0 && errno == ENOENT) {
+        storage_log_import(files);
+    } else {
+        FATAL_ON(storage_log.fd < 0, 2, "open %s: %m", storage_log.filename);
+        storage_log_load();
+    }
+    INFO("storage: %d entries in %s", storage_log.entries.entry_cnt, storage_log.filename);
+}
+
+bool storage_log_exists(void)
+{
+    char filename[PATH_MAX];
+
+    if (!g_storage_prefix || !strlen(g_storage_prefix))
+        return false;
+    snprintf(filename, sizeof(filename), "%s%s", g_storage_prefix, STORAGE_LOG_FILENAME);
+    return !access(filename, F_OK);
+}
+
+void storage_log_sync(void)
+{
+    if (!storage_log.sync_pending)
+        return;
+    if (fdatasync(storage_log.fd) < 0)
+        WARN("fdatasync %s: %m", storage_log.filename);
+    storage_log.sync_pending = false;
+}
+
+void storage_log_close(void)
+{
+    struct storage_log_entry *entry;
+
+    if (storage_log.fd < 0)
+        return;
+    storage_log_sync();
+    while ((entry = storage_log_next(NULL)))
+        storage_log_unindex(entry);
+    hash_table_free(&storage_log.entries);
+    close(storage_log.fd);
+    storage_log.fd = -1;
+    storage_log.size = 0;
+    storage_log.live_size = 0;
+}
+
+static FILE *storage_log_fopen(struct storage_parse_info *info, const char *name, const char *mode)
+{
+    struct storage_log_entry *entry;
+    ssize_t ret;
+
+    if (!strcmp(mode, "w")) {
+        info->log_write = true;
+        return open_memstream(&info->log_data, &info->log_len);
+    }
+    BUG_ON(strcmp(mode, "r"), "unsupported mode: %s", mode);
+    entry = storage_log_find(name);
+    if (!entry) {
+        errno = ENOENT;
+        return NULL;
+    }
+    info->log_data = xalloc(entry->len + 1);
+    info->log_len = entry->len;
+    ret = pread(storage_log.fd, info->log_data, entry->len, entry->offset);
+    if (ret != entry->len) {
+        if (ret >= 0)
+            errno = EIO;
+        free(info->log_data);
+        info->log_data = NULL;
+        return NULL;
+    }
+    return fmemopen(info->log_data, info->log_len, "r");
+}
+
 struct storage_parse_info *storage_open(const char *filename, const char *mode)
 {
     struct storage_parse_info *info;
 
     info = zalloc(sizeof(struct storage_parse_info));
     snprintf(info->filename, sizeof(info->filename), "%s", filename);
-    info->file = fopen(info->filename, mode);
+    if (storage_log_name(info->filename))
+        info->file = storage_log_fopen(info, storage_log_name(info->filename), mode);
+    else
+        info->file = fopen(info->filename, mode);
     if (!info->file) {
         free(info);
         return NULL;
@@ -69,13 +559,17 @@ struct storage_parse_info *storage_open_prefix(const char *filename, const char
 
 int storage_close(struct storage_parse_info *info)
 {
-    FILE *file;
+    int ret;
 
     BUG_ON(!info);
     BUG_ON(!info->file);
-    file = info->file;
+    ret = fclose(info->file);
+    if (!ret && info->log_write)
+        ret = storage_log_append(STORAGE_LOG_PUT, storage_log_name(info->filename),
+                                 info->log_data, info->log_len);
+    free(info->log_data);
     free(info);
-    return fclose(file);
+    return ret;
 }
 
 static char *storage_get_line(struct storage_parse_info *info)
@@ -130,6 +624,14 @@ void storage_delete(const char *files[])
         return;
 
     for (; *files; files++) {
+        if (storage_log.fd >= 0) {
+            if (storage_glob(*files, &globbuf))
+                continue;
+            for (int i = 0; globbuf.gl_pathv[i]; i++)
+                storage_log_append(STORAGE_LOG_DEL, storage_log_name(globbuf.gl_pathv[i]), NULL, 0);
+            storage_globfree(&globbuf);
+            continue;
+        }
         snprintf(filename, sizeof(filename), "%s%s", g_storage_prefix, *files);
         ret = glob(filename, 0, NULL, &globbuf);
         if (ret == GLOB_NOMATCH) {
@@ -145,3 +647,73 @@ void storage_delete(const char *files[])
         globfree(&globbuf);
     }
 }
+
+static int storage_glob_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+int storage_glob(const char *pattern, glob_t *globbuf)
+{
+    struct storage_log_entry *entry;
+    char filename[PATH_MAX];
+    int cnt = 0;
+
+    if (!g_storage_prefix)
+        return GLOB_NOMATCH;
+    if (storage_log.fd < 0) {
+        snprintf(filename, sizeof(filename), "%s%s", g_storage_prefix, pattern);
+        return glob(filename, 0, NULL, globbuf);
+    }
+
+    memset(globbuf, 0, sizeof(*globbuf));
+    globbuf->gl_pathv = xalloc((storage_log.entries.entry_cnt + 1) * sizeof(char *));
+    for (entry = storage_log_next(NULL); entry; entry = storage_log_next(entry)) {
+        // Same rules as glob()
+        if (fnmatch(pattern, entry->name, FNM_PATHNAME | FNM_PERIOD))
+            continue;
+        if (asprintf(&globbuf->gl_pathv[cnt], "%s%s", g_storage_prefix, entry->name) < 0)
+            FATAL(2, "%s: cannot allocate memory", __func__);
+        cnt++;
+    }
+    globbuf->gl_pathv[cnt] = NULL;
+    globbuf->gl_pathc = cnt;
+    if (!cnt) {
+        storage_globfree(globbuf);
+        return GLOB_NOMATCH;
+    }
+    qsort(globbuf->gl_pathv, cnt, sizeof(char *), storage_glob_cmp);
+    return 0;
+}
+
+void storage_globfree(glob_t *globbuf)
+{
+    if (storage_log.fd < 0) {
+        globfree(globbuf);
+        return;
+    }
+    for (int i = 0; i < globbuf->gl_pathc; i++)
+        free(globbuf->gl_pathv[i]);
+    free(globbuf->gl_pathv);
+    globbuf->gl_pathv = NULL;
+}
+
+bool storage_exists(const char *filename)
+{
+    if (storage_log_name(filename))
+        return storage_log_find(storage_log_name(filename));
+    return !access(filename, F_OK);
+}
+
+int storage_remove(const char *filename)
+{
+    const char *name = storage_log_name(filename);
+
+    if (!name)
+        return unlink(filename);
+    if (!storage_log_find(name)) {
+        errno = ENOENT;
+        return -1;
+    }
+    return storage_log_append(STORAGE_LOG_DEL, name, NULL, 0);
+}
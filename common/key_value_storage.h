@@ -31,10 +31,18 @@
  * In addition, if storage_parse_line() detects a number under brackets (like in
  * "gtk[0]"), the value under bracket is placed in key_array_index (otherwise,
  * key_array_index value is UINT_MAX)
+ *
+ * Optionally, storage_log_open() stores all the files located under
+ * g_storage_prefix in a single append-only log instead of one file per entity.
+ * This is transparent for the users of storage_open(), as long as the files
+ * are listed with storage_glob() and removed with storage_remove() or
+ * storage_delete() (instead of glob() and unlink()).
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <limits.h>
+#include <glob.h>
 
 struct storage_parse_info {
     FILE *file;
@@ -43,6 +51,11 @@ struct storage_parse_info {
     char line[256];
     char key[256], value[256];
     unsigned int key_array_index;
+
+    // Internal fields, used when the file is stored in the log
+    bool log_write;
+    char *log_data;
+    size_t log_len;
 };
 
 extern const char *g_storage_prefix;
@@ -54,4 +67,20 @@ int storage_close(struct storage_parse_info *file);
 int storage_parse_line(struct storage_parse_info *file);
 void storage_delete(const char *files[]);
 
+// Patterns are relative to g_storage_prefix, paths returned are absolute.
+int storage_glob(const char *pattern, glob_t *globbuf);
+void storage_globfree(glob_t *globbuf);
+bool storage_exists(const char *filename);
+int storage_remove(const char *filename);
+
+// Open (or create) the log "storage.log" in g_storage_prefix. When the log is
+// created, the existing files matching the patterns of files[] are imported
+// and removed.
+void storage_log_open(const char *files[]);
+// True if g_storage_prefix contains a log, whether it is used or not
+bool storage_log_exists(void);
+// Flush the records written since the last call to the disk
+void storage_log_sync(void);
+void storage_log_close(void);
+
 #endif
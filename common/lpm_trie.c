@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <stdlib.h>
+
+#include "common/bits.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+
+#include "lpm_trie.h"
+
+// Number of leading bits (in the bittest() order) shared by a and b, up to
+// max_len
+static int lpm_trie_common_len(const uint8_t *a, const uint8_t *b, int max_len)
+{
+    uint8_t diff;
+
+    for (int i = 0; i * 8 < max_len; i++) {
+        diff = a[i] ^ b[i];
+        if (diff)
+            return MIN(i * 8 + __builtin_ctz(diff), max_len);
+    }
+    return max_len;
+}
+
+static bool lpm_trie_node_match(const struct lpm_trie_node *node, const uint8_t *key)
+{
+    return !bitcmp(node->prefix, key, node->prefix_len);
+}
+
+static struct lpm_trie_node *lpm_trie_node_new(const uint8_t *prefix, int prefix_len,
+                                               struct lpm_trie_node *parent)
+{
+    struct lpm_trie_node *node = zalloc(sizeof(*node));
+
+    bitcpy(node->prefix, prefix, prefix_len);
+    node->prefix_len = prefix_len;
+    node->parent = parent;
+    LIST_INIT(&node->entries);
+    return node;
+}
+
+static struct lpm_trie_node **lpm_trie_node_link(struct lpm_trie *trie, struct lpm_trie_node *node)
+{
+    if (!node->parent)
+        return &trie->root;
+    return &node->parent->child[node->parent->child[1] == node];
+}
+
+static struct lpm_trie_node *lpm_trie_node_get(struct lpm_trie *trie, const uint8_t *prefix, int prefix_len)
+{
+    struct lpm_trie_node **link = &trie->root;
+    struct lpm_trie_node *parent = NULL;
+    struct lpm_trie_node *node, *glue;
+    int len;
+
+    while (*link) {
+        node = *link;
+        len = lpm_trie_common_len(node->prefix, prefix, MIN(node->prefix_len, prefix_len));
+        if (len < node->prefix_len) {
+            // The new prefix diverges from the branch (or is shorter): insert
+            // a node above it
+            if (len == prefix_len) {
+                glue = lpm_trie_node_new(prefix, prefix_len, parent);
+                glue->child[bittest(node->prefix, len)] = node;
+                node->parent = glue;
+                *link = glue;
+                return glue;
+            }
+            glue = lpm_trie_node_new(prefix, len, parent);
+            glue->child[bittest(node->prefix, len)] = node;
+            node->parent = glue;
+            *link = glue;
+            parent = glue;
+            link = &glue->child[bittest(prefix, len)];
+            break;
+        }
+        if (node->prefix_len == prefix_len)
+            return node;
+        parent = node;
+        link = &node->child[bittest(prefix, node->prefix_len)];
+    }
+    *link = lpm_trie_node_new(prefix, prefix_len, parent);
+    return *link;
+}
+
+void lpm_trie_insert(struct lpm_trie *trie, struct lpm_trie_entry *entry,
+                     const uint8_t *prefix, int prefix_len)
+{
+    BUG_ON(prefix_len < 0 || prefix_len > LPM_TRIE_KEY_BITS);
+    BUG_ON(entry->node);
+    entry->node = lpm_trie_node_get(trie, prefix, prefix_len);
+    LIST_INSERT_HEAD(&entry->node->entries, entry, link);
+}
+
+void lpm_trie_remove(struct lpm_trie *trie, struct lpm_trie_entry *entry)
+{
+    struct lpm_trie_node *node = entry->node;
+    struct lpm_trie_node *parent, *child;
+
+    BUG_ON(!node);
+    LIST_REMOVE(entry, link);
+    entry->node = NULL;
+
+    // Release the nodes which are not needed anymore to join two branches
+    while (node && LIST_EMPTY(&node->entries)) {
+        if (node->child[0] && node->child[1])
+            break;
+        child = node->child[0] ? node->child[0] : node->child[1];
+        parent = node->parent;
+        *lpm_trie_node_link(trie, node) = child;
+        free(node);
+        if (child) {
+            child->parent = parent;
+            break;
+        }
+        node = parent;
+    }
+}
+
+struct lpm_trie_node *lpm_trie_find(const struct lpm_trie *trie,
+                                    const uint8_t *prefix, int prefix_len)
+{
+    struct lpm_trie_node *node = trie->root;
+
+    while (node && node->prefix_len <= prefix_len) {
+        if (!lpm_trie_node_match(node, prefix))
+            return NULL;
+        if (node->prefix_len == prefix_len)
+            return LIST_EMPTY(&node->entries) ? NULL : node;
+        node = node->child[bittest(prefix, node->prefix_len)];
+    }
+    return NULL;
+}
+
+struct lpm_trie_node *lpm_trie_lookup(const struct lpm_trie *trie, const uint8_t *key)
+{
+    struct lpm_trie_node *node = trie->root;
+    struct lpm_trie_node *best = NULL;
+
+    while (node && lpm_trie_node_match(node, key)) {
+        if (!LIST_EMPTY(&node->entries))
+            best = node;
+        if (node->prefix_len == LPM_TRIE_KEY_BITS)
+            break;
+        node = node->child[bittest(key, node->prefix_len)];
+    }
+    return best;
+}
+
+struct lpm_trie_node *lpm_trie_lookup_next(const struct lpm_trie_node *node)
+{
+    // Ancestors necessarily match the key as well
+    for (node = node->parent; node; node = node->parent)
+        if (!LIST_EMPTY(&node->entries))
+            return (struct lpm_trie_node *)node;
+    return NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef LPM_TRIE_H
+#define LPM_TRIE_H
+#include <sys/queue.h>
+#include <stdint.h>
+
+/*
+ * Path-compressed binary trie for longest prefix match on keys of up to 128
+ * bits (typically IPv6 prefixes).
+ *
+ * Bits are numbered as in bittest(), so a prefix matches a key exactly when
+ * bitcmp() would report them equal.
+ *
+ * Each node holds a prefix and the list of the entries registered with this
+ * prefix. Nodes without entries only exist to join two branches, so the depth
+ * of the trie is bounded by the number of distinct prefixes rather than by
+ * the key length. Nodes are allocated and released by the trie, entries are
+ * owned by the caller which usually embeds struct lpm_trie_entry and uses
+ * container_of().
+ *
+ * The entries sharing a prefix are kept in reverse insertion order.
+ *
+ * The trie has to be initialized with zeros.
+ */
+
+#define LPM_TRIE_KEY_BITS 128
+
+struct lpm_trie_entry {
+    // Internal fields
+    struct lpm_trie_node *node;
+    LIST_ENTRY(lpm_trie_entry) link;
+};
+
+struct lpm_trie_node {
+    LIST_HEAD(, lpm_trie_entry) entries;
+
+    // Internal fields
+    uint8_t prefix[LPM_TRIE_KEY_BITS / 8];
+    uint8_t prefix_len;
+    struct lpm_trie_node *parent;
+    struct lpm_trie_node *child[2];
+};
+
+struct lpm_trie {
+    struct lpm_trie_node *root;
+};
+
+void lpm_trie_insert(struct lpm_trie *trie, struct lpm_trie_entry *entry,
+                     const uint8_t *prefix, int prefix_len);
+void lpm_trie_remove(struct lpm_trie *trie, struct lpm_trie_entry *entry);
+
+// Return the node registered with exactly this prefix, or NULL.
+struct lpm_trie_node *lpm_trie_find(const struct lpm_trie *trie,
+                                    const uint8_t *prefix, int prefix_len);
+
+// Return the node with the longest prefix matching key (128 bits), or NULL.
+// The shorter matches are then retrieved with lpm_trie_lookup_next().
+struct lpm_trie_node *lpm_trie_lookup(const struct lpm_trie *trie, const uint8_t *key);
+struct lpm_trie_node *lpm_trie_lookup_next(const struct lpm_trie_node *node);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include "common/log.h"
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK  (TIMER_WHEEL_SLOTS - 1)
+// Maximum distance that can be represented without parking the timer
+#define TIMER_WHEEL_RANGE      (1ull << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+static int timer_wheel_slot_index(uint64_t tick, int level)
+{
+    return (tick >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+}
+
+static void timer_wheel_insert(struct timer_wheel *wheel, struct timer_wheel_entry *entry)
+{
+    uint64_t delta = entry->expire - wheel->now;
+    uint64_t expire = entry->expire;
+    int level, slot;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+        if (delta < 1ull << (TIMER_WHEEL_SLOT_BITS * (level + 1)))
+            break;
+    if (delta >= TIMER_WHEEL_RANGE)
+        expire = wheel->now + TIMER_WHEEL_RANGE - 1;
+    slot = timer_wheel_slot_index(expire, level);
+    LIST_INSERT_HEAD(&wheel->slots[level][slot], entry, link);
+    wheel->bitmap[level] |= 1ull << slot;
+    entry->slot = level * TIMER_WHEEL_SLOTS + slot;
+}
+
+static void timer_wheel_remove(struct timer_wheel *wheel, struct timer_wheel_entry *entry)
+{
+    int level = entry->slot / TIMER_WHEEL_SLOTS;
+    int slot = entry->slot % TIMER_WHEEL_SLOTS;
+
+    LIST_REMOVE(entry, link);
+    if (LIST_EMPTY(&wheel->slots[level][slot]))
+        wheel->bitmap[level] &= ~(1ull << slot);
+}
+
+void timer_wheel_arm(struct timer_wheel *wheel, struct timer_wheel_entry *entry, uint64_t ticks)
+{
+    BUG_ON(!ticks);
+    BUG_ON(!entry->callback);
+    if (entry->expire)
+        timer_wheel_remove(wheel, entry);
+    entry->expire = wheel->now + ticks;
+    timer_wheel_insert(wheel, entry);
+}
+
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_wheel_entry *entry)
+{
+    if (!entry->expire)
+        return;
+    timer_wheel_remove(wheel, entry);
+    entry->expire = 0;
+}
+
+// Distance (1 to 64) from slot index to the next non-empty slot
+static int timer_wheel_slot_distance(uint64_t bitmap, int index)
+{
+    int shift = (index + 1) & TIMER_WHEEL_SLOT_MASK;
+
+    if (shift)
+        bitmap = (bitmap >> shift) | (bitmap << (TIMER_WHEEL_SLOTS - shift));
+    return __builtin_ctzll(bitmap) + 1;
+}
+
+uint64_t timer_wheel_next(const struct timer_wheel *wheel)
+{
+    uint64_t next = UINT64_MAX;
+    uint64_t tick;
+    int shift;
+
+    if (wheel->bitmap[0])
+        next = wheel->now + timer_wheel_slot_distance(wheel->bitmap[0],
+                                                      timer_wheel_slot_index(wheel->now, 0));
+    // Timers of upper levels need to be cascaded when the wheel reaches their
+    // slot. They cannot expire before that.
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (!wheel->bitmap[level])
+            continue;
+        shift = TIMER_WHEEL_SLOT_BITS * level;
+        tick = (wheel->now >> shift) + timer_wheel_slot_distance(wheel->bitmap[level],
+                                                                 timer_wheel_slot_index(wheel->now, level));
+        tick <<= shift;
+        if (tick < next)
+            next = tick;
+    }
+    return next;
+}
+
+static void timer_wheel_cascade(struct timer_wheel *wheel, int level, int slot)
+{
+    struct timer_wheel_entry *entry, *next;
+
+    entry = LIST_FIRST(&wheel->slots[level][slot]);
+    LIST_INIT(&wheel->slots[level][slot]);
+    wheel->bitmap[level] &= ~(1ull << slot);
+    while (entry) {
+        next = LIST_NEXT(entry, link);
+        timer_wheel_insert(wheel, entry);
+        entry = next;
+    }
+}
+
+static void timer_wheel_step(struct timer_wheel *wheel)
+{
+    struct timer_wheel_entry *entry;
+    int slot;
+
+    wheel->now++;
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (timer_wheel_slot_index(wheel->now, level - 1))
+            break;
+        timer_wheel_cascade(wheel, level, timer_wheel_slot_index(wheel->now, level));
+    }
+
+    slot = timer_wheel_slot_index(wheel->now, 0);
+    while ((entry = LIST_FIRST(&wheel->slots[0][slot]))) {
+        BUG_ON(entry->expire != wheel->now);
+        timer_wheel_remove(wheel, entry);
+        entry->expire = 0;
+        entry->callback(entry);
+    }
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t tick)
+{
+    uint64_t next;
+
+    while (wheel->now < tick) {
+        next = timer_wheel_next(wheel);
+        if (next > tick) {
+            wheel->now = tick;
+            return;
+        }
+        // Nothing to do until then
+        wheel->now = next - 1;
+        timer_wheel_step(wheel);
+    }
+}
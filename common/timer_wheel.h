@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+#include <sys/queue.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hierarchical timing wheel, as described in "Hashed and Hierarchical Timing
+ * Wheels" (Varghese & Lauck). Time is expressed in abstract ticks.
+ *
+ * Each level contains 64 slots, each slot of level N covering 64^N ticks.
+ * Timers are stored in the slot matching their expiration, and are moved
+ * (cascaded) to a lower level when the wheel reaches their slot. Arming and
+ * cancelling a timer are O(1). Timers more than 64^4 ticks away are parked in
+ * the last level and re-inserted until they get close enough.
+ *
+ * A bitmap of non-empty slots is maintained for each level, so
+ * timer_wheel_next() can find the next tick where some work is needed without
+ * walking the timers. This allows the caller to skip idle periods entirely
+ * with timer_wheel_advance().
+ *
+ * Timers are owned by the caller, which usually embeds struct
+ * timer_wheel_entry and uses container_of() in the callback. The wheel has to
+ * be initialized with zeros.
+ */
+
+#define TIMER_WHEEL_LEVELS     4
+#define TIMER_WHEEL_SLOT_BITS  6
+#define TIMER_WHEEL_SLOTS      (1 << TIMER_WHEEL_SLOT_BITS)
+
+struct timer_wheel_entry {
+    void (*callback)(struct timer_wheel_entry *entry);
+
+    // Internal fields
+    uint64_t expire; // Absolute tick, 0 if the timer is not armed
+    uint16_t slot;
+    LIST_ENTRY(timer_wheel_entry) link;
+};
+
+struct timer_wheel {
+    uint64_t now;
+    uint64_t bitmap[TIMER_WHEEL_LEVELS];
+    LIST_HEAD(, timer_wheel_entry) slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+// Arm (or re-arm) the timer to expire in ticks (> 0) from now.
+void timer_wheel_arm(struct timer_wheel *wheel, struct timer_wheel_entry *entry, uint64_t ticks);
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_wheel_entry *entry);
+
+static inline bool timer_wheel_is_armed(const struct timer_wheel_entry *entry)
+{
+    return entry->expire;
+}
+
+// Return the next tick at which timer_wheel_advance() has something to do
+// (expire or cascade some timers), or UINT64_MAX if the wheel is empty.
+uint64_t timer_wheel_next(const struct timer_wheel *wheel);
+
+// Move the wheel to tick, and call the callback of every timer expiring in
+// the meantime (in chronological order). The callbacks are allowed to arm and
+// cancel timers.
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t tick);
+
+#endif
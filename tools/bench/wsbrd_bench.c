@@ -0,0 +1,3020 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <linux/if_tun.h>
+#include <netinet/in.h>
+#include <netlink/route/neighbour.h>
+#include <netlink/route/route.h>
+#include <net/if.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#include "common/key_value_storage.h"
+#include "common/change_journal.h"
+#include "common/event_loop.h"
+#include "common/events_scheduler.h"
+#include "common/hash_table.h"
+#include "common/fnv_hash.h"
+#include "common/timer_wheel.h"
+#include "common/time_extra.h"
+#include "common/lpm_trie.h"
+#include "common/mathutils.h"
+#include "common/parsers.h"
+#include "common/memutils.h"
+#include "common/ns_list.h"
+#include "common/specs/ieee802154.h"
+#include "common/specs/icmpv6.h"
+#include "common/specs/rpl.h"
+#include "common/bus_uart.h"
+#include "common/endian.h"
+#include "common/bits.h"
+#include "common/bus.h"
+#include "common/capture.h"
+#include "common/crc.h"
+#include "common/hif.h"
+#include "common/ieee802154_ie.h"
+#include "common/log.h"
+#include "6lowpan/mac/mpx_api.h"
+#include "6lowpan/lowpan_adaptation_interface.h"
+#include "6lowpan/bootstraps/protocol_6lowpan.h"
+#include "app/rcp_api_legacy.h"
+#include "app/frame_helpers.h"
+#include "app/rcp_api.h"
+#include "app/tun.h"
+#include "app/wsbr.h"
+#include "app/wsbr_mac.h"
+#include "ipv6/ipv6_routing_table.h"
+#include "ipv6/nd_router_object.h"
+#include "ipv6/icmpv6.h"
+#include "net/ns_buffer.h"
+#include "net/protocol.h"
+#include "net/timers.h"
+#include "rpl/rpl_srh.h"
+#include "rpl/rpl_storage.h"
+#include "rpl/rpl.h"
+#include "security/protocols/sec_prot_keys.h"
+#include "ws/ws_ie_lib.h"
+#include "ws/ws_neigh.h"
+#include "ws/ws_pae_key_storage.h"
+#include "ws/ws_pae_lib.h"
+
+/*
+ * Micro-benchmarks of the data structures and algorithms on the hot paths of
+ * wsbrd. Most benchmarks print the average time per operation, others print a
+ * throughput or a latency distribution. They are meant to compare two
+ * versions of the code on the same machine, not to give absolute numbers.
+ *
+ * Usage: wsbrd-bench [NAME]...
+ */
+
+struct bench {
+    const char *name;
+    void (*fn)(void);
+};
+
+static uint64_t bench_rand_state = 0x9e3779b97f4a7c15;
+
+// xorshift64, so the runs are reproducible
+static uint64_t bench_rand(void)
+{
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 7;
+    bench_rand_state ^= bench_rand_state << 17;
+    return bench_rand_state;
+}
+
+static void bench_rand_fill(void *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        ((uint8_t *)buf)[i] = bench_rand();
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * 1000000000ull + tp.tv_nsec;
+}
+
+static void bench_report(const char *name, const char *op, uint64_t t0, uint64_t cnt)
+{
+    uint64_t elapsed = bench_now_ns() - t0;
+
+    printf("%-12s %-24s %10"PRIu64" ops %10.1f ns/op\n", name, op, cnt, (double)elapsed / cnt);
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+    const uint64_t *x = a, *y = b;
+
+    return (*x > *y) - (*x < *y);
+}
+
+// Sorts the samples
+static void bench_report_latency(const char *name, const char *op, uint64_t *samples, int cnt)
+{
+    uint64_t sum = 0;
+
+    BUG_ON(!cnt);
+    qsort(samples, cnt, sizeof(*samples), bench_cmp_u64);
+    for (int i = 0; i < cnt; i++)
+        sum += samples[i];
+    printf("%-12s %-24s %10d ops avg %.1f us p50 %.1f us p99 %.1f us max %.1f us\n",
+           name, op, cnt, sum / 1000.0 / cnt, samples[cnt / 2] / 1000.0,
+           samples[cnt * 99 / 100] / 1000.0, samples[cnt - 1] / 1000.0);
+}
+
+// Prevent the compiler from dropping the computations
+static volatile uint64_t bench_sink;
+
+/*
+ * Wakeup to dispatch latency of the main loop. A timerfd expires every
+ * millisecond (1000 events/s) among as many idle sources as wsbrd has, and
+ * the latency is measured from the expiration to the call of the handler.
+ * The poll() variant scans all the slots after each wakeup, like wsbr_poll()
+ * did before the event loop was introduced.
+ */
+#define BENCH_LOOP_IDLE_CNT 11
+
+struct bench_loop {
+    struct event_loop_src src;
+    uint64_t start_ns;
+    uint64_t expiration_cnt;
+    uint64_t *samples;
+    int sample_cnt;
+};
+
+static void bench_loop_on_timer(struct bench_loop *bench, int fd)
+{
+    const uint64_t period_ns = 1000000;
+    uint64_t now = bench_now_ns();
+    uint64_t val;
+
+    if (read(fd, &val, sizeof(val)) != sizeof(val))
+        return;
+    bench->expiration_cnt += val;
+    bench->samples[bench->sample_cnt++] = now - (bench->start_ns + bench->expiration_cnt * period_ns);
+}
+
+static void bench_loop_on_src(struct event_loop_src *src, uint32_t revents)
+{
+    struct bench_loop *bench = container_of(src, struct bench_loop, src);
+
+    if (revents & EPOLLIN)
+        bench_loop_on_timer(bench, src->fd);
+}
+
+static void bench_loop_on_idle(struct event_loop_src *src, uint32_t revents)
+{
+    BUG("idle source dispatched");
+}
+
+static int bench_loop_timer_start(struct bench_loop *bench)
+{
+    struct itimerspec parms = {
+        .it_value.tv_nsec    = 1000000,
+        .it_interval.tv_nsec = 1000000,
+    };
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    FATAL_ON(fd < 0, 2, "timerfd_create: %m");
+    bench->expiration_cnt = 0;
+    bench->sample_cnt = 0;
+    bench->start_ns = bench_now_ns();
+    // Relative timer, so the first expiration is slightly after start_ns
+    FATAL_ON(timerfd_settime(fd, 0, &parms, NULL) < 0, 2, "timerfd_settime: %m");
+    return fd;
+}
+
+static void bench_event_loop(void)
+{
+    const int event_cnt = 1000;
+    struct event_loop_src idle[BENCH_LOOP_IDLE_CNT] = { };
+    struct pollfd fds[BENCH_LOOP_IDLE_CNT + 1] = { };
+    int pipes[BENCH_LOOP_IDLE_CNT][2];
+    struct bench_loop bench = { };
+    struct event_loop loop;
+    int i;
+
+    bench.samples = xalloc(event_cnt * sizeof(*bench.samples));
+    for (i = 0; i < BENCH_LOOP_IDLE_CNT; i++)
+        FATAL_ON(pipe(pipes[i]) < 0, 2, "pipe: %m");
+
+    event_loop_init(&loop);
+    for (i = 0; i < BENCH_LOOP_IDLE_CNT; i++) {
+        idle[i].fd = pipes[i][0];
+        idle[i].events = EPOLLIN;
+        idle[i].callback = bench_loop_on_idle;
+        event_loop_add(&loop, &idle[i]);
+    }
+    bench.src.fd = bench_loop_timer_start(&bench);
+    bench.src.events = EPOLLIN;
+    bench.src.callback = bench_loop_on_src;
+    event_loop_add(&loop, &bench.src);
+    while (bench.sample_cnt < event_cnt)
+        event_loop_dispatch(&loop, -1);
+    event_loop_del(&loop, &bench.src);
+    close(bench.src.fd);
+    for (i = 0; i < BENCH_LOOP_IDLE_CNT; i++)
+        event_loop_del(&loop, &idle[i]);
+    close(loop.epoll_fd);
+    bench_report_latency("event_loop", "epoll 1000 ev/s", bench.samples, bench.sample_cnt);
+
+    for (i = 0; i < BENCH_LOOP_IDLE_CNT; i++) {
+        fds[i].fd = pipes[i][0];
+        fds[i].events = POLLIN;
+    }
+    fds[i].fd = bench_loop_timer_start(&bench);
+    fds[i].events = POLLIN;
+    while (bench.sample_cnt < event_cnt) {
+        FATAL_ON(poll(fds, ARRAY_SIZE(fds), -1) < 0, 2, "poll: %m");
+        for (i = 0; i < ARRAY_SIZE(fds); i++) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            BUG_ON(i != BENCH_LOOP_IDLE_CNT, "idle source dispatched");
+            bench_loop_on_timer(&bench, fds[i].fd);
+        }
+    }
+    close(fds[BENCH_LOOP_IDLE_CNT].fd);
+    bench_report_latency("event_loop", "poll 1000 ev/s", bench.samples, bench.sample_cnt);
+
+    for (i = 0; i < BENCH_LOOP_IDLE_CNT; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    free(bench.samples);
+}
+
+/*
+ * One simulated hour of wsbrd timers with 1k, 5k and 10k armed periodic
+ * timers (with periods between 1 s and 100 s, in 50 ms ticks). The wheel is
+ * either advanced at each tick, or only at the ticks returned by
+ * timer_wheel_next() like in tickless mode. The "scan" variant decrements a
+ * counter per timer at each tick, like ws_timer_global_tick() used to do.
+ * The result is the CPU time consumed per simulated hour.
+ */
+#define BENCH_TIMER_TICKS_PER_HOUR (3600 * 1000 / 50)
+
+struct bench_timer {
+    struct timer_wheel_entry entry;
+    int period;
+    int remaining;
+};
+
+static struct timer_wheel bench_wheel;
+static uint64_t bench_timer_expire_cnt;
+
+static void bench_timer_expire(struct timer_wheel_entry *entry)
+{
+    struct bench_timer *timer = container_of(entry, struct bench_timer, entry);
+
+    bench_timer_expire_cnt++;
+    timer_wheel_arm(&bench_wheel, entry, timer->period);
+}
+
+static uint64_t bench_cpu_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp);
+    return tp.tv_sec * 1000000000ull + tp.tv_nsec;
+}
+
+static void bench_report_cpu_hour(const char *op, int timer_cnt, uint64_t t0, uint64_t wakeup_cnt)
+{
+    printf("%-12s %-24s %6d timers %10"PRIu64" wakeups %8.2f ms CPU/hour\n",
+           "timer_wheel", op, timer_cnt, wakeup_cnt, (bench_cpu_ns() - t0) / 1000000.0);
+}
+
+static void bench_timer_wheel_run(int timer_cnt)
+{
+    struct bench_timer *timers = xalloc(timer_cnt * sizeof(*timers));
+    uint64_t t0, wakeup_cnt, end;
+
+    memset(&bench_wheel, 0, sizeof(bench_wheel));
+    for (int i = 0; i < timer_cnt; i++) {
+        memset(&timers[i], 0, sizeof(timers[i]));
+        timers[i].entry.callback = bench_timer_expire;
+        timers[i].period = 20 + bench_rand() % 2000;
+        timers[i].remaining = timers[i].period;
+    }
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < timer_cnt; i++)
+        timer_wheel_arm(&bench_wheel, &timers[i].entry, timers[i].period);
+    bench_report("timer_wheel", "arm", t0, timer_cnt);
+
+    t0 = bench_cpu_ns();
+    end = bench_wheel.now + BENCH_TIMER_TICKS_PER_HOUR;
+    for (wakeup_cnt = 0; bench_wheel.now < end; wakeup_cnt++)
+        timer_wheel_advance(&bench_wheel, bench_wheel.now + 1);
+    bench_report_cpu_hour("periodic tick", timer_cnt, t0, wakeup_cnt);
+
+    t0 = bench_cpu_ns();
+    end = bench_wheel.now + BENCH_TIMER_TICKS_PER_HOUR;
+    for (wakeup_cnt = 0; bench_wheel.now < end; wakeup_cnt++)
+        timer_wheel_advance(&bench_wheel, MIN(timer_wheel_next(&bench_wheel), end));
+    bench_report_cpu_hour("tickless", timer_cnt, t0, wakeup_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < timer_cnt; i++)
+        timer_wheel_cancel(&bench_wheel, &timers[i].entry);
+    bench_report("timer_wheel", "cancel", t0, timer_cnt);
+
+    t0 = bench_cpu_ns();
+    for (wakeup_cnt = 0; wakeup_cnt < BENCH_TIMER_TICKS_PER_HOUR; wakeup_cnt++) {
+        for (int i = 0; i < timer_cnt; i++) {
+            if (--timers[i].remaining)
+                continue;
+            bench_timer_expire_cnt++;
+            timers[i].remaining = timers[i].period;
+        }
+    }
+    bench_report_cpu_hour("scan", timer_cnt, t0, wakeup_cnt);
+    free(timers);
+}
+
+static void bench_timer_wheel(void)
+{
+    bench_timer_wheel_run(1000);
+    bench_timer_wheel_run(5000);
+    bench_timer_wheel_run(10000);
+    bench_sink = bench_timer_expire_cnt;
+}
+
+// Byte-wise table-driven CRC-16/CCITT, as computed before slicing-by-8
+static uint16_t bench_crc16_ref(uint16_t crc, const uint8_t *data, int len)
+{
+    static uint16_t table[256];
+
+    if (!table[1]) {
+        for (int i = 0; i < 256; i++) {
+            table[i] = i;
+            for (int j = 0; j < 8; j++)
+                table[i] = table[i] & 1 ? (table[i] >> 1) ^ 0x8408 : table[i] >> 1;
+        }
+    }
+    for (int i = 0; i < len; i++)
+        crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xff];
+    return crc;
+}
+
+static void bench_report_throughput(const char *name, const char *op, uint64_t t0, uint64_t bytes)
+{
+    uint64_t elapsed = bench_now_ns() - t0;
+
+    printf("%-12s %-24s %10"PRIu64" bytes %8.1f MB/s\n", name, op, bytes, bytes * 1000.0 / elapsed);
+}
+
+// Called with the size of a typical frame header (20 bytes) and of a large
+// frame (2 KiB)
+static void bench_crc_run(int len, int iter_cnt)
+{
+    uint8_t data[2048];
+    uint16_t crc = 0xffff;
+    char op[24];
+    uint64_t t0;
+
+    BUG_ON(len > sizeof(data));
+    bench_rand_fill(data, len);
+    FATAL_ON(crc16(0xffff, data, len) != bench_crc16_ref(0xffff, data, len), 1,
+             "crc16 mismatch with reference");
+    snprintf(op, sizeof(op), "crc16 %d bytes", len);
+    t0 = bench_now_ns();
+    for (int i = 0; i < iter_cnt; i++)
+        crc = crc16(crc, data, len);
+    bench_report_throughput("crc", op, t0, (uint64_t)iter_cnt * len);
+    snprintf(op, sizeof(op), "bytewise %d bytes", len);
+    t0 = bench_now_ns();
+    for (int i = 0; i < iter_cnt; i++)
+        crc = bench_crc16_ref(crc, data, len);
+    bench_report_throughput("crc", op, t0, (uint64_t)iter_cnt * len);
+    bench_sink = crc;
+}
+
+static void bench_crc(void)
+{
+    bench_crc_run(20, 2000000);
+    bench_crc_run(2048, 20000);
+}
+
+/*
+ * Replay of a corrupted serial stream: 4 MiB of frames with 120 bytes of
+ * payload, where every 4th frame is followed by 64 bytes of noise (APIv2), or
+ * has a corrupted byte (legacy HDLC). The data goes through a pipe, so
+ * uart_read() is exercised as well. uart_rx() is compared with its previous
+ * version, which shifted the whole receive buffer for every dropped byte.
+ */
+#define BENCH_UART_STREAM_LEN (4 * 1024 * 1024)
+
+static int bench_uart_rx_ref(struct bus *bus, void *buf, unsigned int buf_len)
+{
+    struct iobuf_read iobuf = { };
+    const uint8_t *hdr;
+    uint16_t len, fcs;
+    ssize_t size;
+
+    if (!bus->uart.data_ready) {
+        size = read(bus->fd, bus->uart.rx_buf + bus->uart.rx_buf_len,
+                    sizeof(bus->uart.rx_buf) - bus->uart.rx_buf_len);
+        FATAL_ON(size <= 0, 2, "read: %m");
+        bus->uart.rx_buf_len += size;
+    }
+    bus->uart.data_ready = false;
+    iobuf.data      = bus->uart.rx_buf;
+    iobuf.data_size = bus->uart.rx_buf_len;
+    hdr = iobuf_pop_data_ptr(&iobuf, 4);
+    if (iobuf.err)
+        return 0;
+    if (!crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2))) {
+        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
+        bus->uart.rx_buf_len -= 1;
+        bus->uart.data_ready = true;
+        bus->uart.rx_err_hcs++;
+        return 0;
+    }
+    len = FIELD_GET(UART_HDR_LEN_MASK, read_le16(hdr));
+    BUG_ON(buf_len < len);
+    iobuf_pop_data(&iobuf, buf, len);
+    fcs = iobuf_pop_le16(&iobuf);
+    if (iobuf.err)
+        return 0;
+    bus->uart.data_ready = true;
+    if (!crc_check(CRC_INIT_FCS, buf, len, fcs)) {
+        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
+        bus->uart.rx_buf_len -= 1;
+        bus->uart.rx_err_fcs++;
+        return 0;
+    }
+    memmove(bus->uart.rx_buf, iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf));
+    bus->uart.rx_buf_len = iobuf_remaining_size(&iobuf);
+    return len;
+}
+
+static void bench_uart_push_hdlc(struct iobuf_write *stream, uint8_t byte)
+{
+    if (byte == 0x7D || byte == 0x7E) {
+        iobuf_push_u8(stream, 0x7D);
+        iobuf_push_u8(stream, byte ^ 0x20);
+    } else {
+        iobuf_push_u8(stream, byte);
+    }
+}
+
+static void bench_uart_stream(struct iobuf_write *stream, bool legacy)
+{
+    uint8_t payload[120];
+    uint8_t tail[2];
+    int offset;
+
+    for (int i = 0; stream->len < BENCH_UART_STREAM_LEN; i++) {
+        bench_rand_fill(payload, sizeof(payload));
+        if (legacy) {
+            write_le16(tail, crc16(CRC_INIT_LEGACY, payload, sizeof(payload)) ^ CRC_XOROUT_LEGACY);
+            offset = stream->len;
+            for (int j = 0; j < sizeof(payload); j++)
+                bench_uart_push_hdlc(stream, payload[j]);
+            bench_uart_push_hdlc(stream, tail[0]);
+            bench_uart_push_hdlc(stream, tail[1]);
+            // Corrupt a byte, without creating a flag or an escape
+            if (i % 4 == 3)
+                stream->data[offset + 10] = stream->data[offset + 10] == 0x5D ? 0x5C : 0x5D;
+            iobuf_push_u8(stream, 0x7E);
+        } else {
+            offset = stream->len;
+            iobuf_push_le16(stream, sizeof(payload));
+            iobuf_push_le16(stream, crc16(CRC_INIT_HCS, stream->data + offset, 2));
+            iobuf_push_data(stream, payload, sizeof(payload));
+            iobuf_push_le16(stream, crc16(CRC_INIT_FCS, payload, sizeof(payload)));
+            if (i % 4 == 3)
+                for (int j = 0; j < 64; j++)
+                    iobuf_push_u8(stream, bench_rand());
+        }
+    }
+}
+
+static void bench_uart_replay(const char *op, const struct iobuf_write *stream,
+                              int (*rx)(struct bus *bus, void *buf, unsigned int len))
+{
+    struct bus *bus = zalloc(sizeof(*bus));
+    uint8_t buf[2048];
+    int pending, len, fds[2];
+    int frame_cnt = 0;
+    size_t offset = 0;
+    uint64_t t0;
+
+    FATAL_ON(pipe(fds) < 0, 2, "pipe: %m");
+    bus->fd = fds[0];
+    // Errors are dropped instead of being fatal
+    bus->uart.init_phase = true;
+    t0 = bench_now_ns();
+    while (offset < stream->len) {
+        len = MIN(stream->len - offset, 4096);
+        FATAL_ON(write(fds[1], stream->data + offset, len) != len, 2, "write: %m");
+        offset += len;
+        for (;;) {
+            FATAL_ON(ioctl(fds[0], FIONREAD, &pending) < 0, 2, "ioctl: %m");
+            if (!pending && !bus->uart.data_ready)
+                break;
+            frame_cnt += rx(bus, buf, sizeof(buf)) > 0;
+        }
+    }
+    printf("%-12s %-24s %10d frames %8.1f MB/s hcs %"PRIu64" fcs %"PRIu64" crc %"PRIu64" drop %"PRIu64" bytes\n",
+           "uart", op, frame_cnt, stream->len * 1000.0 / (bench_now_ns() - t0),
+           bus->uart.rx_err_hcs, bus->uart.rx_err_fcs, bus->uart.rx_err_hdlc_crc,
+           bus->uart.rx_drop_bytes);
+    close(fds[0]);
+    close(fds[1]);
+    free(bus);
+}
+
+static void bench_uart(void)
+{
+    struct iobuf_write stream = { };
+
+    bench_uart_stream(&stream, false);
+    bench_uart_replay("uart_rx", &stream, uart_rx);
+    bench_uart_replay("memmove resync", &stream, bench_uart_rx_ref);
+    iobuf_free(&stream);
+    bench_uart_stream(&stream, true);
+    bench_uart_replay("uart_legacy_rx", &stream, uart_legacy_rx);
+    iobuf_free(&stream);
+}
+
+/*
+ * Replay of a mixed stream of HIF frames received by a running RCP through
+ * rcp_rx(): for every 16 frames, 8 data indications of 40 to 200 bytes, 6 data
+ * confirmations, a NOP indication and a replay timer indication, plus an
+ * unsupported command every 64 frames. The data goes through a pipe written by
+ * 4 KiB chunks, like with the UART. The dispatch table is compared with the
+ * previous version, which checked the initialization state and scanned
+ * rcp_cmd_table for each frame.
+ */
+#define BENCH_RCP_RX_FRAME_CNT 200000
+
+static uint64_t bench_rcp_rx_ind_cnt;
+static uint64_t bench_rcp_rx_cnf_cnt;
+
+static void bench_rcp_rx_on_tx_cnf(struct rcp *rcp, const struct hif_tx_cnf *cnf)
+{
+    bench_rcp_rx_cnf_cnt++;
+}
+
+static void bench_rcp_rx_on_rx_ind(struct rcp *rcp, const struct hif_rx_ind *ind)
+{
+    bench_rcp_rx_ind_cnt++;
+}
+
+static bool bench_rcp_rx_frame_ref(struct rcp *rcp)
+{
+    struct iobuf_read buf = { .data = rcp_rx_buf };
+    uint32_t cmd;
+
+    buf.data_size = rcp->bus.rx(&rcp->bus, rcp_rx_buf, sizeof(rcp_rx_buf));
+    if (!buf.data_size)
+        return false;
+    capture_record_hif(buf.data, buf.data_size);
+    cmd = hif_pop_u8(&buf);
+    TRACE(TR_HIF, "hif rx: %s %s", hif_cmd_str(cmd),
+          tr_bytes(iobuf_ptr(&buf), iobuf_remaining_size(&buf),
+                   NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+    if (!rcp->has_reset ? cmd != HIF_CMD_IND_RESET :
+        !rcp->has_rf_list ? cmd != HIF_CMD_CNF_RADIO_LIST : false) {
+        TRACE(TR_DROP, "drop %-9s: unexpected command during reset sequence", "hif");
+        return true;
+    }
+    for (const struct rcp_cmd *entry = rcp_cmd_table; entry->fn; entry++) {
+        if (entry->cmd == cmd) {
+            entry->fn(rcp, &buf);
+            return true;
+        }
+    }
+    TRACE(TR_DROP, "drop %-9s: unsupported command 0x%02x", "hif", cmd);
+    return true;
+}
+
+static void bench_rcp_rx_ref(struct rcp *rcp)
+{
+    int cnt = 0;
+
+    do {
+        if (!bench_rcp_rx_frame_ref(rcp))
+            break;
+        cnt++;
+    } while (rcp->bus.uart.data_ready && cnt < 16); // RCP_RX_BUDGET
+}
+
+static void bench_rcp_rx_stream(struct iobuf_write *stream)
+{
+    struct iobuf_write frame = { };
+    uint8_t payload[200];
+    int offset;
+
+    for (int i = 0; i < BENCH_RCP_RX_FRAME_CNT; i++) {
+        if (i % 64 == 63) {
+            hif_push_u8(&frame, HIF_CMD_REQ_RESET);
+        } else if (i % 16 < 8) {
+            bench_rand_fill(payload, sizeof(payload));
+            hif_push_u8(&frame, HIF_CMD_IND_DATA_RX);
+            hif_push_data(&frame, payload, 40 + bench_rand() % 161);
+            hif_push_u64(&frame, i);
+            hif_push_u8(&frame, 200);
+            hif_push_i8(&frame, -80);
+            hif_push_u8(&frame, 2);
+            hif_push_u16(&frame, i % 64);
+        } else if (i % 16 < 14) {
+            bench_rand_fill(payload, 30);
+            hif_push_u8(&frame, HIF_CMD_CNF_DATA_TX);
+            hif_push_u8(&frame, i % 256);
+            hif_push_u8(&frame, 0);
+            hif_push_data(&frame, payload, 30);
+            hif_push_u64(&frame, i);
+            hif_push_u8(&frame, 200);
+            hif_push_u8(&frame, -80);
+            hif_push_u32(&frame, i);
+            hif_push_u16(&frame, i % 64);
+            hif_push_u8(&frame, 0);
+            hif_push_u8(&frame, 0);
+            hif_push_u8(&frame, 0);
+        } else if (i % 16 == 14) {
+            hif_push_u8(&frame, HIF_CMD_IND_NOP);
+        } else {
+            hif_push_u8(&frame, HIF_CMD_IND_REPLAY_TIMER);
+        }
+        offset = stream->len;
+        iobuf_push_le16(stream, frame.len);
+        iobuf_push_le16(stream, crc16(CRC_INIT_HCS, stream->data + offset, 2));
+        iobuf_push_data(stream, frame.data, frame.len);
+        iobuf_push_le16(stream, crc16(CRC_INIT_FCS, frame.data, frame.len));
+        iobuf_free(&frame);
+    }
+}
+
+static void bench_rcp_rx_replay(const char *op, const struct iobuf_write *stream,
+                                bool cmd_timing, void (*rx)(struct rcp *rcp))
+{
+    struct rcp *rcp = zalloc(sizeof(*rcp));
+    int pending, len, fds[2];
+    uint64_t wakeup_cnt = 0;
+    size_t offset = 0;
+    uint64_t t0;
+
+    FATAL_ON(pipe(fds) < 0, 2, "pipe: %m");
+    rcp_init(rcp);
+    rcp->cmd_timing = cmd_timing;
+    rcp->has_reset   = true;
+    rcp->has_rf_list = true;
+    rcp->bus.fd = fds[0];
+    rcp->bus.rx = uart_rx;
+    rcp->on_tx_cnf = bench_rcp_rx_on_tx_cnf;
+    rcp->on_rx_ind = bench_rcp_rx_on_rx_ind;
+    bench_rcp_rx_ind_cnt = 0;
+    bench_rcp_rx_cnf_cnt = 0;
+    t0 = bench_now_ns();
+    while (offset < stream->len) {
+        len = MIN(stream->len - offset, 4096);
+        FATAL_ON(write(fds[1], stream->data + offset, len) != len, 2, "write: %m");
+        offset += len;
+        for (;;) {
+            FATAL_ON(ioctl(fds[0], FIONREAD, &pending) < 0, 2, "ioctl: %m");
+            if (!pending && !rcp->bus.uart.data_ready)
+                break;
+            rx(rcp);
+            wakeup_cnt++;
+        }
+    }
+    bench_report("rcp_rx", op, t0, BENCH_RCP_RX_FRAME_CNT);
+    FATAL_ON(bench_rcp_rx_ind_cnt != BENCH_RCP_RX_FRAME_CNT / 16 * 8 ||
+             bench_rcp_rx_cnf_cnt != BENCH_RCP_RX_FRAME_CNT / 16 * 6,
+             1, "rcp_rx: %"PRIu64" indications, %"PRIu64" confirmations",
+             bench_rcp_rx_ind_cnt, bench_rcp_rx_cnf_cnt);
+    printf("%-12s %-24s %10.1f frames/wakeup\n", "rcp_rx", op,
+           (double)BENCH_RCP_RX_FRAME_CNT / wakeup_cnt);
+    close(fds[0]);
+    close(fds[1]);
+    free(rcp);
+}
+
+static void bench_rcp_rx(void)
+{
+    struct iobuf_write stream = { };
+
+    bench_rcp_rx_stream(&stream);
+    bench_rcp_rx_replay("dispatch table", &stream, false, rcp_rx);
+    bench_rcp_rx_replay("dispatch table, timing", &stream, true, rcp_rx);
+    bench_rcp_rx_replay("table scan", &stream, false, bench_rcp_rx_ref);
+    iobuf_free(&stream);
+}
+
+struct bench_hash_entry {
+    uint8_t key[16];
+    struct hash_entry hash_entry;
+};
+
+static struct bench_hash_entry *bench_hash_find(struct hash_table *table, const uint8_t key[16])
+{
+    struct bench_hash_entry *entry;
+    struct hash_entry *it;
+
+    hash_table_foreach(table, it, hash_table_key(key, 16)) {
+        entry = container_of(it, struct bench_hash_entry, hash_entry);
+        if (!memcmp(entry->key, key, 16))
+            return entry;
+    }
+    return NULL;
+}
+
+static void bench_hash_table(void)
+{
+    const int entry_cnt = 100000;
+    struct bench_hash_entry *entries = xalloc(entry_cnt * sizeof(*entries));
+    struct hash_table table = { };
+    uint64_t t0;
+
+    for (int i = 0; i < entry_cnt; i++)
+        bench_rand_fill(entries[i].key, 16);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        hash_table_insert(&table, &entries[i].hash_entry, hash_table_key(entries[i].key, 16));
+    bench_report("hash_table", "insert", t0, entry_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        FATAL_ON(bench_hash_find(&table, entries[i].key) != &entries[i], 1, "hash_table lookup");
+    bench_report("hash_table", "lookup hit", t0, entry_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        FATAL_ON(bench_hash_find(&table, (uint8_t [16]){ i }), 1, "hash_table lookup");
+    bench_report("hash_table", "lookup miss", t0, entry_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        hash_table_remove(&table, &entries[i].hash_entry);
+    bench_report("hash_table", "remove", t0, entry_cnt);
+    hash_table_free(&table);
+    free(entries);
+}
+
+/*
+ * Lookup and expiration of 100, 1000 and 5000 Wi-SUN neighbors. Lookups are
+ * compared with a walk of the neighbor list, like ws_neigh_get() did before
+ * the hash index. Expiration is measured when no neighbor has expired (the
+ * call made every second), and when all of them expire at once.
+ */
+static struct ws_neigh_table bench_neigh_table;
+
+static void bench_ws_neigh_on_expire(const uint8_t *mac64)
+{
+    ws_neigh_del(&bench_neigh_table, mac64);
+}
+
+static struct ws_neigh *bench_ws_neigh_get_ref(struct ws_neigh_table *table, const uint8_t *mac64)
+{
+    struct ws_neigh *neigh;
+
+    LIST_FOREACH(neigh, &table->neigh_list, link)
+        if (!memcmp(neigh->mac64, mac64, 8))
+            return neigh;
+    return NULL;
+}
+
+static void bench_ws_neigh_run(int neigh_cnt)
+{
+    const int lookup_cnt = 1000000;
+    struct ws_neigh_table *table = &bench_neigh_table;
+    uint8_t (*mac64)[8] = xalloc(neigh_cnt * sizeof(*mac64));
+    struct ws_neigh **neighs = xalloc(neigh_cnt * sizeof(*neighs));
+    int ref_lookup_cnt = lookup_cnt / neigh_cnt * 100;
+    char op[24];
+    uint64_t t0;
+
+    table->on_expire = bench_ws_neigh_on_expire;
+    for (int i = 0; i < neigh_cnt; i++)
+        bench_rand_fill(mac64[i], 8);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < neigh_cnt; i++)
+        neighs[i] = ws_neigh_add(table, mac64[i], WS_NR_ROLE_ROUTER, 14, 0);
+    snprintf(op, sizeof(op), "add %d", neigh_cnt);
+    bench_report("ws_neigh", op, t0, neigh_cnt);
+    for (int i = 0; i < neigh_cnt; i++)
+        ws_neigh_refresh(table, neighs[i], 3600 + bench_rand() % 3600);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < lookup_cnt; i++)
+        FATAL_ON(ws_neigh_get(table, mac64[i % neigh_cnt]) != neighs[i % neigh_cnt], 1, "ws_neigh_get");
+    snprintf(op, sizeof(op), "get %d", neigh_cnt);
+    bench_report("ws_neigh", op, t0, lookup_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < ref_lookup_cnt; i++)
+        FATAL_ON(bench_ws_neigh_get_ref(table, mac64[i % neigh_cnt]) != neighs[i % neigh_cnt], 1, "ws_neigh_get");
+    snprintf(op, sizeof(op), "list walk %d", neigh_cnt);
+    bench_report("ws_neigh", op, t0, ref_lookup_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < lookup_cnt; i++)
+        ws_neigh_table_expire(table, 1);
+    snprintf(op, sizeof(op), "expire none %d", neigh_cnt);
+    bench_report("ws_neigh", op, t0, lookup_cnt);
+    FATAL_ON(table->count != neigh_cnt, 1, "ws_neigh_table_expire");
+
+    for (int i = 0; i < neigh_cnt; i++)
+        ws_neigh_refresh(table, neighs[i], 0);
+    t0 = bench_now_ns();
+    ws_neigh_table_expire(table, 1);
+    snprintf(op, sizeof(op), "expire all %d", neigh_cnt);
+    bench_report("ws_neigh", op, t0, neigh_cnt);
+    FATAL_ON(table->count, 1, "ws_neigh_table_expire");
+    free(neighs);
+    free(mac64);
+}
+
+static void bench_ws_neigh(void)
+{
+    bench_ws_neigh_run(100);
+    bench_ws_neigh_run(1000);
+    bench_ws_neigh_run(5000);
+}
+
+/*
+ * Address registrations (NS with ARO) from 10000 neighbors, each registering
+ * a link-local address and a GUA, so the neighbor cache holds 20000 entries.
+ * The NS options are processed by nd_ns_earo_handler(), ARO routes and
+ * neighbor storage included. The TUN is left out: without a netlink socket,
+ * the tun_*() calls return early. The first round creates the entries, the
+ * next rounds refresh random ones. ipv6_neighbour_used() is called for each
+ * packet sent to a neighbor. The ARO routes of a node are removed and
+ * restored when its 15.4 neighbor entry is lost and found again. The traces
+ * of the route table, printed on every change, are discarded.
+ */
+#define BENCH_ARO_NEIGH_CNT 10000
+
+static void bench_aro_addr(uint8_t addr[16], const uint8_t eui64[8], bool gua)
+{
+    memset(addr, 0, 16);
+    addr[0] = gua ? 0xfd : 0xfe;
+    addr[1] = gua ? 0x00 : 0x80;
+    memcpy(addr + 8, eui64, 8);
+    addr[8] ^= 0x02;
+}
+
+static void bench_aro_register(struct net_if *net_if, const uint8_t addr[16], const uint8_t eui64[8])
+{
+    struct ipv6_nd_opt_earo na_earo = { };
+    uint8_t earo[16] = { ICMPV6_OPT_ADDR_REGISTRATION, 2 };
+    uint8_t slla[10] = { ICMPV6_OPT_SRC_LL_ADDR, 2 };
+
+    write_be16(earo + 6, 120); // Lifetime in minutes
+    memcpy(earo + 8, eui64, 8);
+    memcpy(slla + 2, eui64, 8);
+    nd_ns_earo_handler(net_if, earo, sizeof(earo), slla, addr, addr, &na_earo);
+    FATAL_ON(na_earo.status != ARO_SUCCESS, 1, "nd_ns_earo_handler: status %d", na_earo.status);
+}
+
+static void bench_aro(void)
+{
+    static const char *files[] = { "neighbor-*", NULL };
+    char prefix[32] = "/tmp/wsbrd-bench-XXXXXX";
+    const int round_cnt = 5;
+    const int used_cnt = 1000000;
+    struct net_if *net_if = zalloc(sizeof(*net_if));
+    ipv6_neighbour_cache_t *cache = &net_if->ipv6_neighbour_cache;
+    uint8_t (*eui64)[8] = xalloc(BENCH_ARO_NEIGH_CNT * sizeof(*eui64));
+    FILE *trace_stream = g_trace_stream;
+    ipv6_neighbour_t *neigh;
+    uint8_t addr[16];
+    char op[32];
+    uint64_t t0;
+    int node;
+
+    g_trace_stream = fopen("/dev/null", "w");
+    FATAL_ON(!g_trace_stream, 2, "fopen: %m");
+    FATAL_ON(!mkdtemp(prefix), 2, "mkdtemp: %m");
+    strcat(prefix, "/");
+    g_storage_prefix = prefix;
+    ns_list_init(&net_if->ip_addresses);
+    ns_list_init(&cache->list);
+    ns_list_init(&cache->gc_list);
+    ipv6_neighbour_cache_init(cache, net_if->id);
+    protocol_6lowpan_up(net_if);
+    cache->send_nud_probes = false;
+    for (int i = 0; i < BENCH_ARO_NEIGH_CNT; i++) {
+        bench_rand_fill(eui64[i], 8);
+        ws_neigh_add(&net_if->ws_info.neighbor_storage, eui64[i], WS_NR_ROLE_ROUTER, 14, 0);
+    }
+
+    snprintf(op, sizeof(op), "%d new", BENCH_ARO_NEIGH_CNT);
+    t0 = bench_now_ns();
+    for (int i = 0; i < BENCH_ARO_NEIGH_CNT; i++) {
+        bench_aro_addr(addr, eui64[i], false);
+        bench_aro_register(net_if, addr, eui64[i]);
+        bench_aro_addr(addr, eui64[i], true);
+        bench_aro_register(net_if, addr, eui64[i]);
+    }
+    bench_report("aro", op, t0, 2 * BENCH_ARO_NEIGH_CNT);
+
+    snprintf(op, sizeof(op), "%d refresh", BENCH_ARO_NEIGH_CNT);
+    t0 = bench_now_ns();
+    for (int i = 0; i < round_cnt * BENCH_ARO_NEIGH_CNT; i++) {
+        node = bench_rand() % BENCH_ARO_NEIGH_CNT;
+        bench_aro_addr(addr, eui64[node], i % 2);
+        bench_aro_register(net_if, addr, eui64[node]);
+    }
+    bench_report("aro", op, t0, round_cnt * BENCH_ARO_NEIGH_CNT);
+    FATAL_ON(cache->addr_index.entry_cnt != 2 * BENCH_ARO_NEIGH_CNT, 1, "ipv6_neighbour_create");
+    FATAL_ON(cache->gc_count, 1, "ipv6_neighbour_set_type");
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < used_cnt; i++) {
+        node = bench_rand() % BENCH_ARO_NEIGH_CNT;
+        bench_aro_addr(addr, eui64[node], i % 2);
+        ipv6_neighbour_used(cache, ipv6_neighbour_lookup(cache, addr));
+    }
+    bench_report("aro", "used", t0, used_cnt);
+    for (int i = 0; i < BENCH_ARO_NEIGH_CNT; i++) {
+        neigh = ipv6_neighbour_lookup_gua_by_eui64(cache, eui64[i]);
+        bench_aro_addr(addr, eui64[i], true);
+        FATAL_ON(!neigh || memcmp(neigh->ip_address, addr, 16), 1, "ipv6_neighbour_lookup_gua_by_eui64");
+    }
+
+    snprintf(op, sizeof(op), "%d routes del/add", BENCH_ARO_NEIGH_CNT);
+    t0 = bench_now_ns();
+    for (int i = 0; i < BENCH_ARO_NEIGH_CNT; i++) {
+        nd_remove_aro_routes_by_eui64(net_if, eui64[i]);
+        nd_restore_aro_routes_by_eui64(net_if, eui64[i]);
+    }
+    bench_report("aro", op, t0, BENCH_ARO_NEIGH_CNT);
+
+    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+        ipv6_neighbour_entry_remove(cache, cur);
+    hash_table_free(&cache->addr_index);
+    hash_table_free(&cache->eui64_index);
+    ipv6_route_table_remove_interface(net_if->id);
+    for (int i = 0; i < BENCH_ARO_NEIGH_CNT; i++)
+        ws_neigh_del(&net_if->ws_info.neighbor_storage, eui64[i]);
+    hash_table_free(&net_if->ws_info.neighbor_storage.index);
+    free(net_if->ws_info.neighbor_storage.expire_heap);
+    storage_delete(files);
+    rmdir(prefix);
+    g_storage_prefix = NULL;
+    fclose(g_trace_stream);
+    g_trace_stream = trace_stream;
+    free(eui64);
+    free(net_if);
+}
+
+/*
+ * Longest prefix match with 1000 and 10000 routes below a common /64, mostly
+ * host routes with a few shorter prefixes. Half of the lookups only match a
+ * shorter prefix. The trie is compared with a walk of all the routes using
+ * bitcmp(), like ipv6_route_find_best() did before the trie.
+ */
+static int bench_lpm_linear(uint8_t (*prefixes)[16], const uint8_t *prefix_lens,
+                            int entry_cnt, const uint8_t key[16])
+{
+    int best = -1;
+
+    for (int i = 0; i < entry_cnt; i++) {
+        if (bitcmp(key, prefixes[i], prefix_lens[i]))
+            continue;
+        if (best < 0 || prefix_lens[i] > prefix_lens[best])
+            best = i;
+    }
+    return best;
+}
+
+static void bench_lpm_trie_run(int entry_cnt)
+{
+    const int lookup_cnt = 1000000;
+    const int linear_lookup_cnt = 10000000 / entry_cnt;
+    struct lpm_trie_entry *entries = xalloc(entry_cnt * sizeof(*entries));
+    uint8_t (*prefixes)[16] = xalloc(entry_cnt * sizeof(*prefixes));
+    uint8_t *prefix_lens = xalloc(entry_cnt);
+    struct lpm_trie_node *node;
+    struct lpm_trie trie = { };
+    uint8_t key[16];
+    char op[24];
+    uint64_t t0;
+    int hit = 0;
+
+    for (int i = 0; i < entry_cnt; i++) {
+        memset(&entries[i], 0, sizeof(entries[i]));
+        memcpy(prefixes[i], (uint8_t [8]){ 0x20, 0x01, 0x0d, 0xb8 }, 8);
+        bench_rand_fill(prefixes[i] + 8, 8);
+        prefix_lens[i] = i % 100 ? 128 : 64 + i % 64;
+    }
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        lpm_trie_insert(&trie, &entries[i], prefixes[i], prefix_lens[i]);
+    snprintf(op, sizeof(op), "insert %d", entry_cnt);
+    bench_report("lpm_trie", op, t0, entry_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < lookup_cnt; i++) {
+        memcpy(key, prefixes[i % entry_cnt], 16);
+        if (i & 1)
+            key[15] ^= 1;
+        node = lpm_trie_lookup(&trie, key);
+        hit += node != NULL;
+    }
+    snprintf(op, sizeof(op), "lookup %d", entry_cnt);
+    bench_report("lpm_trie", op, t0, lookup_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < linear_lookup_cnt; i++) {
+        memcpy(key, prefixes[i % entry_cnt], 16);
+        if (i & 1)
+            key[15] ^= 1;
+        hit += bench_lpm_linear(prefixes, prefix_lens, entry_cnt, key) >= 0;
+    }
+    snprintf(op, sizeof(op), "linear lookup %d", entry_cnt);
+    bench_report("lpm_trie", op, t0, linear_lookup_cnt);
+    bench_sink = hit;
+
+    // Both must find the same prefix
+    for (int i = 0; i < 1000; i++) {
+        memcpy(key, prefixes[i % entry_cnt], 16);
+        if (i & 1)
+            key[15] ^= 1;
+        node = lpm_trie_lookup(&trie, key);
+        hit = bench_lpm_linear(prefixes, prefix_lens, entry_cnt, key);
+        FATAL_ON(hit < 0 ? node != NULL : node != entries[hit].node, 1,
+                 "lpm_trie mismatch with linear lookup");
+    }
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < entry_cnt; i++)
+        lpm_trie_remove(&trie, &entries[i]);
+    snprintf(op, sizeof(op), "remove %d", entry_cnt);
+    bench_report("lpm_trie", op, t0, entry_cnt);
+    free(prefix_lens);
+    free(prefixes);
+    free(entries);
+}
+
+static void bench_lpm_trie(void)
+{
+    bench_lpm_trie_run(1000);
+    bench_lpm_trie_run(10000);
+}
+
+/*
+ * DAOs are fed to rpl_recv() through a UDP socket on the loopback interface,
+ * which provides the IPV6_PKTINFO ancillary data expected from the ICMPv6
+ * socket. The payload starts with the ICMPv6 header.
+ */
+struct bench_rpl {
+    struct rpl_root root;
+    int tx_fd;
+};
+
+static void bench_rpl_init(struct bench_rpl *bench)
+{
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr   = IN6ADDR_LOOPBACK_INIT,
+    };
+    socklen_t addr_len = sizeof(addr);
+
+    memset(bench, 0, sizeof(*bench));
+    bench->root.instance_id = 0;
+    memcpy(bench->root.dodag_id, (uint8_t [16]){ 0xfd, [15] = 1 }, 16);
+    bench->root.pcs = 1;
+    bench->root.lifetime_unit_s = 60;
+    bench->root.lifetime_s = 120 * 60;
+    TAILQ_INIT(&bench->root.storage_dirty);
+
+    bench->root.sockfd = socket(AF_INET6, SOCK_DGRAM, 0);
+    FATAL_ON(bench->root.sockfd < 0, 2, "socket: %m");
+    FATAL_ON(setsockopt(bench->root.sockfd, IPPROTO_IPV6, IPV6_RECVPKTINFO, (int[1]){ true }, sizeof(int)) < 0,
+             2, "setsockopt: %m");
+    FATAL_ON(bind(bench->root.sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0, 2, "bind: %m");
+    FATAL_ON(getsockname(bench->root.sockfd, (struct sockaddr *)&addr, &addr_len) < 0, 2, "getsockname: %m");
+    bench->tx_fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    FATAL_ON(bench->tx_fd < 0, 2, "socket: %m");
+    FATAL_ON(connect(bench->tx_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0, 2, "connect: %m");
+}
+
+static void bench_rpl_free(struct bench_rpl *bench)
+{
+    struct rpl_target *target;
+
+    while ((target = SLIST_FIRST(&bench->root.targets)))
+        rpl_target_del(&bench->root, target);
+    hash_table_free(&bench->root.targets_index);
+    hash_table_free(&bench->root.srh_children);
+    close(bench->root.sockfd);
+    close(bench->tx_fd);
+}
+
+// Non-storing DAO with one target and its preferred parent
+static void bench_rpl_dao(struct bench_rpl *bench, const uint8_t target[16],
+                          const uint8_t parent[16], uint8_t path_seq)
+{
+    struct iobuf_write buf = { };
+
+    iobuf_push_u8(&buf, ICMPV6_TYPE_RPL);
+    iobuf_push_u8(&buf, RPL_CODE_DAO);
+    iobuf_push_be16(&buf, 0); // Checksum
+    iobuf_push_u8(&buf, bench->root.instance_id);
+    iobuf_push_u8(&buf, 0);   // Flags
+    iobuf_push_u8(&buf, 0);   // Reserved
+    iobuf_push_u8(&buf, path_seq); // DAO Sequence
+    iobuf_push_u8(&buf, RPL_OPT_TARGET);
+    iobuf_push_u8(&buf, 18);
+    iobuf_push_u8(&buf, 0);   // Flags
+    iobuf_push_u8(&buf, 128); // Prefix Length
+    iobuf_push_data(&buf, target, 16);
+    iobuf_push_u8(&buf, RPL_OPT_TRANSIT);
+    iobuf_push_u8(&buf, 20);
+    iobuf_push_u8(&buf, 0);    // Flags
+    iobuf_push_u8(&buf, 0x80); // Path Control
+    iobuf_push_u8(&buf, path_seq);
+    iobuf_push_u8(&buf, 120);  // Path Lifetime
+    iobuf_push_data(&buf, parent, 16);
+    FATAL_ON(send(bench->tx_fd, buf.data, buf.len, 0) != buf.len, 2, "send: %m");
+    iobuf_free(&buf);
+    rpl_recv(&bench->root);
+}
+
+static void bench_rpl_addr(uint8_t addr[16], int i)
+{
+    memset(addr, 0, 16);
+    addr[0] = 0xfd;
+    write_be32(addr + 12, i + 2);
+}
+
+/*
+ * Ingestion of DAOs by the root with 1000 to 10000 targets, each DAO going
+ * through rpl_recv() and rpl_target_get(). The first round creates the targets
+ * with rpl_target_new(), the next rounds refresh them in a random order with a
+ * new path sequence. The lookup of the targets is also compared with the list
+ * walk that rpl_target_get() used before the prefix index.
+ */
+static struct rpl_target *bench_dao_target_get_ref(struct rpl_root *root, const uint8_t prefix[16])
+{
+    struct rpl_target *target;
+
+    SLIST_FOREACH(target, &root->targets, link)
+        if (!memcmp(target->prefix, prefix, 16))
+            return target;
+    return NULL;
+}
+
+static void bench_dao_run(int target_cnt)
+{
+    const int round_cnt = 5;
+    struct rpl_target *entry;
+    struct bench_rpl bench;
+    uint8_t target[16];
+    char op[32];
+    uint64_t t0;
+
+    bench_rpl_init(&bench);
+    snprintf(op, sizeof(op), "%d new", target_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < target_cnt; i++) {
+        bench_rpl_addr(target, i);
+        bench_rpl_dao(&bench, target, bench.root.dodag_id, 0);
+    }
+    bench_report("dao", op, t0, target_cnt);
+    FATAL_ON(rpl_target_count(&bench.root) != target_cnt, 1, "rpl_target_count");
+
+    snprintf(op, sizeof(op), "%d refresh", target_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < round_cnt * target_cnt; i++) {
+        bench_rpl_addr(target, bench_rand() % target_cnt);
+        entry = rpl_target_get(&bench.root, target);
+        bench_rpl_dao(&bench, target, bench.root.dodag_id, entry->path_seq + 1);
+    }
+    bench_report("dao", op, t0, round_cnt * target_cnt);
+
+    snprintf(op, sizeof(op), "%d lookup", target_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < round_cnt * target_cnt; i++) {
+        bench_rpl_addr(target, bench_rand() % target_cnt);
+        bench_sink += (uintptr_t)rpl_target_get(&bench.root, target);
+    }
+    bench_report("dao", op, t0, round_cnt * target_cnt);
+
+    snprintf(op, sizeof(op), "%d list walk", target_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < round_cnt * target_cnt; i++) {
+        bench_rpl_addr(target, bench_rand() % target_cnt);
+        bench_sink += (uintptr_t)bench_dao_target_get_ref(&bench.root, target);
+    }
+    bench_report("dao", op, t0, round_cnt * target_cnt);
+    bench_rpl_free(&bench);
+}
+
+static void bench_dao(void)
+{
+    bench_dao_run(1000);
+    bench_dao_run(5000);
+    bench_dao_run(10000);
+}
+
+/*
+ * Downward routes in a synthetic network of 10000 nodes spread on 15 ranks,
+ * where each node picks a random parent in the previous rank. Source routes
+ * are built for random destinations, while periodic DAOs refresh the
+ * transits (same parent, new path sequence) and some nodes change their
+ * preferred parent. Packets are also routed with the cache invalidated
+ * before each lookup, to show the cost of computing the route.
+ */
+#define BENCH_SRH_NODE_CNT 10000
+#define BENCH_SRH_RANK_CNT 15
+
+static void bench_srh_run(struct bench_rpl *bench, const char *op, int packet_cnt,
+                          int dao_period, int parent_change_period, bool invalidate)
+{
+    const int rank_size = BENCH_SRH_NODE_CNT / BENCH_SRH_RANK_CNT;
+    uint64_t hit = bench->root.srh_cache_hit;
+    uint64_t miss = bench->root.srh_cache_miss;
+    struct iobuf_write buf = { };
+    uint8_t target[16], parent[16];
+    struct rpl_target *entry;
+    const uint8_t *nxthop;
+    uint64_t t0;
+    int node;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < packet_cnt; i++) {
+        if (dao_period && i % dao_period == 0) {
+            node = bench_rand() % BENCH_SRH_NODE_CNT;
+            bench_rpl_addr(target, node);
+            entry = rpl_target_get(&bench->root, target);
+            if (node < rank_size)
+                memcpy(parent, bench->root.dodag_id, 16);
+            else if (parent_change_period && i % parent_change_period == 0)
+                bench_rpl_addr(parent, node / rank_size * rank_size - rank_size + bench_rand() % rank_size);
+            else
+                memcpy(parent, rpl_transit_preferred(&bench->root, entry)->parent, 16);
+            bench_rpl_dao(bench, target, parent, entry->path_seq + 1);
+        }
+        bench_rpl_addr(target, bench_rand() % BENCH_SRH_NODE_CNT);
+        entry = rpl_target_get(&bench->root, target);
+        if (invalidate) {
+            free(entry->srh_cache);
+            entry->srh_cache = NULL;
+        }
+        buf.len = 0;
+        FATAL_ON(rpl_srh_build_push(&bench->root, target, &buf, 17, &nxthop) < 0, 1, "rpl_srh_build_push");
+    }
+    bench_report("srh", op, t0, packet_cnt);
+    hit = bench->root.srh_cache_hit - hit;
+    miss = bench->root.srh_cache_miss - miss;
+    printf("%-12s %-24s %10.1f %% hit\n", "srh", op, 100.0 * hit / (hit + miss));
+    iobuf_free(&buf);
+}
+
+static void bench_srh(void)
+{
+    const int rank_size = BENCH_SRH_NODE_CNT / BENCH_SRH_RANK_CNT;
+    struct bench_rpl bench;
+    uint8_t target[16], parent[16];
+
+    bench_rpl_init(&bench);
+    for (int i = 0; i < BENCH_SRH_NODE_CNT; i++) {
+        bench_rpl_addr(target, i);
+        if (i < rank_size)
+            memcpy(parent, bench.root.dodag_id, 16);
+        else
+            bench_rpl_addr(parent, i / rank_size * rank_size - rank_size + bench_rand() % rank_size);
+        bench_rpl_dao(&bench, target, parent, 0);
+    }
+    bench_srh_run(&bench, "uncached", 100000, 0, 0, true);
+    bench_srh_run(&bench, "no DAO", 1000000, 0, 0, false);
+    bench_srh_run(&bench, "refresh 1/10", 1000000, 10, 0, false);
+    bench_srh_run(&bench, "refresh 1/10 move 1/1000", 1000000, 10, 1000, false);
+    bench_rpl_free(&bench);
+}
+
+static void bench_storage_put(const char *name, int val)
+{
+    struct storage_parse_info *info = storage_open_prefix(name, "w");
+
+    FATAL_ON(!info, 1, "storage_open %s", name);
+    fprintf(info->file, "value = %d\n", val);
+    FATAL_ON(storage_close(info), 1, "storage_close %s", name);
+}
+
+static void bench_storage_load(const char *op, int file_cnt, uint64_t t0)
+{
+    struct storage_parse_info *info;
+    glob_t globbuf;
+
+    FATAL_ON(storage_glob("bench-*", &globbuf), 1, "storage_glob");
+    FATAL_ON(globbuf.gl_pathc != file_cnt, 1, "storage_glob: %zu files", globbuf.gl_pathc);
+    for (int i = 0; globbuf.gl_pathv[i]; i++) {
+        info = storage_open(globbuf.gl_pathv[i], "r");
+        FATAL_ON(!info, 1, "storage_open %s", globbuf.gl_pathv[i]);
+        while (storage_parse_line(info) != EOF)
+            ;
+        storage_close(info);
+    }
+    storage_globfree(&globbuf);
+    bench_report("storage_log", op, t0, file_cnt);
+}
+
+/*
+ * Write file_cnt files, then read them back as done on startup, first with
+ * one file per entity, then with the log. Legacy files are never synced,
+ * while the log is either synced after each record (as wsbrd used to) or once
+ * every 100 records (as one main loop iteration would batch them). The cold
+ * start re-opens the log, which reads it entirely and rebuilds the index.
+ * The import moves the legacy files to the log with a single sync. Sync times
+ * mostly depend on the file system holding /tmp.
+ */
+static void bench_storage_log_run(int file_cnt)
+{
+    static const char *files[] = { "bench-*", NULL };
+    char prefix[32] = "/tmp/wsbrd-bench-XXXXXX";
+    char path[PATH_MAX];
+    char name[32];
+    char op[32];
+    uint64_t t0;
+
+    FATAL_ON(!mkdtemp(prefix), 2, "mkdtemp: %m");
+    strcat(prefix, "/");
+    g_storage_prefix = prefix;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < file_cnt; i++) {
+        snprintf(name, sizeof(name), "bench-%d", i);
+        bench_storage_put(name, i);
+    }
+    snprintf(op, sizeof(op), "%d files write", file_cnt);
+    bench_report("storage_log", op, t0, file_cnt);
+    snprintf(op, sizeof(op), "%d files load", file_cnt);
+    bench_storage_load(op, file_cnt, bench_now_ns());
+
+    t0 = bench_now_ns();
+    storage_log_open(files);
+    snprintf(op, sizeof(op), "%d files import", file_cnt);
+    bench_report("storage_log", op, t0, file_cnt);
+    snprintf(path, sizeof(path), "%sbench-0", prefix);
+    FATAL_ON(!access(path, F_OK), 1, "%s not imported", path);
+    t0 = bench_now_ns();
+    for (int i = 0; i < file_cnt; i++) {
+        snprintf(name, sizeof(name), "bench-%d", i);
+        bench_storage_put(name, i);
+        storage_log_sync();
+    }
+    snprintf(op, sizeof(op), "%d log write sync/1", file_cnt);
+    bench_report("storage_log", op, t0, file_cnt);
+    t0 = bench_now_ns();
+    for (int i = 0; i < file_cnt; i++) {
+        snprintf(name, sizeof(name), "bench-%d", i);
+        bench_storage_put(name, i + 1);
+        if (i % 100 == 99)
+            storage_log_sync();
+    }
+    storage_log_sync();
+    snprintf(op, sizeof(op), "%d log write sync/100", file_cnt);
+    bench_report("storage_log", op, t0, file_cnt);
+    storage_log_close();
+
+    t0 = bench_now_ns();
+    storage_log_open(files);
+    snprintf(op, sizeof(op), "%d log cold start", file_cnt);
+    bench_storage_load(op, file_cnt, t0);
+    storage_log_close();
+
+    snprintf(path, sizeof(path), "%sstorage.log", prefix);
+    unlink(path);
+    rmdir(prefix);
+    g_storage_prefix = NULL;
+}
+
+static void bench_storage_log(void)
+{
+    bench_storage_log_run(1000);
+    bench_storage_log_run(5000);
+    bench_storage_log_run(10000);
+}
+
+/*
+ * Supplicant list used by the D-Bus Nodes property, with 5000 key files.
+ * The reference reads the storage on every request like wsbrd used to: glob
+ * the key files and parse each of them to retrieve the node role. The key
+ * storage now parses them once, then serves the list from memory.
+ */
+#define BENCH_SUPP_CNT 5000
+
+static int bench_supp_list_ref(uint8_t (*eui64)[8], uint8_t *node_role)
+{
+    supp_entry_t *supp;
+    glob_t globbuf;
+    int cnt;
+
+    if (storage_glob("keys-*:*:*:*:*:*:*:*", &globbuf))
+        return 0;
+    for (cnt = 0; globbuf.gl_pathv[cnt]; cnt++) {
+        parse_byte_array(eui64[cnt], 8, strrchr(globbuf.gl_pathv[cnt], '-') + 1);
+        supp = ws_pae_key_storage_supp_read(NULL, eui64[cnt], NULL, NULL, NULL);
+        node_role[cnt] = supp->sec_keys.node_role;
+        free(supp);
+    }
+    storage_globfree(&globbuf);
+    return cnt;
+}
+
+static int bench_supp_list_cached(uint8_t (*eui64)[8], uint8_t *node_role)
+{
+    const struct ws_pae_key_storage_supp_info *info;
+    int cnt;
+
+    info = ws_pae_key_storage_supp_list(&cnt);
+    for (int i = 0; i < cnt; i++) {
+        memcpy(eui64[i], info[i].eui64, 8);
+        node_role[i] = info[i].node_role;
+    }
+    return cnt;
+}
+
+static void bench_supp_run(const char *op, int (*fn)(uint8_t (*)[8], uint8_t *), int req_cnt)
+{
+    uint8_t (*eui64)[8] = xalloc(BENCH_SUPP_CNT * sizeof(*eui64));
+    uint8_t *node_role = xalloc(BENCH_SUPP_CNT);
+    uint64_t *samples = xalloc(req_cnt * sizeof(*samples));
+    uint64_t t0;
+
+    for (int i = 0; i < req_cnt; i++) {
+        t0 = bench_now_ns();
+        FATAL_ON(fn(eui64, node_role) != BENCH_SUPP_CNT, 1, "%s: missing supplicants", op);
+        samples[i] = bench_now_ns() - t0;
+    }
+    bench_report_latency("supp_list", op, samples, req_cnt);
+    free(samples);
+    free(node_role);
+    free(eui64);
+}
+
+static void bench_supp_list(void)
+{
+    static const char *files[] = { "keys-*", NULL };
+    char prefix[32] = "/tmp/wsbrd-bench-XXXXXX";
+    supp_entry_t *supp = zalloc(sizeof(*supp));
+    uint64_t t0;
+
+    FATAL_ON(!mkdtemp(prefix), 2, "mkdtemp: %m");
+    strcat(prefix, "/");
+    g_storage_prefix = prefix;
+
+    supp->sec_keys.ptk_eui_64_set = true;
+    supp->sec_keys.pmk_set = true;
+    supp->sec_keys.pmk_lifetime = 3600;
+    supp->sec_keys.ptk_set = true;
+    supp->sec_keys.ptk_lifetime = 3600;
+    t0 = bench_now_ns();
+    for (int i = 0; i < BENCH_SUPP_CNT; i++) {
+        bench_rand_fill(supp->addr.eui_64, 8);
+        bench_rand_fill(supp->sec_keys.pmk, sizeof(supp->sec_keys.pmk));
+        bench_rand_fill(supp->sec_keys.ptk, sizeof(supp->sec_keys.ptk));
+        supp->sec_keys.node_role = i % 2 ? WS_NR_ROLE_LFN : WS_NR_ROLE_ROUTER;
+        FATAL_ON(ws_pae_key_storage_supp_write(NULL, supp), 1, "ws_pae_key_storage_supp_write");
+    }
+    bench_report("supp_list", "5000 write", t0, BENCH_SUPP_CNT);
+    free(supp);
+
+    bench_supp_run("5000 storage scan", bench_supp_list_ref, 10);
+    // The first call loads the cache from the storage
+    bench_supp_run("5000 cached, first call", bench_supp_list_cached, 1);
+    bench_supp_run("5000 cached", bench_supp_list_cached, 1000);
+
+    storage_delete(files);
+    rmdir(prefix);
+    g_storage_prefix = NULL;
+}
+
+/*
+ * Cost of the D-Bus node journal (see dbus.c) with 10000 nodes, 1 out of 10
+ * being a neighbor. The changed nodes are reported one by one, like
+ * dbus_process_changes() does with the keys passed to
+ * dbus_emit_nodes_change(). The full refresh, which computes the digest of
+ * every node, is only used when too many keys are pending and is given for
+ * comparison. The link metrics of the neighbors change before every round
+ * but are not part of the digest. The replies are serialized
+ * following the D-Bus marshalling rules of the (aya{sv}) entries, without the
+ * message header, since sd-bus itself is not linked in the benchmark.
+ */
+#define BENCH_DBUS_NODE_CNT 10000
+
+struct bench_dbus_node {
+    uint8_t eui64[8];
+    uint8_t node_role;
+    bool is_neighbor;
+    uint8_t rssi;
+    uint8_t lqi;
+    int rsl;
+    int rsl_adv;
+    uint8_t pom[3];
+};
+
+static void bench_dbus_pad(struct iobuf_write *buf, int align)
+{
+    while (buf->len % align)
+        iobuf_push_u8(buf, 0);
+}
+
+static void bench_dbus_push_u32(struct iobuf_write *buf, uint32_t val)
+{
+    bench_dbus_pad(buf, 4);
+    iobuf_push_le32(buf, val);
+}
+
+// Dictionary entry {sv}, the value is either a byte array or a basic type
+static void bench_dbus_push_sv(struct iobuf_write *buf, const char *key, const char *sig,
+                               uint32_t val, const uint8_t *data)
+{
+    bench_dbus_pad(buf, 8);
+    bench_dbus_push_u32(buf, strlen(key));
+    iobuf_push_data(buf, key, strlen(key) + 1);
+    iobuf_push_u8(buf, strlen(sig));
+    iobuf_push_data(buf, sig, strlen(sig) + 1);
+    if (sig[0] == 'a') {
+        bench_dbus_push_u32(buf, val);
+        iobuf_push_data(buf, data, val);
+    } else if (sig[0] == 'y') {
+        iobuf_push_u8(buf, val);
+    } else {
+        bench_dbus_push_u32(buf, val);
+    }
+}
+
+static void bench_dbus_push_node(struct iobuf_write *buf, const struct bench_dbus_node *node)
+{
+    int len_offset, start;
+
+    bench_dbus_pad(buf, 8);
+    bench_dbus_push_u32(buf, 8);
+    iobuf_push_data(buf, node->eui64, 8);
+    bench_dbus_push_u32(buf, 0);
+    len_offset = buf->len - 4;
+    bench_dbus_pad(buf, 8);
+    start = buf->len;
+    bench_dbus_push_sv(buf, "node_role", "y", node->node_role, NULL);
+    bench_dbus_push_sv(buf, "is_authenticated", "b", true, NULL);
+    bench_dbus_push_sv(buf, "is_neighbor", "b", node->is_neighbor, NULL);
+    if (node->is_neighbor) {
+        bench_dbus_push_sv(buf, "rssi", "y", node->rssi, NULL);
+        bench_dbus_push_sv(buf, "lqi", "y", node->lqi, NULL);
+        bench_dbus_push_sv(buf, "rsl", "i", node->rsl, NULL);
+        bench_dbus_push_sv(buf, "rsl_adv", "i", node->rsl_adv, NULL);
+        bench_dbus_push_sv(buf, "pom", "ay", sizeof(node->pom), node->pom);
+        bench_dbus_push_sv(buf, "mdr_cmd_capable", "b", false, NULL);
+    }
+    write_le32(buf->data + len_offset, buf->len - start);
+}
+
+static uint32_t bench_dbus_node_digest(const struct bench_dbus_node *node)
+{
+    uint32_t hash = fnv_hash_reverse_32_init(NULL, 0);
+    int val;
+
+    val = node->node_role;
+    hash = fnv_hash_reverse_32_update((const uint8_t *)&val, sizeof(val), hash);
+    if (!node->is_neighbor)
+        return hash;
+    val = false;
+    hash = fnv_hash_reverse_32_update((const uint8_t *)&val, sizeof(val), hash);
+    return fnv_hash_reverse_32_update(node->pom, sizeof(node->pom), hash);
+}
+
+static void bench_dbus_refresh(struct change_journal *journal, struct bench_dbus_node *nodes)
+{
+    change_journal_refresh_start(journal);
+    for (int i = 0; i < BENCH_DBUS_NODE_CNT; i++)
+        change_journal_refresh(journal, nodes[i].eui64, bench_dbus_node_digest(&nodes[i]));
+    change_journal_refresh_end(journal);
+}
+
+// The index of the node is stored in the first bytes of its EUI-64
+static int bench_dbus_serialize(struct iobuf_write *buf, const struct change_journal *journal,
+                                struct bench_dbus_node *nodes, uint64_t gen)
+{
+    struct change_journal_entry *entry;
+    int cnt = 0;
+
+    iobuf_reset(buf);
+    for (entry = change_journal_first_since(journal, gen); entry; entry = change_journal_next(entry)) {
+        bench_dbus_push_node(buf, &nodes[read_be32(entry->key)]);
+        cnt++;
+    }
+    return cnt;
+}
+
+static void bench_dbus_run(const char *op, struct change_journal *journal,
+                           struct bench_dbus_node *nodes, int change_cnt)
+{
+    const int refresh_cnt = 100;
+    struct iobuf_write buf = { };
+    uint64_t update_ns = 0, refresh_ns = 0, serialize_ns = 0, gen;
+    uint64_t entry_cnt = 0, byte_cnt = 0;
+    struct bench_dbus_node *node;
+    int changed[BENCH_DBUS_NODE_CNT];
+    uint64_t t0;
+
+    for (int i = 0; i < refresh_cnt; i++) {
+        for (int j = 0; j < BENCH_DBUS_NODE_CNT; j += 10) {
+            nodes[j].rssi = bench_rand();
+            nodes[j].rsl = -(int)(bench_rand() % 100);
+        }
+        for (int j = 0; j < change_cnt; j++) {
+            changed[j] = bench_rand() % BENCH_DBUS_NODE_CNT;
+            node = &nodes[changed[j]];
+            if (node->is_neighbor)
+                node->pom[0] ^= 1;
+            else
+                node->node_role ^= WS_NR_ROLE_ROUTER ^ WS_NR_ROLE_LFN;
+        }
+        gen = journal->gen;
+        t0 = bench_now_ns();
+        for (int j = 0; j < change_cnt; j++)
+            change_journal_update(journal, nodes[changed[j]].eui64,
+                                  bench_dbus_node_digest(&nodes[changed[j]]));
+        update_ns += bench_now_ns() - t0;
+        t0 = bench_now_ns();
+        entry_cnt += bench_dbus_serialize(&buf, journal, nodes, gen);
+        serialize_ns += bench_now_ns() - t0;
+        byte_cnt += buf.len;
+        // Nothing left to change, the cost is the walk of the whole set
+        t0 = bench_now_ns();
+        bench_dbus_refresh(journal, nodes);
+        refresh_ns += bench_now_ns() - t0;
+    }
+    printf("%-12s %-24s %8.1f us update %8.1f us refresh %8.1f us serialize %8"PRIu64" entries %10"PRIu64" bytes\n",
+           "dbus_nodes", op, update_ns / 1000.0 / refresh_cnt, refresh_ns / 1000.0 / refresh_cnt,
+           serialize_ns / 1000.0 / refresh_cnt, entry_cnt / refresh_cnt, byte_cnt / refresh_cnt);
+    iobuf_free(&buf);
+}
+
+static void bench_dbus_nodes(void)
+{
+    struct bench_dbus_node *nodes = zalloc(BENCH_DBUS_NODE_CNT * sizeof(*nodes));
+    struct change_journal journal;
+    struct iobuf_write buf = { };
+    uint64_t t0;
+    int cnt;
+
+    for (int i = 0; i < BENCH_DBUS_NODE_CNT; i++) {
+        write_be32(nodes[i].eui64, i);
+        bench_rand_fill(nodes[i].eui64 + 4, 4);
+        nodes[i].node_role = i % 2 ? WS_NR_ROLE_LFN : WS_NR_ROLE_ROUTER;
+        nodes[i].is_neighbor = !(i % 10);
+        bench_rand_fill(nodes[i].pom, sizeof(nodes[i].pom));
+    }
+    change_journal_init(&journal, 8, 4096);
+    bench_dbus_refresh(&journal, nodes);
+
+    // Nodes property or GetNodesPage from generation 0
+    t0 = bench_now_ns();
+    cnt = bench_dbus_serialize(&buf, &journal, nodes, 0);
+    printf("%-12s %-24s %10.1f us serialize %8d entries %10d bytes\n",
+           "dbus_nodes", "10000 full", (bench_now_ns() - t0) / 1000.0, cnt, buf.len);
+    iobuf_free(&buf);
+
+    bench_dbus_run("10000 no change", &journal, nodes, 0);
+    bench_dbus_run("10000 1% changed", &journal, nodes, BENCH_DBUS_NODE_CNT / 100);
+    bench_dbus_run("10000 10% changed", &journal, nodes, BENCH_DBUS_NODE_CNT / 10);
+
+    // Drop all the entries
+    journal.tombstone_max = 0;
+    change_journal_refresh_start(&journal);
+    change_journal_refresh_end(&journal);
+    hash_table_free(&journal.index);
+    free(nodes);
+}
+
+/*
+ * Parsing of the IEs of received PA, PC, data and EAPOL frames. Each frame
+ * carries the IEs wsbrd usually receives, and the reads of the RX handlers
+ * are replayed. The reference looks up each IE from the start of the list,
+ * like the ws_*_read() functions did before the IEs were indexed: a scan of
+ * the header IEs per WH-IE, and a scan of the WP-IE content per nested IE.
+ * It only locates the IEs, so it compares with the index build alone. The
+ * full cost of the reads, content parsing included, is given separately.
+ */
+struct bench_ie_frame {
+    const char *name;
+    struct iobuf_write header;
+    struct iobuf_write payload;
+    const uint8_t *wh;  // Sub-IDs read by the RX handlers, 0 terminated
+    const uint8_t *wp_short;
+    const uint8_t *wp_long;
+    void (*read)(const struct ws_ie_index *ie);
+};
+
+static void bench_ie_read_pa(const struct ws_ie_index *ie)
+{
+    struct ws_wp_netname netname;
+    struct ws_pom_ie pom;
+    struct ws_pan_ie pan;
+    struct ws_utt_ie utt;
+    struct ws_us_ie us;
+
+    bench_sink += ws_wh_utt_read(ie, &utt) + ws_wp_nested_us_read(ie, &us) +
+                  ws_wp_nested_netname_read(ie, &netname) +
+                  ws_wp_nested_pan_read(ie, &pan) + ws_wp_nested_pom_read(ie, &pom);
+}
+
+static void bench_ie_read_pc(const struct ws_ie_index *ie)
+{
+    struct ws_lfnver_ie lfnver;
+    gtkhash_t lgtkhash[3];
+    gtkhash_t gtkhash[4];
+    unsigned lgtk_index;
+    uint16_t pan_version;
+    struct ws_pom_ie pom;
+    struct ws_utt_ie utt;
+    struct ws_bt_ie bt;
+    struct ws_us_ie us;
+    struct ws_bs_ie bs;
+
+    bench_sink += ws_wh_utt_read(ie, &utt) + ws_wh_bt_read(ie, &bt) +
+                  ws_wp_nested_us_read(ie, &us) + ws_wp_nested_bs_read(ie, &bs) +
+                  ws_wp_nested_panver_read(ie, &pan_version) +
+                  ws_wp_nested_gtkhash_read(ie, gtkhash) +
+                  ws_wp_nested_lfnver_read(ie, &lfnver) +
+                  ws_wp_nested_lgtkhash_read(ie, lgtkhash, &lgtk_index) +
+                  ws_wp_nested_pom_read(ie, &pom);
+}
+
+static void bench_ie_read_data(const struct ws_ie_index *ie)
+{
+    struct ws_pom_ie pom;
+    struct ws_utt_ie utt;
+    struct ws_bt_ie bt;
+    struct ws_us_ie us;
+    struct ws_bs_ie bs;
+
+    bench_sink += ws_wh_utt_read(ie, &utt) + ws_wh_bt_read(ie, &bt) +
+                  ws_wp_nested_us_read(ie, &us) + ws_wp_nested_bs_read(ie, &bs) +
+                  ws_wp_nested_pom_read(ie, &pom);
+}
+
+static void bench_ie_read_eapol(const struct ws_ie_index *ie)
+{
+    struct ws_utt_ie utt;
+    struct ws_bt_ie bt;
+    struct ws_us_ie us;
+    struct ws_bs_ie bs;
+    uint8_t eui64[8];
+
+    bench_sink += ws_wh_utt_read(ie, &utt) + ws_wh_bt_read(ie, &bt) + ws_wh_ea_read(ie, eui64) +
+                  ws_wp_nested_us_read(ie, &us) + ws_wp_nested_bs_read(ie, &bs);
+}
+
+static void bench_ie_find_wh(const uint8_t *data, uint16_t length, uint8_t subid, struct iobuf_read *wh_content)
+{
+    const uint8_t *end = data + length;
+
+    do {
+        ieee802154_ie_find_header(data, length, IEEE802154_IE_ID_WH, wh_content);
+        if (iobuf_pop_u8(wh_content) == subid)
+            return;
+        if (wh_content->err)
+            return;
+        length -= wh_content->data + wh_content->data_size - data;
+        data = wh_content->data + wh_content->data_size;
+    } while (data < end);
+    wh_content->err = true;
+}
+
+static void bench_ie_read_ref(const struct bench_ie_frame *frame)
+{
+    struct iobuf_read ie_wp, ie_buf;
+
+    for (const uint8_t *id = frame->wh; *id; id++) {
+        bench_ie_find_wh(frame->header.data, frame->header.len, *id, &ie_buf);
+        bench_sink += iobuf_pop_u8(&ie_buf) + !ie_buf.err;
+    }
+    ieee802154_ie_find_payload(frame->payload.data, frame->payload.len, IEEE802154_IE_ID_WP, &ie_wp);
+    for (const uint8_t *id = frame->wp_short; *id; id++) {
+        ieee802154_ie_find_nested(ie_wp.data, ie_wp.data_size, *id, &ie_buf, false);
+        bench_sink += iobuf_pop_u8(&ie_buf) + !ie_buf.err;
+    }
+    for (const uint8_t *id = frame->wp_long; *id; id++) {
+        ieee802154_ie_find_nested(ie_wp.data, ie_wp.data_size, *id, &ie_buf, true);
+        bench_sink += iobuf_pop_u8(&ie_buf) + !ie_buf.err;
+    }
+}
+
+static void bench_ie_frames_init(struct bench_ie_frame frames[4])
+{
+    static const uint8_t phy_op_modes[16] = { 0x02, 0x22, 0x54 };
+    static const gtkhash_t gtkhash[4] = { { 1 }, { 2 }, { 3 }, { 4 } };
+    struct ws_fhss_config fhss_config = {
+        .chan_plan    = 1,
+        .chan0_freq   = 902200000,
+        .chan_spacing = 200000,
+        .chan_count   = 129,
+        .uc_dwell_interval = 255,
+        .bc_interval  = 1020,
+        .bc_dwell_interval = 255,
+    };
+    struct ws_phy_config phy_config = { };
+    uint8_t eui64[8] = { 0x02, 0x12, 0x34 };
+    int offset;
+
+    memset(fhss_config.uc_chan_mask, 0xff, 16);
+    memset(fhss_config.bc_chan_mask, 0xff, 16);
+    frames[0] = (struct bench_ie_frame){
+        .name = "pa", .read = bench_ie_read_pa,
+        .wh       = (const uint8_t []){ WS_WHIE_UTT, 0 },
+        .wp_short = (const uint8_t []){ WS_WPIE_NETNAME, WS_WPIE_PAN, WS_WPIE_POM, 0 },
+        .wp_long  = (const uint8_t []){ WS_WPIE_US, 0 },
+    };
+    ws_wh_utt_write(&frames[0].header, WS_FT_PA);
+    offset = ieee802154_ie_push_payload(&frames[0].payload, IEEE802154_IE_ID_WP);
+    ws_wp_nested_us_write(&frames[0].payload, &phy_config, &fhss_config);
+    ws_wp_nested_pan_write(&frames[0].payload, 1000, 0, 1);
+    ws_wp_nested_netname_write(&frames[0].payload, "Wi-SUN Network");
+    ws_wp_nested_pom_write(&frames[0].payload, phy_op_modes, false);
+    ieee802154_ie_fill_len_payload(&frames[0].payload, offset);
+
+    frames[1] = (struct bench_ie_frame){
+        .name = "pc", .read = bench_ie_read_pc,
+        .wh       = (const uint8_t []){ WS_WHIE_UTT, WS_WHIE_BT, 0 },
+        .wp_short = (const uint8_t []){ WS_WPIE_PANVER, WS_WPIE_GTKHASH, WS_WPIE_LFNVER,
+                                        WS_WPIE_LGTKHASH, WS_WPIE_POM, 0 },
+        .wp_long  = (const uint8_t []){ WS_WPIE_US, WS_WPIE_BS, 0 },
+    };
+    ws_wh_utt_write(&frames[1].header, WS_FT_PC);
+    ws_wh_bt_write(&frames[1].header);
+    offset = ieee802154_ie_push_payload(&frames[1].payload, IEEE802154_IE_ID_WP);
+    ws_wp_nested_us_write(&frames[1].payload, &phy_config, &fhss_config);
+    ws_wp_nested_bs_write(&frames[1].payload, &phy_config, &fhss_config);
+    ws_wp_nested_panver_write(&frames[1].payload, 1);
+    ws_wp_nested_gtkhash_write(&frames[1].payload, gtkhash);
+    ws_wp_nested_lfnver_write(&frames[1].payload, 1);
+    ws_wp_nested_lgtkhash_write(&frames[1].payload, gtkhash, 0);
+    ws_wp_nested_pom_write(&frames[1].payload, phy_op_modes, false);
+    ieee802154_ie_fill_len_payload(&frames[1].payload, offset);
+
+    frames[2] = (struct bench_ie_frame){
+        .name = "data", .read = bench_ie_read_data,
+        .wh       = (const uint8_t []){ WS_WHIE_UTT, WS_WHIE_BT, 0 },
+        .wp_short = (const uint8_t []){ WS_WPIE_POM, 0 },
+        .wp_long  = (const uint8_t []){ WS_WPIE_US, WS_WPIE_BS, 0 },
+    };
+    ws_wh_utt_write(&frames[2].header, WS_FT_DATA);
+    ws_wh_bt_write(&frames[2].header);
+    offset = ieee802154_ie_push_payload(&frames[2].payload, IEEE802154_IE_ID_WP);
+    ws_wp_nested_us_write(&frames[2].payload, &phy_config, &fhss_config);
+    ieee802154_ie_fill_len_payload(&frames[2].payload, offset);
+    offset = ieee802154_ie_push_payload(&frames[2].payload, IEEE802154_IE_ID_MPX);
+    iobuf_push_data_reserved(&frames[2].payload, 100);
+    ieee802154_ie_fill_len_payload(&frames[2].payload, offset);
+
+    frames[3] = (struct bench_ie_frame){
+        .name = "eapol", .read = bench_ie_read_eapol,
+        .wh       = (const uint8_t []){ WS_WHIE_UTT, WS_WHIE_BT, WS_WHIE_EA, 0 },
+        .wp_short = (const uint8_t []){ 0 },
+        .wp_long  = (const uint8_t []){ WS_WPIE_US, WS_WPIE_BS, 0 },
+    };
+    ws_wh_utt_write(&frames[3].header, WS_FT_EAPOL);
+    ws_wh_bt_write(&frames[3].header);
+    ws_wh_ea_write(&frames[3].header, eui64);
+    offset = ieee802154_ie_push_payload(&frames[3].payload, IEEE802154_IE_ID_WP);
+    ws_wp_nested_us_write(&frames[3].payload, &phy_config, &fhss_config);
+    ws_wp_nested_bs_write(&frames[3].payload, &phy_config, &fhss_config);
+    ieee802154_ie_fill_len_payload(&frames[3].payload, offset);
+    offset = ieee802154_ie_push_payload(&frames[3].payload, IEEE802154_IE_ID_MPX);
+    iobuf_push_data_reserved(&frames[3].payload, 100);
+    ieee802154_ie_fill_len_payload(&frames[3].payload, offset);
+}
+
+static void bench_ie_parse(void)
+{
+    const int iter_cnt = 1000000;
+    struct bench_ie_frame frames[4] = { };
+    struct ws_ie_index ie;
+    char op[32];
+    uint64_t t0;
+
+    bench_ie_frames_init(frames);
+    for (int i = 0; i < ARRAY_SIZE(frames); i++) {
+        t0 = bench_now_ns();
+        for (int j = 0; j < iter_cnt; j++)
+            bench_ie_read_ref(&frames[i]);
+        snprintf(op, sizeof(op), "%s lookup per IE", frames[i].name);
+        bench_report("ie_parse", op, t0, iter_cnt);
+        t0 = bench_now_ns();
+        for (int j = 0; j < iter_cnt; j++) {
+            ws_ie_index_build(&ie, frames[i].header.data, frames[i].header.len,
+                              frames[i].payload.data, frames[i].payload.len);
+            bench_sink += ie.has_wp;
+        }
+        snprintf(op, sizeof(op), "%s index build", frames[i].name);
+        bench_report("ie_parse", op, t0, iter_cnt);
+        t0 = bench_now_ns();
+        for (int j = 0; j < iter_cnt; j++) {
+            ws_ie_index_build(&ie, frames[i].header.data, frames[i].header.len,
+                              frames[i].payload.data, frames[i].payload.len);
+            frames[i].read(&ie);
+        }
+        snprintf(op, sizeof(op), "%s index + read", frames[i].name);
+        bench_report("ie_parse", op, t0, iter_cnt);
+        iobuf_free(&frames[i].header);
+        iobuf_free(&frames[i].payload);
+    }
+}
+
+/*
+ * Data requests per second through wsbr_data_req_ext(), down to the UART
+ * transmission queue. The frames are secured broadcast data frames with a
+ * UTT-IE, a BT-IE and an MPX-IE, written to /dev/null. The reference builds
+ * the frame, the HIF command and the UART frame in three buffers allocated
+ * for each frame, like before the serialization was done in the bus buffer.
+ */
+static void bench_data_req_ref(struct net_if *net_if, const struct mcps_data_req *req,
+                               const struct mcps_data_req_ie_list *ie_ext)
+{
+    struct iobuf_write frame = { }, cmd = { };
+
+    wsbr_data_req_rebuild(&frame, net_if->rcp, req, ie_ext, net_if->ws_info.pan_information.pan_id);
+    hif_push_u8(&cmd, HIF_CMD_REQ_DATA_TX);
+    hif_push_u8(&cmd, req->msduHandle);
+    hif_push_u16(&cmd, frame.len);
+    iobuf_push_data(&cmd, frame.data, frame.len);
+    hif_push_u16(&cmd, HIF_FHSS_TYPE_FFN_BC);
+    uart_tx(&net_if->rcp->bus, cmd.data, cmd.len);
+    iobuf_free(&cmd);
+    iobuf_free(&frame);
+}
+
+static void bench_data_req_run(struct net_if *net_if, const char *op, int payload_len, bool legacy)
+{
+    const int frame_cnt = 200000;
+    struct mcps_data_req req = {
+        .SrcAddrMode = MAC_ADDR_MODE_64_BIT,
+        .DstAddrMode = MAC_ADDR_MODE_NONE,
+        .fhss_type   = HIF_FHSS_TYPE_FFN_BC,
+        .Key.SecurityLevel = SEC_ENC_MIC64,
+        .Key.KeyIndex      = 1,
+    };
+    struct iobuf_write header = { }, payload = { };
+    struct mcps_data_req_ie_list ie_ext = { };
+    struct iovec iov[2];
+    uint64_t elapsed;
+    char name[32];
+    uint64_t t0;
+    int offset;
+
+    ws_wh_utt_write(&header, WS_FT_DATA);
+    ws_wh_bt_write(&header);
+    offset = ieee802154_ie_push_payload(&payload, IEEE802154_IE_ID_MPX);
+    iobuf_push_data_reserved(&payload, payload_len);
+    ieee802154_ie_fill_len_payload(&payload, offset);
+    iov[0] = (struct iovec){ header.data, header.len };
+    iov[1] = (struct iovec){ payload.data, payload.len };
+    ie_ext.headerIeVectorList  = &iov[0];
+    ie_ext.headerIovLength     = 1;
+    ie_ext.payloadIeVectorList = &iov[1];
+    ie_ext.payloadIovLength    = 1;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < frame_cnt; i++) {
+        req.msduHandle = i;
+        if (legacy)
+            bench_data_req_ref(net_if, &req, &ie_ext);
+        else
+            wsbr_data_req_ext(net_if, &req, &ie_ext);
+        // Called by wsbr_poll() after each event
+        uart_tx_commit(&net_if->rcp->bus);
+    }
+    elapsed = bench_now_ns() - t0;
+    snprintf(name, sizeof(name), "%s %d bytes", op, payload_len);
+    printf("%-12s %-24s %10d ops %10.1f ns/op %10.0f frames/s\n",
+           "data_req", name, frame_cnt, (double)elapsed / frame_cnt, frame_cnt * 1e9 / elapsed);
+    iobuf_free(&payload);
+    iobuf_free(&header);
+}
+
+static void bench_data_req(void)
+{
+    struct net_if *net_if = zalloc(sizeof(*net_if));
+    struct rcp *rcp = zalloc(sizeof(*rcp));
+    static const int payload_len[] = { 100, 500, 1500 };
+
+    rcp->bus.fd = open("/dev/null", O_WRONLY);
+    FATAL_ON(rcp->bus.fd < 0, 2, "open /dev/null: %m");
+    rcp->bus.tx       = uart_tx;
+    rcp->bus.tx_start = uart_tx_start;
+    rcp->bus.tx_end   = uart_tx_end;
+    memcpy(rcp->eui64, (uint8_t [8]){ 0x02, 0x12, 0x34 }, 8);
+    net_if->rcp = rcp;
+    net_if->ws_info.pan_information.pan_id = 0x1234;
+    for (int i = 0; i < ARRAY_SIZE(payload_len); i++) {
+        bench_data_req_run(net_if, "3 buffers", payload_len[i], true);
+        bench_data_req_run(net_if, "bus buffer", payload_len[i], false);
+    }
+    close(rcp->bus.fd);
+    iobuf_free(&rcp->bus.uart.tx_queue);
+    free(rcp);
+    free(net_if);
+}
+
+/*
+ * Packets per second from the TUN interface down to the UART transmission
+ * queue of a stub RCP. A datagram socket pair stands for the TUN interface
+ * and is filled with bursts of TUN_RX_BUDGET UDP packets, the RCP bus writes
+ * to /dev/null. Each packet is read, its IPv6 header is parsed like in
+ * wsbr_tun_recv(), and it is sent with wsbr_data_req_ext() as the MPX-IE
+ * payload of a broadcast data frame. The 6LoWPAN compression and the
+ * adaptation layer queue are not part of the measure.
+ */
+static void bench_tun_run(struct net_if *net_if, int fds[2], int packet_len)
+{
+    const int packet_cnt = 100000;
+    struct mcps_data_req req = {
+        .SrcAddrMode = MAC_ADDR_MODE_64_BIT,
+        .DstAddrMode = MAC_ADDR_MODE_NONE,
+        .fhss_type   = HIF_FHSS_TYPE_FFN_BC,
+        .Key.SecurityLevel = SEC_ENC_MIC64,
+        .Key.KeyIndex      = 1,
+    };
+    struct iobuf_write header = { }, mpx = { }, packet = { };
+    struct mcps_data_req_ie_list ie_ext = { };
+    uint8_t buf[1504], src[16], dst[16];
+    struct iobuf_read iobuf;
+    struct iovec iov[3];
+    uint64_t elapsed;
+    char name[32];
+    uint64_t t0;
+
+    iobuf_push_be32(&packet, FIELD_PREP(0xf0000000, 6));
+    iobuf_push_be16(&packet, packet_len - 40);
+    iobuf_push_u8(&packet, IPPROTO_UDP);
+    iobuf_push_u8(&packet, 64);
+    iobuf_push_data(&packet, (uint8_t [16]){ 0x20, 0x01, 0x0d, 0xb8, [15] = 1 }, 16);
+    iobuf_push_data(&packet, (uint8_t [16]){ 0xfd, 0x12, 0x34, 0x56, [15] = 2 }, 16);
+    iobuf_push_be16(&packet, 1234);
+    iobuf_push_be16(&packet, 5678);
+    iobuf_push_data_reserved(&packet, packet_len - packet.len);
+    ws_wh_utt_write(&header, WS_FT_DATA);
+    ws_wh_bt_write(&header);
+    ieee802154_ie_push_payload(&mpx, IEEE802154_IE_ID_MPX);
+    ieee802154_ie_set_len(&mpx, 0, packet_len, IEEE802154_IE_PAYLOAD_LEN_MASK);
+    iov[0] = (struct iovec){ header.data, header.len };
+    iov[1] = (struct iovec){ mpx.data, mpx.len };
+    ie_ext.headerIeVectorList  = &iov[0];
+    ie_ext.headerIovLength     = 1;
+    ie_ext.payloadIeVectorList = &iov[1];
+    ie_ext.payloadIovLength    = 2;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < packet_cnt; i += TUN_RX_BUDGET) {
+        for (int j = 0; j < TUN_RX_BUDGET; j++)
+            FATAL_ON(write(fds[0], packet.data, packet.len) != packet.len, 2, "write: %m");
+        for (int j = 0; j < TUN_RX_BUDGET; j++) {
+            iobuf = (struct iobuf_read){ .data = buf };
+            iobuf.data_size = read(fds[1], buf, sizeof(buf));
+            FATAL_ON(iobuf.data_size != packet.len, 2, "read: %m");
+            BUG_ON(FIELD_GET(0xf0000000, iobuf_pop_be32(&iobuf)) != 6);
+            iobuf_pop_be16(&iobuf);
+            BUG_ON(iobuf_pop_u8(&iobuf) != IPPROTO_UDP);
+            iobuf_pop_u8(&iobuf);
+            iobuf_pop_data(&iobuf, src, 16);
+            iobuf_pop_data(&iobuf, dst, 16);
+            bench_sink += iobuf_pop_be16(&iobuf) + iobuf_pop_be16(&iobuf) + src[15] + dst[15];
+
+            // The IPv6 packet stands for the 6LoWPAN frame
+            iov[2] = (struct iovec){ buf, iobuf.data_size };
+            req.msduHandle = i + j;
+            wsbr_data_req_ext(net_if, &req, &ie_ext);
+        }
+        // Called by wsbr_poll() after each event
+        uart_tx_commit(&net_if->rcp->bus);
+    }
+    elapsed = bench_now_ns() - t0;
+    snprintf(name, sizeof(name), "%d bytes", packet_len);
+    printf("%-12s %-24s %10d ops %10.1f ns/op %10.0f packets/s %8.1f MB/s\n",
+           "tun", name, packet_cnt, (double)elapsed / packet_cnt,
+           packet_cnt * 1e9 / elapsed, (double)packet_cnt * packet_len * 1e3 / elapsed);
+    iobuf_free(&header);
+    iobuf_free(&mpx);
+    iobuf_free(&packet);
+}
+
+static void bench_tun(void)
+{
+    struct net_if *net_if = zalloc(sizeof(*net_if));
+    struct rcp *rcp = zalloc(sizeof(*rcp));
+    static const int packet_len[] = { 100, 500, 1280 };
+    int fds[2];
+
+    FATAL_ON(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0, 2, "socketpair: %m");
+    rcp->bus.fd = open("/dev/null", O_WRONLY);
+    FATAL_ON(rcp->bus.fd < 0, 2, "open /dev/null: %m");
+    rcp->bus.tx       = uart_tx;
+    rcp->bus.tx_start = uart_tx_start;
+    rcp->bus.tx_end   = uart_tx_end;
+    memcpy(rcp->eui64, (uint8_t [8]){ 0x02, 0x12, 0x34 }, 8);
+    net_if->rcp = rcp;
+    net_if->ws_info.pan_information.pan_id = 0x1234;
+    for (int i = 0; i < ARRAY_SIZE(packet_len); i++)
+        bench_tun_run(net_if, fds, packet_len[i]);
+    close(rcp->bus.fd);
+    close(fds[0]);
+    close(fds[1]);
+    iobuf_free(&rcp->bus.uart.tx_queue);
+    free(rcp);
+    free(net_if);
+}
+
+/*
+ * Time spent by unicast packets in the adaptation layer queues before their
+ * first transmission, with a simulated clock. The MPX layer is a stub which
+ * transmits one frame at a time at 50 kbit/s and confirms it at the end of
+ * its airtime. A bulk flow keeps 24 packets of 1280 bytes queued to one
+ * destination, like a TCP window, so it uses all the capacity left by the
+ * others. It runs alone, then together with 100 flows sending a 100 bytes
+ * packet every 4s each, which need half of the link. The delays are printed
+ * in milliseconds of simulated time, the last line is the histogram of
+ * lowpan_adaptation_tx_delay_hist().
+ */
+#define BENCH_LOWPAN_FLOW_CNT 100
+
+struct bench_lowpan {
+    struct mpx_api mpx;
+    mpx_data_confirm *confirm;
+    struct net_if *net_if;
+    struct {
+        uint8_t handle;
+        int len;
+    } radio[16]; // More than the frames the adaptation layer keeps in flight
+    int radio_len;
+    uint64_t radio_done_ms;
+    uint64_t now_ms;
+    uint64_t *enqueue_ms;
+    int bulk_queued;
+    uint64_t *samples[2];
+    int sample_cnt[2];
+};
+
+static struct bench_lowpan bench_lowpan;
+
+static void bench_lowpan_data_req(const struct mpx_api *api, const struct mcps_data_req *req, uint16_t user_id)
+{
+    struct bench_lowpan *bench = &bench_lowpan;
+    uint32_t id = read_be32(req->msdu);
+    int flow = req->msduLength > 1000 ? 0 : 1;
+
+    BUG_ON(bench->radio_len >= ARRAY_SIZE(bench->radio));
+    bench->radio[bench->radio_len].handle = req->msduHandle;
+    bench->radio[bench->radio_len].len    = req->msduLength;
+    if (!bench->radio_len)
+        bench->radio_done_ms = bench->now_ms + (req->msduLength + 40) * 8 / 50;
+    bench->radio_len++;
+    if (!flow)
+        bench->bulk_queued--;
+    bench->samples[flow][bench->sample_cnt[flow]++] = bench->now_ms - bench->enqueue_ms[id];
+}
+
+static uint16_t bench_lowpan_headroom(const struct mpx_api *api, uint16_t user_id)
+{
+    return 3;
+}
+
+static int8_t bench_lowpan_register(const struct mpx_api *api, mpx_data_confirm *confirm_cb,
+                                    mpx_data_indication *indication_cb, uint16_t user_id)
+{
+    bench_lowpan.confirm = confirm_cb;
+    return 0;
+}
+
+static void bench_lowpan_radio_done(struct bench_lowpan *bench)
+{
+    struct mcps_data_cnf cnf = {
+        .hif.handle = bench->radio[0].handle,
+        .hif.status = HIF_STATUS_SUCCESS,
+    };
+
+    bench->radio_len--;
+    memmove(bench->radio, bench->radio + 1, bench->radio_len * sizeof(bench->radio[0]));
+    if (bench->radio_len)
+        bench->radio_done_ms = bench->now_ms + (bench->radio[0].len + 40) * 8 / 50;
+    // May queue the next frames
+    bench->confirm(&bench->mpx, &cnf);
+}
+
+static void bench_lowpan_send(struct bench_lowpan *bench, const uint8_t mac64[8], int len, uint32_t id)
+{
+    buffer_t *buf = buffer_get(len);
+
+    FATAL_ON(!buf, 1, "buffer_get");
+    buf->interface = bench->net_if;
+    buf->src_sa.addr_type = ADDR_802_15_4_LONG;
+    buf->dst_sa.addr_type = ADDR_802_15_4_LONG;
+    write_be16(buf->dst_sa.address, 0x1234);
+    memcpy(buf->dst_sa.address + 2, mac64, 8);
+    buf->link_specific.ieee802_15_4.requestAck = true;
+    buffer_data_length_set(buf, len);
+    write_be32(buffer_data_pointer(buf), id);
+    bench->enqueue_ms[id] = bench->now_ms;
+    lowpan_adaptation_interface_tx(bench->net_if, buf);
+}
+
+static void bench_lowpan_print(const char *op, uint64_t *samples, int cnt)
+{
+    uint64_t sum = 0;
+
+    qsort(samples, cnt, sizeof(*samples), bench_cmp_u64);
+    for (int i = 0; i < cnt; i++)
+        sum += samples[i];
+    printf("%-12s %-24s %10d ops avg %.0f ms p50 %"PRIu64" ms p99 %"PRIu64" ms max %"PRIu64" ms\n",
+           "lowpan_tx", op, cnt, (double)sum / cnt, samples[cnt / 2],
+           samples[cnt * 99 / 100], samples[cnt - 1]);
+}
+
+static void bench_lowpan_run(struct bench_lowpan *bench, int flow_cnt)
+{
+    const uint64_t duration_ms = 600000;
+    const int sample_max = duration_ms / 100 + duration_ms / 4000 * flow_cnt;
+    const uint32_t *hist;
+    uint8_t mac64[BENCH_LOWPAN_FLOW_CNT + 1][8];
+    int phase_ms[BENCH_LOWPAN_FLOW_CNT];
+    uint32_t id = 0;
+    char op[24];
+
+    for (int i = 0; i <= flow_cnt; i++) {
+        bench_rand_fill(mac64[i], 8);
+        ws_neigh_add(&bench->net_if->ws_info.neighbor_storage, mac64[i], WS_NR_ROLE_ROUTER, 14, 0);
+    }
+    for (int i = 0; i < flow_cnt; i++)
+        phase_ms[i] = bench_rand() % 4000;
+    lowpan_adaptation_interface_init(bench->net_if->id);
+    lowpan_adaptation_interface_set_tx_queue(bench->net_if->id, 1280, 32);
+    lowpan_adaptation_interface_mpx_register(bench->net_if->id, &bench->mpx, 0);
+    bench->enqueue_ms = xalloc(sample_max * sizeof(uint64_t));
+    for (int i = 0; i < 2; i++) {
+        bench->samples[i] = xalloc(sample_max * sizeof(uint64_t));
+        bench->sample_cnt[i] = 0;
+    }
+    bench->bulk_queued = 0;
+    bench->radio_len = 0;
+
+    for (bench->now_ms = 0; bench->now_ms < duration_ms; bench->now_ms++) {
+        g_monotonic_time_100ms = bench->now_ms / 100;
+        if (bench->radio_len && bench->now_ms >= bench->radio_done_ms)
+            bench_lowpan_radio_done(bench);
+        for (int i = 0; i < flow_cnt; i++)
+            if (bench->now_ms % 4000 == phase_ms[i])
+                bench_lowpan_send(bench, mac64[i + 1], 100, id++);
+        while (bench->bulk_queued < 24) {
+            bench->bulk_queued++;
+            bench_lowpan_send(bench, mac64[0], 1280, id++);
+        }
+    }
+
+    if (flow_cnt) {
+        snprintf(op, sizeof(op), "bulk with %d flows", flow_cnt);
+        bench_lowpan_print(op, bench->samples[0], bench->sample_cnt[0]);
+        snprintf(op, sizeof(op), "%d flows with bulk", flow_cnt);
+        bench_lowpan_print(op, bench->samples[1], bench->sample_cnt[1]);
+    } else {
+        bench_lowpan_print("bulk alone", bench->samples[0], bench->sample_cnt[0]);
+    }
+    hist = lowpan_adaptation_tx_delay_hist(bench->net_if->id);
+    printf("%-12s %-24s <100ms:%u <200ms:%u <400ms:%u <800ms:%u <1.6s:%u <3.2s:%u <6.4s:%u more:%u\n",
+           "lowpan_tx", "histogram", hist[0], hist[1], hist[2], hist[3], hist[4], hist[5], hist[6], hist[7]);
+
+    lowpan_adaptation_interface_free(bench->net_if->id);
+    for (int i = 0; i <= flow_cnt; i++)
+        ws_neigh_del(&bench->net_if->ws_info.neighbor_storage, mac64[i]);
+    for (int i = 0; i < 2; i++)
+        free(bench->samples[i]);
+    free(bench->enqueue_ms);
+}
+
+static void bench_lowpan_tx(void)
+{
+    struct bench_lowpan *bench = &bench_lowpan;
+    int monotonic_time_100ms = g_monotonic_time_100ms;
+
+    bench->mpx.mpx_data_request      = bench_lowpan_data_req;
+    bench->mpx.mpx_headroom_size_get = bench_lowpan_headroom;
+    bench->mpx.mpx_user_registration = bench_lowpan_register;
+    bench->net_if = zalloc(sizeof(*bench->net_if));
+    bench->net_if->id = 1;
+    bench->net_if->mac_parameters.mtu = 2047;
+    // Like ws_bootstrap_packet_congestion_init() at 50 kbit/s
+    bench->net_if->random_early_detection.weight = RED_AVERAGE_WEIGHT_EIGHTH;
+    bench->net_if->random_early_detection.threshold_min = 85;
+    bench->net_if->random_early_detection.threshold_max = 170;
+    bench->net_if->random_early_detection.drop_max_probability = 10;
+    ns_list_add_to_start(&protocol_interface_info_list, bench->net_if);
+    bench_lowpan_run(bench, 0);
+    bench_lowpan_run(bench, BENCH_LOWPAN_FLOW_CNT);
+    ns_list_remove(&protocol_interface_info_list, bench->net_if);
+    free(bench->net_if);
+    g_monotonic_time_100ms = monotonic_time_100ms;
+}
+
+/*
+ * Programming of the proxy neighbors and routes of 1000 and 5000 nodes in
+ * the kernel, each run in a new network namespace with its own TUN
+ * interface (requires CAP_NET_ADMIN). Registrations go through
+ * tun_add_node_to_proxy_neightbl() and tun_add_ipv6_direct_route(), flushed
+ * every 16 registrations like after a main loop iteration, then all the
+ * nodes register again. The reference is the code before the requests were
+ * batched: for each node, a socket to dump the kernel neighbor table, then
+ * one synchronous request for the neighbor and another socket for the route.
+ */
+static void bench_netlink_ref(int ifindex, const uint8_t addr[16])
+{
+    struct rtnl_nexthop *nl_nexthop;
+    struct rtnl_neigh *nl_neigh;
+    struct rtnl_route *nl_route;
+    struct nl_addr *nl_addr;
+    struct nl_cache *cache;
+    struct nl_sock *sock;
+    int err;
+
+    nl_addr = nl_addr_build(AF_INET6, addr, 16);
+    FATAL_ON(!nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
+
+    sock = nl_socket_alloc();
+    BUG_ON(!sock);
+    err = nl_connect(sock, NETLINK_ROUTE);
+    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    err = rtnl_neigh_alloc_cache(sock, &cache);
+    FATAL_ON(err < 0, 2, "rtnl_neigh_alloc_cache: %s", nl_geterror(err));
+    nl_neigh = rtnl_neigh_get(cache, ifindex, nl_addr);
+    nl_cache_put(cache);
+    if (!nl_neigh) {
+        nl_neigh = rtnl_neigh_alloc();
+        BUG_ON(!nl_neigh);
+        rtnl_neigh_set_ifindex(nl_neigh, ifindex);
+        rtnl_neigh_set_dst(nl_neigh, nl_addr);
+        rtnl_neigh_set_flags(nl_neigh, NTF_PROXY);
+        rtnl_neigh_set_flags(nl_neigh, NTF_ROUTER);
+        err = rtnl_neigh_add(sock, nl_neigh, NLM_F_CREATE);
+        FATAL_ON(err < 0, 2, "rtnl_neigh_add: %s", nl_geterror(err));
+    }
+    rtnl_neigh_put(nl_neigh);
+    nl_socket_free(sock);
+
+    sock = nl_socket_alloc();
+    BUG_ON(!sock);
+    err = nl_connect(sock, NETLINK_ROUTE);
+    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    nl_route = rtnl_route_alloc();
+    BUG_ON(!nl_route);
+    nl_nexthop = rtnl_route_nh_alloc();
+    BUG_ON(!nl_nexthop);
+    rtnl_route_set_iif(nl_route, AF_INET6);
+    err = rtnl_route_set_dst(nl_route, nl_addr);
+    FATAL_ON(err < 0, 2, "rtnl_route_set_dst: %s", nl_geterror(err));
+    rtnl_route_nh_set_ifindex(nl_nexthop, ifindex);
+    rtnl_route_add_nexthop(nl_route, nl_nexthop);
+    err = rtnl_route_add(sock, nl_route, 0);
+    if (err < 0 && err != -NLE_EXIST)
+        FATAL(2, "rtnl_route_add: %s", nl_geterror(err));
+    rtnl_route_put(nl_route);
+    nl_socket_free(sock);
+    nl_addr_put(nl_addr);
+}
+
+// Return the interface index
+static int bench_netlink_netns(const char *tun_dev)
+{
+    struct ifreq ifr = {
+        .ifr_flags = IFF_TUN | IFF_NO_PI,
+    };
+    int fd, sock;
+
+    FATAL_ON(unshare(CLONE_NEWNET) < 0, 2, "unshare: %m");
+    fd = open("/dev/net/tun", O_RDWR);
+    FATAL_ON(fd < 0, 2, "open /dev/net/tun: %m");
+    strcpy(ifr.ifr_name, tun_dev);
+    FATAL_ON(ioctl(fd, TUNSETIFF, &ifr) < 0, 2, "TUNSETIFF: %m");
+    sock = socket(AF_INET6, SOCK_DGRAM, 0);
+    FATAL_ON(sock < 0, 2, "socket: %m");
+    ifr.ifr_flags = IFF_UP;
+    FATAL_ON(ioctl(sock, SIOCSIFFLAGS, &ifr) < 0, 2, "SIOCSIFFLAGS: %m");
+    close(sock);
+    // The TUN interface lives as long as the process
+    return if_nametoindex(tun_dev);
+}
+
+static void bench_netlink_run(int node_cnt, bool legacy)
+{
+    struct wsbr_ctxt *ctxt = &g_ctxt;
+    uint8_t (*addr)[16];
+    int ifindex, err;
+    char op[24];
+    uint64_t t0;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    FATAL_ON(pid < 0, 2, "fork: %m");
+    if (pid) {
+        FATAL_ON(waitpid(pid, &err, 0) < 0, 2, "waitpid: %m");
+        FATAL_ON(!WIFEXITED(err) || WEXITSTATUS(err), 1, "netlink bench failed");
+        return;
+    }
+
+    strcpy(ctxt->config.tun_dev, "wsbench0");
+    ifindex = bench_netlink_netns(ctxt->config.tun_dev);
+    addr = xalloc(node_cnt * sizeof(*addr));
+    for (int i = 0; i < node_cnt; i++) {
+        memcpy(addr[i], (uint8_t [8]){ 0x20, 0x01, 0x0d, 0xb8 }, 8);
+        bench_rand_fill(addr[i] + 8, 8);
+    }
+
+    if (legacy) {
+        t0 = bench_now_ns();
+        for (int i = 0; i < node_cnt; i++)
+            bench_netlink_ref(ifindex, addr[i]);
+        snprintf(op, sizeof(op), "sync+dump %d", node_cnt);
+        bench_report("netlink", op, t0, node_cnt);
+        exit(0);
+    }
+
+    ctxt->nl_sock = nl_socket_alloc();
+    BUG_ON(!ctxt->nl_sock);
+    err = nl_connect(ctxt->nl_sock, NETLINK_ROUTE);
+    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    for (int pass = 0; pass < 2; pass++) {
+        t0 = bench_now_ns();
+        for (int i = 0; i < node_cnt; i++) {
+            tun_add_node_to_proxy_neightbl(&ctxt->net_if, addr[i]);
+            tun_add_ipv6_direct_route(&ctxt->net_if, addr[i]);
+            if (i % 16 == 15)
+                wsbr_tun_nl_flush(ctxt);
+        }
+        wsbr_tun_nl_flush(ctxt);
+        snprintf(op, sizeof(op), "%s %d", pass ? "batch again" : "batch", node_cnt);
+        bench_report("netlink", op, t0, node_cnt);
+    }
+    exit(0);
+}
+
+static void bench_netlink(void)
+{
+    bench_netlink_run(1000, false);
+    bench_netlink_run(1000, true);
+    bench_netlink_run(5000, false);
+    bench_netlink_run(5000, true);
+}
+
+/*
+ * Burst of 100000 events sent to a tasklet before the main loop wakes up,
+ * then dispatched. The first burst grows the ring, the second one reuses it.
+ * The number of eventfd writes is read back from the eventfd counter. The
+ * reference queues a heap copy of each event in a list and writes to a
+ * non-blocking pipe for each event, like before the ring.
+ */
+struct bench_event_ref {
+    struct event_payload payload;
+    ns_list_link_t link;
+};
+
+static uint64_t bench_event_cnt;
+
+static void bench_event_handler(struct event_payload *event)
+{
+    bench_event_cnt++;
+    bench_sink += (uintptr_t)event->data_ptr;
+}
+
+static void bench_events_ref(int event_cnt)
+{
+    NS_LIST_HEAD(struct bench_event_ref, link) queue = NS_LIST_INIT(queue);
+    struct bench_event_ref *event;
+    uint64_t val = 'W';
+    int fds[2];
+    uint64_t t0;
+
+    FATAL_ON(pipe(fds) < 0, 2, "pipe: %m");
+    fcntl(fds[1], F_SETPIPE_SZ, sizeof(uint64_t) * 2);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    t0 = bench_now_ns();
+    for (int i = 0; i < event_cnt; i++) {
+        event = xalloc(sizeof(*event));
+        event->payload = (struct event_payload){ .data_ptr = (void *)(uintptr_t)i };
+        ns_list_add_to_end(&queue, event);
+        write(fds[1], &val, sizeof(val));
+    }
+    bench_report("events", "list+pipe send", t0, event_cnt);
+    t0 = bench_now_ns();
+    while (read(fds[0], &val, sizeof(val)) > 0)
+        ;
+    while ((event = ns_list_get_first(&queue))) {
+        ns_list_remove(&queue, event);
+        bench_event_handler(&event->payload);
+        free(event);
+    }
+    bench_report("events", "list+pipe dispatch", t0, event_cnt);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Stays registered as the global scheduler. The loop is never dispatched,
+// the event file descriptor is read by the benchmark.
+static struct events_scheduler bench_events_scheduler;
+static struct event_loop bench_events_loop;
+
+static void bench_events(void)
+{
+    const int event_cnt = 100000;
+    struct events_scheduler *sched = &bench_events_scheduler;
+    struct event_payload event = { };
+    uint64_t wakeup_cnt;
+    char op[24];
+    uint64_t t0;
+
+    event_loop_init(&bench_events_loop);
+    event_scheduler_init(sched, &bench_events_loop);
+    event.receiver = event_handler_create(bench_event_handler);
+    for (int burst = 0; burst < 2; burst++) {
+        bench_event_cnt = 0;
+        t0 = bench_now_ns();
+        for (int i = 0; i < event_cnt; i++) {
+            event.data_ptr = (void *)(uintptr_t)i;
+            FATAL_ON(event_send(&event), 1, "event_send");
+        }
+        snprintf(op, sizeof(op), "ring send %s", burst ? "reused" : "growing");
+        bench_report("events", op, t0, event_cnt);
+        t0 = bench_now_ns();
+        FATAL_ON(read(sched->event_fd, &wakeup_cnt, sizeof(wakeup_cnt)) != sizeof(wakeup_cnt), 2, "read: %m");
+        event_scheduler_run_until_idle();
+        snprintf(op, sizeof(op), "ring dispatch %s", burst ? "reused" : "growing");
+        bench_report("events", op, t0, event_cnt);
+        FATAL_ON(bench_event_cnt != event_cnt, 1, "events lost");
+        printf("%-12s %-24s %10"PRIu64" eventfd writes, ring of %u events\n",
+               "events", "wakeups", wakeup_cnt, sched->queue_size);
+    }
+    bench_event_cnt = 0;
+    bench_events_ref(event_cnt);
+    FATAL_ON(bench_event_cnt != event_cnt, 1, "events lost");
+}
+
+/*
+ * Reallocations of an iobuf per message, for messages built with the small
+ * pushes of the IE writers and of the HIF serializers (1 to 8 bytes each).
+ * The reference grows the buffer to the exact size needed, like
+ * iobuf_enlarge_buffer() used to. The last variant recycles the buffer with
+ * iobuf_reset() like rcp_tx_buf() and the UART transmission queue do.
+ */
+static const int bench_iobuf_pushes[] = { 2, 1, 4, 1, 8, 2, 3, 1 };
+static uint64_t bench_iobuf_realloc_cnt;
+
+static void bench_iobuf_push_ref(struct iobuf_write *buf, const void *data, int len)
+{
+    if (buf->data_size < buf->len + len) {
+        buf->data_size = MAX(64, buf->len + len);
+        buf->data = realloc(buf->data, buf->data_size);
+        FATAL_ON(!buf->data, 2);
+        bench_iobuf_realloc_cnt++;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void bench_iobuf_push(struct iobuf_write *buf, const void *data, int len)
+{
+    int data_size = buf->data_size;
+
+    iobuf_push_data(buf, data, len);
+    if (buf->data_size != data_size)
+        bench_iobuf_realloc_cnt++;
+}
+
+static void bench_iobuf_build(struct iobuf_write *buf, const uint8_t *data, int msg_len,
+                              void (*push)(struct iobuf_write *, const void *, int))
+{
+    for (int i = 0; buf->len < msg_len; i = (i + 1) % ARRAY_SIZE(bench_iobuf_pushes))
+        push(buf, data + buf->len, MIN(bench_iobuf_pushes[i], msg_len - buf->len));
+    bench_sink += buf->len;
+}
+
+static void bench_iobuf_report(const char *op, int msg_len, uint64_t t0, int msg_cnt)
+{
+    uint64_t elapsed = bench_now_ns() - t0;
+    char name[32];
+
+    snprintf(name, sizeof(name), "%s %d bytes", op, msg_len);
+    printf("%-12s %-24s %10d ops %10.1f ns/op %7.2f reallocs/msg\n", "iobuf", name,
+           msg_cnt, (double)elapsed / msg_cnt, (double)bench_iobuf_realloc_cnt / msg_cnt);
+    bench_iobuf_realloc_cnt = 0;
+}
+
+static void bench_iobuf(void)
+{
+    static const int msg_len[] = { 64, 128, 512, 2047 };
+    const int msg_cnt = 200000;
+    struct iobuf_write buf = { };
+    uint8_t data[2047];
+    uint64_t t0;
+
+    bench_rand_fill(data, sizeof(data));
+    for (int i = 0; i < ARRAY_SIZE(msg_len); i++) {
+        t0 = bench_now_ns();
+        for (int j = 0; j < msg_cnt; j++) {
+            bench_iobuf_build(&buf, data, msg_len[i], bench_iobuf_push_ref);
+            iobuf_free(&buf);
+        }
+        bench_iobuf_report("exact", msg_len[i], t0, msg_cnt);
+        t0 = bench_now_ns();
+        for (int j = 0; j < msg_cnt; j++) {
+            bench_iobuf_build(&buf, data, msg_len[i], bench_iobuf_push);
+            iobuf_free(&buf);
+        }
+        bench_iobuf_report("doubling", msg_len[i], t0, msg_cnt);
+        t0 = bench_now_ns();
+        for (int j = 0; j < msg_cnt; j++) {
+            iobuf_reset(&buf);
+            bench_iobuf_build(&buf, data, msg_len[i], bench_iobuf_push);
+        }
+        bench_iobuf_report("recycled", msg_len[i], t0, msg_cnt);
+        iobuf_free(&buf);
+    }
+}
+
+static void bench_rpl_storage_update(struct rpl_root *root, struct rpl_target *target, bool updated_transit)
+{
+    rpl_storage_store_target(root, target);
+}
+
+static void bench_rpl_storage_update_sync(struct rpl_root *root, struct rpl_target *target, bool updated_transit)
+{
+    rpl_storage_store_target(root, target);
+    rpl_storage_flush(root, true);
+}
+
+/*
+ * DAO storm: each target sends 5 DAOs in a row with a new path sequence, as
+ * after a DODAG version increment. Targets are either written on every DAO
+ * (as wsbrd used to), or marked dirty and written once by the flush which
+ * follows the storm. The files are written under /tmp, without the storage
+ * log.
+ */
+#define BENCH_RPL_STORM_DAO_CNT 5
+
+static void bench_rpl_storage_run(int target_cnt, bool coalesce)
+{
+    static const char *files[] = { "rpl-*", NULL };
+    char prefix[32] = "/tmp/wsbrd-bench-XXXXXX";
+    struct rpl_target *entry;
+    struct bench_rpl bench;
+    uint8_t target[16];
+    uint64_t t0;
+    char op[32];
+
+    FATAL_ON(!mkdtemp(prefix), 2, "mkdtemp: %m");
+    strcat(prefix, "/");
+    g_storage_prefix = prefix;
+    bench_rpl_init(&bench);
+    if (coalesce)
+        bench.root.on_target_update = bench_rpl_storage_update;
+    else
+        bench.root.on_target_update = bench_rpl_storage_update_sync;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < BENCH_RPL_STORM_DAO_CNT; i++) {
+        for (int j = 0; j < target_cnt; j++) {
+            bench_rpl_addr(target, j);
+            entry = rpl_target_get(&bench.root, target);
+            bench_rpl_dao(&bench, target, bench.root.dodag_id, entry ? entry->path_seq + 1 : 0);
+        }
+    }
+    rpl_storage_flush(&bench.root, true);
+    snprintf(op, sizeof(op), "%d %s", target_cnt, coalesce ? "coalesced" : "write each");
+    bench_report("rpl_storage", op, t0, target_cnt * BENCH_RPL_STORM_DAO_CNT);
+    printf("%-12s %-24s %10"PRIu64" writes %10"PRIu64" avoided\n", "rpl_storage", op,
+           bench.root.storage_write_cnt, bench.root.storage_write_avoided_cnt);
+
+    bench.root.on_target_update = NULL;
+    bench_rpl_free(&bench);
+    storage_delete(files);
+    rmdir(prefix);
+    g_storage_prefix = NULL;
+}
+
+static void bench_rpl_storage(void)
+{
+    bench_rpl_storage_run(1000, false);
+    bench_rpl_storage_run(1000, true);
+    bench_rpl_storage_run(10000, false);
+    bench_rpl_storage_run(10000, true);
+}
+
+/*
+ * 1M packets through protocol_push(), alternating the TUN to 6LoWPAN path
+ * (buffer_get_minimal() followed by buffer_headroom() for the compressed
+ * headers) and the RCP to IPv6 path (buffer_get() of the received frame).
+ * The stack handler only frees the buffer. The same sequence is replayed with
+ * malloc()/free(), like ns_buffer.c did before the size class pools.
+ */
+#define BENCH_BUFFER_HEADROOM 64
+
+static uint64_t bench_buffer_malloc_cnt;
+
+static void bench_buffer_handler(buffer_t *buf)
+{
+    // Simulate the 6LoWPAN and MAC headers for TX packets
+    if (buf->buf_ptr < BENCH_BUFFER_HEADROOM)
+        buf = buffer_headroom(buf, BENCH_BUFFER_HEADROOM);
+    bench_sink += buf->buf_end;
+    buffer_free(buf);
+}
+
+static void bench_buffer_ref(uint16_t len, bool tx)
+{
+    uint32_t size = tx ? len : MAX(BUFFER_DEFAULT_HEADROOM + len, BUFFER_DEFAULT_MIN_SIZE);
+    buffer_t *buf, *new_buf;
+
+    buf = malloc(sizeof(buffer_t) + size);
+    FATAL_ON(!buf, 2);
+    bench_buffer_malloc_cnt++;
+    memset(buf, 0, sizeof(buffer_t));
+    memset(buf->buf + size - len, 0, len);
+    buf->size = size;
+    if (tx) {
+        new_buf = malloc(sizeof(buffer_t) + BENCH_BUFFER_HEADROOM + len);
+        FATAL_ON(!new_buf, 2);
+        bench_buffer_malloc_cnt++;
+        *new_buf = *buf;
+        memcpy(new_buf->buf + BENCH_BUFFER_HEADROOM, buf->buf, len);
+        free(buf);
+        buf = new_buf;
+    }
+    bench_sink += buf->size;
+    free(buf);
+}
+
+static unsigned int bench_buffer_pools_alloc_cnt(void)
+{
+    struct buffer_pool_stats stats[8];
+    unsigned int cnt = 0;
+    int stats_len;
+
+    stats_len = buffer_pools_get_stats(stats, ARRAY_SIZE(stats));
+    for (int i = 0; i < stats_len; i++)
+        cnt += stats[i].alloc_cnt;
+    return cnt;
+}
+
+static void bench_buffer(void)
+{
+    const int packet_cnt = 1000000;
+    struct net_if *net_if = zalloc(sizeof(*net_if));
+    unsigned int alloc_cnt;
+    uint16_t len;
+    buffer_t *buf;
+    uint64_t t0;
+
+    net_if->if_stack_buffer_handler = bench_buffer_handler;
+    // Allocate the pools before counting
+    buffer_free(buffer_get(0));
+    alloc_cnt = bench_buffer_pools_alloc_cnt();
+    t0 = bench_now_ns();
+    for (int i = 0; i < packet_cnt; i++) {
+        len = 64 + bench_rand() % 1217;
+        if (i & 1)
+            buf = buffer_get_minimal(len);
+        else
+            buf = buffer_get(len);
+        FATAL_ON(!buf, 1, "buffer_get");
+        buf->interface = net_if;
+        buffer_data_length_set(buf, len);
+        memset(buffer_data_pointer(buf), 0, len);
+        protocol_push(buf);
+    }
+    bench_report("buffer", "protocol_push", t0, packet_cnt);
+    printf("%-12s %-24s %10.3f malloc/packet\n", "buffer", "pools",
+           (double)(bench_buffer_pools_alloc_cnt() - alloc_cnt) / packet_cnt);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < packet_cnt; i++)
+        bench_buffer_ref(64 + bench_rand() % 1217, i & 1);
+    bench_report("buffer", "malloc/free", t0, packet_cnt);
+    printf("%-12s %-24s %10.3f malloc/packet\n", "buffer", "malloc/free",
+           (double)bench_buffer_malloc_cnt / packet_cnt);
+    free(net_if);
+}
+
+// ip_fcf_v() as it was before it summed 32 bits at a time: 16 bits at a time,
+// with the dangling byte of an odd chunk paired with the next chunk
+static uint16_t bench_ip_fcf_v_ref(uint_fast8_t count, const struct iovec vec[count])
+{
+    uint_fast32_t acc32 = 0;
+    bool odd = false;
+
+    while (count) {
+        const uint8_t *data_ptr = vec->iov_base;
+        uint_fast16_t data_length = vec->iov_len;
+        if (odd && data_length > 0) {
+            acc32 += *data_ptr++;
+            data_length--;
+            odd = false;
+        }
+        while (data_length >= 2) {
+            acc32 += (uint_fast16_t) data_ptr[0] << 8 | data_ptr[1];
+            data_ptr += 2;
+            data_length -= 2;
+        }
+        if (data_length) {
+            acc32 += (uint_fast16_t) data_ptr[0] << 8;
+            odd = true;
+        }
+        vec++;
+        count--;
+    }
+    acc32 = (acc32 >> 16) + (acc32 & 0xffff);
+    return ~(uint16_t)((acc32 >> 16) + (acc32 & 0xffff));
+}
+
+// The TSC counts at a constant rate, close to the nominal CPU frequency
+static uint64_t bench_cycles(void)
+{
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    return bench_now_ns();
+#endif
+}
+
+#ifdef __x86_64__
+#define BENCH_CYCLES_PER_BYTE "cycles/byte"
+#else
+#define BENCH_CYCLES_PER_BYTE "ns/byte"
+#endif
+
+/*
+ * IPv6 checksum of 64 to 1280 bytes of payload with buffer_ipv6_fcf(),
+ * compared with the 16-bit loop ip_fcf_v() used before. Both are first
+ * checked against each other on random payloads of random lengths (odd ones
+ * included), at random alignments, and on all-ones packets which make the
+ * most carries.
+ */
+static void bench_checksum_check(buffer_t *buf)
+{
+    const int check_cnt = 100000;
+    uint8_t hdr[4] = { 0, 0, 0, 17 };
+    struct iovec vec[4] = {
+        { buf->src_sa.address, 16 },
+        { buf->dst_sa.address, 16 },
+        { hdr, 4 },
+    };
+    int len;
+
+    for (int i = 0; i < check_cnt; i++) {
+        len = bench_rand() % 1281;
+        buffer_data_clear_with_headroom(buf, BUFFER_DEFAULT_HEADROOM + bench_rand() % 8);
+        buffer_data_length_set(buf, len);
+        if (i % 4) {
+            bench_rand_fill(buf->src_sa.address, 16);
+            bench_rand_fill(buf->dst_sa.address, 16);
+            bench_rand_fill(buffer_data_pointer(buf), len);
+        } else {
+            memset(buf->src_sa.address, 0xff, 16);
+            memset(buf->dst_sa.address, 0xff, 16);
+            memset(buffer_data_pointer(buf), 0xff, len);
+        }
+        hdr[0] = len >> 8;
+        hdr[1] = len;
+        vec[3].iov_base = buffer_data_pointer(buf);
+        vec[3].iov_len = len;
+        FATAL_ON(buffer_ipv6_fcf(buf, 17) != bench_ip_fcf_v_ref(ARRAY_SIZE(vec), vec), 1,
+                 "checksum mismatch with reference");
+    }
+    buffer_data_clear(buf);
+}
+
+static void bench_checksum_run(buffer_t *buf, uint16_t len, bool legacy)
+{
+    const int iter_cnt = 200000000 / len;
+    volatile uint8_t *data = buffer_data_pointer(buf);
+    uint8_t hdr[] = { len >> 8, len, 0, 17 };
+    struct iovec vec[4] = {
+        { buf->src_sa.address, 16 },
+        { buf->dst_sa.address, 16 },
+        { hdr, 4 },
+        { buffer_data_pointer(buf), len },
+    };
+    uint64_t t0, c0, cycles;
+    uint16_t sum = 0;
+    char op[24];
+
+    buffer_data_length_set(buf, len);
+    t0 = bench_now_ns();
+    c0 = bench_cycles();
+    for (int i = 0; i < iter_cnt; i++) {
+        data[0] = i;
+        if (legacy)
+            sum += bench_ip_fcf_v_ref(ARRAY_SIZE(vec), vec);
+        else
+            sum += buffer_ipv6_fcf(buf, 17);
+    }
+    cycles = bench_cycles() - c0;
+    bench_sink = sum;
+    snprintf(op, sizeof(op), "%s %u bytes", legacy ? "16-bit" : "ipv6", len);
+    printf("%-12s %-24s %10d ops %10.1f ns/op %6.2f %s\n", "checksum", op, iter_cnt,
+           (double)(bench_now_ns() - t0) / iter_cnt, (double)cycles / iter_cnt / len,
+           BENCH_CYCLES_PER_BYTE);
+}
+
+static void bench_checksum(void)
+{
+    static const uint16_t len[] = { 64, 128, 256, 512, 1024, 1280 };
+    buffer_t *buf;
+
+    buf = buffer_get(1280 + 8);
+    FATAL_ON(!buf, 1, "buffer_get");
+    bench_checksum_check(buf);
+    bench_rand_fill(buf->src_sa.address, 16);
+    bench_rand_fill(buf->dst_sa.address, 16);
+    bench_rand_fill(buffer_data_pointer(buf), 1280);
+    for (int i = 0; i < ARRAY_SIZE(len); i++) {
+        bench_checksum_run(buf, len[i], false);
+        bench_checksum_run(buf, len[i], true);
+    }
+    buffer_free(buf);
+}
+
+static const struct bench bench_table[] = {
+    { "event_loop",  bench_event_loop },
+    { "events",      bench_events },
+    { "timer_wheel", bench_timer_wheel },
+    { "crc",         bench_crc },
+    { "uart",        bench_uart },
+    { "rcp_rx",      bench_rcp_rx },
+    { "hash_table",  bench_hash_table },
+    { "ws_neigh",    bench_ws_neigh },
+    { "aro",         bench_aro },
+    { "lpm_trie",    bench_lpm_trie },
+    { "dao",         bench_dao },
+    { "srh",         bench_srh },
+    { "storage_log", bench_storage_log },
+    { "rpl_storage", bench_rpl_storage },
+    { "supp_list",   bench_supp_list },
+    { "dbus_nodes",  bench_dbus_nodes },
+    { "ie_parse",    bench_ie_parse },
+    { "data_req",    bench_data_req },
+    { "tun",         bench_tun },
+    { "lowpan_tx",   bench_lowpan_tx },
+    { "netlink",     bench_netlink },
+    { "iobuf",       bench_iobuf },
+    { "buffer",      bench_buffer },
+    { "checksum",    bench_checksum },
+};
+
+int main(int argc, char *argv[])
+{
+    int i, j;
+
+    for (i = 1; i < argc; i++) {
+        for (j = 0; j < ARRAY_SIZE(bench_table); j++)
+            if (!strcmp(argv[i], bench_table[j].name))
+                break;
+        FATAL_ON(j == ARRAY_SIZE(bench_table), 1, "unknown benchmark \"%s\"", argv[i]);
+    }
+    for (j = 0; j < ARRAY_SIZE(bench_table); j++) {
+        for (i = 1; i < argc; i++)
+            if (!strcmp(argv[i], bench_table[j].name))
+                break;
+        if (argc == 1 || i < argc)
+            bench_table[j].fn();
+    }
+    return 0;
+}
@@ -14,12 +14,14 @@
 #define _GNU_SOURCE
 #include <stdint.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include "6lbr/net/netaddr_types.h"
 #include "6lbr/security/kmp/kmp_socket_if.h"
 #include "6lbr/ws/ws_eapol_relay.h"
 #include "6lbr/ws/ws_eapol_auth_relay.h"
+#include "6lbr/app/tun.h"
 #include "6lbr/app/wsbr.h"
 #include "6lbr/app/wsbr_mac.h"
 #include "common/log.h"
@@ -84,11 +86,20 @@ void fuzz_ind_replay_socket(struct rcp *rcp, struct iobuf_read *buf)
     FATAL_ON(ret < size, 2, "%s: write: Short write", __func__);
 }
 
+static void fuzz_on_tun(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *wsbrd = container_of(src, struct wsbr_ctxt, loop_tun);
+
+    if (revents & EPOLLIN)
+        wsbr_tun_read(wsbrd);
+}
+
 void __real_wsbr_tun_init(struct wsbr_ctxt *wsbrd);
 void __wrap_wsbr_tun_init(struct wsbr_ctxt *wsbrd)
 {
     struct fuzz_ctxt *ctxt = &g_fuzz_ctxt;
     struct fuzz_iface *iface;
+    int ret;
 
     BUG_ON(ctxt->wsbrd != wsbrd);
     if (!ctxt->replay_count) {
@@ -97,7 +108,14 @@ void __wrap_wsbr_tun_init(struct wsbr_ctxt *wsbrd)
     }
 
     iface = fuzz_iface_new(ctxt);
+    // Like the TUN device, wsbr_tun_read() reads until EAGAIN
+    ret = fcntl(iface->pipefd[0], F_SETFL, O_NONBLOCK);
+    FATAL_ON(ret < 0, 2, "fcntl: %m");
     wsbrd->tun_fd = iface->pipefd[0];
+    wsbrd->loop_tun.fd       = wsbrd->tun_fd;
+    wsbrd->loop_tun.events   = 0;
+    wsbrd->loop_tun.callback = fuzz_on_tun;
+    event_loop_add(&wsbrd->loop, &wsbrd->loop_tun);
 
     memcpy(ctxt->tun_gua, wsbrd->config.ipv6_prefix, 8);
     memcpy(ctxt->tun_gua + 8, wsbrd->rcp.eui64, 8);
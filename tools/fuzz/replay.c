@@ -19,11 +19,20 @@
 #include "6lbr/net/timers.h"
 #include "tools/fuzz/wsbrd_fuzz.h"
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/bus.h"
 #include "common/hif.h"
 
 ssize_t __real_write(int fd, const void *buf, size_t count);
 
+static void fuzz_on_timer(struct event_loop_src *src, uint32_t revents)
+{
+    struct wsbr_ctxt *wsbrd = container_of(src, struct wsbr_ctxt, loop_timer);
+
+    if (revents & EPOLLIN)
+        wsbr_common_timer_process(wsbrd);
+}
+
 void __real_wsbr_common_timer_init(struct wsbr_ctxt *wsbrd);
 void __wrap_wsbr_common_timer_init(struct wsbr_ctxt *wsbrd)
 {
@@ -33,6 +42,10 @@ void __wrap_wsbr_common_timer_init(struct wsbr_ctxt *wsbrd)
     if (ctxt->replay_count) {
         wsbrd->timerfd = eventfd(0, EFD_NONBLOCK);
         FATAL_ON(wsbrd->timerfd < 0, 2, "eventfd: %m");
+        wsbrd->loop_timer.fd       = wsbrd->timerfd;
+        wsbrd->loop_timer.events   = EPOLLIN;
+        wsbrd->loop_timer.callback = fuzz_on_timer;
+        event_loop_add(&wsbrd->loop, &wsbrd->loop_timer);
     } else {
         __real_wsbr_common_timer_init(wsbrd);
     }
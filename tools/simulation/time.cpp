@@ -18,6 +18,7 @@
 #include <ns3/libwsbrd-ns3.hpp>
 
 extern "C" {
+#include "6lbr/app/timers.h"
 #include "6lbr/app/wsbr.h"
 #include "common/capture.h"
 #include "common/log.h"
@@ -33,23 +34,30 @@ static void wsbr_ns3_timer_tick(struct wsbr_ctxt *ctxt)
     FATAL_ON(ret < 8, 2, "%s: write: Short write", __func__);
 }
 
-extern "C" void __wrap_wsbr_common_timer_init(struct wsbr_ctxt *ctxt)
+static void wsbr_ns3_on_timer(struct event_loop_src *src, uint32_t revents)
 {
-    ctxt->timerfd = eventfd(0, EFD_NONBLOCK);
-    FATAL_ON(ctxt->timerfd < 0, 2, "eventfd: %m");
-    capture_register_timerfd(ctxt->timerfd);
-    wsbr_ns3_timer_tick(ctxt);
-}
+    struct wsbr_ctxt *ctxt = &g_ctxt;
 
-extern "C" void __real_wsbr_common_timer_process(struct wsbr_ctxt *ctxt);
-extern "C" void __wrap_wsbr_common_timer_process(struct wsbr_ctxt *ctxt)
-{
+    if (!(revents & EPOLLIN))
+        return;
     ns3::Simulator::ScheduleWithContext(
         g_simulation_id,
         ns3::MilliSeconds(50),
         wsbr_ns3_timer_tick, ctxt
     );
-    __real_wsbr_common_timer_process(ctxt);
+    wsbr_common_timer_process(ctxt);
+}
+
+extern "C" void __wrap_wsbr_common_timer_init(struct wsbr_ctxt *ctxt)
+{
+    ctxt->timerfd = eventfd(0, EFD_NONBLOCK);
+    FATAL_ON(ctxt->timerfd < 0, 2, "eventfd: %m");
+    capture_register_timerfd(ctxt->timerfd);
+    ctxt->loop_timer.fd       = ctxt->timerfd;
+    ctxt->loop_timer.events   = EPOLLIN;
+    ctxt->loop_timer.callback = wsbr_ns3_on_timer;
+    event_loop_add(&ctxt->loop, &ctxt->loop_timer);
+    wsbr_ns3_timer_tick(ctxt);
 }
 
 extern "C" int __wrap_clock_gettime(clock_t clockid, struct timespec *tp)